@@ -27,6 +27,7 @@
 #include <vw/Camera/LinescanModel.h>
 #include <vw/Camera/PinholeModel.h>
 #include <vw/Camera/Extrinsics.h>
+#include <vw/Cartography/Datum.h>
 
 #include <asp/Core/StereoSettings.h>  // TESTING
 
@@ -97,6 +98,22 @@ namespace asp {
     /// by extension at neighboring lines as well.
     vw::camera::PinholeModel linescan_to_pinhole(double y) const;
 
+    /// Cache the pixels of a grid of ground points, with num_samples
+    /// longitudes and latitudes over the image footprint and three
+    /// heights within height_range of the mean surface elevation.
+    /// Then point_to_pixel() starts its solver from a guess
+    /// interpolated in the grid, which is nearly exact, so it needs
+    /// just a few iterations. Points outside the grid use the usual
+    /// guess. Not thread-safe, call it before the model is shared.
+    void build_point_to_pixel_grid(int num_samples, double height_range);
+    bool has_point_to_pixel_grid() const { return !m_grid_pixels.empty(); }
+    void clear_point_to_pixel_grid() { m_grid_pixels.clear(); }
+
+    /// The starting guess point_to_pixel() takes from the grid made by
+    /// build_point_to_pixel_grid(). Return false if there is no grid or
+    /// the point is outside it, when the usual guess is used instead.
+    bool point_to_pixel_from_grid(vw::Vector3 const& point, vw::Vector2 & pixel) const;
+
 
     PositionFuncT const& get_position_func() const {return m_position_func;} ///< Access the position function
     vw::camera::LinearPiecewisePositionInterpolation
@@ -127,6 +144,15 @@ namespace asp {
     vw::Vector2  m_detector_origin; 
     double       m_focal_length;    ///< The focal length, also stored in pixels.
 
+    // The grid of ground points for point_to_pixel(), given by the
+    // longitude, latitude, and height of its first point, the spacing,
+    // and the number of points along each. In m_grid_pixels the
+    // longitude varies fastest. Pixels which could not be found are NaN.
+    vw::cartography::Datum   m_grid_datum;
+    vw::Vector3              m_grid_origin, m_grid_spacing;
+    vw::Vector3i             m_grid_size;
+    std::vector<vw::Vector2> m_grid_pixels;
+
     // Levenberg Marquardt solver for linescan number
     //
     // We solve for the line number of the image that position the
@@ -23,9 +23,37 @@
 #include <asp/Camera/RPCModel.h>
 #include <asp/Camera/RPC_XML.h>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <cmath>
+#include <limits>
 
 namespace asp {
 
+/// Intersect a ray with the ellipsoid with the given semi-axes.
+/// Return false if the ray misses it.
+inline bool ray_ellipsoid_intersection(double semi_major_axis, double semi_minor_axis,
+                                       vw::Vector3 const& ctr, vw::Vector3 const& dir,
+                                       vw::Vector3 & xyz) {
+  // Scale z to turn the ellipsoid into a sphere
+  double z_scale = semi_major_axis/semi_minor_axis;
+  vw::Vector3 c(ctr[0], ctr[1], ctr[2]*z_scale), d(dir[0], dir[1], dir[2]*z_scale);
+  double A = dot_prod(d, d), B = 2.0*dot_prod(c, d);
+  double C = dot_prod(c, c) - semi_major_axis*semi_major_axis;
+  double disc = B*B - 4.0*A*C;
+  if (A <= 0 || disc < 0)
+    return false;
+  double t = (-B - sqrt(disc))/(2.0*A);
+  if (t < 0)
+    return false;
+  vw::Vector3 p = c + t*d;
+  xyz = vw::Vector3(p[0], p[1], p[2]/z_scale);
+  return true;
+}
+
+/// Bring a longitude difference to [-180, 180)
+inline double wrap_lon_diff(double diff) {
+  return diff - 360.0*floor((diff + 180.0)/360.0);
+}
+
 // -----------------------------------------------------------------
 // LinescanDGModel class functions
 
@@ -52,10 +80,14 @@ vw::Vector3 LinescanDGModel<PositionFuncT, PoseFuncT>::get_local_pixel_vector(vw
 template <class PositionFuncT, class PoseFuncT>
 vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel(vw::Vector3 const& point, double starty) const {
 
-  // Use the uncorrected function to get a fast but good starting seed.
+  // Interpolate a nearly exact starting seed in the grid, if there
+  // is one, else use the uncorrected function to get a fast but good
+  // starting seed.
   vw::camera::CameraGenericLMA model( this, point );
   int status;
-  vw::Vector2 start = point_to_pixel_uncorrected(point, starty);
+  vw::Vector2 start;
+  if (!point_to_pixel_from_grid(point, start))
+    start = point_to_pixel_uncorrected(point, starty);
 
   // Run the solver
   vw::Vector3 objective(0, 0, 0);
@@ -70,6 +102,124 @@ vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel(vw::Vector
   return solution;
 }
 
+template <class PositionFuncT, class PoseFuncT>
+void LinescanDGModel<PositionFuncT, PoseFuncT>::build_point_to_pixel_grid(int num_samples,
+                                                                         double height_range) {
+
+  VW_ASSERT( num_samples >= 2 && height_range > 0,
+             vw::ArgumentErr() << "The point_to_pixel grid needs at least two samples "
+             << "and a positive height range.\n" );
+
+  m_grid_pixels.clear();
+  m_grid_datum = vw::cartography::Datum("WGS84");
+  double a = m_grid_datum.semi_major_axis(), b = m_grid_datum.semi_minor_axis();
+  double heights[2] = {this->m_mean_surface_elevation - height_range,
+                       this->m_mean_surface_elevation + height_range};
+
+  // Find the footprint of the image by intersecting with the
+  // ellipsoid, at the lowest and highest heights, the rays through
+  // the pixels on the image boundary.
+  const int NUM_EDGE_SAMPLES = 20;
+  double cols = m_image_size.x() - 1, rows = m_image_size.y() - 1;
+  double ref_lon = std::numeric_limits<double>::quiet_NaN();
+  vw::BBox2 footprint;
+  for (int k = 0; k <= NUM_EDGE_SAMPLES; k++) {
+    double r = double(k)/NUM_EDGE_SAMPLES;
+    vw::Vector2 edge_pix[4] = {vw::Vector2(r*cols, 0), vw::Vector2(r*cols, rows),
+                               vw::Vector2(0, r*rows), vw::Vector2(cols, r*rows)};
+    for (int e = 0; e < 4; e++) {
+      vw::Vector3 ctr = this->camera_center(edge_pix[e]);
+      vw::Vector3 dir = this->pixel_to_vector(edge_pix[e]);
+      for (int h = 0; h < 2; h++) {
+        vw::Vector3 xyz;
+        if (!ray_ellipsoid_intersection(a + heights[h], b + heights[h], ctr, dir, xyz))
+          continue;
+        vw::Vector3 llh = m_grid_datum.cartesian_to_geodetic(xyz);
+        if (std::isnan(ref_lon))
+          ref_lon = llh[0];
+        footprint.grow(vw::Vector2(ref_lon + wrap_lon_diff(llh[0] - ref_lon), llh[1]));
+      }
+    }
+  }
+  if (footprint.empty()) {
+    vw::vw_out(vw::WarningMessage) << "Could not find the ground footprint of the "
+                                   << "camera. Will not use a point_to_pixel grid.\n";
+    return;
+  }
+
+  // Pad the footprint by a grid cell, for points near its edge
+  vw::Vector2 spacing = footprint.size()/(num_samples - 1.0);
+  footprint.min() -= spacing;
+  footprint.max() += spacing;
+  spacing = footprint.size()/(num_samples - 1.0);
+
+  m_grid_origin  = vw::Vector3(footprint.min().x(), footprint.min().y(), heights[0]);
+  m_grid_spacing = vw::Vector3(spacing.x(), spacing.y(), height_range);
+  m_grid_size    = vw::Vector3i(num_samples, num_samples, 3);
+
+  // Project the grid points into the camera. Start each solve from
+  // the pixel of the previous point, which is close by.
+  vw::Vector2 nan_pix(std::numeric_limits<double>::quiet_NaN(),
+                      std::numeric_limits<double>::quiet_NaN());
+  std::vector<vw::Vector2> pixels(m_grid_size[0]*m_grid_size[1]*m_grid_size[2], nan_pix);
+  int count = 0;
+  for (int k = 0; k < m_grid_size[2]; k++) {
+    double starty = -1;
+    for (int j = 0; j < m_grid_size[1]; j++) {
+      for (int i = 0; i < m_grid_size[0]; i++, count++) {
+        vw::Vector3 llh = m_grid_origin + elem_prod(vw::Vector3(i, j, k), m_grid_spacing);
+        try {
+          pixels[count] = this->point_to_pixel(m_grid_datum.geodetic_to_cartesian(llh), starty);
+          starty = pixels[count].y();
+        } catch (vw::camera::PointToPixelErr const& e) {
+          starty = -1;
+        }
+      }
+    }
+  }
+  m_grid_pixels.swap(pixels);
+}
+
+template <class PositionFuncT, class PoseFuncT>
+bool LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel_from_grid(vw::Vector3 const& point,
+                                                                        vw::Vector2 & pixel) const {
+  if (m_grid_pixels.empty())
+    return false;
+
+  vw::Vector3 llh = m_grid_datum.cartesian_to_geodetic(point);
+  double center_lon = m_grid_origin[0] + 0.5*m_grid_spacing[0]*(m_grid_size[0] - 1);
+  llh[0] = center_lon + wrap_lon_diff(llh[0] - center_lon);
+
+  // The grid cell having the point, and the position in the cell
+  vw::Vector3i cell;
+  vw::Vector3  frac;
+  for (int c = 0; c < 3; c++) {
+    double x = (llh[c] - m_grid_origin[c])/m_grid_spacing[c];
+    if (!(x >= 0 && x <= m_grid_size[c] - 1))
+      return false;
+    cell[c] = std::min(int(floor(x)), m_grid_size[c] - 2);
+    frac[c] = x - cell[c];
+  }
+
+  // Trilinear interpolation
+  pixel = vw::Vector2();
+  for (int dk = 0; dk < 2; dk++) {
+    for (int dj = 0; dj < 2; dj++) {
+      for (int di = 0; di < 2; di++) {
+        vw::Vector2 const& p = m_grid_pixels[((cell[2] + dk)*m_grid_size[1] + cell[1] + dj)
+                                             *m_grid_size[0] + cell[0] + di];
+        if (std::isnan(p[0]) || std::isnan(p[1]))
+          return false;
+        double w = (di ? frac[0] : 1.0 - frac[0])
+                 * (dj ? frac[1] : 1.0 - frac[1])
+                 * (dk ? frac[2] : 1.0 - frac[2]);
+        pixel += w*p;
+      }
+    }
+  }
+  return true;
+}
+
 // Computing the uncorrected pixel location is much faster.
 template <class PositionFuncT, class PoseFuncT>
 vw::Vector2 LinescanDGModel<PositionFuncT, PoseFuncT>::point_to_pixel_uncorrected(vw::Vector3 const& point, double starty) const {
@@ -255,7 +405,7 @@ boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const
   // This is where we could set the Earth radius if we have that info.
 
   typedef boost::shared_ptr<DGCameraModel> CameraModelPtr;
-  return CameraModelPtr(new DGCameraModel(vw::camera::PiecewiseAPositionInterpolation(eph.position_vec, eph.velocity_vec, et0, edt ),
+  CameraModelPtr cam(new DGCameraModel(vw::camera::PiecewiseAPositionInterpolation(eph.position_vec, eph.velocity_vec, et0, edt ),
 					                                vw::camera::LinearPiecewisePositionInterpolation(eph.velocity_vec, et0, edt),
 					                                vw::camera::SLERPPoseInterpolation(att.quat_vec, at0, adt),
 					                                tlc_time_interpolation, img.image_size,
@@ -265,6 +415,18 @@ boost::shared_ptr<DGCameraModel> load_dg_camera_model_from_xml(std::string const
 					                                !stereo_settings().disable_correct_velocity_aberration,
 					                                !stereo_settings().disable_correct_atmospheric_refraction)
 		    );
+
+  // Cache the pixels of points over the range of heights in the RPC
+  // model, if present, to speed up point_to_pixel().
+  if (stereo_settings().dg_point_to_pixel_grid_size > 0) {
+    const double DEFAULT_HEIGHT_RANGE = 1000.0, MIN_HEIGHT_RANGE = 100.0;
+    double height_range = DEFAULT_HEIGHT_RANGE;
+    if (!bbox.empty())
+      height_range = std::max((bbox.max()[2] - bbox.min()[2])/2.0, MIN_HEIGHT_RANGE);
+    cam->build_point_to_pixel_grid(stereo_settings().dg_point_to_pixel_grid_size, height_range);
+  }
+
+  return cam;
 } // End function load_dg_camera_model()
 
 
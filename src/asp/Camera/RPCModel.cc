@@ -204,6 +204,39 @@ namespace asp {
                               << ", loaded wrong number of coefficients!");
   }
 
+  namespace {
+
+    // The RPC polynomial with the given coefficients, in the order of
+    // the terms in RPCModel::calculate_terms(), evaluated by factoring
+    // out the variables, rather than forming all terms first.
+    inline double rpc_poly(double const* c, double x, double y, double z) {
+      return c[0]
+        + x*(c[1] + y*(c[4] + z*c[10] + y*c[12]) + z*(c[5] + z*c[13])
+             + x*(c[7] + y*c[14] + z*c[17] + x*c[11]))
+        + y*(c[2] + z*(c[6] + z*c[16]) + y*(c[8] + z*c[18] + y*c[15]))
+        + z*(c[3] + z*(c[9] + z*c[19]));
+    }
+
+    // The partial derivatives of rpc_poly() in respect to x, y, and z
+    inline void rpc_poly_grad(double const* c, double x, double y, double z,
+                              double & dx, double & dy, double & dz) {
+      dx = c[1] + y*(c[4] + z*c[10] + y*c[12]) + z*(c[5] + z*c[13])
+        + x*(2.0*(c[7] + y*c[14] + z*c[17]) + 3.0*x*c[11]);
+      dy = c[2] + x*(c[4] + z*c[10] + 2.0*y*c[12] + x*c[14]) + z*(c[6] + z*c[16])
+        + y*(2.0*(c[8] + z*c[18]) + 3.0*y*c[15]);
+      dz = c[3] + x*(c[5] + y*c[10] + 2.0*z*c[13] + x*c[17]) + y*(c[6] + 2.0*z*c[16] + y*c[18])
+        + z*(2.0*c[9] + 3.0*z*c[19]);
+    }
+
+    // Copy the coefficients to a plain array, so that the loops over
+    // points below keep them in registers and cache.
+    inline void copy_coeffs(RPCModel::CoeffVec const& in, double * out) {
+      for (int i = 0; i < 20; i++)
+        out[i] = in[i];
+    }
+
+  } // end anonymous namespace
+
   // All of these implementations are largely inspired by the GDAL
   // code. We don't use the GDAL code unfortunately because they don't
   // make that part of the API available. However I believe this is a
@@ -231,13 +264,11 @@ namespace asp {
    RPCModel::CoeffVec const& sample_num_coeff,
    RPCModel::CoeffVec const& sample_den_coeff){
 
-    CoeffVec term = calculate_terms( normalized_geodetic );
-    Vector2 normalized_pixel( dot_prod(term,sample_num_coeff) /
-                              dot_prod(term,sample_den_coeff),
-                              dot_prod(term,line_num_coeff) /
-                              dot_prod(term,line_den_coeff) );
-
-    return normalized_pixel;
+    double G[3] = {normalized_geodetic[0], normalized_geodetic[1], normalized_geodetic[2]};
+    double P[2];
+    normalized_geodetic_to_normalized_pixel(1, G, line_num_coeff, line_den_coeff,
+                                            sample_num_coeff, sample_den_coeff, P);
+    return Vector2(P[0], P[1]);
   }
 
   Vector2 RPCModel::normalized_geodetic_to_normalized_pixel
@@ -251,6 +282,103 @@ namespace asp {
                                                    );
   }
 
+  void RPCModel::normalized_geodetic_to_normalized_pixel
+  (int num_points, double const* normalized_geodetics,
+   RPCModel::CoeffVec const& line_num_coeff,
+   RPCModel::CoeffVec const& line_den_coeff,
+   RPCModel::CoeffVec const& sample_num_coeff,
+   RPCModel::CoeffVec const& sample_den_coeff,
+   double * normalized_pixels, double * jacobians) {
+
+    double ln[20], ld[20], sn[20], sd[20];
+    copy_coeffs(line_num_coeff,   ln);
+    copy_coeffs(line_den_coeff,   ld);
+    copy_coeffs(sample_num_coeff, sn);
+    copy_coeffs(sample_den_coeff, sd);
+
+    // The loops have no branches, so the compiler can vectorize them
+    if (jacobians == NULL) {
+      for (int i = 0; i < num_points; i++) {
+        double const* G = normalized_geodetics + 3*i;
+        double x = G[0], y = G[1], z = G[2];
+        normalized_pixels[2*i    ] = rpc_poly(sn, x, y, z) / rpc_poly(sd, x, y, z);
+        normalized_pixels[2*i + 1] = rpc_poly(ln, x, y, z) / rpc_poly(ld, x, y, z);
+      }
+      return;
+    }
+
+    for (int i = 0; i < num_points; i++) {
+      double const* G = normalized_geodetics + 3*i;
+      double x = G[0], y = G[1], z = G[2];
+
+      double s_num = rpc_poly(sn, x, y, z), s_den = rpc_poly(sd, x, y, z);
+      double l_num = rpc_poly(ln, x, y, z), l_den = rpc_poly(ld, x, y, z);
+      normalized_pixels[2*i    ] = s_num / s_den;
+      normalized_pixels[2*i + 1] = l_num / l_den;
+
+      // The derivative of n/d is (n'*d - n*d')/d^2
+      double n[3], d[3];
+      double * J = jacobians + 6*i;
+      rpc_poly_grad(sn, x, y, z, n[0], n[1], n[2]);
+      rpc_poly_grad(sd, x, y, z, d[0], d[1], d[2]);
+      double s_den2 = s_den*s_den;
+      for (int j = 0; j < 3; j++)
+        J[j] = (n[j]*s_den - s_num*d[j]) / s_den2;
+      rpc_poly_grad(ln, x, y, z, n[0], n[1], n[2]);
+      rpc_poly_grad(ld, x, y, z, d[0], d[1], d[2]);
+      double l_den2 = l_den*l_den;
+      for (int j = 0; j < 3; j++)
+        J[3 + j] = (n[j]*l_den - l_num*d[j]) / l_den2;
+    }
+  }
+
+  void RPCModel::geodetic_to_pixel_batch(std::vector<Vector3> const& geodetics,
+                                         std::vector<Vector2> & pixels,
+                                         std::vector< Matrix<double, 2, 3> > * jacobians) const {
+
+    int num_points = geodetics.size();
+    pixels.resize(num_points);
+    if (jacobians != NULL)
+      jacobians->resize(num_points);
+    if (num_points == 0)
+      return;
+
+    std::vector<double> G(3*num_points), P(2*num_points), J;
+    for (int i = 0; i < num_points; i++) {
+      for (int j = 0; j < 3; j++)
+        G[3*i + j] = (geodetics[i][j] - m_lonlatheight_offset[j]) / m_lonlatheight_scale[j];
+    }
+    if (jacobians != NULL)
+      J.resize(6*num_points);
+
+    normalized_geodetic_to_normalized_pixel(num_points, &G[0],
+                                            m_line_num_coeff,   m_line_den_coeff,
+                                            m_sample_num_coeff, m_sample_den_coeff,
+                                            &P[0], jacobians != NULL ? &J[0] : NULL);
+
+    for (int i = 0; i < num_points; i++) {
+      for (int r = 0; r < 2; r++)
+        pixels[i][r] = P[2*i + r] * m_xy_scale[r] + m_xy_offset[r];
+    }
+
+    if (jacobians == NULL)
+      return;
+    for (int i = 0; i < num_points; i++) {
+      Matrix<double, 2, 3> & M = (*jacobians)[i];
+      for (int r = 0; r < 2; r++)
+        for (int c = 0; c < 3; c++)
+          M(r, c) = J[6*i + 3*r + c] * m_xy_scale[r] / m_lonlatheight_scale[c];
+    }
+  }
+
+  void RPCModel::point_to_pixel_batch(std::vector<Vector3> const& points,
+                                      std::vector<Vector2> & pixels) const {
+    std::vector<Vector3> geodetics(points.size());
+    for (size_t i = 0; i < points.size(); i++)
+      geodetics[i] = m_datum.cartesian_to_geodetic(points[i]);
+    geodetic_to_pixel_batch(geodetics, pixels);
+  }
+
   RPCModel::CoeffVec RPCModel::calculate_terms( vw::Vector3 const& normalized_geodetic ) {
 
     double x = normalized_geodetic.x(); // normalized lon
@@ -387,18 +515,17 @@ namespace asp {
 
   Matrix<double, 2, 3> RPCModel::geodetic_to_pixel_Jacobian( Vector3 const& geodetic ) const {
 
-    Vector3 normalized_geodetic = elem_quot(geodetic - m_lonlatheight_offset, m_lonlatheight_scale);
-
-    CoeffVec term = calculate_terms( normalized_geodetic );
-
-    CoeffVec Qs = quotient_Jacobian(sample_num_coeff(), sample_den_coeff(), term );
-    CoeffVec Ql = quotient_Jacobian(line_num_coeff(),   line_den_coeff(),   term );
-    Matrix<double, 20, 3> MN = terms_Jacobian3( normalized_geodetic ) *
-                                normalization_Jacobian( m_lonlatheight_scale );
+    double G[3], P[2], Jn[6];
+    for (int c = 0; c < 3; c++)
+      G[c] = (geodetic[c] - m_lonlatheight_offset[c]) / m_lonlatheight_scale[c];
+    normalized_geodetic_to_normalized_pixel(1, G, m_line_num_coeff, m_line_den_coeff,
+                                            m_sample_num_coeff, m_sample_den_coeff, P, Jn);
 
+    // Undo the normalization of the input and output
     Matrix<double, 2, 3> J;
-    select_row( J, 0 ) = m_xy_scale[0] * transpose( Qs ) * MN;
-    select_row( J, 1 ) = m_xy_scale[1] * transpose( Ql ) * MN;
+    for (int r = 0; r < 2; r++)
+      for (int c = 0; c < 3; c++)
+        J(r, c) = Jn[3*r + c] * m_xy_scale[r] / m_lonlatheight_scale[c];
 
     return J;
   }
@@ -415,16 +542,14 @@ namespace asp {
 
     // 3. The output is in normalized pixels (see m_xy_scale and m_xy_offset).
 
-    CoeffVec term = calculate_terms( normalized_geodetic );
-
-    CoeffVec Qs = quotient_Jacobian(sample_num_coeff(), sample_den_coeff(), term );
-    CoeffVec Ql = quotient_Jacobian(line_num_coeff(),   line_den_coeff(),   term );
-
-    Matrix<double, 20, 2> Jt = terms_Jacobian2( normalized_geodetic );
+    double G[3] = {normalized_geodetic[0], normalized_geodetic[1], normalized_geodetic[2]};
+    double P[2], J3[6];
+    normalized_geodetic_to_normalized_pixel(1, G, m_line_num_coeff, m_line_den_coeff,
+                                            m_sample_num_coeff, m_sample_den_coeff, P, J3);
 
     Matrix<double, 2, 2> J;
-    select_row( J, 0 ) = transpose( Qs ) * Jt;
-    select_row( J, 1 ) = transpose( Ql ) * Jt;
+    J(0, 0) = J3[0]; J(0, 1) = J3[1];
+    J(1, 0) = J3[3]; J(1, 1) = J3[4];
 
     return J;
   }
@@ -509,12 +634,112 @@ namespace asp {
 
   }
 
+  namespace {
+    // Center of valid region to bottom of valid region (normalized)
+    const double VERT_SCALE_FACTOR = 0.9; // - The virtual center should be above the terrain
+    // This is a distance in meters approx from the top of the llh valid cube
+    const double LONG_SCALE_UP = 10000;
+  }
+
+  void RPCModel::image_to_ground_batch(std::vector<Vector2> const& pixels, double height,
+                                       std::vector<Vector2> const& lonlat_guesses,
+                                       std::vector<Vector2> & lonlats) const {
+
+    if (lonlat_guesses.size() != pixels.size())
+      vw_throw( ArgumentErr() << "Expecting a lon-lat guess for each pixel.\n" );
+
+    // The same tolerance and initial guesses as in image_to_ground()
+    double abs_tolerance = 1e-6;
+    int    num_points    = pixels.size();
+    double normalized_height = (height - m_lonlatheight_offset[2])/m_lonlatheight_scale[2];
+    Vector2 lonlat_offset = subvector(m_lonlatheight_offset, 0, 2);
+    Vector2 lonlat_scale  = subvector(m_lonlatheight_scale,  0, 2);
+    std::vector<Vector2> normalized_pixels(num_points), normalized_lonlats(num_points);
+    for (int i = 0; i < num_points; i++) {
+      normalized_pixels[i] = elem_quot(pixels[i] - m_xy_offset, m_xy_scale);
+      Vector2 lonlat_guess = lonlat_guesses[i];
+      if (lonlat_guess == Vector2(0.0, 0.0))
+        lonlat_guess = lonlat_offset;
+      normalized_lonlats[i] = elem_quot(lonlat_guess - lonlat_offset, lonlat_scale);
+      double len = norm_2(normalized_lonlats[i]);
+      if (len != len || len > 1.5)
+        normalized_lonlats[i] = Vector2(0.0, 0.0);
+    }
+
+    // The points which did not converge yet
+    std::vector<int> active(num_points);
+    for (int i = 0; i < num_points; i++)
+      active[i] = i;
+
+    std::vector<double> G, P, J;
+    for (int iter = 0; iter < 10 && !active.empty(); iter++) {
+
+      int num_active = active.size();
+      G.resize(3*num_active);
+      P.resize(2*num_active);
+      J.resize(6*num_active);
+      for (int k = 0; k < num_active; k++) {
+        G[3*k    ] = normalized_lonlats[active[k]][0];
+        G[3*k + 1] = normalized_lonlats[active[k]][1];
+        G[3*k + 2] = normalized_height;
+      }
+      normalized_geodetic_to_normalized_pixel(num_active, &G[0],
+                                              m_line_num_coeff,   m_line_den_coeff,
+                                              m_sample_num_coeff, m_sample_den_coeff,
+                                              &P[0], &J[0]);
+
+      // One Newton step for each point, with the inverse of the
+      // Jacobian in respect to the normalized lon and lat.
+      int num_left = 0;
+      for (int k = 0; k < num_active; k++) {
+        int i = active[k];
+        double const* Jk = &J[6*k];
+        double det = Jk[0]*Jk[4] - Jk[1]*Jk[3];
+        double i00 =  Jk[4]/det, i01 = -Jk[1]/det;
+        double i10 = -Jk[3]/det, i11 =  Jk[0]/det;
+        Vector2 error_try(P[2*k] - normalized_pixels[i][0], P[2*k + 1] - normalized_pixels[i][1]);
+        normalized_lonlats[i][0] -= i00*error_try[0] + i01*error_try[1];
+        normalized_lonlats[i][1] -= i10*error_try[0] + i11*error_try[1];
+        if (norm_2(error_try) >= abs_tolerance)
+          active[num_left++] = i;
+      }
+      active.resize(num_left);
+    }
+
+    lonlats.resize(num_points);
+    for (int i = 0; i < num_points; i++)
+      lonlats[i] = elem_prod(normalized_lonlats[i], lonlat_scale) + lonlat_offset;
+  }
+
+  void RPCModel::point_and_dir_batch(std::vector<Vector2> const& pixels,
+                                     std::vector<Vector3> & P,
+                                     std::vector<Vector3> & dir) const {
+
+    // The same as point_and_dir(), with the lon-lats found in two batches
+    double height_up = m_lonlatheight_offset[2] + m_lonlatheight_scale[2]*VERT_SCALE_FACTOR;
+    double height_dn = m_lonlatheight_offset[2] - m_lonlatheight_scale[2]*VERT_SCALE_FACTOR;
+
+    std::vector<Vector2> guesses(pixels.size(), subvector(m_lonlatheight_offset, 0, 2));
+    std::vector<Vector2> lonlat_up, lonlat_dn;
+    image_to_ground_batch(pixels, height_up, guesses,   lonlat_up);
+    image_to_ground_batch(pixels, height_dn, lonlat_up, lonlat_dn);
+
+    P.resize(pixels.size());
+    dir.resize(pixels.size());
+    for (size_t i = 0; i < pixels.size(); i++) {
+      Vector3 P_up = m_datum.geodetic_to_cartesian(Vector3(lonlat_up[i][0], lonlat_up[i][1],
+                                                           height_up));
+      Vector3 P_dn = m_datum.geodetic_to_cartesian(Vector3(lonlat_dn[i][0], lonlat_dn[i][1],
+                                                           height_dn));
+      dir[i] = normalize(P_dn - P_up);
+      P[i]   = P_up - dir[i]*LONG_SCALE_UP;
+    }
+  }
+
   void RPCModel::point_and_dir(Vector2 const& pix, Vector3 & P, Vector3 & dir ) const {
 
     // For an RPC model there is no defined origin so it and the ray need to be computed.
 
-    // Center of valid region to bottom of valid region (normalized)
-    const double VERT_SCALE_FACTOR = 0.9; // - The virtual center should be above the terrain
     double  height_up = m_lonlatheight_offset[2] + m_lonlatheight_scale[2]*VERT_SCALE_FACTOR;
     double  height_dn = m_lonlatheight_offset[2] - m_lonlatheight_scale[2]*VERT_SCALE_FACTOR;
 
@@ -546,7 +771,6 @@ namespace asp {
     
     // Set the origin location very far in the opposite direction of the pointing vector,
     //  to put it high above the terrain.
-    const double LONG_SCALE_UP = 10000; // This is a distance in meters approx from the top of the llh valid cube
     P = P_up - dir*LONG_SCALE_UP;
   }
 
@@ -37,6 +37,7 @@
 
 #include <string>
 #include <ostream>
+#include <vector>
 
 namespace vw {
   class DiskImageResourceGDAL;
@@ -93,6 +94,29 @@ namespace asp {
 
     vw::Vector2 geodetic_to_pixel( vw::Vector3 const& geodetic ) const;
 
+    /// Evaluate the RPC model for num_points normalized geodetics,
+    /// packed as consecutive (lon, lat, height) triplets, writing
+    /// the normalized pixels as consecutive pairs. If jacobians is
+    /// not NULL, it receives for each point the 2x3 Jacobian of the
+    /// normalized pixel in respect to the normalized geodetic, in row
+    /// major order, computed in the same pass.
+    static void normalized_geodetic_to_normalized_pixel
+      (int num_points, double const* normalized_geodetics,
+       CoeffVec const& line_num_coeff,   CoeffVec const& line_den_coeff,
+       CoeffVec const& sample_num_coeff, CoeffVec const& sample_den_coeff,
+       double * normalized_pixels, double * jacobians = NULL);
+
+    /// Project many geodetics at once. This is faster than calling
+    /// geodetic_to_pixel() for each of them. If jacobians is not
+    /// NULL, it receives the same as geodetic_to_pixel_Jacobian().
+    void geodetic_to_pixel_batch(std::vector<vw::Vector3> const& geodetics,
+                                 std::vector<vw::Vector2> & pixels,
+                                 std::vector< vw::Matrix<double, 2, 3> > * jacobians = NULL) const;
+
+    /// Project many points in ECEF at once
+    void point_to_pixel_batch(std::vector<vw::Vector3> const& points,
+                              std::vector<vw::Vector2> & pixels) const;
+
     // Access to constants
     vw::cartography::Datum const& datum   () const { return m_datum;               }
     CoeffVec    const& line_num_coeff     () const { return m_line_num_coeff;      }
@@ -129,6 +153,19 @@ namespace asp {
     /// and the direction of the ray going through that point.
     void point_and_dir(vw::Vector2 const& pix, vw::Vector3 & P, vw::Vector3 & dir ) const;
 
+    /// As image_to_ground(), for many pixels at the same height, each
+    /// with its own guess. The Newton iterations of all pixels are
+    /// done together, each projecting the pixels not converged yet in
+    /// one batch.
+    void image_to_ground_batch(std::vector<vw::Vector2> const& pixels, double height,
+                               std::vector<vw::Vector2> const& lonlat_guesses,
+                               std::vector<vw::Vector2> & lonlats) const;
+
+    /// As point_and_dir(), for many pixels at once
+    void point_and_dir_batch(std::vector<vw::Vector2> const& pixels,
+                             std::vector<vw::Vector3> & P,
+                             std::vector<vw::Vector3> & dir) const;
+
   private:
     vw::cartography::Datum m_datum;
 
@@ -83,18 +83,13 @@ namespace asp {
       result_type result;
       result.set_size(m_normalizedPixels.size());
       
-      // Loop through each test point
-      for (int i = 0; i < numPts; i++){
-        // Unpack the normalized Geodetic coordinate
-        vw::Vector3 G = subvector(m_normalizedGeodetics, RPCModel::GEODETIC_COORD_SIZE*i, RPCModel::GEODETIC_COORD_SIZE);
-        
-        // Project the normalized geodetic coordinate into the RPC camera to get a normalized pixel
-        vw::Vector2 pxn = RPCModel::normalized_geodetic_to_normalized_pixel(G, lineNum, lineDen, sampNum, sampDen);
-             
-        // Pack the normalized pixel into the output result vector
-        subvector(result, RPCModel::IMAGE_COORD_SIZE*i, RPCModel::IMAGE_COORD_SIZE) = pxn;
-
-      }
+      // Project all the normalized geodetic coordinates into the RPC
+      // camera at once to get the normalized pixels, packed in the
+      // output result vector.
+      if (numPts > 0)
+        RPCModel::normalized_geodetic_to_normalized_pixel(numPts, &m_normalizedGeodetics[0],
+                                                          lineNum, lineDen, sampNum, sampDen,
+                                                          &result[0]);
 
       // There are 4*20 - 2 = 78 coefficients we optimize. Of those, 2
       // are 0-th degree, 4*3 = 12 are 1st degree, and the rest, 78 - 12
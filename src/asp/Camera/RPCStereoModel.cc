@@ -59,6 +59,17 @@ namespace asp {
     };
   }
 
+  vector<const RPCModel*> RPCStereoModel::rpc_cameras() const {
+    vector<const RPCModel*> rpc_cams(m_cameras.size());
+    for (size_t p = 0; p < m_cameras.size(); p++){
+      // Get the RPC pointer so we can call RPC specific functions on it
+      rpc_cams[p] = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[p]));
+      VW_ASSERT(rpc_cams[p] != NULL,
+                vw::ArgumentErr() << "Camera models are not RPC.\n");
+    }
+    return rpc_cams;
+  }
+
   Vector3 RPCStereoModel::operator()(vector<Vector2> const& pixVec,
                                      Vector3& errorVec) const {
 
@@ -72,78 +83,133 @@ namespace asp {
     errorVec = Vector3();
 
     try {
-      vector<Vector3> camDirs(num_cams), 
-                      camCtrs(num_cams);
-      vector<const RPCModel*> rpc_cams(num_cams);
-      camDirs.clear(); 
-      camCtrs.clear(); 
-      rpc_cams.clear();
+      vector<const RPCModel*> rpc_cams = rpc_cameras();
+      vector<Vector3> camDirs, camCtrs;
 
       // Pick the valid rays
       for (int p = 0; p < num_cams; p++){
 
-        // Get the RPC pointer so we can call RPC specific functions on it
-        const RPCModel *rpc_cam = dynamic_cast<const RPCModel*>(vw::camera::unadjusted_model(m_cameras[p]));
-        VW_ASSERT(rpc_cam != NULL,
-                  vw::ArgumentErr() << "Camera models are not RPC.\n");
-        rpc_cams.push_back(rpc_cam);
-
         Vector2 pix = pixVec[p];
         if (pix != pix || // i.e., NaN
             pix == camera::CameraModel::invalid_pixel() ) continue;
 
         // The base class function would call point_and_dir twice, but we only need to call it once!
         Vector3 ctr, dir;
-        rpc_cam->point_and_dir(pix, ctr, dir);
+        rpc_cams[p]->point_and_dir(pix, ctr, dir);
         camDirs.push_back(dir);
         camCtrs.push_back(ctr);
       }
 
+      return triangulate_rays(pixVec, rpc_cams, camDirs, camCtrs, errorVec);
+
+    } catch (const camera::PixelToRayErr& /*e*/) {}
+    return Vector3();
+  }
+
+  void RPCStereoModel::triangulate_batch(vector< vector<Vector2> > const& pixels,
+                                         vector<Vector3> & points,
+                                         vector<Vector3> & errors) const {
+
+    int num_cams = m_cameras.size();
+    VW_ASSERT((int)pixels.size() == num_cams,
+              vw::ArgumentErr() << "the number of pixel lists must match "
+                                << "the number of cameras.\n");
+    size_t num_points = (num_cams > 0) ? pixels[0].size() : 0;
+    for (int p = 0; p < num_cams; p++)
+      VW_ASSERT(pixels[p].size() == num_points,
+                vw::ArgumentErr() << "Expecting the same number of pixels for each camera.\n");
+
+    points.assign(num_points, Vector3());
+    errors.assign(num_points, Vector3());
+    vector<const RPCModel*> rpc_cams = rpc_cameras();
+
+    // The rays of the valid pixels of each camera, and for each point
+    // the index of its ray, or -1 if its pixel is not valid.
+    vector< vector<Vector3> > ctrs(num_cams), dirs(num_cams);
+    vector< vector<int> >     ray_index(num_cams);
+    for (int p = 0; p < num_cams; p++){
+      vector<Vector2> valid_pixels;
+      ray_index[p].assign(num_points, -1);
+      for (size_t k = 0; k < num_points; k++){
+        Vector2 const& pix = pixels[p][k];
+        if (pix != pix || // i.e., NaN
+            pix == camera::CameraModel::invalid_pixel() ) continue;
+        ray_index[p][k] = valid_pixels.size();
+        valid_pixels.push_back(pix);
+      }
+      rpc_cams[p]->point_and_dir_batch(valid_pixels, ctrs[p], dirs[p]);
+    }
+
+    vector<Vector2> pixVec(num_cams);
+    vector<Vector3> camDirs, camCtrs;
+    for (size_t k = 0; k < num_points; k++){
+      camDirs.clear();
+      camCtrs.clear();
+      for (int p = 0; p < num_cams; p++){
+        pixVec[p] = pixels[p][k];
+        int r = ray_index[p][k];
+        if (r < 0) continue;
+        camDirs.push_back(dirs[p][r]);
+        camCtrs.push_back(ctrs[p][r]);
+      }
+      try {
+        points[k] = triangulate_rays(pixVec, rpc_cams, camDirs, camCtrs, errors[k]);
+      } catch (const camera::PixelToRayErr& /*e*/) {
+        points[k] = Vector3();
+      }
+    }
+  }
+
+  Vector3 RPCStereoModel::triangulate_rays(vector<Vector2> const& pixVec,
+                                           vector<const RPCModel*> const& rpc_cams,
+                                           vector<Vector3> const& camDirs,
+                                           vector<Vector3> const& camCtrs,
+                                           Vector3 & errorVec) const {
 
-      // Not enough valid rays
-      if (camDirs.size() < 2) 
-          return Vector3();
+    errorVec = Vector3();
 
-      if (are_nearly_parallel(m_least_squares, m_angle_tol, camDirs)) 
-          return Vector3();
+    // Not enough valid rays
+    if (camDirs.size() < 2) 
+      return Vector3();
 
-      // Determine range by triangulation
-      Vector3 result = triangulate_point(camDirs, camCtrs, errorVec);
+    if (are_nearly_parallel(m_least_squares, m_angle_tol, camDirs)) 
+      return Vector3();
 
-      if ( m_least_squares ){
+    // Determine range by triangulation
+    Vector3 result = triangulate_point(camDirs, camCtrs, errorVec);
 
-        // Refine triangulation
+    if ( m_least_squares ){
 
-        if (num_cams != 2)
-          vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
-                       << "implemented for multi-view stereo.");
+      // Refine triangulation
 
-        detail::RPCTriangulateLMA model(rpc_cams[0], rpc_cams[1]);
-        Vector4 objective(pixVec[0][0], pixVec[0][1], pixVec[1][0], pixVec[1][1]);
-        int status = 0;
+      int num_cams = m_cameras.size();
+      if (num_cams != 2)
+        vw::vw_throw(vw::NoImplErr() << "Least squares refinement is not "
+                     << "implemented for multi-view stereo.");
 
-        Vector3 initialGeodetic = rpc_cams[0]->datum().cartesian_to_geodetic(result);
+      detail::RPCTriangulateLMA model(rpc_cams[0], rpc_cams[1]);
+      Vector4 objective(pixVec[0][0], pixVec[0][1], pixVec[1][0], pixVec[1][1]);
+      int status = 0;
 
-        // To do: Find good values for the numbers controlling the convergence
-        Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
-                                                     objective, status, 1e-3, 1e-6, 10 );
+      Vector3 initialGeodetic = rpc_cams[0]->datum().cartesian_to_geodetic(result);
 
-        if ( status > 0 )
-          result = rpc_cams[0]->datum().geodetic_to_cartesian(finalGeodetic);
-      } // End least squares case
+      // To do: Find good values for the numbers controlling the convergence
+      Vector3 finalGeodetic = levenberg_marquardt( model, initialGeodetic,
+                                                   objective, status, 1e-3, 1e-6, 10 );
 
+      if ( status > 0 )
+        result = rpc_cams[0]->datum().geodetic_to_cartesian(finalGeodetic);
+    } // End least squares case
 
-      // Reflect points that fall behind one of the two cameras
-      bool reflect = false;
-      for (int p = 0; p < (int)camCtrs.size(); p++)
-        if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
-      if (reflect)
-        result = -result + 2*camCtrs[0];
 
-      return result;
+    // Reflect points that fall behind one of the two cameras
+    bool reflect = false;
+    for (int p = 0; p < (int)camCtrs.size(); p++)
+      if (dot_prod(result - camCtrs[p], camDirs[p]) < 0 ) reflect = true;
+    if (reflect)
+      result = -result + 2*camCtrs[0];
 
-    } catch (const camera::PixelToRayErr& /*e*/) {}
-    return Vector3();
+    return result;
   }
 
   Vector3 RPCStereoModel::operator()(vw::Vector2 const& pix1,
@@ -32,6 +32,8 @@ namespace vw {
 
 namespace asp {
 
+  class RPCModel;
+
   /// Derived StereoModel class implementing the RPC camera model.
   /// - Using a seperate class allows us to get a speed improvement in ray generation.
   class RPCStereoModel: public vw::stereo::StereoModel {
@@ -64,6 +66,26 @@ namespace asp {
     virtual vw::Vector3 operator()(vw::Vector2 const& pix1,
                                    vw::Vector2 const& pix2,
                                    double& error) const;
+
+    /// Triangulate many points at once. The pixel of point k in camera
+    /// c is pixels[c][k], which is NaN if the point is not seen there.
+    /// The rays of each camera are found in one batch, and the rest is
+    /// as in operator().
+    void triangulate_batch(std::vector< std::vector<vw::Vector2> > const& pixels,
+                           std::vector<vw::Vector3> & points,
+                           std::vector<vw::Vector3> & errors) const;
+
+  private:
+
+    /// The RPC models of the cameras, with no adjustments
+    std::vector<const RPCModel*> rpc_cameras() const;
+
+    /// Intersect the rays of the valid pixels in pixVec
+    vw::Vector3 triangulate_rays(std::vector<vw::Vector2> const& pixVec,
+                                 std::vector<const RPCModel*> const& rpc_cams,
+                                 std::vector<vw::Vector3> const& camDirs,
+                                 std::vector<vw::Vector3> const& camCtrs,
+                                 vw::Vector3 & errorVec) const;
   };
   
 } // namespace asp
@@ -158,3 +158,64 @@ TEST(DGCameraModel, CreateCamera) {
   XMLPlatformUtils::Terminate();
 }
 
+TEST(DGCameraModel, PointToPixelGrid) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  boost::shared_ptr<DGCameraModel> cam = load_dg_camera_model_from_xml("dg_example1.xml");
+  ASSERT_TRUE( cam.get() != 0 );
+  EXPECT_FALSE( cam->has_point_to_pixel_grid() );
+
+  // Points on the ground, at the height offset of the RPC model in
+  // the XML file.
+  cartography::Datum datum("WGS84");
+  double height = 2281, height_range = 637;
+  std::vector<Vector2> pixels;
+  std::vector<Vector3> points;
+  for (int i = 0; i < 35000; i += 1000) {
+    for (int j = 0; j < 23000; j += 1000) {
+      Vector2 pix(i, j);
+      Vector3 xyz;
+      if (!ray_ellipsoid_intersection(datum.semi_major_axis() + height,
+                                      datum.semi_minor_axis() + height,
+                                      cam->camera_center(pix), cam->pixel_to_vector(pix), xyz))
+        continue;
+      pixels.push_back(pix);
+      points.push_back(xyz);
+    }
+  }
+  ASSERT_GT( points.size(), 500u );
+
+  Vector2 seed;
+  std::vector<Vector2> plain(points.size());
+  for (size_t k = 0; k < points.size(); k++) {
+    plain[k] = cam->point_to_pixel(points[k]);
+    EXPECT_FALSE( cam->point_to_pixel_from_grid(points[k], seed) );
+  }
+
+  cam->build_point_to_pixel_grid(20, height_range);
+  EXPECT_TRUE( cam->has_point_to_pixel_grid() );
+
+  // Each point is in the grid, and the seed from the grid is nearly
+  // the solution, so the solver starts from it. The grid changes only
+  // the starting guess, not the result.
+  std::vector<Vector2> with_grid(points.size());
+  for (size_t k = 0; k < points.size(); k++) {
+    with_grid[k] = cam->point_to_pixel(points[k]);
+    ASSERT_TRUE( cam->point_to_pixel_from_grid(points[k], seed) );
+    EXPECT_VECTOR_NEAR( with_grid[k], seed, 0.5 );
+    EXPECT_VECTOR_NEAR( plain[k], with_grid[k], 1e-3 );
+    EXPECT_VECTOR_NEAR( pixels[k], with_grid[k], 1e-1 );
+  }
+
+  // A point far above the grid is projected without it
+  Vector2 pix(17000, 12000);
+  Vector3 high_point = cam->camera_center(pix) + 2e4 * cam->pixel_to_vector(pix);
+  EXPECT_FALSE( cam->point_to_pixel_from_grid(high_point, seed) );
+  EXPECT_VECTOR_NEAR( pix, cam->point_to_pixel(high_point), 1e-1 );
+
+  cam->clear_point_to_pixel_grid();
+  EXPECT_FALSE( cam->has_point_to_pixel_grid() );
+
+  XMLPlatformUtils::Terminate();
+}
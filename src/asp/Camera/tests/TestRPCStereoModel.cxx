@@ -22,6 +22,7 @@
 // This also contains the RPCModel tests so they should be seperated out some time.
 
 #include <vw/Camera/CameraModel.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/Stereo/StereoModel.h>
 #include <test/Helpers.h>
 #include <asp/Camera/XMLBase.h>
@@ -192,6 +193,88 @@ TEST( StereoSessionRPC, InstantiateTest ) {
   xercesc::XMLPlatformUtils::Terminate();
 }
 
+TEST( RPCModel, BatchEvaluation ) {
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml;
+  xml.read_from_file( "dg_example1.xml" );
+  RPCModel model( *xml.rpc_ptr() );
+
+  // Points spanning the lon-lat-height box of the model
+  std::vector<Vector3> geodetics;
+  Vector3 offset = model.lonlatheight_offset(), scale = model.lonlatheight_scale();
+  for (int i = 0; i < 1000; i++) {
+    Vector3 u((i % 10)/4.5 - 1.0, ((i/10) % 10)/4.5 - 1.0, (i/100)/4.5 - 1.0);
+    geodetics.push_back(offset + elem_prod(u, scale));
+  }
+
+  std::vector<Vector2> pixels;
+  std::vector< Matrix<double, 2, 3> > jacobians;
+  model.geodetic_to_pixel_batch(geodetics, pixels, &jacobians);
+  ASSERT_EQ(geodetics.size(), pixels.size());
+  ASSERT_EQ(geodetics.size(), jacobians.size());
+
+  for (size_t i = 0; i < geodetics.size(); i++) {
+
+    // Compare with evaluating all the terms of the polynomials
+    Vector3 u = elem_quot(geodetics[i] - offset, scale);
+    RPCModel::CoeffVec term = RPCModel::calculate_terms(u);
+    Vector2 pix(dot_prod(term, model.sample_num_coeff()) / dot_prod(term, model.sample_den_coeff()),
+                dot_prod(term, model.line_num_coeff())   / dot_prod(term, model.line_den_coeff()));
+    pix = elem_prod(pix, model.xy_scale()) + model.xy_offset();
+    EXPECT_VECTOR_NEAR(pix, pixels[i], 1e-6);
+    EXPECT_VECTOR_NEAR(pix, model.geodetic_to_pixel(geodetics[i]), 1e-6);
+
+    Matrix<double, 20, 3> MN = RPCModel::terms_Jacobian3(u) *
+      RPCModel::normalization_Jacobian(scale);
+    Matrix<double, 2, 3> J;
+    select_row(J, 0) = model.xy_scale()[0] * transpose
+      (RPCModel::quotient_Jacobian(model.sample_num_coeff(), model.sample_den_coeff(), term)) * MN;
+    select_row(J, 1) = model.xy_scale()[1] * transpose
+      (RPCModel::quotient_Jacobian(model.line_num_coeff(), model.line_den_coeff(), term)) * MN;
+    double relErr = max(abs(J - jacobians[i]))/max(abs(J));
+    EXPECT_LT(relErr, 1e-10);
+    relErr = max(abs(J - model.geodetic_to_pixel_Jacobian(geodetics[i])))/max(abs(J));
+    EXPECT_LT(relErr, 1e-10);
+  }
+
+  // From ECEF
+  std::vector<Vector3> points;
+  for (size_t i = 0; i < geodetics.size(); i++)
+    points.push_back(model.datum().geodetic_to_cartesian(geodetics[i]));
+  std::vector<Vector2> point_pixels;
+  model.point_to_pixel_batch(points, point_pixels);
+  ASSERT_EQ(points.size(), point_pixels.size());
+  for (size_t i = 0; i < points.size(); i++)
+    EXPECT_VECTOR_NEAR(model.point_to_pixel(points[i]), point_pixels[i], 1e-6);
+
+  // Compare the speed with evaluating all the terms for each point
+  const int NUM_REPEATS = 200;
+  double sum = 0.0;
+  Stopwatch sw_terms, sw_batch;
+  sw_terms.start();
+  for (int r = 0; r < NUM_REPEATS; r++) {
+    for (size_t i = 0; i < geodetics.size(); i++) {
+      Vector3 u = elem_quot(geodetics[i] - offset, scale);
+      RPCModel::CoeffVec term = RPCModel::calculate_terms(u);
+      sum += dot_prod(term, model.sample_num_coeff()) / dot_prod(term, model.sample_den_coeff())
+        + dot_prod(term, model.line_num_coeff()) / dot_prod(term, model.line_den_coeff());
+    }
+  }
+  sw_terms.stop();
+  sw_batch.start();
+  for (int r = 0; r < NUM_REPEATS; r++) {
+    model.geodetic_to_pixel_batch(geodetics, pixels);
+    sum += pixels[0][0];
+  }
+  sw_batch.stop();
+  vw_out() << "RPC evaluation of " << NUM_REPEATS*geodetics.size() << " points: "
+           << sw_terms.elapsed_seconds() << " s with all terms, "
+           << sw_batch.elapsed_seconds() << " s in batch (" << sum << ").\n";
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 TEST( StereoSessionRPC, CheckStereo ) {
 
   xercesc::XMLPlatformUtils::Initialize();
@@ -214,6 +297,65 @@ TEST( StereoSessionRPC, CheckStereo ) {
   xercesc::XMLPlatformUtils::Terminate();
 }
 
+TEST( StereoSessionRPC, TriangulateBatch ) {
+
+  xercesc::XMLPlatformUtils::Initialize();
+
+  RPCXML xml1, xml2;
+  xml1.read_from_file( "dg_example1.xml" );
+  xml2.read_from_file( "dg_example4.xml" );
+  RPCModel model1( *xml1.rpc_ptr() );
+  RPCModel model2( *xml2.rpc_ptr() );
+
+  // Project points near the center of the first model into both cameras
+  Vector3 offset = model1.lonlatheight_offset(), scale = model1.lonlatheight_scale();
+  std::vector< std::vector<Vector2> > pixels(2);
+  for (int i = 0; i < 100; i++) {
+    Vector3 u((i % 10)/45.0 - 0.1, (i/10)/45.0 - 0.1, (i % 7)/30.0 - 0.1);
+    Vector3 xyz = model1.datum().geodetic_to_cartesian(offset + elem_prod(u, scale));
+    pixels[0].push_back(model1.point_to_pixel(xyz));
+    pixels[1].push_back(model2.point_to_pixel(xyz));
+  }
+  // Some points seen in one image only
+  double nan = std::numeric_limits<double>::quiet_NaN();
+  pixels[1][3]  = Vector2(nan, nan);
+  pixels[0][50] = Vector2(nan, nan);
+
+  // The rays in batch are those found one pixel at a time
+  std::vector<Vector3> P, dir;
+  model1.point_and_dir_batch(pixels[0], P, dir);
+  ASSERT_EQ(pixels[0].size(), P.size());
+  ASSERT_EQ(pixels[0].size(), dir.size());
+  for (size_t k = 0; k < pixels[0].size(); k++) {
+    if (k == 50)
+      continue;
+    Vector3 P1, dir1;
+    model1.point_and_dir(pixels[0][k], P1, dir1);
+    EXPECT_VECTOR_NEAR(P1,   P[k],   1e-3);
+    EXPECT_VECTOR_NEAR(dir1, dir[k], 1e-8);
+  }
+
+  // And so are the triangulated points
+  RPCStereoModel RPC_stereo(&model1, &model2);
+  std::vector<Vector3> points, errors;
+  RPC_stereo.triangulate_batch(pixels, points, errors);
+  ASSERT_EQ(pixels[0].size(), points.size());
+  ASSERT_EQ(pixels[0].size(), errors.size());
+  std::vector<Vector2> pixVec(2);
+  for (size_t k = 0; k < pixels[0].size(); k++) {
+    pixVec[0] = pixels[0][k];
+    pixVec[1] = pixels[1][k];
+    Vector3 errorVec;
+    Vector3 xyz = RPC_stereo(pixVec, errorVec);
+    EXPECT_VECTOR_NEAR(xyz,      points[k], 1e-3);
+    EXPECT_VECTOR_NEAR(errorVec, errors[k], 1e-3);
+  }
+  EXPECT_EQ(Vector3(), points[3]);
+  EXPECT_EQ(Vector3(), points[50]);
+
+  xercesc::XMLPlatformUtils::Terminate();
+}
+
 
 
 /// Make sure that the AdjustedCameraModel class handles cropping with RPC models
@@ -0,0 +1,194 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/CorrMemory.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+    // SGM keeps a one-byte cost and a two-byte accumulated cost for
+    // each disparity searched at each pixel.
+    const double BYTES_PER_COST = 3.0;
+
+    // Away from the coarsest level, pixels whose disparity is uncertain
+    // are searched over more than the search buffer.
+    const double UNCERTAIN_FACTOR = 2.0;
+
+    // The left image, its mask, the output disparity, and the per-pixel
+    // search bounds, for each pixel of the tile, and the right image and
+    // its mask for each pixel of the right region.
+    const double BYTES_PER_LEFT_PIXEL  = 40.0;
+    const double BYTES_PER_RIGHT_PIXEL = 5.0;
+
+    // Assume the pyramid is not made coarser than this
+    const int MIN_LEVEL_SIZE = 32;
+  }
+
+  double sgm_memory_mb(Vector2i const& tile_size, BBox2i const& search_range,
+                       Vector2i const& search_buffer, int max_levels) {
+
+    if (tile_size.x() <= 0 || tile_size.y() <= 0)
+      return 0.0;
+
+    double num_pixels = double(tile_size.x())*double(tile_size.y());
+
+    int levels = std::max(max_levels, 0);
+    while (levels > 0 &&
+           std::min(tile_size.x(), tile_size.y())/(1 << levels) < MIN_LEVEL_SIZE)
+      levels--;
+    double scale = double(1 << levels);
+
+    // The full search range is searched at the coarsest level, and a
+    // small neighborhood of the disparity found at the level above is
+    // searched at each finer level. The levels are done one at a time.
+    double range_w = 0.0, range_h = 0.0;
+    if (!search_range.empty()) {
+      range_w = search_range.width();
+      range_h = search_range.height();
+    }
+    double coarse_costs = (num_pixels/(scale*scale))
+      * (floor(range_w/scale) + 1.0) * (floor(range_h/scale) + 1.0);
+    double fine_costs = 0.0;
+    if (levels > 0)
+      fine_costs = num_pixels * UNCERTAIN_FACTOR
+        * (2.0*search_buffer.x() + 1.0) * (2.0*search_buffer.y() + 1.0);
+    double cost_bytes = BYTES_PER_COST * std::max(coarse_costs, fine_costs);
+
+    double right_pixels = (tile_size.x() + range_w) * (tile_size.y() + range_h);
+    double image_bytes  = num_pixels*BYTES_PER_LEFT_PIXEL + right_pixels*BYTES_PER_RIGHT_PIXEL;
+
+    return (cost_bytes + image_bytes)/(1024.0*1024.0);
+  }
+
+  SgmMemoryModel::SgmMemoryModel(ImageView<PixelMask<Vector2f> > const& sub_disp,
+                                 ImageView<PixelMask<Vector2i> > const& sub_disp_spread,
+                                 Vector2 const& upscale_factor,
+                                 Vector2i const& search_buffer, int max_levels,
+                                 BBox2i const& search_range_limit):
+    m_sub_disp(sub_disp), m_sub_disp_spread(sub_disp_spread),
+    m_upscale_factor(upscale_factor), m_search_buffer(search_buffer),
+    m_max_levels(max_levels), m_search_range_limit(search_range_limit) {
+
+    if (m_upscale_factor[0] <= 0 || m_upscale_factor[1] <= 0)
+      vw_throw( ArgumentErr() << "SgmMemoryModel: The upscale factor must be positive.\n" );
+
+    bool has_spread = (m_sub_disp_spread.cols() != 0 && m_sub_disp_spread.rows() != 0);
+    if (has_spread && (m_sub_disp_spread.cols() != m_sub_disp.cols() ||
+                       m_sub_disp_spread.rows() != m_sub_disp.rows()))
+      vw_throw( ArgumentErr() << "SgmMemoryModel: D_sub and D_sub_spread must have equal sizes.\n" );
+  }
+
+  BBox2i SgmMemoryModel::search_range(BBox2i const& tile) const {
+
+    // The low-res version of the tile
+    BBox2i seed_bbox( elem_quot(tile.min(), m_upscale_factor),
+                      elem_quot(tile.max(), m_upscale_factor) );
+    seed_bbox.expand(1);
+    seed_bbox.crop( bounding_box(m_sub_disp) );
+
+    bool has_spread = (m_sub_disp_spread.cols() != 0 && m_sub_disp_spread.rows() != 0);
+
+    BBox2 range;
+    Vector2 max_spread(0, 0);
+    for (int row = seed_bbox.min().y(); row < seed_bbox.max().y(); row++) {
+      for (int col = seed_bbox.min().x(); col < seed_bbox.max().x(); col++) {
+        PixelMask<Vector2f> const& disp = m_sub_disp(col, row);
+        if (!is_valid(disp))
+          continue;
+        range.grow(Vector2(disp.child()));
+        if (has_spread && is_valid(m_sub_disp_spread(col, row))) {
+          Vector2i const& spread = m_sub_disp_spread(col, row).child();
+          max_spread.x() = std::max(max_spread.x(), double(spread.x()));
+          max_spread.y() = std::max(max_spread.y(), double(spread.y()));
+        }
+      }
+    }
+    if (range.empty())
+      return BBox2i();
+
+    range.min() -= max_spread;
+    range.max() += max_spread;
+
+    // As in stereo_corr, round outward, expand by one because the
+    // low-res disparity is integer, and scale to full resolution.
+    BBox2i int_range(floor(range.min()), ceil(range.max()));
+    int_range.expand(1);
+    BBox2i full_range(floor(elem_prod(Vector2(int_range.min()), m_upscale_factor)),
+                      ceil (elem_prod(Vector2(int_range.max()), m_upscale_factor)));
+
+    if (m_search_range_limit.min() != Vector2i() || m_search_range_limit.max() != Vector2i())
+      full_range.crop(m_search_range_limit);
+
+    return full_range;
+  }
+
+  double SgmMemoryModel::tile_memory_mb(BBox2i const& tile) const {
+    return sgm_memory_mb(tile.size(), search_range(tile), m_search_buffer, m_max_levels);
+  }
+
+  double SgmMemoryModel::max_tile_memory_mb(BBox2i const& region, int tile_size,
+                                            int collar) const {
+    if (tile_size <= 0)
+      vw_throw( ArgumentErr() << "SgmMemoryModel: The tile size must be positive.\n" );
+
+    double max_mb = 0.0;
+    for (int y = region.min().y(); y < region.max().y(); y += tile_size) {
+      for (int x = region.min().x(); x < region.max().x(); x += tile_size) {
+        // As in parallel_stereo, the last tiles are cropped to the
+        // region, then padded by the collar.
+        BBox2i tile(x, y, tile_size, tile_size);
+        tile.crop(region);
+        tile.expand(collar);
+        max_mb = std::max(max_mb, tile_memory_mb(tile));
+      }
+    }
+    return max_mb;
+  }
+
+  int SgmMemoryModel::tile_size_for_memory(BBox2i const& region, int collar,
+                                           double memory_limit_mb,
+                                           int min_tile_size, int max_tile_size,
+                                           int tile_multiple) const {
+
+    if (tile_multiple <= 0 || min_tile_size <= 0 || max_tile_size < min_tile_size)
+      vw_throw( ArgumentErr() << "SgmMemoryModel: Invalid tile size bounds.\n" );
+
+    // The candidates are lo*tile_multiple, ..., hi*tile_multiple. The
+    // memory grows with the tile size, so do a binary search.
+    int lo = (min_tile_size + tile_multiple - 1)/tile_multiple;
+    int hi = max_tile_size/tile_multiple;
+    if (hi < lo || max_tile_memory_mb(region, lo*tile_multiple, collar) > memory_limit_mb)
+      return min_tile_size;
+
+    while (lo < hi) {
+      int mid = lo + (hi - lo + 1)/2;
+      if (max_tile_memory_mb(region, mid*tile_multiple, collar) <= memory_limit_mb)
+        lo = mid;
+      else
+        hi = mid - 1;
+    }
+    return lo*tile_multiple;
+  }
+
+} // namespace asp
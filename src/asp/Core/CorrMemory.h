@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CorrMemory.h
+///
+/// An estimate of the memory used by SGM and MGM correlation, which
+/// is dominated by the cost volume, whose size depends on the tile
+/// size and on the search range of the tile. The search range of each
+/// tile is found from the low-resolution disparity, as stereo_corr
+/// does, so that the largest tile size which fits a memory budget can
+/// be chosen before correlation is started.
+
+#ifndef __ASP_CORE_CORR_MEMORY_H__
+#define __ASP_CORE_CORR_MEMORY_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+
+namespace asp {
+
+  /// Estimate the memory, in MB, used by SGM or MGM to correlate a
+  /// tile of the given size with the given full-resolution search
+  /// range, with at most max_levels pyramid levels, and with the
+  /// given search buffer at the levels finer than the coarsest.
+  double sgm_memory_mb(vw::Vector2i const& tile_size, vw::BBox2i const& search_range,
+                       vw::Vector2i const& search_buffer, int max_levels);
+
+  /// Predict the memory used to correlate tiles of the left aligned
+  /// image with SGM or MGM, given the low-resolution disparity and
+  /// optionally its spread.
+  class SgmMemoryModel {
+  public:
+
+    /// The upscale factor is the ratio of the size of the left image
+    /// to the size of the low-resolution disparity. An empty
+    /// search_range_limit means no limit.
+    SgmMemoryModel(vw::ImageView<vw::PixelMask<vw::Vector2f> > const& sub_disp,
+                   vw::ImageView<vw::PixelMask<vw::Vector2i> > const& sub_disp_spread,
+                   vw::Vector2 const& upscale_factor,
+                   vw::Vector2i const& search_buffer, int max_levels,
+                   vw::BBox2i const& search_range_limit);
+
+    /// The full-resolution search range of a tile, found the same way
+    /// as in stereo_corr, except that local homographies are not
+    /// applied. Empty if the low-resolution disparity has no valid
+    /// values over the tile.
+    vw::BBox2i search_range(vw::BBox2i const& tile) const;
+
+    /// The estimated memory, in MB, to correlate the given tile
+    double tile_memory_mb(vw::BBox2i const& tile) const;
+
+    /// The largest estimated memory, in MB, over the square tiles of
+    /// the given size covering the region, each padded by the collar.
+    double max_tile_memory_mb(vw::BBox2i const& region, int tile_size, int collar) const;
+
+    /// The largest tile size, a multiple of tile_multiple between
+    /// min_tile_size and max_tile_size, such that no tile covering the
+    /// region exceeds the memory limit. Return min_tile_size if even
+    /// that is over the limit.
+    int tile_size_for_memory(vw::BBox2i const& region, int collar, double memory_limit_mb,
+                             int min_tile_size, int max_tile_size,
+                             int tile_multiple = 16) const;
+
+  private:
+    vw::ImageView<vw::PixelMask<vw::Vector2f> > m_sub_disp;
+    vw::ImageView<vw::PixelMask<vw::Vector2i> > m_sub_disp_spread;
+    vw::Vector2  m_upscale_factor;
+    vw::Vector2i m_search_buffer;
+    int          m_max_levels;
+    vw::BBox2i   m_search_range_limit;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_CORR_MEMORY_H__
@@ -0,0 +1,30 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+#include <asp/Core/CorrSubTiles.h>
+
+#include <algorithm>
+
+namespace asp {
+
+double correlation_work(vw::BBox2i const& bbox, vw::BBox2f const& search_range) {
+  return double(bbox.width()) * double(bbox.height())
+    * (std::max(double(search_range.width()),  0.0) + 1.0)
+    * (std::max(double(search_range.height()), 0.0) + 1.0);
+}
+
+} // end namespace asp
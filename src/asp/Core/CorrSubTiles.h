@@ -0,0 +1,94 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file CorrSubTiles.h
+///
+/// Split a tile of the left image into parts which are correlated
+/// with their own search ranges, found from the low-resolution
+/// disparity. On steep terrain this avoids searching the whole tile
+/// over a range which only a small part of it needs.
+
+#ifndef __ASP_CORE_CORR_SUB_TILES_H__
+#define __ASP_CORE_CORR_SUB_TILES_H__
+
+#include <vw/Math/BBox.h>
+#include <vector>
+#include <utility>
+
+namespace asp {
+
+  /// The number of pixel comparisons to correlate a region with a
+  /// search range, ignoring the kernel size, which is the same for all.
+  double correlation_work(vw::BBox2i const& bbox, vw::BBox2f const& search_range);
+
+  /// Split a region of the left image into quadrants, recursively, as
+  /// long as the quadrants, with their own search ranges, take
+  /// sufficiently less work to correlate than the region, and are no
+  /// smaller than min_size. The seed object must provide
+  /// has_seed(BBox2i) and search_range(BBox2i). The parts, with their
+  /// search ranges, are appended to sub_tiles.
+  template <class SeedT>
+  void split_by_search_range(vw::BBox2i const& bbox, vw::BBox2f const& search_range,
+                             int min_size, SeedT const& seed,
+                             std::vector< std::pair<vw::BBox2i, vw::BBox2f> > & sub_tiles) {
+
+    // Each part is padded for the kernel and the pyramid, so split only
+    // when this saves a good fraction of the work.
+    const double MAX_WORK_RATIO = 0.75;
+
+    int half_w = bbox.width()/2, half_h = bbox.height()/2;
+    if (half_w < min_size || half_h < min_size) {
+      sub_tiles.push_back(std::make_pair(bbox, search_range));
+      return;
+    }
+
+    vw::BBox2i quads[4];
+    quads[0] = vw::BBox2i(bbox.min().x(),          bbox.min().y(),
+                          half_w,                  half_h);
+    quads[1] = vw::BBox2i(bbox.min().x() + half_w, bbox.min().y(),
+                          bbox.width() - half_w,   half_h);
+    quads[2] = vw::BBox2i(bbox.min().x(),          bbox.min().y() + half_h,
+                          half_w,                  bbox.height() - half_h);
+    quads[3] = vw::BBox2i(bbox.min().x() + half_w, bbox.min().y() + half_h,
+                          bbox.width() - half_w,   bbox.height() - half_h);
+
+    // A part with no seed would be searched over nothing, so keep the
+    // region whole then.
+    vw::BBox2f ranges[4];
+    double work = 0.0;
+    for (int i = 0; i < 4; i++) {
+      if (!seed.has_seed(quads[i])) {
+        sub_tiles.push_back(std::make_pair(bbox, search_range));
+        return;
+      }
+      ranges[i] = seed.search_range(quads[i]);
+      work += correlation_work(quads[i], ranges[i]);
+    }
+
+    if (work > MAX_WORK_RATIO*correlation_work(bbox, search_range)) {
+      sub_tiles.push_back(std::make_pair(bbox, search_range));
+      return;
+    }
+
+    for (int i = 0; i < 4; i++)
+      split_by_search_range(quads[i], ranges[i], min_size, seed, sub_tiles);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CORR_SUB_TILES_H__
@@ -0,0 +1,264 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <asp/Core/DemMosaic.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    // The distance along the Hilbert curve filling a grid of size n x
+    // n, with n a power of 2, of the cell (x, y).
+    boost::uint64_t hilbert_distance(boost::uint64_t n, boost::uint64_t x, boost::uint64_t y) {
+      boost::uint64_t d = 0;
+      for (boost::uint64_t s = n/2; s > 0; s /= 2) {
+        boost::uint64_t rx = (x & s) > 0;
+        boost::uint64_t ry = (y & s) > 0;
+        d += s*s*((3*rx) ^ ry);
+        // Rotate the quadrant so that the curve in it starts and ends
+        // where the curve at the coarser level does.
+        if (ry == 0) {
+          if (rx == 1) {
+            x = s - 1 - (x & (s - 1));
+            y = s - 1 - (y & (s - 1));
+          }
+          std::swap(x, y);
+        }
+      }
+      return d;
+    }
+
+    struct HilbertLess {
+      std::vector<boost::uint64_t> const& m_dist;
+      int m_start;
+      HilbertLess(std::vector<boost::uint64_t> const& dist, int start):
+        m_dist(dist), m_start(start) {}
+      bool operator()(int a, int b) const {
+        return m_dist[a - m_start] < m_dist[b - m_start];
+      }
+    };
+
+    const char MANIFEST_MAGIC[] = "ASP_DEM_MOSAIC_TILE_MANIFEST_V1";
+  }
+
+  void hilbert_tile_order(int num_tiles_x, int num_tiles_y, std::vector<int> & tile_ids) {
+
+    if (num_tiles_x <= 0 || num_tiles_y <= 0)
+      vw_throw( ArgumentErr() << "hilbert_tile_order: The number of tiles must be positive.\n" );
+    if (tile_ids.empty())
+      return;
+
+    boost::uint64_t n = 1;
+    while (n < boost::uint64_t(std::max(num_tiles_x, num_tiles_y)))
+      n *= 2;
+
+    int start = *std::min_element(tile_ids.begin(), tile_ids.end());
+    int end   = *std::max_element(tile_ids.begin(), tile_ids.end()) + 1;
+    if (start < 0 || end > num_tiles_x*num_tiles_y)
+      vw_throw( ArgumentErr() << "hilbert_tile_order: Tile index out of range.\n" );
+
+    std::vector<boost::uint64_t> dist(end - start);
+    for (int tile_id = start; tile_id < end; tile_id++)
+      dist[tile_id - start] = hilbert_distance(n, tile_id % num_tiles_x, tile_id / num_tiles_x);
+
+    std::stable_sort(tile_ids.begin(), tile_ids.end(), HilbertLess(dist, start));
+  }
+
+  PixelValueStack::PixelValueStack(int cols, int rows, std::string const& tmp_file,
+                                   size_t max_memory_bytes):
+    m_cols(cols), m_rows(rows), m_tmp_file(tmp_file), m_max_memory_bytes(max_memory_bytes),
+    m_memory_bytes(0), m_file_records(0), m_num_values(0), m_finished(false) {
+
+    if (m_cols < 0 || m_rows < 0)
+      vw_throw( ArgumentErr() << "PixelValueStack: The image size must not be negative.\n" );
+    m_records.resize(m_rows);
+    m_chunks.resize(m_rows);
+  }
+
+  PixelValueStack::~PixelValueStack() {
+    if (m_ofs.is_open())
+      m_ofs.close();
+    if (m_file_records > 0)
+      boost::filesystem::remove(m_tmp_file);
+  }
+
+  void PixelValueStack::add_image(ImageView<double> const& image, double nodata_value,
+                                  int index) {
+
+    if (m_finished)
+      vw_throw( LogicErr() << "PixelValueStack: Cannot add images after finish().\n" );
+    if (image.cols() != m_cols || image.rows() != m_rows)
+      vw_throw( ArgumentErr() << "PixelValueStack: Expecting an image of size "
+                << m_cols << " x " << m_rows << ".\n" );
+
+    Record record;
+    record.index = index;
+    for (int row = 0; row < m_rows; row++) {
+      for (int col = 0; col < m_cols; col++) {
+        double value = image(col, row);
+        if (value == nodata_value)
+          continue;
+        record.col   = col;
+        record.value = value;
+        m_records[row].push_back(record);
+        m_num_values++;
+        m_memory_bytes += sizeof(Record);
+      }
+    }
+
+    if (m_memory_bytes >= m_max_memory_bytes)
+      spill();
+  }
+
+  void PixelValueStack::spill() {
+
+    if (!m_ofs.is_open()) {
+      m_ofs.open(m_tmp_file.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+      if (!m_ofs.good())
+        vw_throw( ArgumentErr() << "Cannot open for writing: " << m_tmp_file << "\n" );
+    }
+
+    for (int row = 0; row < m_rows; row++) {
+      std::vector<Record> & records = m_records[row];
+      if (records.empty())
+        continue;
+      Chunk chunk;
+      chunk.offset      = m_file_records;
+      chunk.num_records = records.size();
+      m_ofs.write((const char*)&records[0], records.size()*sizeof(Record));
+      m_chunks[row].push_back(chunk);
+      m_file_records += chunk.num_records;
+      std::vector<Record>().swap(records); // release the memory
+    }
+    if (!m_ofs.good())
+      vw_throw( IOErr() << "Failed writing to: " << m_tmp_file << "\n" );
+
+    m_memory_bytes = 0;
+  }
+
+  void PixelValueStack::finish() {
+    // The remaining rows stay in memory. Close the file so that it can
+    // be read.
+    if (m_ofs.is_open())
+      m_ofs.close();
+    m_finished = true;
+  }
+
+  void PixelValueStack::read_row(int row, std::vector< std::vector<Entry> > & entries) const {
+
+    if (!m_finished)
+      vw_throw( LogicErr() << "PixelValueStack: Call finish() before reading values.\n" );
+    if (row < 0 || row >= m_rows)
+      vw_throw( ArgumentErr() << "PixelValueStack: Row out of range.\n" );
+
+    entries.resize(m_cols);
+    for (int col = 0; col < m_cols; col++)
+      entries[col].clear();
+
+    // The records saved to disk came before the ones in memory
+    std::vector<Record> records;
+    std::vector<Chunk> const& chunks = m_chunks[row];
+    if (!chunks.empty()) {
+      std::ifstream ifs(m_tmp_file.c_str(), std::ios::binary | std::ios::in);
+      if (!ifs.good())
+        vw_throw( ArgumentErr() << "Cannot open for reading: " << m_tmp_file << "\n" );
+      for (size_t c = 0; c < chunks.size(); c++) {
+        size_t start = records.size();
+        records.resize(start + chunks[c].num_records);
+        ifs.seekg(chunks[c].offset*sizeof(Record), std::ios::beg);
+        ifs.read((char*)&records[start], chunks[c].num_records*sizeof(Record));
+        if (!ifs.good())
+          vw_throw( IOErr() << "Failed reading from: " << m_tmp_file << "\n" );
+      }
+    }
+    records.insert(records.end(), m_records[row].begin(), m_records[row].end());
+
+    Entry entry;
+    for (size_t i = 0; i < records.size(); i++) {
+      entry.value = records[i].value;
+      entry.index = records[i].index;
+      entries[records[i].col].push_back(entry);
+    }
+  }
+
+  void write_tile_manifest(std::string const& manifest_file, std::string const& key,
+                           std::string const& tile_file,
+                           std::vector<std::string> const& dem_signatures) {
+
+    // Write to a temporary file first, so that an interrupted run
+    // does not leave behind a partial manifest.
+    std::string tmp_file = manifest_file + ".tmp";
+    {
+      std::ofstream ofs(tmp_file.c_str());
+      if (!ofs.good())
+        vw_throw( IOErr() << "Cannot open for writing: " << tmp_file << "\n" );
+
+      ofs << MANIFEST_MAGIC << "\n";
+      ofs << key << "\n";
+      ofs << file_signature(tile_file) << "\n";
+      ofs << dem_signatures.size() << "\n";
+      for (size_t i = 0; i < dem_signatures.size(); i++)
+        ofs << dem_signatures[i] << "\n";
+
+      if (!ofs.good())
+        vw_throw( IOErr() << "Failed writing: " << tmp_file << "\n" );
+    }
+    boost::filesystem::rename(tmp_file, manifest_file);
+  }
+
+  bool tile_manifest_is_current(std::string const& manifest_file, std::string const& key,
+                                std::string const& tile_file,
+                                std::vector<std::string> const& dem_signatures) {
+
+    std::ifstream ifs(manifest_file.c_str());
+    if (!ifs.good())
+      return false;
+
+    // Each item is on its own line, as file names may have spaces
+    std::string line;
+    if (!std::getline(ifs, line) || line != MANIFEST_MAGIC)
+      return false;
+    if (!std::getline(ifs, line) || line != key)
+      return false;
+    if (!std::getline(ifs, line) || line != file_signature(tile_file))
+      return false;
+    if (!std::getline(ifs, line))
+      return false;
+    std::istringstream is(line);
+    size_t num_dems = 0;
+    if (!(is >> num_dems) || num_dems != dem_signatures.size())
+      return false;
+    for (size_t i = 0; i < num_dems; i++) {
+      if (!std::getline(ifs, line) || line != dem_signatures[i])
+        return false;
+    }
+    return true;
+  }
+
+} // namespace asp
@@ -0,0 +1,201 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file DemMosaic.h
+///
+/// Utilities for mosaicking many DEMs: a cache of open DEM files, to
+/// be shared by the threads which create the output tiles, and an
+/// ordering of the output tiles so that neighboring tiles, which
+/// mostly need the same DEMs, are created one after another. Also,
+/// functions to record the inputs an output tile was made from, so
+/// that it need not be made again if they did not change, and a
+/// store of the values of many DEMs at each pixel of a tile, for
+/// finding their median without keeping all DEMs in memory.
+
+#ifndef __ASP_CORE_DEM_MOSAIC_H__
+#define __ASP_CORE_DEM_MOSAIC_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Image/ImageView.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <asp/Core/FileUtils.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Keep open at most a given number of DEM files, closing the least
+  /// recently used one when another must be opened. A handle obtained
+  /// from get() stays valid while it is held, even if in the meantime
+  /// it is evicted from the cache, so at any time at most the cache
+  /// size plus the number of threads files are open.
+  template <class PixelT>
+  class DiskImageCache: private boost::noncopyable {
+  public:
+    typedef vw::DiskImageView<PixelT>   ImageType;
+    typedef boost::shared_ptr<ImageType> HandleType;
+
+    DiskImageCache(std::vector<std::string> const& files, size_t max_open):
+      m_files(files), m_max_open(std::max(max_open, size_t(1))), m_num_opened(0) {}
+
+    /// Return a handle to the image with the given index in the list
+    /// of files, opening it if needed.
+    HandleType get(size_t index) {
+      {
+        vw::Mutex::Lock lock(m_mutex);
+        typename MapType::iterator it = m_handles.find(index);
+        if (it != m_handles.end()) {
+          m_lru.splice(m_lru.begin(), m_lru, it->second.second); // most recently used
+          return it->second.first;
+        }
+      }
+
+      // Open the file without holding the lock, so that other threads
+      // can meanwhile use the files already open.
+      HandleType handle(new ImageType(m_files[index]));
+
+      vw::Mutex::Lock lock(m_mutex);
+      m_num_opened++;
+      typename MapType::iterator it = m_handles.find(index);
+      if (it != m_handles.end())
+        return it->second.first; // another thread got there first
+      while (m_handles.size() >= m_max_open && !m_lru.empty()) {
+        m_handles.erase(m_lru.back());
+        m_lru.pop_back();
+      }
+      m_lru.push_front(index);
+      m_handles[index] = std::make_pair(handle, m_lru.begin());
+      return handle;
+    }
+
+    std::string const& file_name(size_t index) const { return m_files[index]; }
+    size_t size() const { return m_files.size(); }
+
+    /// How many times a file was opened, to tell if the cache is too small
+    size_t num_opened() const {
+      vw::Mutex::Lock lock(m_mutex);
+      return m_num_opened;
+    }
+
+    /// Close all files not currently in use
+    void clear() {
+      vw::Mutex::Lock lock(m_mutex);
+      m_handles.clear();
+      m_lru.clear();
+    }
+
+  private:
+    typedef std::list<size_t> ListType;
+    typedef std::map<size_t, std::pair<HandleType, typename ListType::iterator> > MapType;
+
+    std::vector<std::string> m_files;
+    size_t                   m_max_open, m_num_opened;
+    ListType                 m_lru;
+    MapType                  m_handles;
+    mutable vw::Mutex        m_mutex;
+  };
+
+  /// Collect the values at each pixel of a tile from a stack of
+  /// images of the size of the tile, such as DEMs, to find order
+  /// statistics like the median. Only valid values are stored. At most
+  /// about the given number of bytes are kept in memory, the rest are
+  /// saved to a temporary file, which is wiped at the end. The values
+  /// are then retrieved one row at a time, so the memory used does not
+  /// grow with the number of images.
+  class PixelValueStack: private boost::noncopyable {
+
+  public:
+    /// A value and the index of the image it came from
+    struct Entry {
+      double         value;
+      boost::int32_t index;
+    };
+
+    PixelValueStack(int cols, int rows, std::string const& tmp_file, size_t max_memory_bytes);
+    ~PixelValueStack();
+
+    /// Add the values of an image, except those equal to nodata_value
+    void add_image(vw::ImageView<double> const& image, double nodata_value, int index);
+
+    /// Must be called after all images are added
+    void finish();
+
+    /// Get the entries at each pixel in a row, in the order the
+    /// images were added.
+    void read_row(int row, std::vector< std::vector<Entry> > & entries) const;
+
+    boost::uint64_t num_values() const { return m_num_values; }
+
+  private:
+
+    // A value stored in a row
+    struct Record {
+      boost::int32_t col, index;
+      double         value;
+    };
+
+    // A part of a row which is saved to disk
+    struct Chunk {
+      boost::uint64_t offset, num_records;
+    };
+
+    void spill(); // append all rows in memory to the temporary file
+
+    int                                   m_cols, m_rows;
+    std::string                           m_tmp_file;
+    size_t                                m_max_memory_bytes, m_memory_bytes;
+    std::vector< std::vector<Record> >    m_records;
+    std::vector< std::vector<Chunk> >     m_chunks;
+    std::ofstream                         m_ofs;
+    boost::uint64_t                       m_file_records, m_num_values;
+    bool                                  m_finished;
+  };
+
+  /// Order the tiles of a grid of num_tiles_x by num_tiles_y tiles,
+  /// with tile index tile_x + tile_y*num_tiles_x, along a Hilbert
+  /// curve, so that tiles close along the curve are close in the
+  /// grid. The tiles to order are given in tile_ids, which is sorted
+  /// in place.
+  void hilbert_tile_order(int num_tiles_x, int num_tiles_y, std::vector<int> & tile_ids);
+
+  /// Save the signatures of the DEMs an output tile was made from and
+  /// of the tile itself. The key should identify all the settings
+  /// which affect the tile.
+  void write_tile_manifest(std::string const& manifest_file, std::string const& key,
+                           std::string const& tile_file,
+                           std::vector<std::string> const& dem_signatures);
+
+  /// Return true if the tile manifest was saved with the same key and
+  /// DEM signatures, and the tile file is unchanged since then, or
+  /// still does not exist if it had no valid pixels.
+  bool tile_manifest_is_current(std::string const& manifest_file, std::string const& key,
+                                std::string const& tile_file,
+                                std::vector<std::string> const& dem_signatures);
+
+} // namespace asp
+
+#endif // __ASP_CORE_DEM_MOSAIC_H__
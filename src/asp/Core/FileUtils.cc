@@ -18,6 +18,8 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/operations.hpp>
 
+#include <ctime>
+
 #include <asp/Core/FileUtils.h>
 
 namespace asp{
@@ -61,6 +63,20 @@ namespace asp{
     return is_latest_timestamp(test_file, vec);
   }
 
+  std::string file_signature(std::string const& file) {
+    namespace fs = boost::filesystem;
+    boost::system::error_code ec;
+    boost::uintmax_t size = fs::file_size(file, ec);
+    if (ec)
+      return "";
+    std::time_t time = fs::last_write_time(file, ec);
+    if (ec)
+      return "";
+    std::ostringstream os;
+    os << size << ' ' << time << ' ' << file;
+    return os.str();
+  }
+
   void read_1d_points(std::string const& file, std::vector<double> & points){
 
     std::ifstream ifs(file.c_str());
@@ -40,6 +40,11 @@ namespace asp {
                            std::string const& f1, std::string const& f2,
                            std::string const& f3, std::string const& f4);
 
+  /// A description of a file, made of its size, modification time,
+  /// and name, which changes when the file is modified. Empty if the
+  /// file does not exist.
+  std::string file_signature(std::string const& file);
+
   void read_1d_points(std::string const& file, std::vector<double> & points);
   void read_2d_points(std::string const& file, std::vector<vw::Vector2> & points);
   void read_3d_points(std::string const& file, std::vector<vw::Vector3> & points);
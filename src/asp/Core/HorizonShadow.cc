@@ -0,0 +1,324 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/LinearAlgebra.h>
+#include <asp/Core/HorizonShadow.h>
+
+#include <boost/noncopyable.hpp>
+#include <algorithm>
+#include <limits>
+
+using namespace vw;
+
+namespace asp {
+
+namespace {
+
+  // Convert a range of DEM rows to the local frame.
+  class EnuTask: public vw::Task, private boost::noncopyable {
+    ImageView<double>      const& m_dem;
+    cartography::GeoReference     m_geo; // a copy, for thread safety
+    Vector3                       m_center;
+    Matrix3x3                     m_ecef_to_enu;
+    int                           m_beg_row, m_end_row;
+    ImageView<Vector3f>         & m_enu;
+  public:
+    EnuTask(ImageView<double> const& dem, cartography::GeoReference const& geo,
+            Vector3 const& center, Matrix3x3 const& ecef_to_enu,
+            int beg_row, int end_row, ImageView<Vector3f> & enu):
+      m_dem(dem), m_geo(geo), m_center(center), m_ecef_to_enu(ecef_to_enu),
+      m_beg_row(beg_row), m_end_row(end_row), m_enu(enu){}
+
+    void operator()() {
+      for (int row = m_beg_row; row < m_end_row; row++) {
+        for (int col = 0; col < m_dem.cols(); col++) {
+          Vector2 lonlat = m_geo.pixel_to_lonlat(Vector2(col, row));
+          Vector3 xyz = m_geo.datum().geodetic_to_cartesian
+            (Vector3(lonlat[0], lonlat[1], m_dem(col, row)));
+          m_enu(col, row) = Vector3f(m_ecef_to_enu*(xyz - m_center));
+        }
+      }
+    }
+  };
+
+  // Sweep a range of DEM lines parallel to the azimuth direction and
+  // find the horizon angle at each pixel. The lines are traversed
+  // starting from the end closest to the sun, and the upper convex
+  // hull of the terrain profile traversed so far is kept in a
+  // stack. Points below the hull can never be the horizon for the
+  // points further along the line, so each point is pushed and
+  // popped at most once.
+  class HorizonTask: public vw::Task, private boost::noncopyable {
+    ImageView<Vector3f> const& m_enu;
+    Vector2                    m_dir;     // azimuth direction in the local frame
+    bool                       m_col_major;
+    double                     m_slope;   // change in minor coordinate per major step
+    int                        m_major_beg, m_major_end, m_major_inc;
+    int                        m_beg_line, m_end_line;
+    ImageView<float>         & m_horizon;
+  public:
+    HorizonTask(ImageView<Vector3f> const& enu, Vector2 const& dir,
+                bool col_major, double slope,
+                int major_beg, int major_end, int major_inc,
+                int beg_line, int end_line,
+                ImageView<float> & horizon):
+      m_enu(enu), m_dir(dir), m_col_major(col_major), m_slope(slope),
+      m_major_beg(major_beg), m_major_end(major_end), m_major_inc(major_inc),
+      m_beg_line(beg_line), m_end_line(end_line), m_horizon(horizon){}
+
+    void operator()() {
+
+      int num_minor = m_col_major ? m_enu.rows() : m_enu.cols();
+
+      // Distances shorter than this are degenerate. They can occur only
+      // due to rounding of the line to the pixel grid.
+      double min_dist = 1e-6;
+
+      std::vector<double> hull_t, hull_z;
+      for (int line = m_beg_line; line < m_end_line; line++) {
+
+        hull_t.clear();
+        hull_z.clear();
+
+        for (int major = m_major_beg; major != m_major_end; major += m_major_inc) {
+
+          int minor = (int)floor(line + m_slope*major + 0.5);
+          if (minor < 0 || minor >= num_minor)
+            continue;
+
+          int col = m_col_major ? major : minor;
+          int row = m_col_major ? minor : major;
+
+          // Distance along the line increases as we move away from the sun
+          Vector3f const& P = m_enu(col, row);
+          double t = -(m_dir[0]*P[0] + m_dir[1]*P[1]);
+          double z = P[2];
+
+          // Pop the hull points which are under the segment from the
+          // previous hull point to the current point.
+          int n = hull_t.size();
+          while (n >= 2) {
+            double s1 = (hull_z[n-1] - z)/std::max(t - hull_t[n-1], min_dist);
+            double s2 = (hull_z[n-2] - z)/std::max(t - hull_t[n-2], min_dist);
+            if (s2 < s1)
+              break;
+            hull_t.pop_back();
+            hull_z.pop_back();
+            n--;
+          }
+
+          if (n == 0)
+            m_horizon(col, row) = -M_PI/2.0; // nothing in the way of the sun
+          else
+            m_horizon(col, row)
+              = atan((hull_z[n-1] - z)/std::max(t - hull_t[n-1], min_dist));
+
+          hull_t.push_back(t);
+          hull_z.push_back(z);
+        }
+      }
+    }
+  };
+
+} // end anonymous namespace
+
+HorizonShadow::HorizonShadow(ImageView<double> const& dem,
+                             cartography::GeoReference const& geo){
+
+  if (dem.cols() <= 0 || dem.rows() <= 0)
+    vw_throw( ArgumentErr() << "HorizonShadow: The input DEM is empty.\n" );
+
+  // The local frame is tangent to the datum at the DEM center
+  Vector2 lonlat = geo.pixel_to_lonlat(Vector2((dem.cols() - 1)/2.0,
+                                               (dem.rows() - 1)/2.0));
+  m_center = geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], 0.0));
+
+  double lon = lonlat[0]*M_PI/180.0, lat = lonlat[1]*M_PI/180.0;
+  m_ecef_to_enu(0, 0) = -sin(lon);
+  m_ecef_to_enu(0, 1) =  cos(lon);
+  m_ecef_to_enu(0, 2) =  0.0;
+  m_ecef_to_enu(1, 0) = -sin(lat)*cos(lon);
+  m_ecef_to_enu(1, 1) = -sin(lat)*sin(lon);
+  m_ecef_to_enu(1, 2) =  cos(lat);
+  m_ecef_to_enu(2, 0) =  cos(lat)*cos(lon);
+  m_ecef_to_enu(2, 1) =  cos(lat)*sin(lon);
+  m_ecef_to_enu(2, 2) =  sin(lat);
+
+  m_enu.set_size(dem.cols(), dem.rows());
+  FifoWorkQueue queue( vw_settings().default_num_threads() );
+  int rows_per_task = 64;
+  for (int row = 0; row < dem.rows(); row += rows_per_task) {
+    boost::shared_ptr<EnuTask>
+      task(new EnuTask(dem, geo, m_center, m_ecef_to_enu, row,
+                       std::min(row + rows_per_task, dem.rows()), m_enu));
+    queue.add_task(task);
+  }
+  queue.join_all();
+
+  // How the horizontal local coordinates change along DEM columns and
+  // rows near the DEM center. Inverting this tells us which direction
+  // in the DEM corresponds to a given azimuth.
+  int c0 = std::min(std::max((dem.cols() - 1)/2, 0), std::max(dem.cols() - 2, 0));
+  int r0 = std::min(std::max((dem.rows() - 1)/2, 0), std::max(dem.rows() - 2, 0));
+  Matrix2x2 jac;
+  jac(0, 0) = 1.0; jac(0, 1) = 0.0;
+  jac(1, 0) = 0.0; jac(1, 1) = -1.0;
+  if (dem.cols() > 1 && dem.rows() > 1) {
+    for (int it = 0; it < 2; it++) {
+      jac(it, 0) = m_enu(c0 + 1, r0)[it] - m_enu(c0, r0)[it];
+      jac(it, 1) = m_enu(c0, r0 + 1)[it] - m_enu(c0, r0)[it];
+    }
+  }
+  m_enu_to_pix = vw::math::inverse(jac);
+}
+
+void HorizonShadow::azimuth_elevation(Vector3 const& xyz,
+                                      double & azimuth, double & elevation) const {
+  Vector3 dir = m_ecef_to_enu*(xyz - m_center);
+  double len = norm_2(dir);
+  if (len == 0)
+    vw_throw( ArgumentErr() << "HorizonShadow: Cannot find the direction to the "
+              << "center of the local frame.\n" );
+  dir /= len;
+  azimuth   = atan2(dir[0], dir[1]);
+  elevation = asin(std::max(-1.0, std::min(1.0, dir[2])));
+}
+
+void HorizonShadow::compute_horizon(double azimuth, ImageView<float> & horizon,
+                                    int num_threads) const {
+
+  int cols = m_enu.cols(), rows = m_enu.rows();
+  horizon.set_size(cols, rows);
+
+  // The azimuth direction in the local frame and in the DEM pixel grid
+  Vector2 dir(sin(azimuth), cos(azimuth));
+  Vector2 pix_dir = m_enu_to_pix*dir;
+
+  // We walk from the sun side, so in the direction opposite to the
+  // azimuth. Step by one pixel along the dominant axis.
+  Vector2 walk = -pix_dir;
+  bool col_major = (std::abs(walk[0]) >= std::abs(walk[1]));
+  int num_major = col_major ? cols : rows;
+  int num_minor = col_major ? rows : cols;
+  double major_comp = col_major ? walk[0] : walk[1];
+  double minor_comp = col_major ? walk[1] : walk[0];
+  double slope = (major_comp != 0) ? minor_comp/major_comp : 0.0;
+
+  int major_beg = 0, major_end = num_major, major_inc = 1;
+  if (major_comp < 0) {
+    major_beg = num_major - 1; major_end = -1; major_inc = -1;
+  }
+
+  // Lines are indexed by their minor coordinate at major coordinate 0.
+  // Each pixel belongs to exactly one line.
+  double shift_min = std::min(0.0, slope*(num_major - 1));
+  double shift_max = std::max(0.0, slope*(num_major - 1));
+  int beg_line = (int)floor(-shift_max) - 1;
+  int end_line = (int)ceil(num_minor - shift_min) + 1;
+
+  if (num_threads <= 0)
+    num_threads = vw_settings().default_num_threads();
+  FifoWorkQueue queue(num_threads);
+  int lines_per_task = 32;
+  for (int line = beg_line; line < end_line; line += lines_per_task) {
+    boost::shared_ptr<HorizonTask>
+      task(new HorizonTask(m_enu, dir, col_major, slope,
+                           major_beg, major_end, major_inc,
+                           line, std::min(line + lines_per_task, end_line),
+                           horizon));
+    queue.add_task(task);
+  }
+  queue.join_all();
+}
+
+void HorizonShadow::compute_shadow(Vector3 const& sun_pos, ImageView<float> & shadow,
+                                   int num_threads) const {
+  std::vector<Vector3> sun_positions(1, sun_pos);
+  std::vector< ImageView<float> > shadows;
+  compute_shadows(sun_positions, 0.0, shadows, num_threads);
+  shadow = shadows[0];
+}
+
+void HorizonShadow::compute_shadows(std::vector<Vector3> const& sun_positions,
+                                    double azimuth_tol,
+                                    std::vector< ImageView<float> > & shadows,
+                                    int num_threads) const {
+
+  int num_suns = sun_positions.size();
+  shadows.resize(num_suns);
+
+  std::vector<double> azimuths(num_suns), elevations(num_suns);
+  std::vector< std::pair<double, int> > sorted_az(num_suns);
+  for (int it = 0; it < num_suns; it++) {
+    azimuth_elevation(sun_positions[it], azimuths[it], elevations[it]);
+    sorted_az[it] = std::make_pair(azimuths[it], it);
+  }
+  std::sort(sorted_az.begin(), sorted_az.end());
+
+  // The azimuths are on a circle. Start after the largest gap between
+  // neighbors, adding 2 pi to the azimuths before it, so that a group
+  // is not split at +/- pi and its mean is not on the opposite side.
+  if (num_suns > 1) {
+    int start = 0;
+    double max_gap = -1.0;
+    for (int it = 0; it < num_suns; it++) {
+      double next = (it + 1 < num_suns) ? sorted_az[it + 1].first : (sorted_az[0].first + 2*M_PI);
+      if (next - sorted_az[it].first > max_gap) {
+        max_gap = next - sorted_az[it].first;
+        start   = (it + 1) % num_suns;
+      }
+    }
+    for (int it = 0; it < start; it++)
+      sorted_az[it].first += 2*M_PI;
+    std::rotate(sorted_az.begin(), sorted_az.begin() + start, sorted_az.end());
+  }
+
+  // Group the sun positions by azimuth and compute one horizon per group
+  ImageView<float> horizon;
+  int beg = 0;
+  while (beg < num_suns) {
+    int end = beg + 1;
+    while (end < num_suns && sorted_az[end].first - sorted_az[beg].first <= azimuth_tol)
+      end++;
+
+    double mean_az = 0.0;
+    for (int it = beg; it < end; it++)
+      mean_az += sorted_az[it].first;
+    mean_az /= (end - beg);
+
+    compute_horizon(mean_az, horizon, num_threads);
+
+    for (int it = beg; it < end; it++) {
+      int index = sorted_az[it].second;
+      double elevation = elevations[index];
+      ImageView<float> & shadow = shadows[index];
+      shadow.set_size(horizon.cols(), horizon.rows());
+      for (int col = 0; col < horizon.cols(); col++) {
+        for (int row = 0; row < horizon.rows(); row++)
+          shadow(col, row) = (horizon(col, row) > elevation);
+      }
+    }
+
+    beg = end;
+  }
+}
+
+} // end namespace asp
@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file HorizonShadow.h
+///
+/// Shadow computation for a DEM based on horizon angles. For a given
+/// sun azimuth, each DEM pixel is assigned the elevation angle of its
+/// horizon in that direction. A pixel is in shadow if the sun is below
+/// that horizon. The horizon angles are found with a sweep along lines
+/// of the DEM parallel to the azimuth, maintaining the upper convex hull
+/// of the terrain profile seen so far, so the cost is linear in the
+/// number of DEM pixels rather than the length of a marched ray per pixel.
+
+#ifndef __ASP_CORE_HORIZON_SHADOW_H__
+#define __ASP_CORE_HORIZON_SHADOW_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Cartography/GeoReference.h>
+
+#include <vector>
+
+namespace asp {
+
+  /// Find horizon angles and shadow masks for a DEM. All computations
+  /// are done in a local East-North-Up frame tangent to the datum at
+  /// the DEM center, which accounts for the curvature of the planet and
+  /// for the distortion of the DEM projection.
+  class HorizonShadow {
+
+  public:
+
+    /// Convert the DEM to the local frame. The heights are relative to
+    /// the datum of the georeference. No-data values are not allowed,
+    /// they must be filled in by the caller.
+    HorizonShadow(vw::ImageView<double> const& dem,
+                  vw::cartography::GeoReference const& geo);
+
+    /// Find the azimuth (clockwise from local North) and elevation, in
+    /// radians, of a given ECEF position as seen from the DEM center.
+    void azimuth_elevation(vw::Vector3 const& xyz,
+                           double & azimuth, double & elevation) const;
+
+    /// Find the horizon elevation angle, in radians, at each DEM pixel,
+    /// looking in the direction of the given azimuth. Pixels with no
+    /// terrain between them and the DEM edge get -pi/2. The work is
+    /// distributed over the given number of threads (0 means use the
+    /// default number of threads).
+    void compute_horizon(double azimuth, vw::ImageView<float> & horizon,
+                         int num_threads = 0) const;
+
+    /// Compute the shadow mask (1 means in shadow, 0 means lit) for the
+    /// sun at the given ECEF position.
+    void compute_shadow(vw::Vector3 const& sun_pos, vw::ImageView<float> & shadow,
+                        int num_threads = 0) const;
+
+    /// Compute the shadow masks for a set of sun positions. Sun positions
+    /// whose azimuths are within azimuth_tol radians of each other,
+    /// also across +/- pi, share one horizon computation.
+    void compute_shadows(std::vector<vw::Vector3> const& sun_positions,
+                         double azimuth_tol,
+                         std::vector< vw::ImageView<float> > & shadows,
+                         int num_threads = 0) const;
+
+  private:
+
+    vw::ImageView<vw::Vector3f> m_enu;    // local East, North, Up coordinates
+    vw::Vector3                 m_center; // ECEF origin of the local frame
+    vw::Matrix3x3               m_ecef_to_enu;
+    vw::Matrix2x2               m_enu_to_pix; // local inverse Jacobian at DEM center
+
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_HORIZON_SHADOW_H__
@@ -0,0 +1,309 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/MaskViews.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <asp/Core/FileUtils.h>
+#include <asp/Core/ImagePyramid.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    const char PYRAMID_MAGIC[] = "ASP_IMAGE_PYRAMID_V1";
+
+    // Halve an image by averaging the valid pixels in each 2x2 block.
+    // A pixel is invalid if all pixels in its block are invalid.
+    template <class ImageT>
+    class HalfResView: public ImageViewBase<HalfResView<ImageT> > {
+      ImageT m_image;
+    public:
+      typedef PixelMask<float> pixel_type;
+      typedef pixel_type       result_type;
+      typedef ProceduralPixelAccessor<HalfResView<ImageT> > pixel_accessor;
+
+      HalfResView(ImageT const& image): m_image(image) {}
+
+      inline int32 cols  () const { return (m_image.cols() + 1)/2; }
+      inline int32 rows  () const { return (m_image.rows() + 1)/2; }
+      inline int32 planes() const { return 1; }
+
+      inline pixel_accessor origin() const { return pixel_accessor(*this, 0, 0); }
+
+      inline result_type operator()(int32 /*i*/, int32 /*j*/, int32 /*p*/ = 0) const {
+        vw_throw(NoImplErr() << "HalfResView::operator()(...) is not implemented.\n");
+        return result_type();
+      }
+
+      typedef CropView<ImageView<pixel_type> > prerasterize_type;
+      inline prerasterize_type prerasterize(BBox2i const& bbox) const {
+
+        BBox2i src_box(2*bbox.min(), 2*bbox.max());
+        src_box.crop(bounding_box(m_image));
+        ImageView<typename ImageT::pixel_type> src = crop(m_image, src_box);
+
+        ImageView<pixel_type> result(bbox.width(), bbox.height());
+        for (int row = 0; row < bbox.height(); row++) {
+          for (int col = 0; col < bbox.width(); col++) {
+            double sum = 0.0;
+            int    count = 0;
+            for (int dy = 0; dy < 2; dy++) {
+              for (int dx = 0; dx < 2; dx++) {
+                int x = 2*(bbox.min().x() + col) + dx - src_box.min().x();
+                int y = 2*(bbox.min().y() + row) + dy - src_box.min().y();
+                if (x >= src.cols() || y >= src.rows() || !is_valid(src(x, y)))
+                  continue;
+                sum += src(x, y).child();
+                count++;
+              }
+            }
+            if (count > 0)
+              result(col, row) = pixel_type(sum/count);
+            else
+              result(col, row).invalidate();
+          }
+        }
+
+        return prerasterize_type(result, BBox2i(-bbox.min().x(), -bbox.min().y(),
+                                                cols(), rows()));
+      }
+
+      template <class DestT>
+      inline void rasterize(DestT const& dest, BBox2i const& bbox) const {
+        vw::rasterize(prerasterize(bbox), dest, bbox);
+      }
+    };
+
+    template <class ImageT>
+    void write_half_res(std::string const& file, ImageT const& image, float nodata_value,
+                        int level, vw::cartography::GdalWriteOptions const& opt) {
+      std::ostringstream tag;
+      tag << "\t    Pyramid level " << level << ": ";
+      bool has_georef = false, has_nodata = true;
+      vw::cartography::block_write_gdal_image(file,
+                                               apply_mask(HalfResView<ImageT>(image),
+                                                          nodata_value),
+                                               has_georef, vw::cartography::GeoReference(),
+                                               has_nodata, nodata_value,
+                                               opt, TerminalProgressCallback("asp", tag.str()));
+    }
+
+    // The signature of what level 1 is made from
+    std::string base_signature(std::string const& image_file, std::string const& mask_file) {
+      std::string image_sig = file_signature(image_file), mask_sig = file_signature(mask_file);
+      if (image_sig.empty() || mask_sig.empty())
+        return "";
+      return image_sig + "|" + mask_sig;
+    }
+
+    struct PyramidManifest {
+      std::string mask_file;
+      double      nodata_value;
+      std::vector<std::string> source_signatures, level_signatures;
+    };
+
+    bool read_manifest(std::string const& manifest_file, PyramidManifest & manifest) {
+
+      std::ifstream ifs(manifest_file.c_str());
+      if (!ifs.good())
+        return false;
+
+      std::string line;
+      if (!std::getline(ifs, line) || line != PYRAMID_MAGIC)
+        return false;
+      if (!std::getline(ifs, manifest.mask_file))
+        return false;
+      int num_levels = 0;
+      if (!std::getline(ifs, line))
+        return false;
+      std::istringstream is(line);
+      if (!(is >> manifest.nodata_value >> num_levels) || num_levels < 0)
+        return false;
+
+      manifest.source_signatures.resize(num_levels);
+      manifest.level_signatures.resize(num_levels);
+      for (int i = 0; i < num_levels; i++) {
+        if (!std::getline(ifs, manifest.source_signatures[i]) ||
+            !std::getline(ifs, manifest.level_signatures[i]))
+          return false;
+      }
+      return true;
+    }
+
+    void write_manifest(std::string const& manifest_file, PyramidManifest const& manifest) {
+
+      // Write to a temporary file first, so that an interrupted run
+      // does not leave behind a partial manifest.
+      std::string tmp_file = manifest_file + ".tmp";
+      {
+        std::ofstream ofs(tmp_file.c_str());
+        if (!ofs.good())
+          vw_throw( IOErr() << "Cannot open for writing: " << tmp_file << "\n" );
+        ofs << PYRAMID_MAGIC << "\n" << manifest.mask_file << "\n";
+        ofs << std::setprecision(17) << manifest.nodata_value << ' '
+            << manifest.level_signatures.size() << "\n";
+        for (size_t i = 0; i < manifest.level_signatures.size(); i++)
+          ofs << manifest.source_signatures[i] << "\n" << manifest.level_signatures[i] << "\n";
+        if (!ofs.good())
+          vw_throw( IOErr() << "Failed writing: " << tmp_file << "\n" );
+      }
+      boost::filesystem::rename(tmp_file, manifest_file);
+    }
+  }
+
+  std::string image_pyramid_level_file(std::string const& image_file, int level) {
+    if (level == 0)
+      return image_file;
+    boost::filesystem::path path(image_file);
+    std::ostringstream os;
+    os << path.stem().string() << "_pyr" << ImagePyramid::level_scale(level)
+       << path.extension().string();
+    return (path.parent_path() / os.str()).string();
+  }
+
+  std::string image_pyramid_manifest_file(std::string const& image_file) {
+    boost::filesystem::path path(image_file);
+    return (path.parent_path() / (path.stem().string() + "_pyr.txt")).string();
+  }
+
+  int build_image_pyramid(std::string const& image_file, std::string const& mask_file,
+                          float nodata_value, int min_size,
+                          vw::cartography::GdalWriteOptions const& opt) {
+
+    if (min_size <= 0)
+      vw_throw( ArgumentErr() << "build_image_pyramid: The minimum size must be positive.\n" );
+
+    int num_levels = 0;
+    {
+      DiskImageView<float> image(image_file);
+      int cols = image.cols(), rows = image.rows();
+      while (std::max(cols, rows) > min_size) {
+        cols = (cols + 1)/2;
+        rows = (rows + 1)/2;
+        num_levels++;
+      }
+    }
+
+    std::string manifest_file = image_pyramid_manifest_file(image_file);
+    PyramidManifest old_manifest;
+    bool have_old = read_manifest(manifest_file, old_manifest) &&
+      old_manifest.mask_file == mask_file && old_manifest.nodata_value == nodata_value;
+
+    PyramidManifest manifest;
+    manifest.mask_file    = mask_file;
+    manifest.nodata_value = nodata_value;
+
+    // A level is made again if what it is made from changed, which in
+    // turn forces the levels above it to be made again.
+    int num_built = 0;
+    for (int level = 1; level <= num_levels; level++) {
+
+      std::string level_file = image_pyramid_level_file(image_file, level);
+      std::string source_sig;
+      if (level == 1)
+        source_sig = base_signature(image_file, mask_file);
+      else
+        source_sig = file_signature(image_pyramid_level_file(image_file, level - 1));
+      std::string level_sig = file_signature(level_file);
+
+      bool is_current = have_old && level <= int(old_manifest.level_signatures.size()) &&
+        !level_sig.empty() &&
+        old_manifest.source_signatures[level - 1] == source_sig &&
+        old_manifest.level_signatures [level - 1] == level_sig;
+
+      if (!is_current) {
+        vw_out() << "Writing: " << level_file << "\n";
+        if (level == 1)
+          write_half_res(level_file,
+                         copy_mask(DiskImageView<float>(image_file),
+                                   create_mask(DiskImageView<uint8>(mask_file))),
+                         nodata_value, level, opt);
+        else
+          write_half_res(level_file,
+                         create_mask(DiskImageView<float>
+                                     (image_pyramid_level_file(image_file, level - 1)),
+                                     nodata_value),
+                         nodata_value, level, opt);
+        level_sig = file_signature(level_file);
+        num_built++;
+      }
+
+      manifest.source_signatures.push_back(source_sig);
+      manifest.level_signatures.push_back(level_sig);
+    }
+
+    if (num_built > 0 || !have_old ||
+        int(old_manifest.level_signatures.size()) != num_levels)
+      write_manifest(manifest_file, manifest);
+    else
+      vw_out() << "\t--> Using cached image pyramid for: " << image_file << "\n";
+
+    return num_built;
+  }
+
+  bool ImagePyramid::read(std::string const& image_file) {
+
+    m_level_files.clear();
+
+    PyramidManifest manifest;
+    if (!read_manifest(image_pyramid_manifest_file(image_file), manifest))
+      return false;
+
+    std::vector<std::string> level_files(1, image_file);
+    for (size_t i = 0; i < manifest.level_signatures.size(); i++) {
+      int level = i + 1;
+      std::string level_file = image_pyramid_level_file(image_file, level);
+      std::string source_sig;
+      if (level == 1)
+        source_sig = base_signature(image_file, manifest.mask_file);
+      else
+        source_sig = file_signature(level_files.back());
+      if (source_sig.empty() || source_sig != manifest.source_signatures[i] ||
+          file_signature(level_file) != manifest.level_signatures[i])
+        return false;
+      level_files.push_back(level_file);
+    }
+
+    m_level_files.swap(level_files);
+    m_nodata_value = manifest.nodata_value;
+    return true;
+  }
+
+  int ImagePyramid::level_for_scale(double scale) const {
+    int level = 0;
+    while (level + 1 < num_levels() && level_scale(level + 1) <= scale)
+      level++;
+    return level;
+  }
+
+} // namespace asp
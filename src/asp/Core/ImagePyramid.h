@@ -0,0 +1,93 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ImagePyramid.h
+///
+/// A pyramid of downsampled versions of an image, such as L.tif and
+/// R.tif, saved next to it. stereo_pprc makes it when invoked with
+/// --build-image-pyramids, and stereo_gui then displays the image
+/// from it instead of making its own pyramid. No other tool reads it,
+/// in particular L_sub.tif, R_sub.tif and the correlation pyramid are
+/// still made from the full-resolution image. Level k is the image
+/// downsampled by 2^k, made from level k - 1 by averaging the valid
+/// pixels in each 2x2 block. Level 0 is the image itself.
+///
+/// A manifest records the signature of the source each level was made
+/// from and of the level itself, so a level is made again only if its
+/// source changed, and a pyramid that is out of date is not used.
+
+#ifndef __ASP_CORE_IMAGE_PYRAMID_H__
+#define __ASP_CORE_IMAGE_PYRAMID_H__
+
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// The file having the given level of the pyramid of an image. For
+  /// run/run-L.tif and level 2 this is run/run-L_pyr4.tif. Level 0 is
+  /// the image itself.
+  std::string image_pyramid_level_file(std::string const& image_file, int level);
+
+  /// The file recording which levels of the pyramid of an image are
+  /// current, such as run/run-L_pyr.txt.
+  std::string image_pyramid_manifest_file(std::string const& image_file);
+
+  /// Make the pyramid of a single-channel image, with pixels invalid
+  /// where the mask is zero, till the largest dimension of the
+  /// coarsest level is no more than min_size. Invalid pixels are
+  /// saved with the given nodata value. Levels which are current are
+  /// not made again. Return the number of levels which were made.
+  int build_image_pyramid(std::string const& image_file, std::string const& mask_file,
+                          float nodata_value, int min_size,
+                          vw::cartography::GdalWriteOptions const& opt);
+
+  /// Look up the levels of a pyramid made with build_image_pyramid().
+  class ImagePyramid {
+  public:
+    ImagePyramid(): m_nodata_value(0.0) {}
+
+    /// Read the manifest of the pyramid of the given image. Return
+    /// false if the pyramid does not exist, or if the image or any
+    /// level changed since the pyramid was made.
+    bool read(std::string const& image_file);
+
+    /// The number of levels, including level 0, the image itself
+    int num_levels() const { return m_level_files.size(); }
+
+    std::string const& level_file(int level) const { return m_level_files[level]; }
+
+    /// How many times level is smaller than the image
+    static int level_scale(int level) { return 1 << level; }
+
+    /// The coarsest level which is not smaller than the image
+    /// downsampled by the given factor.
+    int level_for_scale(double scale) const;
+
+    double nodata_value() const { return m_nodata_value; }
+
+  private:
+    std::vector<std::string> m_level_files;
+    double                   m_nodata_value;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_IMAGE_PYRAMID_H__
@@ -21,6 +21,7 @@
 #include <vw/Math/RANSAC.h>
 #include <vw/Cartography/CameraBBox.h>
 #include <vw/Stereo/StereoModel.h>
+#include <asp/Core/Ransac.h>
 
 using namespace vw;
 
@@ -33,6 +34,11 @@ namespace asp {
 //-------------------------------------------------------------------------------------------------
 // Class EpipolarLinePointMatcher
 
+  const int EpipolarLinePointMatcher::EPIPOLAR_BAND_EXPANSION;
+  const int EpipolarLinePointMatcher::MATCHING_TILE_SIZE;
+  const int EpipolarLinePointMatcher::MIN_TABLE_SPACING;
+  const int EpipolarLinePointMatcher::MAX_TABLE_SPACING;
+
   EpipolarLinePointMatcher::EpipolarLinePointMatcher( bool   single_threaded_camera,
                                                       double uniqueness_threshold,
                                                       double epipolar_threshold,
@@ -114,61 +120,214 @@ namespace asp {
   }
 
   // Local class definition -----
+  // Find the epipolar lines of some rows of nodes of an EpipolarLineTable
+  class EpipolarLineTableTask : public Task, private boost::noncopyable {
+    BBox2                         m_box;
+    double                        m_spacing;
+    int                           m_cols, m_start_row, m_end_row;
+    cartography::Datum const&     m_datum;
+    camera::CameraModel          *m_cam_ip, *m_cam_obj;
+    std::vector<Vector3>&         m_lines;
+  public:
+    EpipolarLineTableTask(BBox2 const& box, double spacing, int cols,
+                          int start_row, int end_row,
+                          cartography::Datum const& datum,
+                          camera::CameraModel* cam_ip, camera::CameraModel* cam_obj,
+                          std::vector<Vector3>& lines):
+      m_box(box), m_spacing(spacing), m_cols(cols),
+      m_start_row(start_row), m_end_row(end_row), m_datum(datum),
+      m_cam_ip(cam_ip), m_cam_obj(cam_obj), m_lines(lines) {}
+
+    void operator()() {
+      for (int row = m_start_row; row < m_end_row; row++) {
+        for (int col = 0; col < m_cols; col++) {
+          Vector2 node = m_box.min() + m_spacing * Vector2(col, row);
+          bool    success = false;
+          Vector3 line = EpipolarLinePointMatcher::epipolar_line(node, m_datum, m_cam_ip,
+                                                                 m_cam_obj, success);
+          double len = norm_2(subvector(line, 0, 2));
+          if (success && len > 0 && line == line)
+            m_lines[row * m_cols + col] = line / len;
+        }
+      }
+    }
+  }; // End class EpipolarLineTableTask -------------------
+
+  void EpipolarLineTable::build(BBox2 const& box, double spacing,
+                                cartography::Datum const& datum,
+                                camera::CameraModel* cam_ip,
+                                camera::CameraModel* cam_obj,
+                                bool single_threaded_camera) {
+    if (spacing <= 0)
+      vw_throw( ArgumentErr() << "EpipolarLineTable: the spacing must be positive.\n" );
+
+    m_box     = box;
+    m_spacing = spacing;
+    m_cols    = std::max(2, int(ceil(box.width () / spacing)) + 1);
+    m_rows    = std::max(2, int(ceil(box.height() / spacing)) + 1);
+    m_lines.assign(size_t(m_cols) * m_rows, Vector3());
+
+    if (single_threaded_camera) {
+      // Cameras which are not thread safe, such as ISIS ones, are called
+      // from this thread only, with no other thread using them meanwhile.
+      EpipolarLineTableTask task(m_box, m_spacing, m_cols, 0, m_rows,
+                                 datum, cam_ip, cam_obj, m_lines);
+      task();
+    } else {
+      int num_threads = vw_settings().default_num_threads();
+#if __APPLE__
+      // Fix due to OpenBLAS crashing. May need to be revisited.
+      num_threads = std::min(num_threads, 4);
+#endif
+      FifoWorkQueue queue(num_threads);
+      int rows_per_job = std::max(1, m_rows / (2 * num_threads));
+      for (int row = 0; row < m_rows; row += rows_per_job) {
+        boost::shared_ptr<Task>
+          task(new EpipolarLineTableTask(m_box, m_spacing, m_cols,
+                                         row, std::min(m_rows, row + rows_per_job),
+                                         datum, cam_ip, cam_obj, m_lines));
+        queue.add_task(task);
+      }
+      queue.join_all();
+    }
+
+    // The sign of a line is arbitrary. Make it the same for all nodes,
+    // so that the lines of neighboring nodes can be interpolated.
+    Vector3 ref;
+    for (size_t i = 0; i < m_lines.size(); i++) {
+      if (m_lines[i] == Vector3())
+        continue;
+      if (ref == Vector3())
+        ref = m_lines[i];
+      if (dot_prod(subvector(m_lines[i], 0, 2), subvector(ref, 0, 2)) < 0)
+        m_lines[i] = -m_lines[i];
+    }
+  }
+
+  Vector3 EpipolarLineTable::epipolar_line(Vector2 const& feature, bool & success) const {
+    success = false;
+    if (m_lines.empty())
+      return Vector3();
+
+    double x = (feature.x() - m_box.min().x()) / m_spacing;
+    double y = (feature.y() - m_box.min().y()) / m_spacing;
+    if (x < 0 || y < 0 || x > m_cols - 1 || y > m_rows - 1)
+      return Vector3();
+
+    int col = std::min(int(x), m_cols - 2), row = std::min(int(y), m_rows - 2);
+    double dx = x - col, dy = y - row;
+    Vector3 const& l00 = m_lines[row * m_cols + col];
+    Vector3 const& l10 = m_lines[row * m_cols + col + 1];
+    Vector3 const& l01 = m_lines[(row + 1) * m_cols + col];
+    Vector3 const& l11 = m_lines[(row + 1) * m_cols + col + 1];
+    if (l00 == Vector3() || l10 == Vector3() || l01 == Vector3() || l11 == Vector3())
+      return Vector3();
+
+    success = true;
+    return (1 - dy) * ((1 - dx) * l00 + dx * l10) + dy * ((1 - dx) * l01 + dx * l11);
+  }
+
+  // A FLANN tree over the descriptors of some of the interest points of an image
+  struct EpipolarDescriptorIndex {
+    std::vector<size_t>            ip_indices; // The index of each row in the image IP
+    Matrix<float        >          matrix_float;
+    Matrix<unsigned char>          matrix_uchar;
+    math::FLANNTree<float        > tree_float;
+    math::FLANNTree<unsigned char> tree_uchar;
+
+    void build(std::vector<ip::InterestPoint const*> const& ip, bool use_uchar_tree) {
+      size_t num_rows = ip_indices.size();
+      if (num_rows == 0)
+        return;
+      size_t num_cols = ip[ip_indices[0]]->descriptor.size();
+      if (use_uchar_tree) {
+        matrix_uchar.set_size(num_rows, num_cols);
+        for (size_t r = 0; r < num_rows; r++) {
+          for (size_t c = 0; c < num_cols; c++)
+            matrix_uchar(r, c) = static_cast<unsigned char>(ip[ip_indices[r]]->descriptor[c]);
+        }
+        tree_uchar.load_match_data(matrix_uchar, vw::math::FLANN_DistType_Hamming);
+      } else {
+        matrix_float.set_size(num_rows, num_cols);
+        for (size_t r = 0; r < num_rows; r++) {
+          for (size_t c = 0; c < num_cols; c++)
+            matrix_float(r, c) = ip[ip_indices[r]]->descriptor[c];
+        }
+        tree_float.load_match_data(matrix_float, vw::math::FLANN_DistType_L2);
+      }
+    }
+  };
+
+  // Local class definition -----
+  // Match some of the IP in the first image against the IP in a tree
+  // made from the second image. If the tree is not shared, it is made
+  // in the task, so that the trees of different tiles are made in parallel.
   class EpipolarLineMatchTask : public Task, private boost::noncopyable {
-    typedef ip::InterestPointList::const_iterator IPListIter;
-    bool                            m_single_threaded_camera;
-    bool                            m_use_uchar_tree;
-    math::FLANNTree<float        >& m_tree_float;
-    math::FLANNTree<unsigned char>& m_tree_uchar;
-    IPListIter                      m_start, m_end;
-    ip::InterestPointList const&    m_ip_other;
-    camera::CameraModel            *m_cam1, *m_cam2;
-    EpipolarLinePointMatcher const& m_matcher;
-    Mutex&                          m_camera_mutex;
-    std::vector<size_t>::iterator   m_output;
+    bool                                         m_single_threaded_camera;
+    bool                                         m_use_uchar_tree, m_build_index;
+    boost::shared_ptr<EpipolarDescriptorIndex>   m_index;
+    std::vector<ip::InterestPoint const*> const& m_ip, & m_ip_other;
+    std::vector<size_t>                          m_query; // The IP to match
+    camera::CameraModel                         *m_cam1, *m_cam2;
+    EpipolarLinePointMatcher const&              m_matcher;
+    EpipolarLineTable const&                     m_table;
+    Mutex&                                       m_camera_mutex;
+    std::vector<size_t>&                         m_output;
   public:
     EpipolarLineMatchTask( bool single_threaded_camera,
-                           bool use_uchar_tree,
-                           math::FLANNTree<float        >& tree_float,
-                           math::FLANNTree<unsigned char>& tree_uchar,
-                           ip::InterestPointList::const_iterator start,
-                           ip::InterestPointList::const_iterator end,
-                           ip::InterestPointList const& ip2,
+                           bool use_uchar_tree, bool build_index,
+                           boost::shared_ptr<EpipolarDescriptorIndex> index,
+                           std::vector<ip::InterestPoint const*> const& ip1,
+                           std::vector<ip::InterestPoint const*> const& ip2,
+                           std::vector<size_t> const& query,
                            camera::CameraModel* cam1,
                            camera::CameraModel* cam2,
                            EpipolarLinePointMatcher const& matcher,
+                           EpipolarLineTable const& table,
                            Mutex& camera_mutex,
-                           std::vector<size_t>::iterator output ) :
+                           std::vector<size_t>& output ) :
       m_single_threaded_camera(single_threaded_camera),
-      m_use_uchar_tree(use_uchar_tree), m_tree_float(tree_float), m_tree_uchar(tree_uchar),
-      m_start(start), m_end(end), m_ip_other(ip2),
+      m_use_uchar_tree(use_uchar_tree), m_build_index(build_index), m_index(index),
+      m_ip(ip1), m_ip_other(ip2), m_query(query),
       m_cam1(cam1), m_cam2(cam2),
-      m_matcher( matcher ), m_camera_mutex(camera_mutex), m_output(output) {}
+      m_matcher( matcher ), m_table(table), m_camera_mutex(camera_mutex), m_output(output) {}
 
     void operator()() {
 
-      const size_t NUM_MATCHES_TO_FIND = 10;
+      if (m_build_index)
+        m_index->build(m_ip_other, m_use_uchar_tree);
+
+      const size_t NUM_MATCHES_TO_FIND = std::min(size_t(10), m_index->ip_indices.size());
       Vector<int   > indices  (NUM_MATCHES_TO_FIND);
       Vector<double> distances(NUM_MATCHES_TO_FIND);
 
-      for ( IPListIter ip = m_start; ip != m_end; ip++ ) {
+      for (size_t q = 0; q < m_query.size(); q++) {
+        ip::InterestPoint const* ip = m_ip[m_query[q]];
+        size_t & output = m_output[m_query[q]];
+        output = (size_t)(-1); // Failed to find a match, return a flag!
+        if (NUM_MATCHES_TO_FIND == 0)
+          continue;
+
         Vector2 ip_org_coord = Vector2( ip->x, ip->y );
         Vector3 line_eq;
 
-        // Find the equation that describes the epipolar line
+        // Find the equation that describes the epipolar line. Use the
+        // cameras only if it cannot be found from the table.
         bool found_epipolar = false;
-        if (m_single_threaded_camera){
-          // ISIS camera is single-threaded
-          Mutex::Lock lock( m_camera_mutex );
-          line_eq = m_matcher.epipolar_line( ip_org_coord, m_matcher.m_datum, m_cam1, m_cam2, found_epipolar);
-        }else{
-          line_eq = m_matcher.epipolar_line( ip_org_coord, m_matcher.m_datum, m_cam1, m_cam2, found_epipolar);
+        if (!m_table.empty())
+          line_eq = m_table.epipolar_line( ip_org_coord, found_epipolar );
+        if (!found_epipolar) {
+          if (m_single_threaded_camera){
+            // ISIS camera is single-threaded
+            Mutex::Lock lock( m_camera_mutex );
+            line_eq = m_matcher.epipolar_line( ip_org_coord, m_matcher.m_datum, m_cam1, m_cam2, found_epipolar);
+          }else{
+            line_eq = m_matcher.epipolar_line( ip_org_coord, m_matcher.m_datum, m_cam1, m_cam2, found_epipolar);
+          }
         }
 
-        if (!found_epipolar) {
-          *m_output++ = (size_t)(-1); // Failed to find a match, return a flag!
+        if (!found_epipolar)
           continue; // Skip to the next IP
-        }
 
         // Use FLANN tree to find the N nearest neighbors according to the IP region descriptor?
         std::vector<std::pair<float,int> > kept_indices;
@@ -180,59 +339,47 @@ namespace asp {
           vw::Vector<unsigned char> uchar_descriptor(ip->descriptor.size());
           for (size_t i=0; i<ip->descriptor.size(); ++i)
             uchar_descriptor[i] = static_cast<unsigned char>(ip->descriptor[i]);
-          num_matches_valid = m_tree_uchar.knn_search( uchar_descriptor, indices, distances, NUM_MATCHES_TO_FIND );
+          num_matches_valid = m_index->tree_uchar.knn_search( uchar_descriptor, indices, distances, NUM_MATCHES_TO_FIND );
         } else {
-          num_matches_valid = m_tree_float.knn_search( ip->descriptor, indices, distances, NUM_MATCHES_TO_FIND );
+          num_matches_valid = m_index->tree_float.knn_search( ip->descriptor, indices, distances, NUM_MATCHES_TO_FIND );
         }
 
-        if (num_matches_valid < 1) {
-          *m_output++ = (size_t)(-1); // Failed to find a match, return a flag!
+        if (num_matches_valid < 1)
           continue; // Skip to the next IP
-        }
-
-        //vw_out() << "For descriptor: " << ip->descriptor << std::endl;
-        //vw_out() << num_matches_valid << " Best match distances: " << distances << std::endl;
-        //vw_out() << "Indices: " << indices << std::endl;
 
         // Loop through the N "nearest" points and keep only the ones within
         //   m_matcher.m_epipolar_threshold pixel distance from the epipolar line
-        const double EPIPOLAR_BAND_EXPANSION = 200;
         double small_epipolar_threshold = m_matcher.m_epipolar_threshold;
-        double large_epipolar_threshold = small_epipolar_threshold + EPIPOLAR_BAND_EXPANSION;
+        double large_epipolar_threshold = small_epipolar_threshold
+          + EpipolarLinePointMatcher::EPIPOLAR_BAND_EXPANSION;
         for ( size_t i = 0; i < num_matches_valid; i++ ) {
-          IPListIter ip2_it = m_ip_other.begin();
-          std::advance( ip2_it, indices[i] );
-
-          if (found_epipolar){
-            Vector2 ip2_org_coord = Vector2( ip2_it->x, ip2_it->y );
-            double  line_distance = m_matcher.distance_point_line( line_eq, ip2_org_coord );
-            if ( line_distance < large_epipolar_threshold ) {
-              if ( line_distance < small_epipolar_threshold )
-                kept_indices.push_back( std::pair<float,int>( distances[i], indices[i] ) );
-              else // In between thresholds
-                kept_indices.push_back( std::pair<float,int>( distances[i], -1 ) );
-            }
-            else {
-              Vector2 ip1_coord( ip->x, ip->y );
-              //double normDist = norm_2(ip1_coord - ip2_org_coord);
-              //vw_out() << "Discarding match between " << ip1_coord << " and " << ip2_org_coord
-              //        << " because distance is " << line_distance << " and threshold is "
-              //        << m_matcher.m_epipolar_threshold << " norm dist = " << normDist<<"\n";
-            }
+          int ip2_index = m_index->ip_indices[indices[i]];
+          ip::InterestPoint const* ip2 = m_ip_other[ip2_index];
+          Vector2 ip2_org_coord = Vector2( ip2->x, ip2->y );
+          double  line_distance = m_matcher.distance_point_line( line_eq, ip2_org_coord );
+          if ( line_distance < large_epipolar_threshold ) {
+            if ( line_distance < small_epipolar_threshold )
+              kept_indices.push_back( std::pair<float,int>( distances[i], ip2_index ) );
+            else // In between thresholds
+              kept_indices.push_back( std::pair<float,int>( distances[i], -1 ) );
           }
         } // End loop for match prunining
 
-        // If we only found one match or the first descriptor match is much better than the second
-        if ( ( (kept_indices.size() > 2)     &&
+        // If we only found one match or the first descriptor match is much better than the second.
+        // With tiles, all candidates are near the epipolar lines of the tile, so two of them
+        // near the line of the IP are common, and are compared. Without tiles, three are needed.
+        size_t min_to_compare = m_build_index ? 2 : 3;
+        if ( ( (kept_indices.size() >= min_to_compare) &&
                (kept_indices[0].second >= 0) &&
                      (kept_indices[0].first < m_matcher.m_uniqueness_threshold * kept_indices[1].first) )
-              || (kept_indices.size() == 1) ){
-          *m_output++ = kept_indices[0].second; // Return the first of the matches we found
-          //vw_out() << "Kept distance: " << kept_indices[0].first << std::endl;
-        } else { // No matches or no clear winner
-          *m_output++ = (size_t)(-1); // Failed to find a match, return a flag!
+              || (kept_indices.size() == 1 && kept_indices[0].second >= 0) ){
+          output = kept_indices[0].second; // Return the first of the matches we found
         }
       } // End loop through IP
+
+      // The tree of a tile is not needed once its IP are matched
+      if (m_build_index)
+        m_index.reset();
     } // End function operator()
 
   }; // End class EpipolarLineMatchTask -------------------
@@ -242,9 +389,8 @@ namespace asp {
                                              DetectIpMethod  ip_detect_method,
                                              camera::CameraModel        * cam1,
                                              camera::CameraModel        * cam2,
-                                             std::vector<size_t>        & output_indices ) const {
-    typedef ip::InterestPointList::const_iterator IPListIter;
-
+                                             std::vector<size_t>        & output_indices,
+                                             bool                         match_by_tile ) const {
     Timer total_time("Total elapsed time", DebugMessage, "interest_point");
     size_t ip1_size = ip1.size(), ip2_size = ip2.size();
 
@@ -255,29 +401,147 @@ namespace asp {
     }
 
     // Build the output indices
-    output_indices.resize( ip1_size );
+    output_indices.resize( ip1_size, (size_t)(-1) );
+
+    // Random access to the IP, as advancing through a list for each
+    // candidate match takes time proportional to the number of IP.
+    std::vector<ip::InterestPoint const*> ip1_vec, ip2_vec;
+    ip1_vec.reserve(ip1_size);
+    ip2_vec.reserve(ip2_size);
+    BOOST_FOREACH(ip::InterestPoint const& ip, ip1)
+      ip1_vec.push_back(&ip);
+    BOOST_FOREACH(ip::InterestPoint const& ip, ip2)
+      ip2_vec.push_back(&ip);
 
-    // Set up FLANNTree objects of all the different types we may need.
-    math::FLANNTree<float        > kd_float;
-    math::FLANNTree<unsigned char> kd_uchar;
+    const bool use_uchar_FLANN = (ip_detect_method == DETECT_IP_METHOD_ORB);
 
-    Matrix<float        > ip2_matrix_float;
-    Matrix<unsigned char> ip2_matrix_uchar;
+    // With many IP, interpolate their epipolar lines from a table with
+    // about a node for every four of them. Then the cameras are called
+    // fewer times, and not while matching, where they may be locked.
+    // Cameras which are not thread safe make the table in one thread.
+    EpipolarLineTable table;
+    BBox2 ip1_box;
+    for (size_t i = 0; i < ip1_size; i++)
+      ip1_box.grow(Vector2(ip1_vec[i]->x, ip1_vec[i]->y));
+    double spacing = 2.0 * sqrt(ip1_box.width() * ip1_box.height() / ip1_size);
+    spacing = std::max(spacing, double(MIN_TABLE_SPACING));
+    double num_nodes = (ceil(ip1_box.width () / spacing) + 1) *
+                       (ceil(ip1_box.height() / spacing) + 1);
+    if (spacing <= MAX_TABLE_SPACING && num_nodes < ip1_size) {
+      table.build(ip1_box, spacing, m_datum, cam1, cam2, m_single_threaded_camera);
+      vw_out(InfoMessage,"interest_point") << "Epipolar line table created with spacing "
+                                           << spacing << ".\n";
+    }
 
-    // Pack the IP descriptors into a matrix and feed it to the chosen FLANNTree object
-    const bool use_uchar_FLANN = (ip_detect_method == DETECT_IP_METHOD_ORB);
-    if (use_uchar_FLANN) {
-      ip_list_to_matrix(ip2, ip2_matrix_uchar);
-      kd_uchar.load_match_data( ip2_matrix_uchar, vw::math::FLANN_DistType_Hamming );
-    }else {
-      ip_list_to_matrix(ip2, ip2_matrix_float);
-      kd_float.load_match_data( ip2_matrix_float,  vw::math::FLANN_DistType_L2 );
+    int num_threads = vw_settings().default_num_threads();
+#if __APPLE__
+    // Fix due to OpenBLAS crashing. May need to be revisited.
+    num_threads = std::min(num_threads, 4);
+#endif
+    FifoWorkQueue matching_queue(num_threads); // Create a thread pool object
+    Mutex camera_mutex;
+
+    if (match_by_tile) {
+
+      // Bin the IP in the first image by tile. The IP of a tile are
+      // only matched with the IP of the second image in the band
+      // around the epipolar lines of the tile, as wide as the band
+      // outside which matches are discarded anyway. The band is not
+      // bounded along the lines, as a match may be anywhere on them,
+      // depending on the terrain. Each tile has its own tree.
+      std::map<std::pair<int, int>, std::vector<size_t> > tiles;
+      for (size_t i = 0; i < ip1_size; i++) {
+        std::pair<int, int> tile(int(floor(ip1_vec[i]->x / MATCHING_TILE_SIZE)),
+                                 int(floor(ip1_vec[i]->y / MATCHING_TILE_SIZE)));
+        tiles[tile].push_back(i);
+      }
+
+      double margin = m_epipolar_threshold + EPIPOLAR_BAND_EXPANSION;
+      size_t num_candidates = 0;
+      typedef std::map<std::pair<int, int>, std::vector<size_t> >::const_iterator TileIter;
+      for (TileIter tile = tiles.begin(); tile != tiles.end(); tile++) {
+        std::vector<size_t> const& query = tile->second;
+
+        BBox2 box;
+        for (size_t q = 0; q < query.size(); q++)
+          box.grow(Vector2(ip1_vec[query[q]]->x, ip1_vec[query[q]]->y));
+
+        // The normalized epipolar lines of the corners of the box, with
+        // the same sign. The line of an IP in the box is about a weighted
+        // mean of these, so the signed distance from it to a point is
+        // between the distances from these, up to an error much less
+        // than the band expansion. If a line is not found, use the
+        // whole image.
+        Vector3 lines[4];
+        bool    use_all = false;
+        for (int c = 0; c < 4 && !use_all; c++) {
+          Vector2 corner((c % 2 == 0) ? box.min().x() : box.max().x(),
+                         (c / 2 == 0) ? box.min().y() : box.max().y());
+          bool success = false;
+          if (!table.empty())
+            lines[c] = table.epipolar_line(corner, success);
+          if (!success) {
+            if (m_single_threaded_camera) {
+              Mutex::Lock lock( camera_mutex );
+              lines[c] = epipolar_line(corner, m_datum, cam1, cam2, success);
+            } else {
+              lines[c] = epipolar_line(corner, m_datum, cam1, cam2, success);
+            }
+          }
+          double len = norm_2(subvector(lines[c], 0, 2));
+          if (!success || len <= 0 || lines[c] != lines[c]) {
+            use_all = true;
+            break;
+          }
+          lines[c] /= len;
+          if (c > 0 && dot_prod(subvector(lines[c], 0, 2), subvector(lines[0], 0, 2)) < 0)
+            lines[c] = -lines[c];
+        }
+
+        boost::shared_ptr<EpipolarDescriptorIndex> index(new EpipolarDescriptorIndex);
+        for (size_t j = 0; j < ip2_size; j++) {
+          if (!use_all) {
+            Vector3 p(ip2_vec[j]->x, ip2_vec[j]->y, 1);
+            double min_dist = dot_prod(lines[0], p), max_dist = min_dist;
+            for (int c = 1; c < 4; c++) {
+              double dist = dot_prod(lines[c], p);
+              min_dist = std::min(min_dist, dist);
+              max_dist = std::max(max_dist, dist);
+            }
+            if (min_dist > margin || max_dist < -margin)
+              continue; // Out of the band
+          }
+          index->ip_indices.push_back(j);
+        }
+        if (index->ip_indices.empty())
+          continue; // Nothing to match with, the outputs stay flagged
+        num_candidates += index->ip_indices.size();
+
+        boost::shared_ptr<Task>
+          match_task( new EpipolarLineMatchTask( m_single_threaded_camera,
+                                                 use_uchar_FLANN, true, index,
+                                                 ip1_vec, ip2_vec, query,
+                                                 cam1, cam2, *this, table,
+                                                 camera_mutex, output_indices ) );
+        matching_queue.add_task( match_task );
+      }
+
+      vw_out(InfoMessage,"interest_point") << "Matching in " << tiles.size()
+                                           << " tiles, with on average "
+                                           << num_candidates / tiles.size()
+                                           << " candidates per tile.\n";
+      matching_queue.join_all(); // Wait for all the jobs to finish.
+      return;
     }
 
-    vw_out(InfoMessage,"interest_point") << "FLANN-Tree created. Searching...\n";
+    // Pack the IP descriptors into a matrix and feed it to the chosen FLANNTree object
+    boost::shared_ptr<EpipolarDescriptorIndex> index(new EpipolarDescriptorIndex);
+    index->ip_indices.resize(ip2_size);
+    for (size_t j = 0; j < ip2_size; j++)
+      index->ip_indices[j] = j;
+    index->build(ip2_vec, use_uchar_FLANN);
 
-    FifoWorkQueue matching_queue; // Create a thread pool object
-    Mutex camera_mutex;
+    vw_out(InfoMessage,"interest_point") << "FLANN-Tree created. Searching...\n";
 
     // Jobs set to 2x the number of cores. This is just incase all jobs are not equal.
     // The total number of interest points will be divided up among the jobs.
@@ -292,31 +556,22 @@ namespace asp {
     if (ip1_size < number_of_jobs)
       number_of_jobs = ip1_size;
 
-    // Get input and output iterators
-    IPListIter start_it = ip1.begin();
-    std::vector<size_t>::iterator output_it = output_indices.begin();
-
-    for ( size_t i = 0; i < number_of_jobs - 1; i++ ) { // For each job...
-      // Update iterators and launch the job.
-      IPListIter end_it = start_it;
-      std::advance( end_it, ip1_size / number_of_jobs );
+    size_t start = 0;
+    for ( size_t i = 0; i < number_of_jobs; i++ ) { // For each job...
+      size_t end = (i + 1 == number_of_jobs) ? ip1_size : start + ip1_size / number_of_jobs;
+      std::vector<size_t> query;
+      query.reserve(end - start);
+      for (size_t j = start; j < end; j++)
+        query.push_back(j);
       boost::shared_ptr<Task>
         match_task( new EpipolarLineMatchTask( m_single_threaded_camera,
-                    use_uchar_FLANN, kd_float, kd_uchar,
-                    start_it, end_it,
-                    ip2, cam1, cam2, *this,
-                    camera_mutex, output_it ) );
+                    use_uchar_FLANN, false, index,
+                    ip1_vec, ip2_vec, query,
+                    cam1, cam2, *this, table,
+                    camera_mutex, output_indices ) );
       matching_queue.add_task( match_task );
-      start_it = end_it;
-      std::advance( output_it, ip1_size / number_of_jobs );
+      start = end;
     }
-    boost::shared_ptr<Task>
-      match_task( new EpipolarLineMatchTask( m_single_threaded_camera,
-                  use_uchar_FLANN, kd_float, kd_uchar,
-                  start_it, ip1.end(),
-                  ip2, cam1, cam2, *this,
-                  camera_mutex, output_it ) );
-    matching_queue.add_task( match_task );
     matching_queue.join_all(); // Wait for all the jobs to finish.
   }
 
@@ -414,7 +669,7 @@ namespace asp {
 
     double thresh_factor = stereo_settings().ip_inlier_factor; // 1/15 by default
     typedef math::HomographyFittingFunctor hfit_func;
-    math::RandomSampleConsensus<hfit_func, math::InterestPointErrorMetric>
+    ParallelRansac<hfit_func, math::InterestPointErrorMetric>
       ransac( hfit_func(), math::InterestPointErrorMetric(),
               stereo_settings().ip_num_ransac_iterations,
               norm_2(Vector2(box1.width(),box1.height())) * (1.5*thresh_factor), // inlier threshold
@@ -446,14 +701,14 @@ namespace asp {
     double thresh_factor = stereo_settings().ip_inlier_factor; // 1/15 by default
     
     // Use RANSAC to determine a good homography transform between the images
-    math::RandomSampleConsensus<math::HomographyFittingFunctor, math::InterestPointErrorMetric>
+    ParallelRansac<math::HomographyFittingFunctor, math::InterestPointErrorMetric>
       ransac( math::HomographyFittingFunctor(),
               math::InterestPointErrorMetric(),
               stereo_settings().ip_num_ransac_iterations,
               norm_2(Vector2(left_size.x(),left_size.y())) * (1.5*thresh_factor), // inlier thresh
               left_copy.size()*2/3 // min output inliers
             );
-    Matrix<double> H = ransac(right_copy, left_copy);
+    Matrix<double> H = ransac(right_copy, left_copy, ip_match_costs(left_ip, right_ip));
     std::vector<size_t> indices = ransac.inlier_indices(H, right_copy, left_copy);
     check_homography_matrix(H, left_copy, right_copy, indices);
 
@@ -830,6 +1085,22 @@ namespace asp {
 
   }
 
+  std::vector<double> ip_match_costs(std::vector<ip::InterestPoint> const& ip1,
+                                     std::vector<ip::InterestPoint> const& ip2) {
+    std::vector<double> costs;
+    if (ip1.size() != ip2.size())
+      return costs;
+    for (size_t i = 0; i < ip1.size(); i++) {
+      if (ip1[i].descriptor.size() == 0 ||
+          ip1[i].descriptor.size() != ip2[i].descriptor.size())
+        return std::vector<double>();
+    }
+    costs.resize(ip1.size());
+    for (size_t i = 0; i < ip1.size(); i++)
+      costs[i] = norm_2(ip1[i].descriptor - ip2[i].descriptor);
+    return costs;
+  }
+
   size_t filter_ip_homog(std::vector<ip::InterestPoint> const& ip1_in,
                          std::vector<ip::InterestPoint> const& ip2_in,
                          std::vector<ip::InterestPoint>      & ip1_out,
@@ -843,16 +1114,17 @@ namespace asp {
                            ransac_ip2 = iplist_to_vectorlist(ip2_in);
 
       vw_out() << "\t    Inlier threshold:                     " << inlier_threshold << "\n";
-      vw_out() << "\t    RANSAC iterations:                    "
+      vw_out() << "\t    Max RANSAC iterations:                "
 	       << stereo_settings().ip_num_ransac_iterations << "\n";
-      typedef math::RandomSampleConsensus<math::HomographyFittingFunctor, math::InterestPointErrorMetric> RansacT;
+      typedef ParallelRansac<math::HomographyFittingFunctor, math::InterestPointErrorMetric> RansacT;
       const int    MIN_NUM_OUTPUT_INLIERS = ransac_ip1.size()/2;
       RansacT ransac( math::HomographyFittingFunctor(),
                       math::InterestPointErrorMetric(),
                       stereo_settings().ip_num_ransac_iterations,
                       inlier_threshold,
                       MIN_NUM_OUTPUT_INLIERS, true);
-      Matrix<double> H(ransac(ransac_ip2,ransac_ip1)); // 2 then 1 is used here for legacy reasons
+      // 2 then 1 is used here for legacy reasons
+      Matrix<double> H(ransac(ransac_ip2, ransac_ip1, ip_match_costs(ip1_in, ip2_in)));
       //vw_out() << "\t--> Homography: " << H << "\n";
       indices = ransac.inlier_indices(H,ransac_ip2,ransac_ip1);
     } catch (const math::RANSACErr& e ) {
@@ -943,12 +1215,12 @@ namespace asp {
     std::vector<size_t> indices;
     try {
 
-      vw::math::RandomSampleConsensus<vw::math::TranslationScaleFittingFunctor, vw::math::InterestPointErrorMetric>
+      ParallelRansac<vw::math::TranslationScaleFittingFunctor, vw::math::InterestPointErrorMetric>
         ransac(vw::math::TranslationScaleFittingFunctor(),
                vw::math::InterestPointErrorMetric(),
                stereo_settings().ip_num_ransac_iterations,
                10, ransac_ip1.size()/2, true);
-      T = ransac( ransac_ip2, ransac_ip1 );
+      T = ransac( ransac_ip2, ransac_ip1, ip_match_costs(matched_ip1, matched_ip2) );
       indices = ransac.inlier_indices(T, ransac_ip2, ransac_ip1 );
     } catch (...) {
       vw_out(WarningMessage,"console") << "Automatic Alignment Failed! Proceed with caution...\n";
@@ -213,6 +213,12 @@ bool ip_matching_w_alignment(bool single_threaded_camera,
                               std::vector<vw::ip::InterestPoint> & left_ip,
                               std::vector<vw::ip::InterestPoint> & right_ip);
 
+  /// The distance between the descriptors of each pair of matched IP,
+  /// so that RANSAC can try the best matches first. Empty if the IP
+  /// have no descriptors.
+  std::vector<double> ip_match_costs(std::vector<vw::ip::InterestPoint> const& ip1,
+                                     std::vector<vw::ip::InterestPoint> const& ip2);
+
   /// Filter IP points by how reasonably the disparity can change along rows
   /// - Returns the number of points remaining after filtering.
   size_t filter_ip_homog(std::vector<vw::ip::InterestPoint> const& ip1_in,
@@ -307,6 +313,8 @@ bool ip_matching_w_alignment(bool single_threaded_camera,
 			      double nodata2 = std::numeric_limits<double>::quiet_NaN());
 
   /// Use epipolar line matching with the provided IP.
+  /// - With --ip-match-by-tile, the IP are matched by tile, each tile
+  ///   with the IP in the band around its epipolar lines.
   template <class Image1T, class Image2T>
   bool epipolar_ip_matching(bool single_threaded_camera,
 			    vw::ip::InterestPointList const& ip1,
@@ -347,16 +355,69 @@ bool ip_matching_w_alignment(bool single_threaded_camera,
                         DETECT_IP_METHOD_SIFT     = 1,
                         DETECT_IP_METHOD_ORB      = 2};
 
+  /// The epipolar lines in one image of the nodes of a grid over the
+  /// other image. These are found once, so that the line of each
+  /// interest point is interpolated from the table rather than found
+  /// with the cameras, which may need to be locked for that. The
+  /// nodes are done in parallel, unless the cameras are not thread
+  /// safe, as for ISIS, when they are done in the calling thread.
+  class EpipolarLineTable {
+  public:
+    EpipolarLineTable(): m_spacing(0), m_cols(0), m_rows(0) {}
+
+    /// Find the lines of the nodes of a grid with the given spacing
+    /// covering the box, projecting from cam_ip into cam_obj.
+    void build(vw::BBox2 const& box, double spacing,
+               vw::cartography::Datum const& datum,
+               vw::camera::CameraModel* cam_ip,
+               vw::camera::CameraModel* cam_obj,
+               bool single_threaded_camera);
+
+    bool empty() const { return m_lines.empty(); }
+
+    /// The interpolated line of a pixel, with the coefficients of the
+    /// equation ax + by + c = 0. Not a success if the pixel is out of
+    /// the box, or if the line of a node around it could not be found.
+    vw::Vector3 epipolar_line(vw::Vector2 const& feature, bool & success) const;
+
+  private:
+    vw::BBox2 m_box;
+    double    m_spacing;
+    int       m_cols, m_rows;
+    std::vector<vw::Vector3> m_lines; // Normalized, zero if not found
+  };
+
   /// Takes interest points and then finds the nearest 10 matches
   /// according to their IP descriptors. It then
   /// filters them by whom are closest to the epipolar line via a
   /// threshold. The first 2 are then selected to be a match if
   /// their descriptor distance is sufficiently far apart.
+  ///
+  /// When matching by tile, the first image is split into tiles, and
+  /// the IP of each tile are only compared with the IP of the second
+  /// image in the band around the epipolar lines of the tile. The band
+  /// is as wide as the one outside which candidates are discarded, and
+  /// is not bounded along the lines, so no match is lost to parallax.
+  /// The tiles are matched in parallel, each with its own tree.
   class EpipolarLinePointMatcher {
     bool   m_single_threaded_camera;
     double m_uniqueness_threshold, m_epipolar_threshold;
     vw::cartography::Datum m_datum;
 
+    /// Matches further than this plus the epipolar threshold from the
+    /// epipolar line are discarded. This is also the width of the band
+    /// of a tile, beyond its epipolar lines.
+    static const int EPIPOLAR_BAND_EXPANSION = 200;
+
+    /// The size of the tiles when matching by tile, the same as the
+    /// tiles of IP detection.
+    static const int MATCHING_TILE_SIZE = 1024;
+
+    /// The epipolar lines are interpolated from a table with about a
+    /// node for every four IP, if the nodes are at most this far apart.
+    /// Otherwise there are too few IP for the table to save time.
+    static const int MIN_TABLE_SPACING = 64, MAX_TABLE_SPACING = 256;
+
   public:
     /// Constructor.
     EpipolarLinePointMatcher(bool single_threaded_camera,
@@ -365,12 +426,14 @@ bool ip_matching_w_alignment(bool single_threaded_camera,
 
     /// This only returns the indicies
     /// - ip_detect_method must match the method used to obtain the interest points
+    /// - If match_by_tile, match each tile in the band of its epipolar lines.
     void operator()(vw::ip::InterestPointList const& ip1,
 		    vw::ip::InterestPointList const& ip2,
 		    DetectIpMethod  ip_detect_method,
 		    vw::camera::CameraModel        * cam1,
 		    vw::camera::CameraModel        * cam2,
-		    std::vector<size_t>            & output_indices) const;
+		    std::vector<size_t>            & output_indices,
+		    bool                             match_by_tile = false) const;
 
     /// Work out an epipolar line from interest point. Returns the
     /// coefficients for the following line equation: ax + by + c = 0
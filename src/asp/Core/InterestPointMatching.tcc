@@ -295,14 +295,17 @@ bool epipolar_ip_matching(bool single_threaded_camera,
   vw_out() << "\t--> Matching interest points using the epipolar line." << std::endl;
   vw_out() << "\t    Uniqueness threshold: " << uniqueness_threshold << "\n";
   vw_out() << "\t    Epipolar threshold:   " << epipolar_threshold   << "\n";
+  bool match_by_tile = stereo_settings().ip_match_by_tile;
+  if (match_by_tile)
+    vw_out() << "\t    Matching by tile." << std::endl;
   
   EpipolarLinePointMatcher matcher(single_threaded_camera,
 				   uniqueness_threshold, epipolar_threshold, datum);
   vw_out() << "\t    Matching forward" << std::endl;
-  matcher(ip1, ip2, detect_method, cam1, cam2, forward_match);
+  matcher(ip1, ip2, detect_method, cam1, cam2, forward_match, match_by_tile);
   vw_out() << "\t    ---> Obtained " << forward_match.size() << " matches." << std::endl;
   vw_out() << "\t    Matching backward" << std::endl;
-  matcher(ip2, ip1, detect_method, cam2, cam1, backward_match);
+  matcher(ip2, ip1, detect_method, cam2, cam1, backward_match, match_by_tile);
   vw_out() << "\t    ---> Obtained " << backward_match.size() << " matches." << std::endl;
 
   // Perform circle consistency check
@@ -36,21 +36,17 @@
 
 #include <asp/Core/SoftwareRenderer.h>
 #include <boost/foreach.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <asp/Core/OrthoRasterizer.h>
 #include <valarray>
+#include <list>
+#include <map>
 
 namespace asp{
 
   using namespace vw;
 
-  class compare_bboxes { // simple comparison function
-  public:
-    bool operator()(const BBox2i A, const BBox2i B) const {
-      return ( A.min().x() < B.min().x() );
-    }
-  };
-
   void dump_image(std::string const& prefix, BBox2i const& box,
                   ImageViewRef<Vector3> const& I){
 
@@ -355,6 +351,63 @@ namespace asp{
       image = copy(buffer);
   }
 
+  /// A thread-safe cache of point cloud tiles, evicting the least
+  /// recently used ones beyond a given size.
+  class PointBlockCache: private boost::noncopyable {
+  public:
+    typedef std::pair<int, int> KeyType;
+    typedef boost::shared_ptr< ImageView<Vector3> > BlockPtr;
+
+    PointBlockCache(size_t max_bytes): m_max_bytes(max_bytes), m_bytes(0) {}
+
+    /// Return the block for this key, or an empty pointer
+    BlockPtr get(KeyType const& key) {
+      Mutex::Lock lock(m_mutex);
+      MapType::iterator it = m_blocks.find(key);
+      if (it == m_blocks.end())
+        return BlockPtr();
+      m_lru.splice(m_lru.begin(), m_lru, it->second.second); // most recently used
+      return it->second.first;
+    }
+
+    void put(KeyType const& key, BlockPtr block) {
+      size_t bytes = block_size(block);
+      if (bytes > m_max_bytes)
+        return;
+      Mutex::Lock lock(m_mutex);
+      if (m_blocks.find(key) != m_blocks.end())
+        return; // another thread got there first
+      while (m_bytes + bytes > m_max_bytes && !m_lru.empty()) {
+        MapType::iterator it = m_blocks.find(m_lru.back());
+        m_bytes -= block_size(it->second.first);
+        m_blocks.erase(it);
+        m_lru.pop_back();
+      }
+      m_lru.push_front(key);
+      m_blocks[key] = std::make_pair(block, m_lru.begin());
+      m_bytes += bytes;
+    }
+
+    void clear() {
+      Mutex::Lock lock(m_mutex);
+      m_blocks.clear();
+      m_lru.clear();
+      m_bytes = 0;
+    }
+
+  private:
+    static size_t block_size(BlockPtr const& block) {
+      return size_t(block->cols())*block->rows()*sizeof(Vector3);
+    }
+
+    typedef std::list<KeyType> ListType;
+    typedef std::map<KeyType, std::pair<BlockPtr, ListType::iterator> > MapType;
+    size_t   m_max_bytes, m_bytes;
+    ListType m_lru;
+    MapType  m_blocks;
+    Mutex    m_mutex;
+  };
+
   OrthoRasterizerView::OrthoRasterizerView
   (ImageViewRef<Vector3> point_image, ImageViewRef<double> texture,
    double search_radius_factor, double sigma_factor, bool use_surface_sampling, int pc_tile_size,
@@ -366,6 +419,7 @@ namespace asp{
    Vector2 median_filter_params, int erode_len, bool has_las_or_csv,
    std::string const& filter,
    double default_grid_size_multiplier,
+   std::string const& index_file, std::string const& index_key,
    size_t *num_invalid_pixels, vw::Mutex *count_mutex,
    const ProgressCallback& progress):
     // Ensure all members are initiated, even if to temporary values
@@ -383,25 +437,15 @@ namespace asp{
     m_median_filter_params(median_filter_params), m_erode_len(erode_len),
     m_default_grid_size_multiplier(default_grid_size_multiplier),
     m_num_invalid_pixels(num_invalid_pixels),
-    m_count_mutex(count_mutex){
+    m_count_mutex(count_mutex),
+    m_point_block_cache(new PointBlockCache(0)),
+    m_texture_is_height(false){
 
     *m_num_invalid_pixels = 0; // Init counter
     set_texture(texture.impl());
 
     // Convert the filter from string to enum, to speed up checking against it later
-    m_percentile = -1; // ensure it is initialized
-    if (filter      == "weighted_average") m_filter = asp::f_weighted_average;
-    else if (filter == "min"             ) m_filter = asp::f_min;
-    else if (filter == "max"             ) m_filter = asp::f_max;
-    else if (filter == "mean"            ) m_filter = asp::f_mean;
-    else if (filter == "median"          ) m_filter = asp::f_median;
-    else if (filter == "stddev"          ) m_filter = asp::f_stddev;
-    else if (filter == "count"           ) m_filter = asp::f_count;
-    else if (filter == "nmad"            ) m_filter = asp::f_nmad;
-    else if (sscanf (filter.c_str(), "%lf-pct", &m_percentile) == 1)
-      m_filter = asp::f_percentile;
-    else
-    vw_throw( ArgumentErr() << "OrthoRasterize: unknown filter: " << filter << ".\n" );
+    m_filter = asp::parse_filter(filter, m_percentile);
     
     //dump_image("img", BBox2(0, 0, 3000, 3000), point_image);
 
@@ -428,26 +472,66 @@ namespace asp{
     sub_block_size = int(round(pow(2.0, floor(log(sub_block_size)/log(2.0)))));
     sub_block_size = std::max(16, sub_block_size);
     sub_block_size = std::min(max_subblock_size(), sub_block_size);
-    std::vector<BBox2i> blocks = subdivide_bbox(m_point_image, m_block_size, m_block_size);
-
-    // Find the bounding box of each subblock, stored in
-    // m_point_image_boundaries, together with other info by
-    // searching through the image.
-    FifoWorkQueue queue( vw_settings().default_num_threads() );
-    typedef SubBlockBoundaryTask task_type;
-    Mutex mutex;
-    float inc_amt = 1.0 / float(blocks.size());
-    for ( size_t i = 0; i < blocks.size(); i++ ) {
-      boost::shared_ptr<task_type>
-        task(new task_type(m_point_image, sub_block_size, blocks[i],
-                           m_bbox, m_point_image_boundaries,
-                           error_image, estim_max_error, estim_proj_box, errors_hist,
-                           max_valid_triangulation_error,
-                           mutex, progress, inc_amt));
-      queue.add_task(task);
+
+    // The boundaries depend on the cloud and the projection, which
+    // the caller's key describes, and on the settings below.
+    std::ostringstream os;
+    os.precision(17);
+    os << index_key << " size: " << point_image.cols() << ' ' << point_image.rows()
+       << " blocks: " << m_block_size << ' ' << sub_block_size
+       << " outliers: " << remove_outliers_with_pct << ' ' << estim_max_error << ' '
+       << estim_proj_box << ' ' << max_valid_triangulation_error;
+    std::string full_key = os.str();
+
+    bool have_index = false;
+    if (!index_file.empty()) {
+      have_index = asp::read_point_cloud_index(index_file, full_key, m_point_image_boundaries,
+                                               m_bbox, errors_hist);
+      if (have_index)
+        vw_out() << "Read point cloud index: " << index_file << "\n";
     }
-    queue.join_all();
-    progress.report_finished();
+
+    if (!have_index) {
+      std::vector<BBox2i> blocks = subdivide_bbox(m_point_image, m_block_size, m_block_size);
+
+      // Find the bounding box of each subblock, stored in
+      // m_point_image_boundaries, together with other info by
+      // searching through the image.
+      FifoWorkQueue queue( vw_settings().default_num_threads() );
+      typedef SubBlockBoundaryTask task_type;
+      Mutex mutex;
+      float inc_amt = 1.0 / float(blocks.size());
+      for ( size_t i = 0; i < blocks.size(); i++ ) {
+        boost::shared_ptr<task_type>
+          task(new task_type(m_point_image, sub_block_size, blocks[i],
+                             m_bbox, m_point_image_boundaries,
+                             error_image, estim_max_error, estim_proj_box, errors_hist,
+                             max_valid_triangulation_error,
+                             mutex, progress, inc_amt));
+        queue.add_task(task);
+      }
+      queue.join_all();
+      progress.report_finished();
+
+      if (!index_file.empty() && !m_bbox.empty()) {
+        // Failing to save the index is not fatal, as it is just an optimization
+        try {
+          asp::write_point_cloud_index(index_file, full_key, m_point_image_boundaries,
+                                       m_bbox, errors_hist);
+          vw_out() << "Wrote point cloud index: " << index_file << "\n";
+        } catch (std::exception const& e) {
+          vw_out(WarningMessage) << "Could not save the point cloud index. "
+                                 << e.what() << "\n";
+        }
+      }
+    }
+
+    std::vector<BBox2> boundary_boxes(m_point_image_boundaries.size());
+    for (size_t i = 0; i < m_point_image_boundaries.size(); i++) {
+      BBox3 const& box = m_point_image_boundaries[i].first;
+      boundary_boxes[i] = BBox2(subvector(box.min(), 0, 2), subvector(box.max(), 0, 2));
+    }
+    m_boundaries_tree.build(boundary_boxes);
 
     if ( m_bbox.empty() )
       vw_throw( ArgumentErr() << "OrthoRasterize: Input point cloud is empty!\n" );
@@ -527,6 +611,15 @@ namespace asp{
   } // End OrthoRasterizerView Constructor
 
 
+  void OrthoRasterizerView::set_point_block_cache_size(size_t max_bytes) {
+    m_point_block_cache.reset(new PointBlockCache(max_bytes));
+  }
+
+  void OrthoRasterizerView::set_point_image(ImageViewRef<Vector3> point_image) {
+    m_point_image = point_image;
+    m_point_block_cache->clear();
+  }
+
   // This is kind of like part 2 of the constructor
   // - This function finalizes the spacing and generates a spacing-snapped BBox.
   void OrthoRasterizerView::initialize_spacing(const double spacing) {
@@ -658,26 +751,29 @@ namespace asp{
 
     // For each block in the DEM space intersecting local_3d_bbox,
     // find the corresponding blocks in the point cloud space.  We
-    // use here a map since we'd like to group together the point
-    // cloud blocks which fall within the same 256 x 256 tile, to do
-    // their union instead of them individually, for reasons of speed.
-    typedef std::map<BBox2i, BBox2i, compare_bboxes> BlockMapType;
+    // group together the point cloud blocks which fall within the
+    // same point cloud tile, to do their union instead of them
+    // individually, for reasons of speed.
+    typedef std::map<PointBlockCache::KeyType, BBox2i> BlockMapType;
     typedef BlockMapType::iterator MapIterType;
     BlockMapType blocks_map;
-    BOOST_FOREACH( BBoxPair const& boundary, m_point_image_boundaries ) {
+    std::vector<size_t> boundary_indices;
+    m_boundaries_tree.intersect(BBox2(subvector(local_3d_bbox.min(), 0, 2),
+                                      subvector(local_3d_bbox.max(), 0, 2)),
+                                boundary_indices);
+    for (size_t k = 0; k < boundary_indices.size(); k++) {
+      BBoxPair const& boundary = m_point_image_boundaries[boundary_indices[k]];
       if (! local_3d_bbox.intersects(boundary.first) )
         continue;
 
       BBox2i pc_block = boundary.second;
-
-      BBox2i snapped_block;
-      snapped_block.min() = m_block_size*floor(pc_block.min()/double(m_block_size));
-      snapped_block.max() = m_block_size*ceil( pc_block.max()/double(m_block_size));
-      MapIterType it = blocks_map.find(snapped_block);
+      PointBlockCache::KeyType tile(pc_block.min().x()/m_block_size,
+                                    pc_block.min().y()/m_block_size);
+      MapIterType it = blocks_map.find(tile);
       if (it != blocks_map.end() ){
         (it->second).grow(pc_block);
       }else{
-        blocks_map.insert(std::pair<BBox2, BBox2>(snapped_block, pc_block));
+        blocks_map.insert(std::make_pair(tile, pc_block));
       }
 
     }
@@ -708,22 +804,39 @@ namespace asp{
       block.max() += Vector2i(d, d);
       block.crop(vw::bounding_box(m_point_image));
 
-      // Pull a copy of the input image in memory.  Expand the image
-      // to be able to see a bit beyond when filling holes.
-      BBox2i biased_block = block;
-      int bias = m_median_filter_params[0]/2 + m_erode_len;
-      biased_block.expand(bias);
-      biased_block.crop(vw::bounding_box(m_point_image));
-      ImageView<Vector3> point_copy = crop(m_point_image, biased_block);
-
-      remove_outliers(point_copy, m_error_image, m_error_cutoff, biased_block);
-      filter_by_median(point_copy, m_median_filter_params);
-      erode_image(point_copy, m_erode_len);
+      // The point cloud tile having this block, with outliers
+      // removed. It is either cached or created and cached now.
+      BBox2i tile_box(it->first.first*m_block_size, it->first.second*m_block_size,
+                      m_block_size, m_block_size);
+      tile_box.max() += Vector2i(d, d);
+      tile_box.crop(vw::bounding_box(m_point_image));
+      PointBlockCache::BlockPtr tile_ptr = m_point_block_cache->get(it->first);
+      if (!tile_ptr) {
+        // Pull a copy of the input image in memory.  Expand the image
+        // to be able to see a bit beyond when filling holes.
+        BBox2i biased_block = tile_box;
+        int bias = m_median_filter_params[0]/2 + m_erode_len;
+        biased_block.expand(bias);
+        biased_block.crop(vw::bounding_box(m_point_image));
+        ImageView<Vector3> point_copy = crop(m_point_image, biased_block);
+
+        remove_outliers(point_copy, m_error_image, m_error_cutoff, biased_block);
+        filter_by_median(point_copy, m_median_filter_params);
+        erode_image(point_copy, m_erode_len);
+
+        // Crop back to the tile
+        tile_ptr.reset(new ImageView<Vector3>(crop(point_copy, tile_box - biased_block.min())));
+        m_point_block_cache->put(it->first, tile_ptr);
+      }
 
-      // Crop back to the area of interest
-      point_copy = crop(point_copy, block - biased_block.min());
+      // Crop to the area of interest
+      ImageView<Vector3> point_copy = crop(*tile_ptr, block - tile_box.min());
 
-      ImageView<float> texture_copy = crop(m_texture, block );
+      ImageView<float> texture_copy;
+      if (m_texture_is_height)
+        texture_copy = select_channel(point_copy, 2);
+      else
+        texture_copy = crop(m_texture, block );
 
       typedef ImageView<Vector3>::pixel_accessor PointAcc;
       PointAcc row_acc = point_copy.origin();
@@ -31,12 +31,15 @@
 #include <vw/Math/Vector.h>
 #include <vw/Math/BBox.h>
 #include <asp/Core/Point2Grid.h>
+#include <asp/Core/PointCloudIndex.h>
+
+#include <boost/shared_ptr.hpp>
 
 namespace asp{
 
   using namespace vw;
 
-  typedef std::pair<BBox3, BBox2i> BBoxPair;
+  class PointBlockCache;
 
   /// Given a point image and corresponding texture, this class
   /// bins and averages the point cloud on a regular grid over the [x,y]
@@ -69,14 +72,24 @@ namespace asp{
     size_t     *m_num_invalid_pixels; ///< Keep a count of nodata output pixels, needs to be pointer due to VW weirdness.
     vw::Mutex  *m_count_mutex;        ///< A lock for m_num_invalid_pixels, needs to be pointer due to C++ weirdness.
 
-    // We could actually use a quadtree here .. but this should be a
-    // good enough improvement.
     std::vector<BBoxPair> m_point_image_boundaries;
     // These boundaries describe a point cloud 3D boundaries and then
     // their location in the the point cloud image. These boxes are
     // overlapping in the pc image X/Y domain to insure that
     // everything is triangulated.
 
+    // An R-tree of the X/Y extents of the boundaries above, to find
+    // the ones overlapping a given tile.
+    BBoxTree m_boundaries_tree;
+
+    // Point cloud tiles with outliers removed, shared by all the
+    // images rasterized from this cloud, such as at several spacings.
+    boost::shared_ptr<PointBlockCache> m_point_block_cache;
+
+    // If the texture is the height of the points, which is then taken
+    // from the cached point cloud tiles rather than read separately.
+    bool m_texture_is_height;
+
     // Function to convert pixel coordinates to the point domain
     BBox3 pixel_to_point_bbox( BBox2 const& px ) const;
 
@@ -87,6 +100,10 @@ namespace asp{
     static int max_subblock_size(){ return 128;} // is used in point2dem and below
 
     /// Constructor.  You must call initialize_spacing before using the object!!
+    /// If index_file is not empty, the boundaries of the point cloud
+    /// blocks are read from it if it was saved with the same
+    /// index_key, and otherwise computed and saved to it. The key must
+    /// identify the point cloud and the projection.
     OrthoRasterizerView(ImageViewRef<Vector3> point_image,
                         ImageViewRef<double > texture,
                         double  search_radius_factor,
@@ -105,6 +122,8 @@ namespace asp{
                         bool    has_las_or_csv,
                         std::string const& filter,
                         double  default_grid_size_multiplier,
+                        std::string const& index_file,
+                        std::string const& index_key,
                         size_t  *num_invalid_pixels,
                         vw::Mutex *count_mutex,
                         const ProgressCallback& progress);
@@ -123,8 +142,16 @@ namespace asp{
       ArgumentErr() << "Orthorasterizer: set_texture() failed."
                     << " Texture dimensions must match point image dimensions.");
       m_texture = channel_cast<float>(channels_to_planes(texture.impl()));
+      m_texture_is_height = false;
     }
 
+    /// Use the point heights as the texture, as when creating a DEM.
+    void set_height_as_texture() { m_texture_is_height = true; }
+
+    /// Keep in memory up to this many bytes of point cloud tiles, to
+    /// be reused when rasterizing several images from the same cloud.
+    void set_point_block_cache_size(size_t max_bytes);
+
     inline int32 cols() const {return (int)round((fabs(m_snapped_bbox.max().x() - m_snapped_bbox.min().x()) / m_spacing)) + 1;}
     inline int32 rows() const {return (int)round((fabs(m_snapped_bbox.max().y() - m_snapped_bbox.min().y()) / m_spacing)) + 1;}
 
@@ -187,7 +214,7 @@ namespace asp{
 
     ImageViewRef<Vector3> get_point_image() { return m_point_image; }
     
-    void set_point_image(ImageViewRef<Vector3> point_image) {m_point_image = point_image;}
+    void set_point_image(ImageViewRef<Vector3> point_image);
     
   };
 
@@ -23,12 +23,29 @@
 #include <vw/Math/Functors.h>
 
 #include <iostream>
+#include <cstdio>
 
 using namespace std;
 using namespace vw;
 
 namespace asp {
   
+FilterType parse_filter(std::string const& filter, double & percentile){
+  percentile = -1; // ensure it is initialized
+  if (filter == "weighted_average") return f_weighted_average;
+  if (filter == "min"             ) return f_min;
+  if (filter == "max"             ) return f_max;
+  if (filter == "mean"            ) return f_mean;
+  if (filter == "median"          ) return f_median;
+  if (filter == "stddev"          ) return f_stddev;
+  if (filter == "count"           ) return f_count;
+  if (filter == "nmad"            ) return f_nmad;
+  if (sscanf (filter.c_str(), "%lf-pct", &percentile) == 1)
+    return f_percentile;
+  vw_throw( ArgumentErr() << "Unknown filter: " << filter << ".\n" );
+  return f_weighted_average;
+}
+
 // ===========================================================================
 // Class Member Functions
 // ===========================================================================
@@ -89,13 +106,17 @@ void Point2Grid::Clear(const float value) {
     }
   }
 
-  // For these we need to keep all values (in fact, for stddev we could get away with less,
-  // but it is not worth trying so hard).
-  if (m_filter == f_median || m_filter == f_stddev ||
-      m_filter == f_nmad   || m_filter == f_percentile) {
-    m_vals.set_size(m_width, m_height);
-  }
-  
+  // Drop the values of an earlier use, if any. Their memory is freed
+  // in normalize(), as each object is used for one tile only.
+  m_val_indices.clear();
+  m_vals.clear();
+}
+
+// For these we need to keep all values (in fact, for stddev we could get away with less,
+// but it is not worth trying so hard).
+bool Point2Grid::keep_all_vals() const {
+  return (m_filter == f_median || m_filter == f_stddev ||
+          m_filter == f_nmad   || m_filter == f_percentile);
 }
 
 void Point2Grid::AddPoint(double x, double y, double z){
@@ -152,7 +173,8 @@ void Point2Grid::AddPoint(double x, double y, double z){
         
       }else if (m_filter == f_stddev || m_filter == f_median ||
                 m_filter == f_nmad   || m_filter == f_percentile){
-        m_vals(ix, iy).push_back(z); // not strictly needed for stddev
+        m_val_indices.push_back(iy*m_buffer.cols() + ix);
+        m_vals.push_back(z); // not strictly needed for stddev
       }
       
     }
@@ -161,6 +183,12 @@ void Point2Grid::AddPoint(double x, double y, double z){
 }
 
 void Point2Grid::normalize(){
+
+  if (keep_all_vals()) {
+    normalize_all_vals();
+    return;
+  }
+
   for (int c = 0; c < m_buffer.cols(); c++){
     for (int r = 0; r < m_buffer.rows(); r++){
 
@@ -170,35 +198,65 @@ void Point2Grid::normalize(){
 
       }else if (m_filter == f_count)
         m_buffer(c, r) = m_weights(c, r); // hence instead of no-data we will have always 0
+    }
+  }
+}
+
+void Point2Grid::normalize_all_vals(){
+
+  // Group the values by grid point with a counting sort. After this,
+  // the values for grid point k are sorted_vals[start[k]] to
+  // sorted_vals[start[k+1] - 1].
+  int num_cells = m_buffer.cols()*m_buffer.rows();
+  std::vector<size_t> start(num_cells + 1, 0);
+  for (size_t it = 0; it < m_val_indices.size(); it++)
+    start[m_val_indices[it] + 1]++;
+  for (int k = 0; k < num_cells; k++)
+    start[k + 1] += start[k];
+
+  std::vector<double> sorted_vals(m_vals.size());
+  {
+    std::vector<size_t> pos(start.begin(), start.end() - 1);
+    for (size_t it = 0; it < m_vals.size(); it++)
+      sorted_vals[pos[m_val_indices[it]]++] = m_vals[it];
+  }
+
+  // Release the unsorted values
+  std::vector<int>().swap(m_val_indices);
+  std::vector<double>().swap(m_vals);
+
+  std::vector<double> vals; // reused for all grid points
+  for (int r = 0; r < m_buffer.rows(); r++){
+    for (int c = 0; c < m_buffer.cols(); c++){
+
+      int k = r*m_buffer.cols() + c;
+      if (start[k] == start[k + 1])
+        continue; // nothing to compute
+      double const* beg = &sorted_vals[0] + start[k];
+      double const* end = &sorted_vals[0] + start[k + 1];
 
-      else if (m_filter == f_stddev){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
+      if (m_filter == f_stddev){
         vw::math::StdDevAccumulator<double> V;
-        for (size_t it = 0; it < m_vals(c, r).size(); it++) 
-          V(m_vals(c, r)[it]);
+        for (double const* it = beg; it != end; it++)
+          V(*it);
         m_buffer(c, r) = V.value();
       }
       
       else if (m_filter == f_median){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
         vw::math::MedianAccumulator<double> V;
-        for (size_t it = 0; it < m_vals(c, r).size(); it++) 
-          V(m_vals(c, r)[it]);
+        for (double const* it = beg; it != end; it++)
+          V(*it);
         m_buffer(c, r) = V.value();
       }
 
       else if (m_filter == f_nmad){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
-        m_buffer(c, r) = vw::math::destructive_nmad(m_vals(c, r));
+        vals.assign(beg, end);
+        m_buffer(c, r) = vw::math::destructive_nmad(vals);
       }
       
       else if (m_filter == f_percentile){
-        if (m_vals(c, r).empty())
-          continue; // nothing to compute
-        m_buffer(c, r) = vw::math::destructive_percentile(m_vals(c, r), m_percentile);
+        vals.assign(beg, end);
+        m_buffer(c, r) = vw::math::destructive_percentile(vals, m_percentile);
       }
       
     }
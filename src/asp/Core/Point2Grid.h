@@ -23,6 +23,8 @@
 #define __VW_POINT2GRID_H__
 
 #include <vw/Image/ImageView.h>
+#include <vector>
+#include <string>
 
 namespace asp {
 
@@ -30,6 +32,10 @@ namespace asp {
   enum FilterType {f_weighted_average, f_min, f_max, f_mean, f_median, f_stddev, f_count,
                    f_nmad, f_percentile};
 
+  /// Convert a filter name, such as "weighted_average", "median", or
+  /// "75-pct", to its type. For a percentile, also return its value.
+  FilterType parse_filter(std::string const& filter, double & percentile);
+
   /// Given a set of xyz points, create an xy grid. For every node in the
   /// grid, combine all points within given radius of the grid point and
   /// calculate a single z value at the grid point.
@@ -48,10 +54,19 @@ namespace asp {
     void normalize();
 
   private:
+    bool keep_all_vals() const; // if the filter needs all values at a grid point
+    void normalize_all_vals();
+
     int m_width, m_height; // DEM dimensions
     vw::ImageView<double> & m_buffer;
     vw::ImageView<double> & m_weights;
-    vw::ImageView< std::vector<double> > m_vals; // when need to keep all individual values
+
+    // When all individual values at a grid point are needed, they are
+    // appended to one array, each with the index of its grid point, and
+    // grouped by grid point only when normalizing. This is much cheaper
+    // than keeping a separate vector for each grid point.
+    std::vector<int>    m_val_indices;
+    std::vector<double> m_vals;
     double     m_x0, m_y0; // lower-left corner
     double     m_grid_size;  // spacing between output DEM pixels
     double     m_radius;   // how far to search for cloud points
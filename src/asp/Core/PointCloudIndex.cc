@@ -0,0 +1,262 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <asp/Core/PointCloudIndex.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    // Sort indices of boxes by the x or y coordinate of the box centers
+    struct CenterLess {
+      std::vector<BBox2> const& m_boxes;
+      int m_coord;
+      CenterLess(std::vector<BBox2> const& boxes, int coord): m_boxes(boxes), m_coord(coord) {}
+      bool operator()(size_t a, size_t b) const {
+        return m_boxes[a].min()[m_coord] + m_boxes[a].max()[m_coord] <
+               m_boxes[b].min()[m_coord] + m_boxes[b].max()[m_coord];
+      }
+    };
+
+    // Unlike BBox::intersects(), count boxes which just touch, and
+    // boxes of zero width, such as for a single point.
+    inline bool overlap(BBox2 const& a, BBox2 const& b) {
+      return a.min().x() <= b.max().x() && b.min().x() <= a.max().x() &&
+             a.min().y() <= b.max().y() && b.min().y() <= a.max().y();
+    }
+
+    const char INDEX_MAGIC[] = "ASP_POINT_CLOUD_INDEX_V1";
+
+    template <class T>
+    void write_val(std::ofstream & ofs, T const& val) {
+      ofs.write((const char*)&val, sizeof(T));
+    }
+    template <class T>
+    bool read_val(std::ifstream & ifs, T & val) {
+      ifs.read((char*)&val, sizeof(T));
+      return ifs.good();
+    }
+  }
+
+  void BBoxTree::str_order(std::vector<BBox2> const& boxes, std::vector<size_t> & order) {
+
+    size_t num = boxes.size();
+    order.resize(num);
+    for (size_t i = 0; i < num; i++)
+      order[i] = i;
+
+    // Sort by x, cut into vertical slices, and sort each slice by y
+    std::sort(order.begin(), order.end(), CenterLess(boxes, 0));
+    size_t num_nodes  = (num + NODE_SIZE - 1)/NODE_SIZE;
+    size_t num_slices = (size_t)ceil(sqrt(double(num_nodes)));
+    size_t slice_len  = std::max(size_t(1), num_slices)*NODE_SIZE;
+    for (size_t beg = 0; beg < num; beg += slice_len) {
+      size_t end = std::min(beg + slice_len, num);
+      std::sort(order.begin() + beg, order.begin() + end, CenterLess(boxes, 1));
+    }
+  }
+
+  void BBoxTree::build(std::vector<BBox2> const& boxes) {
+
+    m_num_boxes = boxes.size();
+    m_boxes.clear();
+    m_ids.clear();
+    m_levels.clear();
+    if (m_num_boxes == 0)
+      return;
+
+    str_order(boxes, m_ids);
+    m_boxes.resize(m_num_boxes);
+    for (size_t i = 0; i < m_num_boxes; i++)
+      m_boxes[i] = boxes[m_ids[i]];
+
+    // Group the boxes in the leaves, then the nodes of each level in
+    // the level above, till there is only one node.
+    std::vector<BBox2> child_boxes = m_boxes;
+    while (1) {
+      std::vector<Node> level;
+      for (size_t beg = 0; beg < child_boxes.size(); beg += NODE_SIZE) {
+        Node node;
+        node.begin = beg;
+        node.end   = std::min(beg + NODE_SIZE, child_boxes.size());
+        for (size_t i = node.begin; i < node.end; i++)
+          node.box.grow(child_boxes[i]);
+        level.push_back(node);
+      }
+
+      if (level.size() > 1) {
+        // Order the nodes of this level before grouping them further
+        std::vector<BBox2> node_boxes(level.size());
+        for (size_t i = 0; i < level.size(); i++)
+          node_boxes[i] = level[i].box;
+        std::vector<size_t> order;
+        str_order(node_boxes, order);
+        std::vector<Node> sorted_level(level.size());
+        child_boxes.resize(level.size());
+        for (size_t i = 0; i < level.size(); i++) {
+          sorted_level[i] = level[order[i]];
+          child_boxes[i]  = sorted_level[i].box;
+        }
+        level.swap(sorted_level);
+      }
+
+      m_levels.push_back(level);
+      if (level.size() <= 1)
+        break;
+    }
+  }
+
+  void BBoxTree::intersect_node(size_t level, size_t node, BBox2 const& box,
+                                std::vector<size_t> & indices) const {
+
+    Node const& n = m_levels[level][node];
+    if (!overlap(n.box, box))
+      return;
+
+    for (size_t i = n.begin; i < n.end; i++) {
+      if (level == 0) {
+        if (overlap(m_boxes[i], box))
+          indices.push_back(m_ids[i]);
+      } else {
+        intersect_node(level - 1, i, box, indices);
+      }
+    }
+  }
+
+  void BBoxTree::intersect(BBox2 const& box, std::vector<size_t> & indices) const {
+    indices.clear();
+    if (m_levels.empty())
+      return;
+    size_t top = m_levels.size() - 1;
+    for (size_t node = 0; node < m_levels[top].size(); node++)
+      intersect_node(top, node, box, indices);
+  }
+
+  void write_point_cloud_index(std::string const& index_file, std::string const& key,
+                               std::vector<BBoxPair> const& boundaries,
+                               BBox3 const& bbox,
+                               std::vector<double> const& errors_hist) {
+
+    // Write to a temporary file first, so that an interrupted run
+    // does not leave behind a partial index.
+    std::string tmp_file = index_file + ".tmp";
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw_throw( IOErr() << "Cannot open for writing: " << tmp_file << "\n" );
+
+      ofs.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+      write_val(ofs, boost::uint64_t(key.size()));
+      ofs.write(key.c_str(), key.size());
+
+      for (int i = 0; i < 3; i++) write_val(ofs, bbox.min()[i]);
+      for (int i = 0; i < 3; i++) write_val(ofs, bbox.max()[i]);
+
+      write_val(ofs, boost::uint64_t(errors_hist.size()));
+      for (size_t i = 0; i < errors_hist.size(); i++)
+        write_val(ofs, errors_hist[i]);
+
+      write_val(ofs, boost::uint64_t(boundaries.size()));
+      for (size_t b = 0; b < boundaries.size(); b++) {
+        BBox3  const& box   = boundaries[b].first;
+        BBox2i const& block = boundaries[b].second;
+        for (int i = 0; i < 3; i++) write_val(ofs, box.min()[i]);
+        for (int i = 0; i < 3; i++) write_val(ofs, box.max()[i]);
+        for (int i = 0; i < 2; i++) write_val(ofs, boost::int32_t(block.min()[i]));
+        for (int i = 0; i < 2; i++) write_val(ofs, boost::int32_t(block.max()[i]));
+      }
+
+      if (!ofs.good())
+        vw_throw( IOErr() << "Failed writing: " << tmp_file << "\n" );
+    }
+    boost::filesystem::rename(tmp_file, index_file);
+  }
+
+  bool read_point_cloud_index(std::string const& index_file, std::string const& key,
+                              std::vector<BBoxPair> & boundaries,
+                              BBox3 & bbox,
+                              std::vector<double> & errors_hist) {
+
+    if (!boost::filesystem::exists(index_file))
+      return false;
+
+    std::ifstream ifs(index_file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::vector<char> magic(sizeof(INDEX_MAGIC));
+    ifs.read(&magic[0], magic.size());
+    if (!ifs.good() || std::string(&magic[0]) != INDEX_MAGIC)
+      return false;
+
+    boost::uint64_t key_len = 0;
+    if (!read_val(ifs, key_len) || key_len != key.size())
+      return false;
+    std::string file_key(key_len, ' ');
+    if (key_len > 0)
+      ifs.read(&file_key[0], key_len);
+    if (!ifs.good() || file_key != key)
+      return false;
+
+    BBox3 file_bbox;
+    for (int i = 0; i < 3; i++) read_val(ifs, file_bbox.min()[i]);
+    for (int i = 0; i < 3; i++) read_val(ifs, file_bbox.max()[i]);
+
+    boost::uint64_t hist_len = 0;
+    if (!read_val(ifs, hist_len))
+      return false;
+    std::vector<double> file_hist(hist_len);
+    for (size_t i = 0; i < hist_len; i++)
+      read_val(ifs, file_hist[i]);
+
+    boost::uint64_t num_boundaries = 0;
+    if (!read_val(ifs, num_boundaries))
+      return false;
+    std::vector<BBoxPair> file_boundaries(num_boundaries);
+    for (size_t b = 0; b < num_boundaries; b++) {
+      BBox3  & box   = file_boundaries[b].first;
+      BBox2i & block = file_boundaries[b].second;
+      for (int i = 0; i < 3; i++) read_val(ifs, box.min()[i]);
+      for (int i = 0; i < 3; i++) read_val(ifs, box.max()[i]);
+      boost::int32_t v;
+      for (int i = 0; i < 2; i++) { read_val(ifs, v); block.min()[i] = v; }
+      for (int i = 0; i < 2; i++) { read_val(ifs, v); block.max()[i] = v; }
+    }
+    if (!ifs.good()) {
+      vw_out(WarningMessage) << "Failed to read: " << index_file << "\n";
+      return false;
+    }
+
+    boundaries.swap(file_boundaries);
+    errors_hist.swap(file_hist);
+    bbox = file_bbox;
+    return true;
+  }
+
+} // namespace asp
@@ -0,0 +1,97 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file PointCloudIndex.h
+///
+/// A spatial index of the blocks of a point cloud, to quickly find
+/// the blocks whose projected points overlap a given region, and
+/// functions to save to disk and read back the block boundaries, so
+/// that they need not be recomputed each time a DEM is created from
+/// the same cloud.
+
+#ifndef __ASP_CORE_POINT_CLOUD_INDEX_H__
+#define __ASP_CORE_POINT_CLOUD_INDEX_H__
+
+#include <vw/Math/BBox.h>
+
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace asp {
+
+  /// The bounding box of the projected points in a block of a point
+  /// cloud image, and the block itself.
+  typedef std::pair<vw::BBox3, vw::BBox2i> BBoxPair;
+
+  /// A static R-tree of 2D boxes, bulk-loaded with the
+  /// Sort-Tile-Recursive method.
+  class BBoxTree {
+  public:
+    BBoxTree(): m_num_boxes(0) {}
+
+    /// Build the tree. Any previous content is discarded.
+    void build(std::vector<vw::BBox2> const& boxes);
+
+    /// Find the indices of the boxes which intersect the given box,
+    /// including those which just touch it.
+    void intersect(vw::BBox2 const& box, std::vector<size_t> & indices) const;
+
+    size_t size() const { return m_num_boxes; }
+
+  private:
+
+    struct Node {
+      vw::BBox2 box;
+      size_t    begin, end; // the range of children in the level below
+    };
+
+    static const size_t NODE_SIZE = 16;
+
+    // Order the boxes so that each consecutive group of NODE_SIZE is compact
+    static void str_order(std::vector<vw::BBox2> const& boxes, std::vector<size_t> & order);
+
+    void intersect_node(size_t level, size_t node, vw::BBox2 const& box,
+                        std::vector<size_t> & indices) const;
+
+    size_t                            m_num_boxes;
+    std::vector<vw::BBox2>            m_boxes;  // the input boxes, in tree order
+    std::vector<size_t>               m_ids;    // their indices in the input
+    std::vector< std::vector<Node> >  m_levels; // level 0 has the leaves
+  };
+
+  /// Save the block boundaries of a point cloud, the bounding box of
+  /// all points, and the histogram of triangulation errors. The key
+  /// should identify the point cloud and all the settings which
+  /// affect these.
+  void write_point_cloud_index(std::string const& index_file, std::string const& key,
+                               std::vector<BBoxPair> const& boundaries,
+                               vw::BBox3 const& bbox,
+                               std::vector<double> const& errors_hist);
+
+  /// Read the data saved by write_point_cloud_index(). Return false
+  /// if the file does not exist, cannot be read, or was saved with a
+  /// different key.
+  bool read_point_cloud_index(std::string const& index_file, std::string const& key,
+                              std::vector<BBoxPair> & boundaries,
+                              vw::BBox3 & bbox,
+                              std::vector<double> & errors_hist);
+
+} // namespace asp
+
+#endif // __ASP_CORE_POINT_CLOUD_INDEX_H__
@@ -132,6 +132,35 @@ namespace asp{
 
   }; // End class CsvReader
 
+  /// A LasReader which owns the input stream and the liblas reader.
+  class LasFileReader: public BaseReader{
+    std::ifstream                     m_ifs;
+    boost::shared_ptr<liblas::Reader> m_las_reader;
+    boost::shared_ptr<LasReader>      m_reader;
+  public:
+
+    LasFileReader(std::string const& las_file){
+      m_ifs.open(las_file.c_str(), std::ios::in | std::ios::binary);
+      if (!m_ifs)
+        vw_throw( vw::IOErr() << "Unable to open file \"" << las_file << "\"" );
+      liblas::ReaderFactory las_reader_factory;
+      m_las_reader.reset(new liblas::Reader(las_reader_factory.CreateWithStream(m_ifs)));
+      m_reader.reset(new LasReader(*m_las_reader));
+      m_num_points = m_reader->m_num_points;
+      m_has_georef = m_reader->m_has_georef;
+      m_georef     = m_reader->m_georef;
+    }
+
+    virtual bool ReadNextPoint(){
+      return m_reader->ReadNextPoint();
+    }
+
+    virtual Vector3 GetPoint(){
+      return m_reader->GetPoint();
+    }
+
+  }; // End class LasFileReader
+
 
 
 
@@ -897,27 +926,8 @@ void asp::las_or_csv_to_tif(std::string const& in_file,
   Vector2 original_tile_size = opt->raster_tile_size;
   opt->raster_tile_size = tile_size;
 
-  boost::shared_ptr<asp::BaseReader> reader_ptr;
-  std::ifstream ifs;
-  liblas::ReaderFactory las_reader_factory;
-  boost::shared_ptr<liblas::Reader> laslib_reader_ptr;
-
-  if (asp::is_csv(in_file)){ // CSV
-
-    reader_ptr = boost::shared_ptr<asp::CsvReader>( new asp::CsvReader(in_file, csv_conv, csv_georef) );
-
-  }else if (asp::is_pcd(in_file)){ // PCD
-
-    reader_ptr = boost::shared_ptr<asp::PcdReader>( new asp::PcdReader(in_file) );
-
-  }else if (asp::is_las(in_file)){ // LAS
-
-    ifs.open(in_file.c_str(), std::ios::in | std::ios::binary);
-    laslib_reader_ptr.reset(new liblas::Reader(las_reader_factory.CreateWithStream(ifs)));
-    reader_ptr = boost::shared_ptr<asp::LasReader>( new asp::LasReader(*laslib_reader_ptr) );
-
-  }else
-    vw_throw( ArgumentErr() << "Unknown file type: " << in_file << "\n");
+  boost::shared_ptr<asp::BaseReader> reader_ptr
+    = asp::open_point_reader(in_file, csv_georef, csv_conv);
 
   ImageViewRef<Vector3> Img
     = asp::LasOrCsvToTif_Class< ImageView<Vector3> > (reader_ptr.get(), num_rows, TILE_LEN, block_size);
@@ -930,6 +940,32 @@ void asp::las_or_csv_to_tif(std::string const& in_file,
 
 }
 
+boost::shared_ptr<asp::BaseReader>
+asp::open_point_reader(std::string const& in_file,
+                       vw::cartography::GeoReference const& csv_georef,
+                       asp::CsvConv const& csv_conv){
+
+  if (asp::is_csv(in_file)) // CSV
+    return boost::shared_ptr<asp::BaseReader>( new asp::CsvReader(in_file, csv_conv, csv_georef) );
+
+  if (asp::is_pcd(in_file)) // PCD
+    return boost::shared_ptr<asp::BaseReader>( new asp::PcdReader(in_file) );
+
+  if (asp::is_las(in_file)) // LAS
+    return boost::shared_ptr<asp::BaseReader>( new asp::LasFileReader(in_file) );
+
+  vw_throw( ArgumentErr() << "Unknown file type: " << in_file << "\n");
+  return boost::shared_ptr<asp::BaseReader>();
+}
+
+vw::Vector3 asp::reader_point_to_cartesian(asp::BaseReader const& reader,
+                                           vw::Vector3 const& point){
+  if (!reader.m_has_georef)
+    return point;
+  Vector2 lonlat = reader.m_georef.point_to_lonlat(subvector(point, 0, 2));
+  return reader.m_georef.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], point[2]));
+}
+
 
 bool asp::is_las(std::string const& file){
   std::string lfile = boost::to_lower_copy(file);
@@ -31,6 +31,7 @@
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Mosaic/ImageComposite.h>
 #include <vw/FileIO/DiskImageUtils.h>
+#include <boost/shared_ptr.hpp>
 
 #include <asp/Core/Common.h>
 
@@ -361,6 +362,17 @@ namespace asp {
     virtual ~PcdReader();
   }; // End class PcdReader
 
+  /// Open a LAS, CSV, or PCD file for reading one point at a time.
+  /// Points in CSV files are interpreted with the given georeference
+  /// and format.
+  boost::shared_ptr<BaseReader> open_point_reader(std::string const& in_file,
+                                                  vw::cartography::GeoReference const& csv_georef,
+                                                  asp::CsvConv const& csv_conv);
+
+  /// Convert a point returned by a reader to ECEF. If the reader has a
+  /// georeference, its points are projected coordinates and height.
+  vw::Vector3 reader_point_to_cartesian(BaseReader const& reader, vw::Vector3 const& point);
+
 //===================================================================================
 // Template function definitions
 
@@ -0,0 +1,417 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Ransac.h
+///
+/// A RANSAC fit which can be used in place of
+/// vw::math::RandomSampleConsensus, with the same fitting and error
+/// functors. The models are tried in parallel, in batches, and the
+/// search stops once enough models were tried to find one made only of
+/// inliers with 99% confidence, given the best inlier ratio so far. The
+/// number of iterations passed in is then the most that is done.
+///
+/// If a cost is given for each match, such as the distance between the
+/// descriptors of two interest points, the models are made at first
+/// from the best matches only, and then from more and more of them, as
+/// in PROSAC. Each iteration has its own random generator, seeded from
+/// its index, so the result does not depend on the number of threads.
+
+#ifndef __ASP_CORE_RANSAC_H__
+#define __ASP_CORE_RANSAC_H__
+
+#include <vw/Core/Log.h>
+#include <vw/Core/Settings.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/RANSAC.h>
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace asp {
+
+  /// Count the matches for which the error of a model is below a
+  /// threshold, calling the error functor for each of them.
+  template <class ErrorFuncT, class ContainerT>
+  class RansacInlierCounter {
+    ErrorFuncT              const& m_error_func;
+    std::vector<ContainerT> const& m_p1, & m_p2;
+  public:
+    RansacInlierCounter(ErrorFuncT const& error_func,
+                        std::vector<ContainerT> const& p1,
+                        std::vector<ContainerT> const& p2):
+      m_error_func(error_func), m_p1(p1), m_p2(p2) {}
+
+    template <class ModelT>
+    size_t operator()(ModelT const& H, double threshold,
+                      std::vector<size_t> * indices = NULL) const {
+      size_t count = 0;
+      for (size_t i = 0; i < m_p1.size(); i++) {
+        if (m_error_func(H, m_p1[i], m_p2[i]) < threshold) {
+          count++;
+          if (indices)
+            indices->push_back(i);
+        }
+      }
+      return count;
+    }
+  };
+
+  /// For the error of a 3x3 transform of homogeneous pixels, the pixels
+  /// are kept by coordinate, and the squared error is compared with the
+  /// squared threshold in a loop without branches, which the compiler
+  /// can vectorize.
+  template <class ContainerT>
+  class RansacInlierCounter<vw::math::InterestPointErrorMetric, ContainerT> {
+    vw::math::InterestPointErrorMetric const& m_error_func;
+    std::vector<ContainerT>            const& m_p1, & m_p2;
+    std::vector<double> m_x1, m_y1, m_w1, m_x2, m_y2, m_w2;
+  public:
+    RansacInlierCounter(vw::math::InterestPointErrorMetric const& error_func,
+                        std::vector<ContainerT> const& p1,
+                        std::vector<ContainerT> const& p2):
+      m_error_func(error_func), m_p1(p1), m_p2(p2) {
+      if (p1.empty() || p1[0].size() != 3)
+        return;
+      size_t n = p1.size();
+      m_x1.resize(n); m_y1.resize(n); m_w1.resize(n);
+      m_x2.resize(n); m_y2.resize(n); m_w2.resize(n);
+      for (size_t i = 0; i < n; i++) {
+        m_x1[i] = p1[i][0]; m_y1[i] = p1[i][1]; m_w1[i] = p1[i][2];
+        m_x2[i] = p2[i][0]; m_y2[i] = p2[i][1]; m_w2[i] = p2[i][2];
+      }
+    }
+
+    size_t operator()(vw::Matrix<double> const& H, double threshold,
+                      std::vector<size_t> * indices = NULL) const {
+      if (m_x1.empty() || H.rows() != 3 || H.cols() != 3)
+        return count_generic(H, threshold, indices);
+
+      double h[9];
+      for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+          h[3 * r + c] = H(r, c);
+      const double t2 = (threshold > 0) ? threshold * threshold : 0;
+      const size_t n  = m_x1.size();
+
+      size_t count = 0;
+      if (indices) {
+        for (size_t i = 0; i < n; i++) {
+          if (squared_error(h, i) < t2) {
+            count++;
+            indices->push_back(i);
+          }
+        }
+        return count;
+      }
+      for (size_t i = 0; i < n; i++)
+        count += (squared_error(h, i) < t2);
+      return count;
+    }
+
+    template <class ModelT>
+    size_t operator()(ModelT const& H, double threshold,
+                      std::vector<size_t> * indices = NULL) const {
+      return count_generic(H, threshold, indices);
+    }
+
+  private:
+    inline double squared_error(double const* h, size_t i) const {
+      double w  = h[6] * m_x1[i] + h[7] * m_y1[i] + h[8] * m_w1[i];
+      double dx = m_x2[i] - (h[0] * m_x1[i] + h[1] * m_y1[i] + h[2] * m_w1[i]) / w;
+      double dy = m_y2[i] - (h[3] * m_x1[i] + h[4] * m_y1[i] + h[5] * m_w1[i]) / w;
+      double dw = m_w2[i] - 1.0;
+      return dx * dx + dy * dy + dw * dw;
+    }
+
+    template <class ModelT>
+    size_t count_generic(ModelT const& H, double threshold,
+                         std::vector<size_t> * indices) const {
+      size_t count = 0;
+      for (size_t i = 0; i < m_p1.size(); i++) {
+        if (m_error_func(H, m_p1[i], m_p2[i]) < threshold) {
+          count++;
+          if (indices)
+            indices->push_back(i);
+        }
+      }
+      return count;
+    }
+  };
+
+  /// Parallel RANSAC with adaptive stopping and optional ordering of
+  /// the matches by cost. Throws vw::math::RANSACErr if no fit is found,
+  /// as vw::math::RandomSampleConsensus does.
+  template <class FittingFuncT, class ErrorFuncT>
+  class ParallelRansac {
+  public:
+    typedef typename FittingFuncT::result_type result_type;
+
+    /// The number of models tried between checks for whether to stop.
+    /// It does not depend on the number of threads.
+    static const int BATCH_SIZE = 64;
+
+    ParallelRansac(FittingFuncT const& fitting_func, ErrorFuncT const& error_func,
+                   int max_iterations, double inlier_threshold,
+                   int min_num_output_inliers,
+                   bool reduce_min_num_output_inliers_if_no_fit = false,
+                   double confidence = 0.99):
+      m_fitting_func(fitting_func), m_error_func(error_func),
+      m_max_iterations(max_iterations), m_inlier_threshold(inlier_threshold),
+      m_min_num_output_inliers(min_num_output_inliers),
+      m_reduce_min_num_output_inliers_if_no_fit(reduce_min_num_output_inliers_if_no_fit),
+      m_confidence(confidence), m_num_iterations_done(0) {}
+
+    /// Fit a model mapping p1 to p2. If there is a cost for each match,
+    /// lower being better, the best matches are tried first. Costs which
+    /// are not one per match are ignored.
+    template <class ContainerT>
+    result_type operator()(std::vector<ContainerT> const& p1,
+                           std::vector<ContainerT> const& p2,
+                           std::vector<double> const& match_costs = std::vector<double>()) {
+      using namespace vw;
+
+      if (p1.size() != p2.size())
+        vw_throw(ArgumentErr() << "RANSAC Error. Input point vectors have different sizes.");
+      if (p1.empty())
+        vw_throw(math::RANSACErr() << "RANSAC Error. No points to fit.");
+
+      const size_t n = p1.size();
+      const size_t m = m_fitting_func.min_elements_needed_for_fit(p1[0]);
+      if (n < m)
+        vw_throw(math::RANSACErr() << "RANSAC Error. Not enough potential matches for this "
+                 << "fitting functor. (" << n << "/" << m << ")");
+
+      // The matches, best first. Without a cost for each of them, they
+      // are all drawn from the start.
+      const bool progressive = (match_costs.size() == n);
+      std::vector<size_t> order(n);
+      for (size_t i = 0; i < n; i++)
+        order[i] = i;
+      if (progressive)
+        std::stable_sort(order.begin(), order.end(), CostLess(match_costs));
+
+      RansacInlierCounter<ErrorFuncT, ContainerT> counter(m_error_func, p1, p2);
+
+      int num_threads = vw_settings().default_num_threads();
+#if __APPLE__
+      // Fix due to OpenBLAS crashing. May need to be revisited.
+      num_threads = std::min(num_threads, 4);
+#endif
+      num_threads = std::max(1, std::min(num_threads, int(BATCH_SIZE)));
+
+      // Try models a batch at a time, until as many were tried as
+      // needed for the best inlier ratio so far.
+      Candidate best;
+      int required = m_max_iterations;
+      m_num_iterations_done = 0;
+      while (m_num_iterations_done < required) {
+        int start = m_num_iterations_done;
+        int end   = std::min(start + int(BATCH_SIZE), m_max_iterations);
+        int num_tasks = std::min(num_threads, end - start);
+        std::vector<Candidate> results(num_tasks);
+        FifoWorkQueue queue(num_threads);
+        for (int t = 0; t < num_tasks; t++) {
+          int task_start = start + (end - start) * t / num_tasks;
+          int task_end   = start + (end - start) * (t + 1) / num_tasks;
+          boost::shared_ptr<Task>
+            task(new SearchTask<ContainerT>(*this, p1, p2, order, progressive, m,
+                                            counter, task_start, task_end, results[t]));
+          queue.add_task(task);
+        }
+        queue.join_all();
+
+        // Earlier iterations win ties, so the result is the same
+        // however the iterations are split among the threads.
+        for (int t = 0; t < num_tasks; t++) {
+          if (results[t].num_inliers > best.num_inliers ||
+              (results[t].num_inliers == best.num_inliers && best.iteration >= 0 &&
+               results[t].iteration >= 0 && results[t].iteration < best.iteration))
+            best = results[t];
+        }
+        m_num_iterations_done = end;
+        if (best.num_inliers > 0)
+          required = required_iterations(double(best.num_inliers) / n, m);
+      }
+
+      int min_num_output_inliers = m_min_num_output_inliers;
+      if (m_reduce_min_num_output_inliers_if_no_fit) {
+        while (int(best.num_inliers) < min_num_output_inliers &&
+               min_num_output_inliers >= int(m)) {
+          min_num_output_inliers = int(min_num_output_inliers / 1.5);
+          vw_out() << "Attempting RANSAC with " << min_num_output_inliers
+                   << " of output inliers.\n";
+        }
+      }
+      if (best.num_inliers < m || int(best.num_inliers) < min_num_output_inliers)
+        vw_throw(math::RANSACErr() << "RANSAC was unable to find a fit that matched the supplied data.");
+
+      // Refit to all the inliers of the best model, while that does
+      // not lose inliers.
+      result_type H = best.model;
+      size_t num_inliers = best.num_inliers;
+      for (int pass = 0; pass < 2; pass++) {
+        std::vector<size_t> indices;
+        counter(H, m_inlier_threshold, &indices);
+        std::vector<ContainerT> inliers1(indices.size()), inliers2(indices.size());
+        for (size_t i = 0; i < indices.size(); i++) {
+          inliers1[i] = p1[indices[i]];
+          inliers2[i] = p2[indices[i]];
+        }
+        try {
+          result_type refined = m_fitting_func(inliers1, inliers2, H);
+          size_t num_refined = counter(refined, m_inlier_threshold);
+          if (num_refined < num_inliers)
+            break;
+          H = refined;
+          num_inliers = num_refined;
+        } catch (...) {
+          break;
+        }
+      }
+
+      vw_out(DebugMessage, "asp") << "RANSAC: " << num_inliers << " inliers out of " << n
+                                  << " after " << m_num_iterations_done << " iterations.\n";
+      return H;
+    }
+
+    /// The matches which are inliers of the given model
+    template <class ContainerT>
+    std::vector<size_t> inlier_indices(result_type const& H,
+                                       std::vector<ContainerT> const& p1,
+                                       std::vector<ContainerT> const& p2) const {
+      std::vector<size_t> indices;
+      RansacInlierCounter<ErrorFuncT, ContainerT> counter(m_error_func, p1, p2);
+      counter(H, m_inlier_threshold, &indices);
+      return indices;
+    }
+
+    /// How many models were tried in the last fit
+    int num_iterations_done() const { return m_num_iterations_done; }
+
+  private:
+
+    struct Candidate {
+      size_t      num_inliers;
+      int         iteration;
+      result_type model;
+      Candidate(): num_inliers(0), iteration(-1) {}
+    };
+
+    struct CostLess {
+      std::vector<double> const& m_costs;
+      CostLess(std::vector<double> const& costs): m_costs(costs) {}
+      bool operator()(size_t a, size_t b) const { return m_costs[a] < m_costs[b]; }
+    };
+
+    // Try the models of some iterations, and keep the one with the most inliers
+    template <class ContainerT>
+    class SearchTask : public vw::Task, private boost::noncopyable {
+      ParallelRansac                              const& m_ransac;
+      std::vector<ContainerT>                     const& m_p1, & m_p2;
+      std::vector<size_t>                         const& m_order;
+      bool                                               m_progressive;
+      size_t                                             m_sample_size;
+      RansacInlierCounter<ErrorFuncT, ContainerT> const& m_counter;
+      int                                                m_start, m_end;
+      Candidate&                                         m_result;
+    public:
+      SearchTask(ParallelRansac const& ransac,
+                 std::vector<ContainerT> const& p1, std::vector<ContainerT> const& p2,
+                 std::vector<size_t> const& order, bool progressive, size_t sample_size,
+                 RansacInlierCounter<ErrorFuncT, ContainerT> const& counter,
+                 int start, int end, Candidate& result):
+        m_ransac(ransac), m_p1(p1), m_p2(p2), m_order(order), m_progressive(progressive),
+        m_sample_size(sample_size), m_counter(counter), m_start(start), m_end(end),
+        m_result(result) {}
+
+      void operator()() {
+        const size_t n = m_p1.size();
+        std::vector<ContainerT> sample1(m_sample_size), sample2(m_sample_size);
+        std::vector<size_t>     picked;
+        for (int iter = m_start; iter < m_end; iter++) {
+
+          // Draw from the best matches at first, then from more of them,
+          // until all can be drawn halfway through the iterations.
+          size_t pool = n;
+          if (m_progressive) {
+            double growth = std::max(1, m_ransac.m_max_iterations / 2);
+            pool = m_sample_size + size_t((n - m_sample_size) * std::min(1.0, (iter + 1) / growth));
+            pool = std::min(pool, n);
+          }
+
+          boost::random::mt19937 gen(vw::uint32(iter) * 2654435761u + 1u);
+          boost::random::uniform_int_distribution<size_t> dist(0, pool - 1);
+          picked.clear();
+          while (picked.size() < m_sample_size) {
+            size_t k = dist(gen);
+            if (std::find(picked.begin(), picked.end(), k) == picked.end())
+              picked.push_back(k);
+          }
+          for (size_t s = 0; s < m_sample_size; s++) {
+            sample1[s] = m_p1[m_order[picked[s]]];
+            sample2[s] = m_p2[m_order[picked[s]]];
+          }
+
+          result_type H;
+          try {
+            H = m_ransac.m_fitting_func(sample1, sample2);
+          } catch (...) {
+            continue; // A degenerate sample
+          }
+          size_t num_inliers = m_counter(H, m_ransac.m_inlier_threshold);
+          if (num_inliers > m_result.num_inliers) {
+            m_result.num_inliers = num_inliers;
+            m_result.iteration   = iter;
+            m_result.model       = H;
+          }
+        }
+      }
+    };
+
+    // How many models to try to draw one made only of inliers with the
+    // wanted confidence
+    int required_iterations(double inlier_ratio, size_t sample_size) const {
+      double p_good = std::pow(inlier_ratio, double(sample_size));
+      if (p_good >= 1.0)
+        return 1;
+      if (p_good <= 0.0)
+        return m_max_iterations;
+      double k = std::log(1.0 - m_confidence) / std::log(1.0 - p_good);
+      if (k >= m_max_iterations)
+        return m_max_iterations;
+      return std::max(1, int(std::ceil(k)));
+    }
+
+    FittingFuncT m_fitting_func;
+    ErrorFuncT   m_error_func;
+    int          m_max_iterations;
+    double       m_inlier_threshold;
+    int          m_min_num_output_inliers;
+    bool         m_reduce_min_num_output_inliers_if_no_fit;
+    double       m_confidence;
+    int          m_num_iterations_done;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_RANSAC_H__
@@ -92,6 +92,9 @@ namespace asp {
     // to get a camera pointer, and there we don't parse stereo.default
     disable_correct_velocity_aberration    = false;
     disable_correct_atmospheric_refraction = false;
+    dg_point_to_pixel_grid_size            = 0;
+    ip_match_by_tile                       = false;
+    build_image_pyramids                   = false;
     
 
     double nan = std::numeric_limits<double>::quiet_NaN();
@@ -135,11 +138,13 @@ namespace asp {
       ("ip-triangulation-max-error", po::value(&global.ip_triangulation_max_error)->default_value(-1),
        "When matching IP, filter out any pairs with a triangulation error higher than this.")
       ("ip-num-ransac-iterations", po::value(&global.ip_num_ransac_iterations)->default_value(100),
-       "How many RANSAC iterations to do in interest point matching.")
+       "The most RANSAC iterations to do in interest point matching. Fewer are done once a fit made only of inliers was found with 99% confidence.")
       ("disable-tri-ip-filter",     po::value(&global.disable_tri_filtering)->default_value(false)->implicit_value(true),
        "Turn off the tri-ip filtering step.")
       ("ip-debug-images",     po::value(&global.ip_debug_images)->default_value(false)->implicit_value(true),
                       "Write debug images to disk when detecting and matching interest points.")
+      ("ip-match-by-tile",    po::bool_switch(&global.ip_match_by_tile)->default_value(false)->implicit_value(true),
+       "Match the interest points of each 1024^2 tile of an image only with those in the band around the epipolar lines of the tile, with a search tree for each tile.")
       ("num-obalog-scales",              po::value(&global.num_scales)->default_value(-1),
        "How many scales to use if detecting interest points with OBALoG. If not specified, 8 will be used. More can help for images with high frequency artifacts.")
       ("nodata-value",             po::value(&global.nodata_value)->default_value(nan),
@@ -158,6 +163,8 @@ namespace asp {
        "Do not assume a reliable datum exists, such as for potato-shaped bodies.")
       ("skip-image-normalization", po::bool_switch(&global.skip_image_normalization)->default_value(false)->implicit_value(true),
        "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.")
+      ("build-image-pyramids", po::bool_switch(&global.build_image_pyramids)->default_value(false)->implicit_value(true),
+       "Save versions of L.tif and R.tif downsampled by factors of 2, 4, ..., for viewing in stereo_gui.")
       ("force-reuse-match-files", po::bool_switch(&global.force_reuse_match_files)->default_value(false)->implicit_value(true),
        "Force reusing the match files even if older than the images or cameras.")
       ("part-of-multiview-run", po::bool_switch(&global.part_of_multiview_run)->default_value(false)->implicit_value(true),
@@ -229,6 +236,8 @@ namespace asp {
                      "Filter blobs this size or less in correlation pyramid step.")
       ("corr-tile-size",         po::value(&global.corr_tile_size_ovr)->default_value(ASPGlobalOptions::corr_tile_size()),
                      "Override the default tile size used for processing.")
+      ("corr-min-sub-tile-size", po::value(&global.corr_min_sub_tile_size)->default_value(0),
+                     "With the local window search, correlate separately parts of a tile no smaller than this whose search ranges from the low-resolution disparity are much smaller than the one of the tile. This is not done for SGM and MGM. The default of 0 does not split tiles.")
       ("sgm-collar-size",        po::value(&global.sgm_collar_size)->default_value(512),
                      "Extend SGM calculation to this distance to increase accuracy at tile borders.")
       ("sgm-search-buffer",        po::value(&global.sgm_search_buffer)->default_value(Vector2i(4,4),"4 4"),
@@ -411,7 +420,9 @@ namespace asp {
       ("disable-correct-velocity-aberration", po::bool_switch(&global.disable_correct_velocity_aberration)->default_value(false)->implicit_value(true),
        "Turn off velocity aberration correction for non-ISIS linescan cameras.")
       ("disable-correct-atmospheric-refraction", po::bool_switch(&global.disable_correct_atmospheric_refraction)->default_value(false)->implicit_value(true),
-       "Turn off atmospheric refraction correction for non-ISIS linescan cameras.");
+       "Turn off atmospheric refraction correction for non-ISIS linescan cameras.")
+      ("dg-point-to-pixel-grid-size", po::value(&global.dg_point_to_pixel_grid_size)->default_value(0),
+       "For Digital Globe cameras, speed up projecting points into the camera by first projecting a grid of this many points along each of longitude and latitude over the image footprint. Set to 0 to not use a grid.");
   }
 
   UndocOptsDescription::UndocOptsDescription() : po::options_description("Undocumented Options") {
@@ -110,6 +110,7 @@ namespace asp {
                                             ///  of the left/right edges of the images being matched.
     bool   ip_normalize_tiles;              ///< Individually normalize tiles for IP detection.
     bool   ip_debug_images;                 ///< Write debug interest point images.
+    bool   ip_match_by_tile;                ///< Match IP by tile, each against the IP in its epipolar band.
     
     double nodata_value;                    ///< Pixels with values less than or equal to this number are treated as no-data.
                                             //  This overrides the nodata values from input images.
@@ -120,6 +121,7 @@ namespace asp {
     bool   skip_rough_homography;           ///< Use this if datum-based rough homography fails. 
     bool   no_datum;                        ///< Do not assume a reliable datum exists
     bool   skip_image_normalization;        ///< Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.
+    bool   build_image_pyramids;            ///< Save downsampled versions of L.tif and R.tif for stereo_gui.
     bool   force_reuse_match_files;         ///< Force reusing the match files even if older than the images or cameras
     bool   part_of_multiview_run;           ///< If this run is part of a larger multiview run
     std::string datum;                      ///< The datum to use with RPC camera models
@@ -165,6 +167,7 @@ namespace asp {
                                       // 2 = Even slower smooth SGM method.
     int    corr_blob_filter_area;     // Use blob filtering in pyramidal correlation
     int    corr_tile_size_ovr;        // Override the default tile size used for processing.
+    int    corr_min_sub_tile_size;    // Smallest part of a tile correlated with its own search range.
     int    sgm_collar_size;           // Extra tile padding used for SGM calculation.
     vw::Vector2i sgm_search_buffer;   // Search padding in SGM around previous pyramid level disparity value.
     size_t corr_memory_limit_mb;      // Correlation memory limit, only important for SGM/MGM.
@@ -254,6 +257,7 @@ namespace asp {
     // Sensor options
     bool disable_correct_velocity_aberration;
     bool disable_correct_atmospheric_refraction;
+    int  dg_point_to_pixel_grid_size; // 0 means do not use a grid
 
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
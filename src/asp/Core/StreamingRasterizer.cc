@@ -0,0 +1,246 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <asp/Core/StreamingRasterizer.h>
+
+#include <boost/filesystem.hpp>
+
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+  PointBinStore::PointBinStore(double bin_size, std::string const& tmp_file,
+                               size_t max_memory_bytes):
+    m_bin_size(bin_size), m_tmp_file(tmp_file), m_max_memory_bytes(max_memory_bytes),
+    m_memory_bytes(0), m_file_points(0), m_num_points(0), m_finished(false),
+    m_last_index(0, 0), m_last_bin(NULL) {
+
+    if (m_bin_size <= 0)
+      vw_throw( ArgumentErr() << "PointBinStore: The bin size must be positive.\n" );
+  }
+
+  PointBinStore::~PointBinStore() {
+    if (m_ofs.is_open())
+      m_ofs.close();
+    if (m_file_points > 0)
+      boost::filesystem::remove(m_tmp_file);
+  }
+
+  PointBinStore::BinIndex PointBinStore::bin_index(double x, double y) const {
+    return BinIndex((int)floor(x/m_bin_size), (int)floor(y/m_bin_size));
+  }
+
+  void PointBinStore::add_point(Vector3 const& point) {
+
+    if (m_finished)
+      vw_throw( LogicErr() << "PointBinStore: Cannot add points after finish().\n" );
+
+    BinIndex index = bin_index(point[0], point[1]);
+    if (m_last_bin == NULL || index != m_last_index) {
+      m_last_index = index;
+      m_last_bin   = &m_bins[index];
+    }
+
+    // Store the position relative to the bin corner so that floats are precise enough
+    m_last_bin->push_back(point[0] - index.first  * m_bin_size);
+    m_last_bin->push_back(point[1] - index.second * m_bin_size);
+    m_last_bin->push_back(point[2]);
+
+    m_bbox.grow(point);
+    m_num_points++;
+    m_memory_bytes += NUM_VALS*sizeof(float);
+
+    if (m_memory_bytes >= m_max_memory_bytes)
+      spill();
+  }
+
+  void PointBinStore::spill() {
+
+    if (m_bins.empty())
+      return;
+
+    if (!m_ofs.is_open()) {
+      m_ofs.open(m_tmp_file.c_str(), std::ios::binary | std::ios::out | std::ios::trunc);
+      if (!m_ofs.good())
+        vw_throw( ArgumentErr() << "Cannot open for writing: " << m_tmp_file << "\n" );
+    }
+
+    vw_out(DebugMessage, "asp") << "Saving " << m_memory_bytes/(1024*1024)
+                                << " MB of points to: " << m_tmp_file << std::endl;
+
+    typedef std::map<BinIndex, std::vector<float> >::iterator BinIter;
+    for (BinIter it = m_bins.begin(); it != m_bins.end(); it++) {
+      std::vector<float> const& vals = it->second;
+      if (vals.empty())
+        continue;
+      Chunk chunk;
+      chunk.offset     = m_file_points;
+      chunk.num_points = vals.size()/NUM_VALS;
+      m_ofs.write((const char*)&vals[0], vals.size()*sizeof(float));
+      m_chunks[it->first].push_back(chunk);
+      m_file_points += chunk.num_points;
+    }
+    if (!m_ofs.good())
+      vw_throw( IOErr() << "Failed writing to: " << m_tmp_file << "\n" );
+
+    m_bins.clear();
+    m_last_bin     = NULL;
+    m_memory_bytes = 0;
+  }
+
+  void PointBinStore::finish() {
+    // The remaining bins stay in memory. Close the file so that it can
+    // be read.
+    if (m_ofs.is_open())
+      m_ofs.close();
+    m_last_bin = NULL;
+    m_finished = true;
+  }
+
+  void PointBinStore::read_points(BBox2 const& box, std::vector<Vector3> & points) const {
+
+    if (!m_finished)
+      vw_throw( LogicErr() << "PointBinStore: Call finish() before reading points.\n" );
+
+    points.clear();
+    if (box.empty())
+      return;
+
+    BinIndex beg = bin_index(box.min().x(), box.min().y());
+    BinIndex end = bin_index(box.max().x(), box.max().y());
+
+    // Each caller opens its own stream, so this can be called in parallel
+    std::ifstream ifs;
+    std::vector<float> vals;
+
+    for (int bx = beg.first; bx <= end.first; bx++) {
+      for (int by = beg.second; by <= end.second; by++) {
+
+        BinIndex index(bx, by);
+        double x0 = bx*m_bin_size, y0 = by*m_bin_size;
+
+        // Collect the values saved to disk, then the ones in memory
+        vals.clear();
+        std::map<BinIndex, std::vector<Chunk> >::const_iterator cit = m_chunks.find(index);
+        if (cit != m_chunks.end()) {
+          if (!ifs.is_open()) {
+            ifs.open(m_tmp_file.c_str(), std::ios::binary | std::ios::in);
+            if (!ifs.good())
+              vw_throw( ArgumentErr() << "Cannot open for reading: " << m_tmp_file << "\n" );
+          }
+          for (size_t c = 0; c < cit->second.size(); c++) {
+            Chunk const& chunk = cit->second[c];
+            size_t start = vals.size();
+            vals.resize(start + chunk.num_points*NUM_VALS);
+            ifs.seekg(chunk.offset*NUM_VALS*sizeof(float), std::ios::beg);
+            ifs.read((char*)&vals[start], chunk.num_points*NUM_VALS*sizeof(float));
+            if (!ifs.good())
+              vw_throw( IOErr() << "Failed reading from: " << m_tmp_file << "\n" );
+          }
+        }
+        std::map<BinIndex, std::vector<float> >::const_iterator bit = m_bins.find(index);
+        if (bit != m_bins.end())
+          vals.insert(vals.end(), bit->second.begin(), bit->second.end());
+
+        for (size_t i = 0; i + NUM_VALS <= vals.size(); i += NUM_VALS) {
+          Vector3 point(x0 + vals[i], y0 + vals[i+1], vals[i+2]);
+          if (box.contains(subvector(point, 0, 2)))
+            points.push_back(point);
+        }
+      }
+    }
+  }
+
+  StreamingRasterizerView::StreamingRasterizerView(PointBinStore const& store,
+                                                   BBox2 const& snapped_box, double spacing,
+                                                   double search_radius, double sigma_factor,
+                                                   FilterType filter, double percentile,
+                                                   double nodata_value,
+                                                   size_t * num_invalid_pixels,
+                                                   Mutex * count_mutex):
+    m_store(store), m_snapped_box(snapped_box), m_spacing(spacing),
+    m_search_radius(search_radius), m_sigma_factor(sigma_factor),
+    m_filter(filter), m_percentile(percentile), m_nodata_value(nodata_value),
+    m_num_invalid_pixels(num_invalid_pixels), m_count_mutex(count_mutex) {
+
+    if (m_spacing <= 0)
+      vw_throw( ArgumentErr() << "StreamingRasterizerView: The spacing must be positive.\n" );
+    if (m_search_radius <= 0)
+      m_search_radius = m_spacing;
+  }
+
+  /// \cond INTERNAL
+  StreamingRasterizerView::prerasterize_type
+  StreamingRasterizerView::prerasterize( BBox2i const& bbox ) const {
+
+    // The projected coordinates of the grid points of this tile. Row 0
+    // of the image is at the top, so the lowest grid point is at the
+    // last row.
+    double x0 = m_snapped_box.min().x() + bbox.min().x()*m_spacing;
+    double y0 = m_snapped_box.max().y() - (bbox.max().y() - 1)*m_spacing;
+    BBox2 region(Vector2(x0, y0),
+                 Vector2(x0 + (bbox.width()  - 1)*m_spacing,
+                         y0 + (bbox.height() - 1)*m_spacing));
+    region.expand(m_search_radius);
+
+    std::vector<Vector3> points;
+    m_store.read_points(region, points);
+
+    ImageView<double> d_buffer, weights;
+    Point2Grid point2grid(bbox.width(), bbox.height(), d_buffer, weights,
+                          x0, y0, m_spacing, m_spacing,
+                          m_search_radius, m_sigma_factor,
+                          m_filter, m_percentile);
+    point2grid.Clear(m_nodata_value);
+    for (size_t i = 0; i < points.size(); i++)
+      point2grid.AddPoint(points[i][0], points[i][1], points[i][2]);
+    point2grid.normalize();
+
+    ImageView<pixel_type> result = flip_vertical(d_buffer);
+
+    size_t num_unset = 0;
+    for (int r = 0; r < result.rows(); r++) {
+      for (int c = 0; c < result.cols(); c++) {
+        if (result(c, r) == m_nodata_value)
+          num_unset++;
+      }
+    }
+    { // Lock and update the total number of invalid pixels
+      Mutex::Lock lock(*m_count_mutex);
+      (*m_num_invalid_pixels) += num_unset;
+    }
+
+    return prerasterize_type(result, BBox2i(-bbox.min().x(), -bbox.min().y(), cols(), rows()));
+  }
+  /// \endcond
+
+  Matrix3x3 StreamingRasterizerView::geo_transform() const {
+    Matrix3x3 geo_transform;
+    geo_transform.set_identity();
+    geo_transform(0,0) = m_spacing;
+    geo_transform(1,1) = -m_spacing;
+    geo_transform(0,2) = m_snapped_box.min().x();
+    geo_transform(1,2) = m_snapped_box.max().y();
+    return geo_transform;
+  }
+
+} // namespace asp
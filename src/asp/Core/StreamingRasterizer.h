@@ -0,0 +1,160 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file StreamingRasterizer.h
+///
+/// Create a DEM directly from points read one at a time, such as from
+/// LAS or CSV files, without first saving them as a point cloud image.
+/// The projected points are put in square bins, which are kept in
+/// memory up to a limit, beyond which they are appended to a temporary
+/// file. Each DEM tile is then gridded from the bins it overlaps.
+
+#ifndef __ASP_CORE_STREAMING_RASTERIZER_H__
+#define __ASP_CORE_STREAMING_RASTERIZER_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Math/Vector.h>
+#include <vw/Math/Matrix.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelTypes.h>
+#include <asp/Core/Point2Grid.h>
+
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// Store projected points (x, y, height) in square bins in the x-y
+  /// plane. At most about the given number of bytes are kept in memory,
+  /// the rest are saved to a temporary file, which is wiped at the end.
+  class PointBinStore: private boost::noncopyable {
+
+  public:
+    PointBinStore(double bin_size, std::string const& tmp_file, size_t max_memory_bytes);
+    ~PointBinStore();
+
+    /// Add a point. Not thread-safe.
+    void add_point(vw::Vector3 const& point);
+
+    /// Must be called after all points are added. Then the store can
+    /// be read from multiple threads.
+    void finish();
+
+    /// Find the points whose x and y are in the given box.
+    void read_points(vw::BBox2 const& box, std::vector<vw::Vector3> & points) const;
+
+    vw::BBox3 bounding_box() const { return m_bbox; }
+    boost::uint64_t num_points() const { return m_num_points; }
+
+  private:
+
+    typedef std::pair<int, int> BinIndex;
+
+    // A part of a bin which is saved to disk
+    struct Chunk {
+      boost::uint64_t offset, num_points;
+    };
+
+    BinIndex bin_index(double x, double y) const;
+    void spill(); // append all bins in memory to the temporary file
+
+    // The points in a bin are stored as x and y relative to the bin
+    // corner, and the height, all as floats.
+    static const int NUM_VALS = 3;
+
+    double                                  m_bin_size;
+    std::string                             m_tmp_file;
+    size_t                                  m_max_memory_bytes, m_memory_bytes;
+    std::map<BinIndex, std::vector<float> > m_bins;
+    std::map<BinIndex, std::vector<Chunk> > m_chunks;
+    std::ofstream                           m_ofs;
+    boost::uint64_t                         m_file_points, m_num_points;
+    vw::BBox3                               m_bbox;
+    bool                                    m_finished;
+
+    // Consecutive points are often in the same bin, so remember the last one
+    BinIndex             m_last_index;
+    std::vector<float> * m_last_bin;
+  };
+
+  /// Grid the points in a PointBinStore with Point2Grid, one tile at a
+  /// time. The grid points are at integer multiples of the spacing
+  /// starting at the upper-left corner of the given box, as with the
+  /// OrthoRasterizerView.
+  class StreamingRasterizerView: public vw::ImageViewBase<StreamingRasterizerView> {
+
+  public:
+    typedef vw::PixelGray<float> pixel_type;
+    typedef pixel_type           result_type;
+    typedef vw::ProceduralPixelAccessor<StreamingRasterizerView> pixel_accessor;
+
+    StreamingRasterizerView(PointBinStore const& store,
+                            vw::BBox2 const& snapped_box, double spacing,
+                            double search_radius, double sigma_factor,
+                            FilterType filter, double percentile,
+                            double nodata_value,
+                            size_t * num_invalid_pixels, vw::Mutex * count_mutex);
+
+    inline vw::int32 cols() const {
+      return (int)round(m_snapped_box.width()/m_spacing) + 1;
+    }
+    inline vw::int32 rows() const {
+      return (int)round(m_snapped_box.height()/m_spacing) + 1;
+    }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor(*this); }
+
+    inline result_type operator()( int /*i*/, int /*j*/, int /*p*/=0 ) const {
+      vw_throw(vw::NoImplErr() << "StreamingRasterizerView::operator() is not implemented.");
+      return pixel_type();
+    }
+
+    /// The affine georeferencing transform
+    vw::Matrix3x3 geo_transform() const;
+
+    /// \cond INTERNAL
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    prerasterize_type prerasterize( vw::BBox2i const& bbox ) const;
+
+    template <class DestT> inline void rasterize( DestT const& dest, vw::BBox2i const& bbox ) const {
+      vw::rasterize( prerasterize(bbox), dest, bbox );
+    }
+    /// \endcond
+
+  private:
+    PointBinStore const& m_store;
+    vw::BBox2  m_snapped_box;
+    double     m_spacing, m_search_radius, m_sigma_factor;
+    FilterType m_filter;
+    double     m_percentile, m_nodata_value;
+    size_t    *m_num_invalid_pixels;
+    vw::Mutex *m_count_mutex;
+  };
+
+} // namespace asp
+
+#endif // __ASP_CORE_STREAMING_RASTERIZER_H__
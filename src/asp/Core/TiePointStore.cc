@@ -0,0 +1,695 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <vw/BundleAdjustment/ControlNetwork.h>
+#include <vw/BundleAdjustment/ControlNetworkLoader.h>
+#include <asp/Core/FileUtils.h>
+#include <asp/Core/TiePointStore.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+using namespace vw;
+
+namespace asp {
+
+  namespace {
+
+    const char MANIFEST_MAGIC [] = "ASP_TIE_POINTS_V2";
+    const char STORE_MAGIC    [] = "ASP_TIE_POINTS3";
+    const char POSITIONS_MAGIC[] = "ASP_TRACK_POSITIONS_V1";
+
+    // The binary file is this header, then the offset of the first
+    // observation of each track and one past the last, then the
+    // observations, then the matches, then the previous index of each
+    // track. The hash of the contents identifies the tracks for the
+    // saved track positions, as the file signature, made of the size
+    // and the time in seconds, may stay the same when the tie points
+    // are made again.
+    struct StoreHeader {
+      char   magic[16];
+      uint64 num_images, num_tracks, num_observations, num_matches, content_hash;
+    };
+
+    size_t store_size(StoreHeader const& header) {
+      return sizeof(StoreHeader) + (header.num_tracks + 1)*sizeof(uint64) +
+        header.num_observations*sizeof(TiePointStore::Observation) +
+        header.num_matches*sizeof(TiePointStore::Match) +
+        header.num_tracks*sizeof(uint32);
+    }
+
+    struct TiePointManifest {
+      int min_matches;
+      std::vector<std::string> image_files;
+      std::vector< std::pair<int, int> > pairs;
+      std::vector<std::string> match_files, match_signatures;
+      std::string store_signature, previous_signature;
+    };
+
+    bool read_manifest(std::string const& manifest_file, TiePointManifest & manifest) {
+
+      std::ifstream ifs(manifest_file.c_str());
+      if (!ifs.good())
+        return false;
+
+      std::string line;
+      if (!std::getline(ifs, line) || line != MANIFEST_MAGIC)
+        return false;
+      int num_images = 0, num_pairs = 0;
+      if (!std::getline(ifs, line))
+        return false;
+      std::istringstream is(line);
+      if (!(is >> manifest.min_matches >> num_images >> num_pairs) ||
+          num_images < 0 || num_pairs < 0)
+        return false;
+
+      manifest.image_files.resize(num_images);
+      for (int i = 0; i < num_images; i++) {
+        if (!std::getline(ifs, manifest.image_files[i]))
+          return false;
+      }
+
+      manifest.pairs.resize(num_pairs);
+      manifest.match_files.resize(num_pairs);
+      manifest.match_signatures.resize(num_pairs);
+      for (int i = 0; i < num_pairs; i++) {
+        if (!std::getline(ifs, line))
+          return false;
+        std::istringstream is2(line);
+        if (!(is2 >> manifest.pairs[i].first >> manifest.pairs[i].second))
+          return false;
+        if (!std::getline(ifs, manifest.match_files[i]) ||
+            !std::getline(ifs, manifest.match_signatures[i]))
+          return false;
+      }
+      return std::getline(ifs, manifest.store_signature) &&
+        std::getline(ifs, manifest.previous_signature);
+    }
+
+    void write_manifest(std::string const& manifest_file, TiePointManifest const& manifest) {
+
+      // Write to a temporary file first, so that an interrupted run
+      // does not leave behind a partial manifest.
+      std::string tmp_file = manifest_file + ".tmp";
+      {
+        std::ofstream ofs(tmp_file.c_str());
+        if (!ofs.good())
+          vw_throw( IOErr() << "Cannot open for writing: " << tmp_file << "\n" );
+        ofs << MANIFEST_MAGIC << "\n" << manifest.min_matches << ' '
+            << manifest.image_files.size() << ' ' << manifest.pairs.size() << "\n";
+        for (size_t i = 0; i < manifest.image_files.size(); i++)
+          ofs << manifest.image_files[i] << "\n";
+        for (size_t i = 0; i < manifest.pairs.size(); i++)
+          ofs << manifest.pairs[i].first << ' ' << manifest.pairs[i].second << "\n"
+              << manifest.match_files[i] << "\n" << manifest.match_signatures[i] << "\n";
+        ofs << manifest.store_signature << "\n" << manifest.previous_signature << "\n";
+        if (!ofs.good())
+          vw_throw( IOErr() << "Failed writing: " << tmp_file << "\n" );
+      }
+      boost::filesystem::rename(tmp_file, manifest_file);
+    }
+
+    // Whether the manifest is for these match files, and they did not
+    // change since.
+    bool is_current(TiePointManifest const& manifest, std::string const& store_file) {
+      for (size_t i = 0; i < manifest.match_files.size(); i++) {
+        if (file_signature(manifest.match_files[i]) != manifest.match_signatures[i])
+          return false;
+      }
+      std::string store_sig = file_signature(store_file);
+      return !store_sig.empty() && store_sig == manifest.store_signature;
+    }
+
+    // Map the images and pairs of the tie points made earlier to the
+    // ones now, by name, and find the pairs whose match files must be
+    // read. Return false if some image or match file used earlier is
+    // not used now, or if a match file changed, as matches cannot be
+    // taken out of tracks.
+    bool map_to_current(TiePointManifest const& old_manifest, TiePointManifest & manifest,
+                        std::vector<uint32> & image_map, std::vector<uint32> & pair_map,
+                        std::vector<bool> & read_pair) {
+
+      std::map<std::string, uint32> image_index;
+      for (size_t i = 0; i < manifest.image_files.size(); i++)
+        image_index[manifest.image_files[i]] = i;
+      image_map.resize(old_manifest.image_files.size());
+      for (size_t i = 0; i < old_manifest.image_files.size(); i++) {
+        std::map<std::string, uint32>::const_iterator it
+          = image_index.find(old_manifest.image_files[i]);
+        if (it == image_index.end())
+          return false;
+        image_map[i] = it->second;
+      }
+
+      std::map<std::pair<int, int>, uint32> pair_index;
+      for (size_t k = 0; k < manifest.pairs.size(); k++)
+        pair_index[manifest.pairs[k]] = k;
+      read_pair.assign(manifest.pairs.size(), true);
+      pair_map.resize(old_manifest.pairs.size());
+      for (size_t k = 0; k < old_manifest.pairs.size(); k++) {
+        std::pair<int, int> pair(image_map[old_manifest.pairs[k].first],
+                                 image_map[old_manifest.pairs[k].second]);
+        std::map<std::pair<int, int>, uint32>::const_iterator it = pair_index.find(pair);
+        if (it == pair_index.end() || manifest.match_files[it->second] != old_manifest.match_files[k])
+          return false;
+        pair_map[k] = it->second;
+
+        // A match file which did not exist then is read now, if it exists
+        if (!old_manifest.match_signatures[k].empty()) {
+          read_pair[it->second] = false;
+          manifest.match_signatures[it->second] = old_manifest.match_signatures[k];
+        }
+      }
+      return true;
+    }
+
+    // The observations of the tie points made earlier and the ones read
+    // from the match files, before joining the ones of the same
+    // feature, ordered by image and pixel.
+    struct RawObservation {
+      uint32 image;
+      float  x, y, sigma;
+      uint32 old_track;
+    };
+
+    bool operator<(RawObservation const& a, RawObservation const& b) {
+      if (a.image != b.image) return a.image < b.image;
+      if (a.x     != b.x    ) return a.x     < b.x;
+      return a.y < b.y;
+    }
+
+    bool same_feature(RawObservation const& a, RawObservation const& b) {
+      return a.image == b.image && a.x == b.x && a.y == b.y;
+    }
+
+    class RawIndexLess {
+      std::vector<RawObservation> const& m_raw;
+    public:
+      RawIndexLess(std::vector<RawObservation> const& raw): m_raw(raw) {}
+      bool operator()(uint32 a, uint32 b) const { return m_raw[a] < m_raw[b]; }
+    };
+
+    // The root of a feature, with path halving. The root of a set is
+    // its smallest feature, so tracks come out in the order of their
+    // first feature.
+    uint32 find_root(std::vector<uint32> & parent, uint32 i) {
+      while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+      }
+      return i;
+    }
+
+    void join(std::vector<uint32> & parent, uint32 a, uint32 b) {
+      a = find_root(parent, a);
+      b = find_root(parent, b);
+      if (a < b)
+        parent[b] = a;
+      else if (b < a)
+        parent[a] = b;
+    }
+
+    bool match_less(TiePointStore::Match const& a, TiePointStore::Match const& b) {
+      if (a.pair != b.pair) return a.pair < b.pair;
+      if (a.left != b.left) return a.left < b.left;
+      return a.right < b.right;
+    }
+
+    bool match_equal(TiePointStore::Match const& a, TiePointStore::Match const& b) {
+      return a.pair == b.pair && a.left == b.left && a.right == b.right;
+    }
+
+    // The 64-bit FNV-1a hash of an array, continuing from the given hash
+    template <class T>
+    uint64 hash_array(std::vector<T> const& vec, uint64 hash) {
+      const unsigned char* data = reinterpret_cast<const unsigned char*>(vec.data());
+      for (size_t i = 0; i < vec.size()*sizeof(T); i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    template <class T>
+    void write_array(std::ofstream & ofs, std::vector<T> const& vec) {
+      if (!vec.empty())
+        ofs.write(reinterpret_cast<const char*>(&vec[0]), vec.size()*sizeof(T));
+    }
+  }
+
+  const vw::uint32 TiePointStore::NO_TRACK;
+
+  std::string tie_point_store_file(std::string const& out_prefix) {
+    return out_prefix + "-tie-points.bin";
+  }
+
+  std::string tie_point_manifest_file(std::string const& out_prefix) {
+    return out_prefix + "-tie-points.txt";
+  }
+
+  bool build_tie_point_store(std::string const& out_prefix,
+                             std::vector<std::string> const& image_files,
+                             std::map< std::pair<int, int>, std::string> const& match_files,
+                             int min_matches, bool incremental) {
+
+    std::string store_file    = tie_point_store_file(out_prefix);
+    std::string manifest_file = tie_point_manifest_file(out_prefix);
+
+    TiePointManifest manifest;
+    manifest.min_matches = min_matches;
+    manifest.image_files = image_files;
+    typedef std::map< std::pair<int, int>, std::string>::const_iterator match_type;
+    for (match_type it = match_files.begin(); it != match_files.end(); it++) {
+      manifest.pairs.push_back(it->first);
+      manifest.match_files.push_back(it->second);
+    }
+    manifest.match_signatures.resize(manifest.pairs.size());
+
+    TiePointManifest old_manifest;
+    bool old_exists = read_manifest(manifest_file, old_manifest);
+    bool have_old   = old_exists && is_current(old_manifest, store_file) &&
+      old_manifest.min_matches == min_matches;
+    if (have_old &&
+        old_manifest.image_files == manifest.image_files &&
+        old_manifest.pairs       == manifest.pairs       &&
+        old_manifest.match_files == manifest.match_files) {
+      vw_out() << "\t--> Using cached tie points: " << store_file << "\n";
+      return false;
+    }
+
+    // In incremental mode, the tie points made earlier are updated with
+    // the match files which are new since, rather than made from scratch.
+    TiePointStore old_store;
+    std::vector<uint32> image_map, pair_map;
+    std::vector<bool> read_pair(manifest.pairs.size(), true);
+    if (incremental && have_old &&
+        map_to_current(old_manifest, manifest, image_map, pair_map, read_pair) &&
+        old_store.read(out_prefix)) {
+      manifest.previous_signature = old_store.signature();
+      vw_out() << "Updating tie points: " << store_file << "\n";
+    } else {
+      if (incremental && old_exists)
+        vw_out() << "The tie points cannot be updated, as some match files changed or "
+                 << "are no longer used. Making them from scratch.\n";
+      for (size_t pair = 0; pair < manifest.pairs.size(); pair++)
+        manifest.match_signatures[pair] = "";
+      read_pair.assign(manifest.pairs.size(), true);
+    }
+
+    // The earlier tie points come first, with the images and pairs they
+    // are in now. Each match is two raw observations. The tracks are
+    // made again from the matches.
+    const uint32 NONE = TiePointStore::NO_TRACK;
+    std::vector<RawObservation> raw;
+    std::vector<uint32> raw_matches; // The two observations of each match
+    std::vector<uint32> raw_pairs;   // The pair of each match
+    std::vector<uint32> old_track_sizes(old_store.num_tracks());
+    for (size_t i = 0; i < old_store.num_observations(); i++) {
+      TiePointStore::Observation const& obs = old_store.observation(i);
+      RawObservation r = {image_map[obs.image], obs.x, obs.y, obs.sigma, obs.track};
+      raw.push_back(r);
+      old_track_sizes[obs.track]++;
+    }
+    for (size_t m = 0; m < old_store.num_matches(); m++) {
+      TiePointStore::Match const& match = old_store.match(m);
+      raw_matches.push_back(match.left);
+      raw_matches.push_back(match.right);
+      raw_pairs.push_back(pair_map[match.pair]);
+    }
+    old_store = TiePointStore(); // The file will be replaced
+
+    // Read the match files one at a time, keeping only the pixels
+    size_t num_read = 0;
+    for (size_t pair = 0; pair < manifest.pairs.size(); pair++) {
+
+      if (!read_pair[pair])
+        continue;
+
+      std::string const& match_file = manifest.match_files[pair];
+      manifest.match_signatures[pair] = file_signature(match_file);
+      if (manifest.match_signatures[pair].empty()) {
+        vw_out() << "Skipping non-existant match file: " << match_file << std::endl;
+        continue;
+      }
+
+      std::vector<ip::InterestPoint> ip1, ip2;
+      ip::read_binary_match_file(match_file, ip1, ip2);
+      if (int(ip1.size()) < min_matches) {
+        vw_out() << "Skipping " << match_file << " with " << ip1.size()
+                 << " matches, fewer than " << min_matches << ".\n";
+        continue;
+      }
+
+      for (size_t i = 0; i < ip1.size(); i++) {
+        RawObservation left  = {uint32(manifest.pairs[pair].first),  ip1[i].x, ip1[i].y,
+                                ip1[i].scale, NONE};
+        RawObservation right = {uint32(manifest.pairs[pair].second), ip2[i].x, ip2[i].y,
+                                ip2[i].scale, NONE};
+        raw_matches.push_back(raw.size());
+        raw.push_back(left);
+        raw_matches.push_back(raw.size());
+        raw.push_back(right);
+        raw_pairs.push_back(pair);
+      }
+      num_read++;
+    }
+    vw_out() << "Read " << num_read << " match files.\n";
+
+    // The same feature shows up in the match file of every pair its
+    // image is in. Give each feature an index. A feature of the earlier
+    // tie points keeps its track.
+    std::vector<uint32> order(raw.size());
+    for (size_t i = 0; i < raw.size(); i++)
+      order[i] = i;
+    std::sort(order.begin(), order.end(), RawIndexLess(raw));
+    std::vector<uint32> raw_feature(raw.size());
+    std::vector<uint32> feature_raw;       // A raw observation of each feature
+    std::vector<uint32> feature_old_track; // Its earlier track, if any
+    for (size_t i = 0; i < order.size(); i++) {
+      if (i == 0 || !same_feature(raw[order[i - 1]], raw[order[i]])) {
+        feature_raw.push_back(order[i]);
+        feature_old_track.push_back(NONE);
+      }
+      raw_feature[order[i]] = feature_raw.size() - 1;
+      if (raw[order[i]].old_track != NONE)
+        feature_old_track.back() = raw[order[i]].old_track;
+    }
+    std::vector<uint32>().swap(order);
+
+    // Join the matched features into tracks
+    size_t num_features = feature_raw.size();
+    std::vector<uint32> parent(num_features);
+    for (size_t i = 0; i < num_features; i++)
+      parent[i] = i;
+    for (size_t m = 0; m < raw_pairs.size(); m++)
+      join(parent, raw_feature[raw_matches[2*m]], raw_feature[raw_matches[2*m + 1]]);
+
+    // The features of each track are consecutive in the features sorted
+    // by root, and within a track they are sorted by image.
+    std::vector< std::pair<uint32, uint32> > by_track(num_features);
+    for (size_t i = 0; i < num_features; i++)
+      by_track[i] = std::make_pair(find_root(parent, i), uint32(i));
+    std::sort(by_track.begin(), by_track.end());
+    std::vector<uint32>().swap(parent);
+
+    std::vector<uint32> feature_obs(num_features, NONE);
+    std::vector<uint64> track_offsets(1, 0);
+    std::vector<uint32> previous_tracks;
+    std::vector<TiePointStore::Observation> observations;
+    size_t num_conflicts = 0, num_unchanged = 0;
+    size_t beg = 0;
+    while (beg < by_track.size()) {
+      size_t end = beg + 1;
+      while (end < by_track.size() && by_track[end].first == by_track[beg].first)
+        end++;
+
+      bool conflict = false;
+      for (size_t i = beg + 1; i < end; i++) {
+        if (raw[feature_raw[by_track[i].second]].image ==
+            raw[feature_raw[by_track[i - 1].second]].image)
+          conflict = true;
+      }
+      if (conflict) {
+        num_conflicts++;
+        beg = end;
+        continue;
+      }
+
+      // A track is the same as before if it has all the features of an
+      // earlier track and no others.
+      uint32 old_track = feature_old_track[by_track[beg].second];
+      for (size_t i = beg; i < end; i++) {
+        if (feature_old_track[by_track[i].second] != old_track)
+          old_track = NONE;
+      }
+      if (old_track != NONE && old_track_sizes[old_track] != end - beg)
+        old_track = NONE;
+      if (old_track != NONE)
+        num_unchanged++;
+      previous_tracks.push_back(old_track);
+
+      for (size_t i = beg; i < end; i++) {
+        RawObservation const& r = raw[feature_raw[by_track[i].second]];
+        TiePointStore::Observation obs = {uint32(track_offsets.size() - 1), r.image,
+                                          r.x, r.y, r.sigma};
+        feature_obs[by_track[i].second] = observations.size();
+        observations.push_back(obs);
+      }
+      track_offsets.push_back(observations.size());
+      beg = end;
+    }
+    if (num_conflicts > 0)
+      vw_out() << "Discarded " << num_conflicts
+               << " tracks seen more than once in the same image.\n";
+
+    // The matches, in the order of the pairs
+    std::vector<TiePointStore::Match> matches;
+    for (size_t m = 0; m < raw_pairs.size(); m++) {
+      TiePointStore::Match match = {raw_pairs[m],
+                                    feature_obs[raw_feature[raw_matches[2*m]]],
+                                    feature_obs[raw_feature[raw_matches[2*m + 1]]]};
+      if (match.left != NONE && match.right != NONE)
+        matches.push_back(match);
+    }
+    std::sort(matches.begin(), matches.end(), match_less);
+    matches.erase(std::unique(matches.begin(), matches.end(), match_equal), matches.end());
+
+    StoreHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+    header.num_images       = image_files.size();
+    header.num_tracks       = track_offsets.size() - 1;
+    header.num_observations = observations.size();
+    header.num_matches      = matches.size();
+    header.content_hash     = 14695981039346656037ULL;
+    header.content_hash     = hash_array(track_offsets,   header.content_hash);
+    header.content_hash     = hash_array(observations,    header.content_hash);
+    header.content_hash     = hash_array(matches,         header.content_hash);
+    header.content_hash     = hash_array(previous_tracks, header.content_hash);
+
+    vw_out() << "Writing: " << store_file << "\n";
+    std::string tmp_file = store_file + ".tmp";
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw_throw( IOErr() << "Cannot open for writing: " << tmp_file << "\n" );
+      ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      write_array(ofs, track_offsets);
+      write_array(ofs, observations);
+      write_array(ofs, matches);
+      write_array(ofs, previous_tracks);
+      if (!ofs.good())
+        vw_throw( IOErr() << "Failed writing: " << tmp_file << "\n" );
+    }
+    boost::filesystem::rename(tmp_file, store_file);
+
+    manifest.store_signature = file_signature(store_file);
+    write_manifest(manifest_file, manifest);
+    vw_out() << "Found " << header.num_tracks << " tracks with "
+             << header.num_observations << " observations.\n";
+    if (!manifest.previous_signature.empty())
+      vw_out() << "Of these, " << num_unchanged << " tracks did not change.\n";
+
+    return true;
+  }
+
+  bool TiePointStore::read(std::string const& out_prefix) {
+
+    *this = TiePointStore();
+
+    std::string store_file = tie_point_store_file(out_prefix);
+    TiePointManifest manifest;
+    if (!read_manifest(tie_point_manifest_file(out_prefix), manifest) ||
+        !is_current(manifest, store_file))
+      return false;
+
+    boost::iostreams::mapped_file_source file(store_file);
+    if (file.size() < sizeof(StoreHeader))
+      return false;
+    StoreHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::strncmp(header.magic, STORE_MAGIC, sizeof(header.magic)) != 0 ||
+        file.size() != store_size(header) ||
+        header.num_images != manifest.image_files.size())
+      return false;
+
+    const char* data = file.data() + sizeof(StoreHeader);
+    m_track_offsets   = reinterpret_cast<uint64      const*>(data);
+    data += (header.num_tracks + 1)*sizeof(uint64);
+    m_observations    = reinterpret_cast<Observation const*>(data);
+    data += header.num_observations*sizeof(Observation);
+    m_matches         = reinterpret_cast<Match       const*>(data);
+    data += header.num_matches*sizeof(Match);
+    m_previous_tracks = reinterpret_cast<uint32      const*>(data);
+
+    m_file               = file;
+    m_image_files        = manifest.image_files;
+    m_pairs              = manifest.pairs;
+    m_match_files        = manifest.match_files;
+    std::ostringstream os;
+    os << std::hex << header.content_hash;
+    m_signature          = os.str();
+    m_previous_signature = manifest.previous_signature;
+    m_num_images         = header.num_images;
+    m_num_tracks         = header.num_tracks;
+    m_num_observations   = header.num_observations;
+    m_num_matches        = header.num_matches;
+    return true;
+  }
+
+  std::string track_positions_file(std::string const& out_prefix) {
+    return out_prefix + "-track-positions.bin";
+  }
+
+  void write_track_positions(std::string const& out_prefix, TiePointStore const& tie_points,
+                             std::vector<vw::Vector3> const& positions) {
+
+    if (positions.size() != tie_points.num_tracks())
+      vw_throw( ArgumentErr() << "Expecting a position for each of the "
+                << tie_points.num_tracks() << " tracks.\n" );
+
+    std::string positions_file = track_positions_file(out_prefix);
+    std::string tmp_file = positions_file + ".tmp";
+    {
+      std::ofstream ofs(tmp_file.c_str(), std::ios::binary);
+      if (!ofs.good())
+        vw_throw( IOErr() << "Cannot open for writing: " << tmp_file << "\n" );
+      ofs << POSITIONS_MAGIC << "\n" << tie_points.signature() << "\n"
+          << positions.size() << "\n";
+      for (size_t i = 0; i < positions.size(); i++)
+        ofs.write(reinterpret_cast<const char*>(&positions[i][0]), 3*sizeof(double));
+      if (!ofs.good())
+        vw_throw( IOErr() << "Failed writing: " << tmp_file << "\n" );
+    }
+    boost::filesystem::rename(tmp_file, positions_file);
+  }
+
+  size_t read_track_positions(std::string const& out_prefix, TiePointStore const& tie_points,
+                              std::vector<vw::Vector3> & positions) {
+
+    positions.assign(tie_points.num_tracks(), Vector3());
+
+    std::ifstream ifs(track_positions_file(out_prefix).c_str(), std::ios::binary);
+    std::string line, signature;
+    if (!std::getline(ifs, line) || line != POSITIONS_MAGIC ||
+        !std::getline(ifs, signature) || signature.empty() ||
+        !std::getline(ifs, line))
+      return 0;
+    std::istringstream is(line);
+    size_t num_positions = 0;
+    if (!(is >> num_positions))
+      return 0;
+
+    // The positions may be for these tracks, or for the ones these were
+    // updated from.
+    bool same_tracks = (signature == tie_points.signature());
+    if (!same_tracks && signature != tie_points.previous_signature())
+      return 0;
+    if (same_tracks && num_positions != tie_points.num_tracks())
+      return 0;
+
+    std::vector<double> values(3*num_positions);
+    if (!values.empty() &&
+        !ifs.read(reinterpret_cast<char*>(&values[0]), values.size()*sizeof(double)))
+      return 0;
+
+    size_t num_found = 0;
+    for (size_t track = 0; track < positions.size(); track++) {
+      size_t index = track;
+      if (!same_tracks) {
+        uint32 previous = tie_points.previous_track(track);
+        if (previous == TiePointStore::NO_TRACK || previous >= num_positions)
+          continue;
+        index = previous;
+      }
+      positions[track] = Vector3(values[3*index], values[3*index + 1], values[3*index + 2]);
+      if (positions[track] != Vector3())
+        num_found++;
+    }
+    return num_found;
+  }
+
+  bool build_control_network(TiePointStore const& tie_points,
+                             vw::ba::ControlNetwork & cnet,
+                             std::vector< boost::shared_ptr<vw::camera::CameraModel> >
+                             const& camera_models,
+                             double min_angle_radians, double forced_triangulation_distance,
+                             std::vector<vw::Vector3> const* positions) {
+
+    if (tie_points.num_images() != camera_models.size())
+      vw_throw( ArgumentErr() << "The tie points are for " << tie_points.num_images()
+                << " images, but there are " << camera_models.size() << " cameras.\n" );
+    if (positions != NULL && positions->size() != tie_points.num_tracks())
+      vw_throw( ArgumentErr() << "Expecting a position for each of the "
+                << tie_points.num_tracks() << " tracks.\n" );
+
+    size_t num_tracks = tie_points.num_tracks();
+    if (num_tracks == 0)
+      return false;
+
+    TerminalProgressCallback progress("ba", "Triangulating: ");
+    progress.report_progress(0);
+    double inc_amount = 1.0/num_tracks;
+    size_t num_failed = 0, num_reused = 0;
+    std::vector<bool> is_affected(camera_models.size(), false);
+    for (size_t track = 0; track < num_tracks; track++) {
+      progress.report_incremental_progress(inc_amount);
+
+      ba::ControlPoint cpoint(ba::ControlPoint::TiePoint);
+      for (TiePointStore::Observation const* obs = tie_points.track_begin(track);
+           obs != tie_points.track_end(track); obs++)
+        cpoint.add_measure(ba::ControlMeasure(obs->x, obs->y, obs->sigma, obs->sigma,
+                                              obs->image));
+
+      // Only tracks which are new or changed are triangulated
+      if (positions != NULL && (*positions)[track] != Vector3()) {
+        cpoint.set_position((*positions)[track]);
+        num_reused++;
+      } else {
+        if (ba::triangulate_control_point(cpoint, camera_models, min_angle_radians,
+                                          forced_triangulation_distance) < 0)
+          num_failed++;
+        for (TiePointStore::Observation const* obs = tie_points.track_begin(track);
+             obs != tie_points.track_end(track); obs++)
+          is_affected[obs->image] = true;
+      }
+      cnet.add_control_point(cpoint);
+    }
+    progress.report_finished();
+
+    if (positions != NULL) {
+      vw_out() << "Reused the positions of " << num_reused << " of " << num_tracks
+               << " tie points. The rest are seen in "
+               << std::count(is_affected.begin(), is_affected.end(), true)
+               << " of " << camera_models.size() << " images.\n";
+    }
+    if (num_failed > 0)
+      vw_out() << "Failed to triangulate " << num_failed << " of " << num_tracks
+               << " tie points.\n";
+    return true;
+  }
+
+} // namespace asp
@@ -0,0 +1,191 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TiePointStore.h
+///
+/// The tie points of a bundle adjustment, made from the match files of
+/// all image pairs, and kept in a compact form: for each observation
+/// only the image, the pixel, its sigma, and the track it belongs to,
+/// where a track is the set of observations of the same ground point
+/// in several images. The matches themselves are kept as pairs of
+/// observation indices, so that clean match files can be written
+/// without reading the match files again.
+///
+/// The store is saved as run/run-tie-points.bin, next to a manifest
+/// recording the signatures of the match files it was made from. It is
+/// made once, and memory-mapped on later runs for as long as the match
+/// files do not change. In incremental mode, when only new match files
+/// were added, such as for new images, these are merged into the
+/// existing tracks rather than reading all match files again. Each
+/// track records whether it is the same as before, so that the
+/// positions of the tracks saved by a previous run can be reused, and
+/// only new or changed tracks need to be triangulated.
+
+#ifndef __ASP_CORE_TIE_POINT_STORE_H__
+#define __ASP_CORE_TIE_POINT_STORE_H__
+
+#include <vw/Core/FundamentalTypes.h>
+#include <vw/Math/Vector.h>
+
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/smart_ptr/shared_ptr.hpp>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vw {
+  namespace camera {
+    class CameraModel;
+  }
+  namespace ba {
+    class ControlNetwork;
+  }
+}
+
+namespace asp {
+
+  /// The file having the tie points for the given output prefix, such
+  /// as run/run-tie-points.bin.
+  std::string tie_point_store_file(std::string const& out_prefix);
+
+  /// The file recording which match files the tie points were made
+  /// from, such as run/run-tie-points.txt.
+  std::string tie_point_manifest_file(std::string const& out_prefix);
+
+  /// Make the tie points from the match file of each pair of images,
+  /// unless the ones on disk were made from the same match files.
+  /// Match files which do not exist or have fewer than min_matches
+  /// matches are skipped. Matches are joined into tracks, and tracks
+  /// seen more than once in the same image are discarded, as they join
+  /// different features. Only one match file is read at a time. If
+  /// incremental is true, and the match files the tie points on disk
+  /// were made from did not change, only the new match files are read
+  /// and merged with these. Return true if the tie points were made.
+  bool build_tie_point_store(std::string const& out_prefix,
+                             std::vector<std::string> const& image_files,
+                             std::map< std::pair<int, int>, std::string> const& match_files,
+                             int min_matches, bool incremental = false);
+
+  /// Look up the tie points made with build_tie_point_store().
+  class TiePointStore {
+  public:
+
+    struct Observation {
+      vw::uint32 track, image;
+      float      x, y, sigma;
+    };
+
+    /// A match between two observations, listed in the match file of the
+    /// given pair. The left observation is in the first image of the pair.
+    struct Match {
+      vw::uint32 pair, left, right;
+    };
+
+    /// The previous index of a track which is new or changed
+    static const vw::uint32 NO_TRACK = vw::uint32(-1);
+
+    TiePointStore(): m_num_images(0), m_num_tracks(0), m_num_observations(0),
+                     m_num_matches(0), m_track_offsets(NULL), m_observations(NULL),
+                     m_matches(NULL), m_previous_tracks(NULL) {}
+
+    /// Map the tie points for the given output prefix. Return false if
+    /// they do not exist, or if any match file changed since they were
+    /// made.
+    bool read(std::string const& out_prefix);
+
+    size_t num_images      () const { return m_num_images;       }
+    std::string const& image_file(size_t image) const { return m_image_files[image]; }
+    size_t num_tracks      () const { return m_num_tracks;       }
+    size_t num_observations() const { return m_num_observations; }
+    size_t num_matches     () const { return m_num_matches;      }
+
+    /// The pairs are in the order of the match files given to
+    /// build_tie_point_store(), including the ones which were skipped.
+    size_t num_pairs() const { return m_pairs.size(); }
+    std::pair<int, int> const& pair_images(size_t pair) const { return m_pairs[pair];       }
+    std::string         const& match_file (size_t pair) const { return m_match_files[pair]; }
+
+    /// The observations of a track, sorted by image
+    Observation const* track_begin(size_t track) const {
+      return m_observations + m_track_offsets[track];
+    }
+    Observation const* track_end(size_t track) const {
+      return m_observations + m_track_offsets[track + 1];
+    }
+
+    Observation const& observation(size_t i) const { return m_observations[i]; }
+
+    /// The matches, sorted by pair
+    Match const& match(size_t i) const { return m_matches[i]; }
+
+    /// The signature of the tie points, a hash of their contents,
+    /// which identifies the tracks the saved track positions are for
+    std::string const& signature() const { return m_signature; }
+
+    /// The signature of the tie points these were updated from in
+    /// incremental mode, and the index a track had in them if it did not
+    /// change, or NO_TRACK. Empty if these were made from scratch.
+    std::string const& previous_signature() const { return m_previous_signature; }
+    vw::uint32 previous_track(size_t track) const { return m_previous_tracks[track]; }
+
+  private:
+    boost::iostreams::mapped_file_source m_file;
+    std::vector<std::string>             m_image_files;
+    std::vector< std::pair<int, int> >   m_pairs;
+    std::vector<std::string>             m_match_files;
+    std::string                          m_signature, m_previous_signature;
+    size_t             m_num_images, m_num_tracks, m_num_observations, m_num_matches;
+    vw::uint64  const* m_track_offsets;
+    Observation const* m_observations;
+    Match       const* m_matches;
+    vw::uint32  const* m_previous_tracks;
+  };
+
+  /// The file having the position of each track, saved at the end of a
+  /// run, such as run/run-track-positions.bin.
+  std::string track_positions_file(std::string const& out_prefix);
+
+  /// Save the position of each track. A zero position, such as for an
+  /// outlier, means the track is to be triangulated again.
+  void write_track_positions(std::string const& out_prefix, TiePointStore const& tie_points,
+                             std::vector<vw::Vector3> const& positions);
+
+  /// Read the positions saved with write_track_positions(), for these
+  /// tie points or the ones they were updated from. Tracks which are new
+  /// or changed since get a zero position. Return the number of tracks
+  /// with a position.
+  size_t read_track_positions(std::string const& out_prefix, TiePointStore const& tie_points,
+                              std::vector<vw::Vector3> & positions);
+
+  /// Make a control network having a tie point for each track, with the
+  /// same index as the track, triangulated with the given cameras,
+  /// unless a nonzero position for the track is given. Ground control
+  /// points, if any, should be added after these. Return false if there
+  /// are no tracks.
+  bool build_control_network(TiePointStore const& tie_points,
+                             vw::ba::ControlNetwork & cnet,
+                             std::vector< boost::shared_ptr<vw::camera::CameraModel> >
+                             const& camera_models,
+                             double min_angle_radians, double forced_triangulation_distance,
+                             std::vector<vw::Vector3> const* positions = NULL);
+
+} // namespace asp
+
+#endif // __ASP_CORE_TIE_POINT_STORE_H__
@@ -0,0 +1,109 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <test/Helpers.h>
+#include <asp/Core/CorrMemory.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( CorrMemory, SgmMemoryMb ) {
+
+  Vector2i buffer(4, 4);
+  BBox2i small_range(0, 0, 64, 8), large_range(-200, -20, 800, 40);
+
+  // More memory for a bigger tile or a bigger search range
+  double base = sgm_memory_mb(Vector2i(1024, 1024), small_range, buffer, 5);
+  EXPECT_GT(base, 0.0);
+  EXPECT_LT(base, sgm_memory_mb(Vector2i(2048, 2048), small_range, buffer, 5));
+  EXPECT_LT(base, sgm_memory_mb(Vector2i(1024, 1024), large_range, buffer, 5));
+
+  // With no pyramid, the full range is searched at every pixel
+  double full = sgm_memory_mb(Vector2i(1024, 1024), large_range, buffer, 0);
+  EXPECT_GT(full, 3.0*1024*1024*800*40/(1024.0*1024.0));
+
+  EXPECT_EQ(0.0, sgm_memory_mb(Vector2i(0, 0), large_range, buffer, 5));
+}
+
+TEST( CorrMemory, SearchRange ) {
+
+  // The left half of the low-res disparity is 0, the right half is 20
+  ImageView<PixelMask<Vector2f> > sub_disp(10, 10);
+  for (int row = 0; row < sub_disp.rows(); row++)
+    for (int col = 0; col < sub_disp.cols(); col++)
+      sub_disp(col, row) = PixelMask<Vector2f>(Vector2f(col < 5 ? 0 : 20, 0));
+  ImageView<PixelMask<Vector2i> > no_spread;
+
+  SgmMemoryModel model(sub_disp, no_spread, Vector2(4, 4), Vector2i(4, 4), 5, BBox2i());
+  EXPECT_EQ(BBox2i(-4, -4, 8, 8),  model.search_range(BBox2i(0, 0, 16, 16)));
+  EXPECT_EQ(BBox2i(76, -4, 8, 8),  model.search_range(BBox2i(24, 0, 16, 16)));
+  EXPECT_EQ(BBox2i(-4, -4, 88, 8), model.search_range(BBox2i(0, 0, 40, 40)));
+
+  // The spread widens the range
+  ImageView<PixelMask<Vector2i> > spread(10, 10);
+  fill(spread, PixelMask<Vector2i>(Vector2i(1, 2)));
+  SgmMemoryModel spread_model(sub_disp, spread, Vector2(4, 4), Vector2i(4, 4), 5, BBox2i());
+  EXPECT_EQ(BBox2i(-8, -12, 16, 24), spread_model.search_range(BBox2i(0, 0, 16, 16)));
+
+  // The user's limit is applied
+  SgmMemoryModel limit_model(sub_disp, no_spread, Vector2(4, 4), Vector2i(4, 4), 5,
+                             BBox2i(0, -2, 80, 4));
+  EXPECT_EQ(BBox2i(0, -2, 80, 4), limit_model.search_range(BBox2i(0, 0, 40, 40)));
+
+  // No valid disparities
+  ImageView<PixelMask<Vector2f> > invalid_disp(10, 10);
+  SgmMemoryModel invalid_model(invalid_disp, no_spread, Vector2(4, 4), Vector2i(4, 4), 5,
+                               BBox2i());
+  EXPECT_TRUE(invalid_model.search_range(BBox2i(0, 0, 16, 16)).empty());
+
+  // Mismatched spread
+  ImageView<PixelMask<Vector2i> > bad_spread(5, 5);
+  EXPECT_THROW(SgmMemoryModel(sub_disp, bad_spread, Vector2(4, 4), Vector2i(4, 4), 5, BBox2i()),
+               ArgumentErr);
+}
+
+TEST( CorrMemory, TileSizeForMemory ) {
+
+  // A disparity which grows across the image, so bigger tiles have
+  // bigger search ranges.
+  ImageView<PixelMask<Vector2f> > sub_disp(200, 200);
+  for (int row = 0; row < sub_disp.rows(); row++)
+    for (int col = 0; col < sub_disp.cols(); col++)
+      sub_disp(col, row) = PixelMask<Vector2f>(Vector2f(col, row/10));
+  ImageView<PixelMask<Vector2i> > no_spread;
+  SgmMemoryModel model(sub_disp, no_spread, Vector2(16, 16), Vector2i(4, 4), 5, BBox2i());
+
+  BBox2i region(0, 0, 3200, 3200);
+  int collar = 64;
+  double limit = 0.5*(model.max_tile_memory_mb(region, 512,  collar) +
+                      model.max_tile_memory_mb(region, 1024, collar));
+
+  int tile_size = model.tile_size_for_memory(region, collar, limit, 256, 4096);
+  EXPECT_EQ(0, tile_size % 16);
+  EXPECT_GE(tile_size, 512);
+  EXPECT_LT(tile_size, 1024);
+  EXPECT_LE(model.max_tile_memory_mb(region, tile_size, collar), limit);
+  EXPECT_GT(model.max_tile_memory_mb(region, tile_size + 16, collar), limit);
+
+  // A generous limit gives the biggest tile, a tiny one the smallest
+  EXPECT_EQ(4096, model.tile_size_for_memory(region, collar, 1.0e+9, 256, 4096));
+  EXPECT_EQ(256,  model.tile_size_for_memory(region, collar, 1.0e-3, 256, 4096));
+
+  EXPECT_THROW(model.tile_size_for_memory(region, collar, limit, 512, 256), ArgumentErr);
+}
@@ -0,0 +1,156 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Stereo/CorrelationView.h>
+#include <asp/Core/CorrSubTiles.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // The same narrow search range everywhere, except that parts
+  // touching the given column have no seed.
+  struct FixedSeed {
+    BBox2f range;
+    int    no_seed_col;
+    FixedSeed(BBox2f const& r, int c = -1): range(r), no_seed_col(c) {}
+    bool has_seed(BBox2i const& bbox) const {
+      return !(no_seed_col >= bbox.min().x() && no_seed_col < bbox.max().x());
+    }
+    BBox2f search_range(BBox2i const&) const { return range; }
+  };
+
+  // Deterministic texture, with no repeating pattern
+  float texture(int col, int row) {
+    unsigned int h = 73856093u*unsigned(col + 100) ^ 19349663u*unsigned(row + 100);
+    h ^= h >> 13; h *= 0x5bd1e995u; h ^= h >> 15;
+    return float(h % 1000)/1000.0f;
+  }
+
+  typedef ImageView<PixelMask<Vector2f> > DispImage;
+
+  DispImage correlate(ImageView<PixelGray<float> > const& left,
+                      ImageView<PixelGray<float> > const& right,
+                      ImageView<uint8> const& mask,
+                      BBox2i const& bbox, BBox2f const& search_range) {
+    typedef stereo::PyramidCorrelationView<ImageView<PixelGray<float> >,
+                                           ImageView<PixelGray<float> >,
+                                           ImageView<uint8>, ImageView<uint8> > CorrView;
+    CorrView corr_view(left, right, mask, mask,
+                       stereo::PREFILTER_LOG, 1.4, search_range,
+                       Vector2i(21, 21), stereo::ABSOLUTE_DIFFERENCE,
+                       0, 0.0,  // no timeout
+                       2, 0,    // L-R consistency threshold, min level
+                       5, 5,    // filter half kernel, max pyramid levels
+                       stereo::VW_CORRELATION_BM, 0,
+                       stereo::SemiGlobalMatcher::SUBPIXEL_NONE, Vector2i(4, 4),
+                       4*1024, 0, false);
+    DispImage disp = crop(corr_view.prerasterize(bbox), bbox);
+    return disp;
+  }
+}
+
+TEST( CorrSubTiles, Split ) {
+
+  BBox2i tile(0, 0, 256, 256);
+  BBox2f tile_range(-16, -4, 40, 8);
+  std::vector< std::pair<BBox2i, BBox2f> > sub_tiles;
+
+  // A narrow range everywhere splits the tile once. Splitting the
+  // quadrants again would not reduce the work.
+  split_by_search_range(tile, tile_range, 64, FixedSeed(BBox2f(0, -2, 6, 4)), sub_tiles);
+  ASSERT_EQ(4u, sub_tiles.size());
+  double work = 0;
+  for (size_t i = 0; i < sub_tiles.size(); i++) {
+    EXPECT_EQ(BBox2f(0, -2, 6, 4), sub_tiles[i].second);
+    EXPECT_EQ(128, sub_tiles[i].first.width());
+    EXPECT_EQ(128, sub_tiles[i].first.height());
+    EXPECT_TRUE(tile.contains(sub_tiles[i].first));
+    work += correlation_work(sub_tiles[i].first, sub_tiles[i].second);
+  }
+  EXPECT_LT(work, 0.75*correlation_work(tile, tile_range));
+
+  // Nothing to gain with the same range
+  sub_tiles.clear();
+  split_by_search_range(tile, tile_range, 64, FixedSeed(tile_range), sub_tiles);
+  ASSERT_EQ(1u, sub_tiles.size());
+  EXPECT_EQ(tile, sub_tiles[0].first);
+
+  // Too small to split
+  sub_tiles.clear();
+  split_by_search_range(tile, tile_range, 200, FixedSeed(BBox2f(0, -2, 6, 4)), sub_tiles);
+  ASSERT_EQ(1u, sub_tiles.size());
+
+  // A part with no seed keeps the tile whole
+  sub_tiles.clear();
+  split_by_search_range(tile, tile_range, 64, FixedSeed(BBox2f(0, -2, 6, 4), 10), sub_tiles);
+  ASSERT_EQ(1u, sub_tiles.size());
+  EXPECT_EQ(tile_range, sub_tiles[0].second);
+}
+
+TEST( CorrSubTiles, MatchesFullTile ) {
+
+  // The right image is the left one shifted by 3 pixels
+  const int size = 256, shift = 3;
+  ImageView<PixelGray<float> > left(size, size), right(size, size);
+  ImageView<uint8> mask(size, size);
+  for (int row = 0; row < size; row++) {
+    for (int col = 0; col < size; col++) {
+      left (col, row) = texture(col, row);
+      right(col, row) = texture(col - shift, row);
+      mask (col, row) = 255;
+    }
+  }
+
+  BBox2i tile(0, 0, size, size);
+  BBox2f tile_range(-16, -4, 40, 8);
+  DispImage full = correlate(left, right, mask, tile, tile_range);
+
+  std::vector< std::pair<BBox2i, BBox2f> > sub_tiles;
+  split_by_search_range(tile, tile_range, 64, FixedSeed(BBox2f(0, -2, 6, 4)), sub_tiles);
+  ASSERT_EQ(4u, sub_tiles.size());
+
+  DispImage parts(size, size);
+  for (size_t i = 0; i < sub_tiles.size(); i++) {
+    BBox2i const& sub_bbox = sub_tiles[i].first;
+    crop(parts, sub_bbox) = correlate(left, right, mask, sub_bbox, sub_tiles[i].second);
+  }
+
+  // Where both are valid they agree, and the parts find about as
+  // many disparities as the whole tile.
+  int num_full = 0, num_parts = 0, num_diff = 0;
+  for (int row = 0; row < size; row++) {
+    for (int col = 0; col < size; col++) {
+      if (is_valid(full(col, row)))
+        num_full++;
+      if (is_valid(parts(col, row)))
+        num_parts++;
+      if (is_valid(full(col, row)) && is_valid(parts(col, row)) &&
+          full(col, row).child() != parts(col, row).child())
+        num_diff++;
+    }
+  }
+  EXPECT_GT(num_full, 0.9*size*size);
+  EXPECT_GT(num_parts, 0.98*num_full);
+  EXPECT_EQ(0, num_diff);
+}
@@ -0,0 +1,178 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <test/Helpers.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <asp/Core/DemMosaic.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+TEST( DemMosaic, DiskImageCache ) {
+
+  // Three small images, each with its own value
+  UnlinkName name0("dem_cache0.tif"), name1("dem_cache1.tif"), name2("dem_cache2.tif");
+  std::vector<std::string> files;
+  files.push_back(name0);
+  files.push_back(name1);
+  files.push_back(name2);
+  for (size_t i = 0; i < files.size(); i++) {
+    ImageView<float> img(5, 4);
+    fill(img, float(i + 1));
+    write_image(files[i], img);
+  }
+
+  // At most two files are kept open
+  DiskImageCache<float> cache(files, 2);
+  EXPECT_EQ(3u, cache.size());
+  EXPECT_EQ(files[1], cache.file_name(1));
+
+  DiskImageCache<float>::HandleType h0 = cache.get(0);
+  EXPECT_EQ(1.0, (*h0)(2, 3));
+  EXPECT_EQ(5, h0->cols());
+  EXPECT_EQ(4, h0->rows());
+  cache.get(1);
+  cache.get(0);
+  EXPECT_EQ(2u, cache.num_opened()); // the second get(0) is a hit
+
+  // Opening the third file closes the least recently used one, which
+  // is the second.
+  EXPECT_EQ(3.0, (*cache.get(2))(0, 0));
+  cache.get(0);
+  EXPECT_EQ(3u, cache.num_opened());
+  EXPECT_EQ(2.0, (*cache.get(1))(4, 3));
+  EXPECT_EQ(4u, cache.num_opened());
+
+  // A handle still held stays valid after it is evicted
+  cache.clear();
+  EXPECT_EQ(1.0, (*h0)(0, 0));
+}
+
+TEST( DemMosaic, HilbertTileOrder ) {
+
+  // On a square grid of a power of 2 size consecutive tiles are neighbors
+  int n = 8;
+  std::vector<int> tile_ids;
+  for (int i = 0; i < n*n; i++)
+    tile_ids.push_back(i);
+  hilbert_tile_order(n, n, tile_ids);
+  ASSERT_EQ(size_t(n*n), tile_ids.size());
+  EXPECT_EQ(0, tile_ids[0]);
+  for (size_t i = 1; i < tile_ids.size(); i++) {
+    int dx = tile_ids[i] % n - tile_ids[i-1] % n;
+    int dy = tile_ids[i] / n - tile_ids[i-1] / n;
+    EXPECT_EQ(1, std::abs(dx) + std::abs(dy));
+  }
+
+  // Any subset of a grid of any size is permuted
+  int nx = 7, ny = 3;
+  std::vector<int> subset, expected;
+  for (int i = 2; i < nx*ny; i += 3)
+    subset.push_back(i);
+  expected = subset;
+  hilbert_tile_order(nx, ny, subset);
+  EXPECT_FALSE(expected == subset);
+  std::sort(subset.begin(), subset.end());
+  EXPECT_EQ(expected, subset);
+
+  std::vector<int> bad(1, nx*ny);
+  EXPECT_THROW(hilbert_tile_order(nx, ny, bad), ArgumentErr);
+}
+
+TEST( DemMosaic, TileManifest ) {
+
+  UnlinkName dem("manifest_dem.tif"), tile("manifest_tile.tif"), manifest("manifest.txt");
+  ImageView<float> img(3, 3);
+  fill(img, 1.0);
+  write_image(dem, img);
+  write_image(tile, img);
+
+  EXPECT_EQ("", file_signature("no_such_file.tif"));
+  std::vector<std::string> dems(1, file_signature(dem));
+  EXPECT_NE("", dems[0]);
+
+  std::string key = "some settings";
+  EXPECT_FALSE(tile_manifest_is_current(manifest, key, tile, dems));
+  write_tile_manifest(manifest, key, tile, dems);
+  EXPECT_TRUE (tile_manifest_is_current(manifest, key, tile, dems));
+  EXPECT_FALSE(tile_manifest_is_current(manifest, "other settings", tile, dems));
+
+  // A new DEM
+  std::vector<std::string> more_dems = dems;
+  more_dems.push_back("10 20 new_dem.tif");
+  EXPECT_FALSE(tile_manifest_is_current(manifest, key, tile, more_dems));
+
+  // The tile was removed
+  std::remove(tile.c_str());
+  EXPECT_FALSE(tile_manifest_is_current(manifest, key, tile, dems));
+
+  // A tile which had no valid pixels and was never saved
+  write_tile_manifest(manifest, key, tile, dems);
+  EXPECT_TRUE(tile_manifest_is_current(manifest, key, tile, dems));
+}
+
+TEST( DemMosaic, PixelValueStack ) {
+
+  // A tiny memory limit, so that most values end up in the temporary file
+  UnlinkName tmp_file("pixel_stack.bin");
+  int cols = 4, rows = 3, num_images = 7;
+  double nodata = -32768;
+  PixelValueStack stack(cols, rows, tmp_file, 50);
+
+  // Image k has the value 10*k + col + row, except for no-data
+  // where (col + row + k) is divisible by 3.
+  for (int k = 0; k < num_images; k++) {
+    ImageView<double> img(cols, rows);
+    for (int col = 0; col < cols; col++) {
+      for (int row = 0; row < rows; row++)
+        img(col, row) = ((col + row + k) % 3 == 0) ? nodata : 10.0*k + col + row;
+    }
+    stack.add_image(img, nodata, 100 + k);
+  }
+  stack.finish();
+
+  std::vector< std::vector<PixelValueStack::Entry> > entries;
+  size_t num_values = 0;
+  for (int row = 0; row < rows; row++) {
+    stack.read_row(row, entries);
+    ASSERT_EQ(size_t(cols), entries.size());
+    for (int col = 0; col < cols; col++) {
+      // All valid values, in the order the images were added
+      size_t pos = 0;
+      for (int k = 0; k < num_images; k++) {
+        if ((col + row + k) % 3 == 0)
+          continue;
+        ASSERT_LT(pos, entries[col].size());
+        EXPECT_EQ(10.0*k + col + row, entries[col][pos].value);
+        EXPECT_EQ(100 + k, entries[col][pos].index);
+        pos++;
+      }
+      EXPECT_EQ(pos, entries[col].size());
+      num_values += pos;
+    }
+  }
+  EXPECT_EQ(num_values, stack.num_values());
+
+  // No images can be added after finish()
+  ImageView<double> img(cols, rows);
+  EXPECT_THROW(stack.add_image(img, nodata, 0), LogicErr);
+}
@@ -0,0 +1,134 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Cartography/GeoReference.h>
+#include <asp/Core/HorizonShadow.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( HorizonShadow, Wall ) {
+
+  // A flat DEM near lon = 0, lat = 0, with a 100 meter wall along
+  // column 50. The pixel size is about 11 meters.
+  int size = 100;
+  ImageView<double> dem(size, size);
+  for (int col = 0; col < size; col++) {
+    for (int row = 0; row < size; row++) {
+      dem(col, row) = (col == 50) ? 100.0 : 0.0;
+    }
+  }
+
+  cartography::GeoReference geo;
+  geo.set_well_known_geogcs("WGS84");
+  Matrix3x3 T;
+  T(0, 0) = 1e-4; T(0, 1) = 0;     T(0, 2) = 0;
+  T(1, 0) = 0;    T(1, 1) = -1e-4; T(1, 2) = 0.01;
+  T(2, 0) = 0;    T(2, 1) = 0;     T(2, 2) = 1;
+  geo.set_transform(T);
+
+  HorizonShadow horizon_shadow(dem, geo);
+
+  // The sun is in the West, at 45 degrees elevation. At lon = 0 and
+  // lat = 0 the local East is the y axis and the local Up is the x axis.
+  Vector2 lonlat = geo.pixel_to_lonlat(Vector2((size - 1)/2.0, (size - 1)/2.0));
+  Vector3 center = geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], 0));
+  Vector3 sun_pos = center + 1e+11*normalize(Vector3(1, -1, 0));
+
+  double azimuth, elevation;
+  horizon_shadow.azimuth_elevation(sun_pos, azimuth, elevation);
+  EXPECT_NEAR(-M_PI/2.0, azimuth,   1e-3);
+  EXPECT_NEAR( M_PI/4.0, elevation, 1e-3);
+
+  ImageView<float> shadow;
+  horizon_shadow.compute_shadow(sun_pos, shadow);
+  ASSERT_EQ(size, shadow.cols());
+  ASSERT_EQ(size, shadow.rows());
+
+  for (int row = 0; row < size; row++) {
+    EXPECT_EQ(0, shadow(48, row)); // West of the wall
+    EXPECT_EQ(0, shadow(50, row)); // the wall itself
+    EXPECT_EQ(1, shadow(52, row)); // East of the wall, within 100 m
+    EXPECT_EQ(1, shadow(57, row));
+    EXPECT_EQ(0, shadow(70, row)); // East of the wall, beyond 100 m
+  }
+
+  // Sun positions with nearby azimuths can share the horizon
+  std::vector<Vector3> sun_positions;
+  sun_positions.push_back(sun_pos);
+  sun_positions.push_back(center + 1e+11*normalize(Vector3(0.2, -1, 0)));
+  std::vector< ImageView<float> > shadows;
+  horizon_shadow.compute_shadows(sun_positions, 0.01, shadows);
+  ASSERT_EQ(2u, shadows.size());
+  for (int row = 0; row < size; row++) {
+    EXPECT_EQ(1, shadows[0](57, row));
+    EXPECT_EQ(1, shadows[1](70, row)); // lower sun, longer shadow
+    EXPECT_EQ(0, shadows[1](48, row));
+  }
+}
+
+TEST( HorizonShadow, AzimuthWrap ) {
+
+  // A flat DEM near lon = 0, lat = 0, with a 100 meter wall along row
+  // 50. Rows grow to the South.
+  int size = 100;
+  ImageView<double> dem(size, size);
+  for (int col = 0; col < size; col++) {
+    for (int row = 0; row < size; row++) {
+      dem(col, row) = (row == 50) ? 100.0 : 0.0;
+    }
+  }
+
+  cartography::GeoReference geo;
+  geo.set_well_known_geogcs("WGS84");
+  Matrix3x3 T;
+  T(0, 0) = 1e-4; T(0, 1) = 0;     T(0, 2) = 0;
+  T(1, 0) = 0;    T(1, 1) = -1e-4; T(1, 2) = 0.01;
+  T(2, 0) = 0;    T(2, 1) = 0;     T(2, 2) = 1;
+  geo.set_transform(T);
+
+  HorizonShadow horizon_shadow(dem, geo);
+
+  // Suns in the South, at 45 degrees elevation, with azimuths on both
+  // sides of +/- pi. The local North is the z axis. Grouped together,
+  // they must still cast the shadow to the North.
+  Vector2 lonlat = geo.pixel_to_lonlat(Vector2((size - 1)/2.0, (size - 1)/2.0));
+  Vector3 center = geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], 0));
+  std::vector<Vector3> sun_positions;
+  sun_positions.push_back(center + 1e+11*normalize(Vector3(1,  0.002, -1)));
+  sun_positions.push_back(center + 1e+11*normalize(Vector3(1, -0.002, -1)));
+  sun_positions.push_back(center + 1e+11*normalize(Vector3(1,  0.006, -1)));
+
+  double azimuth, elevation;
+  horizon_shadow.azimuth_elevation(sun_positions[0], azimuth, elevation);
+  EXPECT_GT(azimuth, M_PI - 0.01);
+  horizon_shadow.azimuth_elevation(sun_positions[1], azimuth, elevation);
+  EXPECT_LT(azimuth, -M_PI + 0.01);
+
+  std::vector< ImageView<float> > shadows;
+  horizon_shadow.compute_shadows(sun_positions, 0.02, shadows);
+  ASSERT_EQ(3u, shadows.size());
+  for (size_t it = 0; it < shadows.size(); it++) {
+    for (int col = 0; col < size; col++) {
+      EXPECT_EQ(1, shadows[it](col, 45)); // North of the wall, within 100 m
+      EXPECT_EQ(0, shadows[it](col, 52)); // South of the wall
+      EXPECT_EQ(0, shadows[it](col, 30)); // North of the wall, beyond 100 m
+    }
+  }
+}
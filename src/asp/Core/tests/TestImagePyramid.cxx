@@ -0,0 +1,101 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+
+#include <test/Helpers.h>
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <asp/Core/ImagePyramid.h>
+#include <boost/filesystem.hpp>
+#include <cstdio>
+
+using namespace vw;
+using namespace asp;
+
+TEST( ImagePyramid, FileNames ) {
+  EXPECT_EQ("run/run-L.tif",      image_pyramid_level_file("run/run-L.tif", 0));
+  EXPECT_EQ("run/run-L_pyr2.tif", image_pyramid_level_file("run/run-L.tif", 1));
+  EXPECT_EQ("run/run-L_pyr8.tif", image_pyramid_level_file("run/run-L.tif", 3));
+  EXPECT_EQ("run/run-L_pyr.txt",  image_pyramid_manifest_file("run/run-L.tif"));
+}
+
+TEST( ImagePyramid, BuildAndRead ) {
+
+  UnlinkName image_file("pyr.tif"), mask_file("pyr_mask.tif"), manifest("pyr_pyr.txt");
+  UnlinkName level1("pyr_pyr2.tif"), level2("pyr_pyr4.tif"), level3("pyr_pyr8.tif");
+  EXPECT_EQ(std::string(level1), image_pyramid_level_file(image_file, 1));
+
+  // The value of each pixel is its column. The first pixel is invalid.
+  ImageView<float> image(20, 12);
+  ImageView<uint8> mask(20, 12);
+  for (int row = 0; row < image.rows(); row++) {
+    for (int col = 0; col < image.cols(); col++) {
+      image(col, row) = col;
+      mask (col, row) = 255;
+    }
+  }
+  mask(0, 0) = 0;
+  write_image(image_file, image);
+  write_image(mask_file,  mask);
+
+  ImagePyramid pyramid;
+  EXPECT_FALSE(pyramid.read(image_file));
+
+  // 20x12 -> 10x6 -> 5x3 -> 3x2
+  float nodata = -32768.0;
+  vw::cartography::GdalWriteOptions opt;
+  EXPECT_EQ(3, build_image_pyramid(image_file, mask_file, nodata, 4, opt));
+  ASSERT_TRUE(pyramid.read(image_file));
+  ASSERT_EQ(4, pyramid.num_levels());
+  EXPECT_EQ(std::string(image_file), pyramid.level_file(0));
+  EXPECT_EQ(std::string(level3),     pyramid.level_file(3));
+  EXPECT_EQ(nodata, pyramid.nodata_value());
+
+  // Only valid pixels are averaged
+  DiskImageView<float> half(pyramid.level_file(1));
+  ASSERT_EQ(10, half.cols());
+  ASSERT_EQ(6,  half.rows());
+  EXPECT_NEAR(2.0/3.0, half(0, 0), 1e-6);
+  EXPECT_NEAR(0.5,     half(0, 1), 1e-6);
+  EXPECT_NEAR(2.5,     half(1, 0), 1e-6);
+  DiskImageView<float> coarsest(pyramid.level_file(3));
+  EXPECT_EQ(3, coarsest.cols());
+  EXPECT_EQ(2, coarsest.rows());
+
+  EXPECT_EQ(0, pyramid.level_for_scale(0.5));
+  EXPECT_EQ(1, pyramid.level_for_scale(3.0));
+  EXPECT_EQ(2, pyramid.level_for_scale(4.0));
+  EXPECT_EQ(3, pyramid.level_for_scale(100.0));
+
+  // Nothing changed, so nothing is made again
+  EXPECT_EQ(0, build_image_pyramid(image_file, mask_file, nodata, 4, opt));
+
+  // Once the image changes the pyramid is out of date, and all of it
+  // is made again.
+  std::time_t time = boost::filesystem::last_write_time(std::string(image_file));
+  boost::filesystem::last_write_time(std::string(image_file), time - 100);
+  EXPECT_FALSE(pyramid.read(image_file));
+  EXPECT_EQ(3, build_image_pyramid(image_file, mask_file, nodata, 4, opt));
+  EXPECT_TRUE(pyramid.read(image_file));
+
+  // A removed level is made again
+  std::remove(level3.c_str());
+  EXPECT_FALSE(pyramid.read(image_file));
+  EXPECT_EQ(1, build_image_pyramid(image_file, mask_file, nodata, 4, opt));
+  EXPECT_TRUE(pyramid.read(image_file));
+}
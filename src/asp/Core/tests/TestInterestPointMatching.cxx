@@ -68,3 +68,222 @@ TEST( InterestPointMatching, DatumIntersection ) {
   }
 
 }
+
+namespace {
+
+  // A camera of the kind above, moved by the given offset and turned to
+  // look at the same ground point as the unmoved one.
+  camera::PinholeModel look_at_camera(Vector3 const& offset, cartography::Datum const& datum) {
+    Matrix3x3 rotation =
+      Quat(-0.0794638597818,-0.0396316037899,-0.40945443655,-0.907998840691).rotation_matrix();
+    Vector3 center(-414653.934175,-2305310.05912,-6759174.5439);
+    camera::PinholeModel cam( center, rotation, 1.65e6, 1.65e6, 17500, 17500,
+                              Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+    Vector3 target = cartography::datum_intersection(datum, &cam, Vector2(17500, 17500));
+
+    // Rotate the view direction onto the direction to the target
+    Vector3 a = normalize(target - center), b = normalize(target - center - offset);
+    Vector3 v = cross_prod(a, b);
+    double  s = norm_2(v), c = dot_prod(a, b);
+    Matrix3x3 vx, turn = math::identity_matrix<3>();
+    vx(0,0) = vx(1,1) = vx(2,2) = 0;
+    vx(0,1) = -v[2]; vx(0,2) =  v[1];
+    vx(1,0) =  v[2]; vx(1,2) = -v[0];
+    vx(2,0) = -v[1]; vx(2,1) =  v[0];
+    if (s > 0)
+      turn += vx + vx * vx * ((1 - c) / (s * s));
+    return camera::PinholeModel( center + offset, turn * rotation, 1.65e6, 1.65e6, 17500, 17500,
+                                 Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+  }
+
+  ip::InterestPoint random_ip(Vector2 const& pix) {
+    ip::InterestPoint ip(pix.x(), pix.y(), 1.0);
+    ip.descriptor.set_size(16);
+    for (int k = 0; k < 16; k++)
+      ip.descriptor[k] = float(std::rand()) / RAND_MAX;
+    return ip;
+  }
+}
+
+TEST( InterestPointMatching, TiledEpipolarMatching ) {
+
+  // Two cameras 60 km apart looking at the same terrain, with relief
+  // of up to 5 km. Then many matches are further along the epipolar
+  // lines from where they would be if on the datum than the width of
+  // the band around the lines.
+  cartography::Datum datum("WGS84");
+  camera::PinholeModel cam1 = look_at_camera(Vector3(), datum);
+  camera::PinholeModel cam2 = look_at_camera(Vector3(40000, 40000, 20000), datum);
+  BBox2 image_box(0, 0, 35000, 35000);
+
+  // Ground points seen in both images, with random descriptors. The
+  // IP in the right image are in the reverse order.
+  std::srand(3);
+  std::vector<ip::InterestPoint> left, right;
+  double max_parallax = 0;
+  for (int i = 0; i < 35000; i += 700) {
+    for (int j = 0; j < 35000; j += 700) {
+      Vector3 pos    = cartography::datum_intersection(datum, &cam1, Vector2(i + 0.5, j + 0.5));
+      double  height = 5000 * sin(i / 4000.0) * cos(j / 6000.0);
+      Vector3 ground = pos * (1 + height / norm_2(pos));
+      Vector2 l = cam1.point_to_pixel(ground), r = cam2.point_to_pixel(ground);
+      if (!image_box.contains(l) || !image_box.contains(r))
+        continue;
+      max_parallax = std::max(max_parallax, norm_2(r - cam2.point_to_pixel(pos)));
+      ip::InterestPoint ip1 = random_ip(l), ip2 = random_ip(r);
+      ip2.descriptor = ip1.descriptor;
+      left.push_back(ip1);
+      right.insert(right.begin(), ip2);
+    }
+  }
+  ASSERT_GT(left.size(), 1000u);
+  EXPECT_GT(max_parallax, 500);
+
+  ip::InterestPointList ip1(left.begin(), left.end()), ip2(right.begin(), right.end());
+  EpipolarLinePointMatcher matcher(false, 0.7, 100, datum);
+  std::vector<size_t> global_match, tiled_match;
+  matcher(ip1, ip2, DETECT_IP_METHOD_INTEGRAL, &cam1, &cam2, global_match);
+  matcher(ip1, ip2, DETECT_IP_METHOD_INTEGRAL, &cam1, &cam2, tiled_match, true);
+  ASSERT_EQ(left.size(), global_match.size());
+  ASSERT_EQ(left.size(), tiled_match.size());
+
+  // The tiled search finds nearly all matches, and all are right.
+  // Without tiles, a match is lost when there is exactly one other
+  // candidate near the epipolar line.
+  size_t num_global = 0, num_tiled = 0;
+  for (size_t i = 0; i < left.size(); i++) {
+    size_t expected = left.size() - 1 - i;
+    if (global_match[i] != size_t(-1)) {
+      EXPECT_EQ(expected, global_match[i]);
+      num_global++;
+    }
+    if (tiled_match[i] != size_t(-1)) {
+      EXPECT_EQ(expected, tiled_match[i]);
+      num_tiled++;
+    }
+  }
+  EXPECT_GT(num_tiled, 95 * left.size() / 100);
+  EXPECT_GE(num_tiled, num_global);
+}
+
+TEST( InterestPointMatching, TwoCandidatesNearEpipolarLine ) {
+
+  cartography::Datum datum("WGS84");
+  camera::PinholeModel cam1 = look_at_camera(Vector3(), datum);
+  camera::PinholeModel cam2 = look_at_camera(Vector3(40000, 40000, 20000), datum);
+
+  // The match of an IP, and another IP on its epipolar line with a
+  // descriptor much further away.
+  Vector2 l(17000, 18000);
+  Vector2 r = cam2.point_to_pixel(cartography::datum_intersection(datum, &cam1, l));
+  bool success = false;
+  Vector3 line = EpipolarLinePointMatcher::epipolar_line(l, datum, &cam1, &cam2, success);
+  ASSERT_TRUE(success);
+  Vector2 dir = normalize(Vector2(-line[1], line[0]));
+  ip::InterestPoint ip1 = random_ip(l), match = random_ip(r), other = random_ip(r + 300 * dir);
+  match.descriptor = ip1.descriptor;
+  match.descriptor[0] += 0.01;
+
+  ip::InterestPointList list1, list2;
+  list1.push_back(ip1);
+  list2.push_back(other);
+  list2.push_back(match);
+
+  // Two candidates are compared only when matching by tile
+  EpipolarLinePointMatcher matcher(false, 0.7, 100, datum);
+  std::vector<size_t> global_match, tiled_match;
+  matcher(list1, list2, DETECT_IP_METHOD_INTEGRAL, &cam1, &cam2, global_match);
+  matcher(list1, list2, DETECT_IP_METHOD_INTEGRAL, &cam1, &cam2, tiled_match, true);
+  ASSERT_EQ(1u, global_match.size());
+  ASSERT_EQ(1u, tiled_match.size());
+  EXPECT_EQ(size_t(-1), global_match[0]);
+  EXPECT_EQ(1u,         tiled_match[0]);
+}
+
+TEST( InterestPointMatching, EpipolarLineTable ) {
+
+  Matrix3x3 rotation =
+    Quat(-0.0794638597818,-0.0396316037899,-0.40945443655,-0.907998840691).rotation_matrix();
+  Vector3 center(-414653.934175,-2305310.05912,-6759174.5439);
+  camera::PinholeModel cam1( center, rotation, 1.65e6, 1.65e6, 17500, 17500,
+                             Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+  camera::PinholeModel cam2( center + Vector3(2000, 1000, 0), rotation,
+                             1.65e6, 1.65e6, 17500, 17500,
+                             Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+  cartography::Datum datum("WGS84");
+
+  EpipolarLineTable table;
+  EXPECT_TRUE(table.empty());
+  table.build(BBox2(1000, 2000, 30000, 20000), 256, datum, &cam1, &cam2, false);
+  EXPECT_FALSE(table.empty());
+
+  // The interpolated lines go through the same points as the ones
+  // found with the cameras.
+  bool success = false;
+  table.epipolar_line(Vector2(500, 5000), success);
+  EXPECT_FALSE(success);
+  for (double x = 1000; x < 31000; x += 1234.5) {
+    for (double y = 2000; y < 20000; y += 987.6) {
+      Vector2 pix(x, y);
+      Vector3 line = table.epipolar_line(pix, success);
+      ASSERT_TRUE(success);
+      Vector3 exact = EpipolarLinePointMatcher::epipolar_line(pix, datum, &cam1, &cam2, success);
+      ASSERT_TRUE(success);
+
+      // Where the pixel is seen, and a point on the exact line far from it
+      Vector2 r0 = cam2.point_to_pixel(cartography::datum_intersection(datum, &cam1, pix));
+      Vector2 dir(-exact[1], exact[0]);
+      Vector2 r1 = r0 + 5000 * dir / norm_2(dir);
+      EXPECT_LT(EpipolarLinePointMatcher::distance_point_line(line, r0), 1.0);
+      EXPECT_LT(EpipolarLinePointMatcher::distance_point_line(line, r1), 1.0);
+    }
+  }
+}
+
+TEST( InterestPointMatching, EpipolarLineTableDistorted ) {
+
+  // The same cameras as above, with strong radial distortion, of
+  // hundreds of pixels at the image corners. The table is made in one
+  // thread, as for cameras which are not thread safe.
+  Vector<double> distortion(4);
+  distortion[0] = 50; // k1
+  Matrix3x3 rotation =
+    Quat(-0.0794638597818,-0.0396316037899,-0.40945443655,-0.907998840691).rotation_matrix();
+  Vector3 center(-414653.934175,-2305310.05912,-6759174.5439);
+  camera::PinholeModel cam1( center, rotation, 1.65e6, 1.65e6, 17500, 17500,
+                             Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1),
+                             camera::TsaiLensDistortion(distortion));
+  camera::PinholeModel cam2( center + Vector3(2000, 1000, 0), rotation,
+                             1.65e6, 1.65e6, 17500, 17500,
+                             Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1),
+                             camera::TsaiLensDistortion(distortion));
+  cartography::Datum datum("WGS84");
+
+  // The distortion is not negligible
+  camera::PinholeModel undistorted( center, rotation, 1.65e6, 1.65e6, 17500, 17500,
+                                    Vector3(1,0,0), Vector3(0,1,0), Vector3(0,0,1));
+  Vector3 corner = cartography::datum_intersection(datum, &undistorted, Vector2(1000, 2000));
+  EXPECT_GT(norm_2(cam1.point_to_pixel(corner) - Vector2(1000, 2000)), 100.0);
+
+  EpipolarLineTable table;
+  table.build(BBox2(1000, 2000, 30000, 20000), 256, datum, &cam1, &cam2, true);
+  EXPECT_FALSE(table.empty());
+
+  bool success = false;
+  for (double x = 1000; x < 31000; x += 1234.5) {
+    for (double y = 2000; y < 20000; y += 987.6) {
+      Vector2 pix(x, y);
+      Vector3 line = table.epipolar_line(pix, success);
+      ASSERT_TRUE(success);
+      Vector3 exact = EpipolarLinePointMatcher::epipolar_line(pix, datum, &cam1, &cam2, success);
+      ASSERT_TRUE(success);
+
+      Vector2 r0 = cam2.point_to_pixel(cartography::datum_intersection(datum, &cam1, pix));
+      Vector2 dir(-exact[1], exact[0]);
+      Vector2 r1 = r0 + 5000 * dir / norm_2(dir);
+      EXPECT_LT(EpipolarLinePointMatcher::distance_point_line(exact, r0), 1e-3);
+      EXPECT_LT(EpipolarLinePointMatcher::distance_point_line(line,  r0), 1.0);
+      EXPECT_LT(EpipolarLinePointMatcher::distance_point_line(line,  r1), 1.0);
+    }
+  }
+}
@@ -0,0 +1,91 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/Point2Grid.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // Grid the same points with a given filter. With a radius of 0.4 and
+  // a grid size of 1 each point contributes only to the nearest grid point.
+  void grid_points(FilterType filter, double percentile, ImageView<double> & buffer) {
+    ImageView<double> weights;
+    Point2Grid point2grid(3, 2, buffer, weights, 0, 0, 1.0, 1.0, 0.4, 0,
+                          filter, percentile);
+    double nodata = -32768;
+    point2grid.Clear(nodata);
+
+    // Interleave the points so that the values for a grid point are
+    // not contiguous.
+    point2grid.AddPoint(0.1, 0.0, 5.0);
+    point2grid.AddPoint(2.0, 1.1, 7.0);
+    point2grid.AddPoint(0.0, 0.1, 1.0);
+    point2grid.AddPoint(1.9, 1.0, 8.0);
+    point2grid.AddPoint(0.0, 0.0, 3.0);
+    point2grid.AddPoint(2.0, 0.9, 9.0);
+    point2grid.AddPoint(1.0, 0.0, 4.0);
+    point2grid.normalize();
+  }
+}
+
+TEST( Point2Grid, OrderStatistics ) {
+
+  ImageView<double> buffer;
+  double nodata = -32768;
+
+  grid_points(f_median, 0, buffer);
+  ASSERT_EQ(3, buffer.cols());
+  ASSERT_EQ(2, buffer.rows());
+  EXPECT_NEAR(3.0, buffer(0, 0), 1e-12);
+  EXPECT_NEAR(4.0, buffer(1, 0), 1e-12);
+  EXPECT_NEAR(8.0, buffer(2, 1), 1e-12);
+  EXPECT_EQ(nodata, buffer(0, 1)); // no points there
+  EXPECT_EQ(nodata, buffer(2, 0));
+
+  grid_points(f_percentile, 75, buffer);
+  EXPECT_GE(buffer(0, 0), 3.0);
+  EXPECT_LE(buffer(0, 0), 5.0);
+  EXPECT_GE(buffer(2, 1), 8.0);
+  EXPECT_LE(buffer(2, 1), 9.0);
+  EXPECT_EQ(nodata, buffer(1, 1));
+
+  grid_points(f_stddev, 0, buffer);
+  EXPECT_NEAR(buffer(0, 0), 2*buffer(2, 1), 1e-12); // twice the spread
+  EXPECT_GT(buffer(0, 0), 0.0);
+
+  grid_points(f_nmad, 0, buffer);
+  EXPECT_NEAR(buffer(0, 0), 2*buffer(2, 1), 1e-12);
+  EXPECT_EQ(nodata, buffer(0, 1));
+}
+
+TEST( Point2Grid, MeanAndCount ) {
+
+  ImageView<double> buffer;
+
+  grid_points(f_mean, 0, buffer);
+  EXPECT_NEAR(3.0, buffer(0, 0), 1e-12);
+  EXPECT_NEAR(8.0, buffer(2, 1), 1e-12);
+
+  grid_points(f_count, 0, buffer);
+  EXPECT_EQ(3, buffer(0, 0));
+  EXPECT_EQ(1, buffer(1, 0));
+  EXPECT_EQ(0, buffer(0, 1));
+}
@@ -0,0 +1,92 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/PointCloudIndex.h>
+#include <algorithm>
+
+using namespace vw;
+using namespace asp;
+
+TEST( PointCloudIndex, BBoxTree ) {
+
+  // Overlapping boxes on a jittered grid
+  std::vector<BBox2> boxes;
+  for (int i = 0; i < 50; i++) {
+    for (int j = 0; j < 40; j++) {
+      double x = 3.0*i + (i*j % 7)*0.1, y = 2.0*j + (i + j) % 5 * 0.2;
+      boxes.push_back(BBox2(x, y, 4.0 + (i % 3), 2.5));
+    }
+  }
+
+  BBoxTree tree;
+  tree.build(boxes);
+  EXPECT_EQ(boxes.size(), tree.size());
+
+  // Compare with a linear search
+  std::vector<BBox2> queries;
+  queries.push_back(BBox2(10, 10, 5, 5));
+  queries.push_back(BBox2(-10, -10, 5, 5));  // outside
+  queries.push_back(BBox2(0, 0, 200, 100));  // everything
+  queries.push_back(BBox2(77.3, 41.1, 0, 0)); // a point
+  for (size_t q = 0; q < queries.size(); q++) {
+    BBox2 const& query = queries[q];
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < boxes.size(); i++) {
+      if (boxes[i].min().x() <= query.max().x() && query.min().x() <= boxes[i].max().x() &&
+          boxes[i].min().y() <= query.max().y() && query.min().y() <= boxes[i].max().y())
+        expected.push_back(i);
+    }
+    std::vector<size_t> found;
+    tree.intersect(query, found);
+    std::sort(found.begin(), found.end());
+    EXPECT_EQ(expected, found);
+  }
+
+  BBoxTree empty_tree;
+  empty_tree.build(std::vector<BBox2>());
+  std::vector<size_t> found;
+  empty_tree.intersect(BBox2(0, 0, 1, 1), found);
+  EXPECT_TRUE(found.empty());
+}
+
+TEST( PointCloudIndex, ReadWrite ) {
+
+  std::vector<BBoxPair> boundaries;
+  boundaries.push_back(BBoxPair(BBox3(Vector3(1, 2, 3), Vector3(4, 5, 6)), BBox2i(0, 0, 16, 16)));
+  boundaries.push_back(BBoxPair(BBox3(Vector3(-1, -2, -3), Vector3(0, 0, 0)), BBox2i(16, 0, 16, 8)));
+  BBox3 bbox(Vector3(-1, -2, -3), Vector3(4, 5, 6));
+  std::vector<double> hist(4, 0.5);
+
+  UnlinkName index_file("pc-index.bin");
+  write_point_cloud_index(index_file, "key", boundaries, bbox, hist);
+
+  std::vector<BBoxPair> boundaries2;
+  BBox3 bbox2;
+  std::vector<double> hist2;
+  EXPECT_FALSE(read_point_cloud_index(index_file, "other", boundaries2, bbox2, hist2));
+  EXPECT_TRUE(boundaries2.empty());
+  ASSERT_TRUE(read_point_cloud_index(index_file, "key", boundaries2, bbox2, hist2));
+  ASSERT_EQ(boundaries.size(), boundaries2.size());
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    EXPECT_EQ(boundaries[i].first,  boundaries2[i].first);
+    EXPECT_EQ(boundaries[i].second, boundaries2[i].second);
+  }
+  EXPECT_EQ(bbox, bbox2);
+  EXPECT_EQ(hist, hist2);
+}
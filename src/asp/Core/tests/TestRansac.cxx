@@ -0,0 +1,98 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Math/Geometry.h>
+#include <asp/Core/Ransac.h>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+
+  // An affine transform of random points, with every third match an outlier
+  void make_matches(std::vector<Vector3> & p1, std::vector<Vector3> & p2,
+                    std::vector<double> & costs, std::vector<bool> & is_inlier) {
+    std::srand(5);
+    for (int i = 0; i < 600; i++) {
+      Vector3 p(std::rand() % 2000, std::rand() % 2000, 1);
+      p1.push_back(p);
+      bool inlier = (i % 3 != 0);
+      is_inlier.push_back(inlier);
+      if (inlier)
+        p2.push_back(Vector3(1.1 * p.x() + 0.05 * p.y() + 30, -0.02 * p.x() + 0.9 * p.y() - 12, 1));
+      else
+        p2.push_back(Vector3(std::rand() % 2000, std::rand() % 2000, 1));
+      costs.push_back(inlier ? std::rand() % 100 : 50 + std::rand() % 100);
+    }
+  }
+
+  typedef ParallelRansac<math::AffineFittingFunctor, math::InterestPointErrorMetric> AffineRansac;
+}
+
+TEST( Ransac, FitAndStopEarly ) {
+
+  std::vector<Vector3> p1, p2;
+  std::vector<double> costs;
+  std::vector<bool> is_inlier;
+  make_matches(p1, p2, costs, is_inlier);
+
+  for (int use_costs = 0; use_costs < 2; use_costs++) {
+    AffineRansac ransac(math::AffineFittingFunctor(), math::InterestPointErrorMetric(),
+                        1000, 2.0, 300);
+    Matrix<double> H = use_costs ? ransac(p1, p2, costs) : ransac(p1, p2);
+    EXPECT_NEAR(1.1, H(0,0), 1e-6);
+    EXPECT_NEAR(30,  H(0,2), 1e-4);
+    EXPECT_NEAR(-12, H(1,2), 1e-4);
+
+    // Two thirds are inliers, so far fewer than the most iterations are needed
+    EXPECT_LT(ransac.num_iterations_done(), 1000);
+
+    std::vector<size_t> indices = ransac.inlier_indices(H, p1, p2);
+    ASSERT_EQ(400u, indices.size());
+    for (size_t i = 0; i < indices.size(); i++)
+      EXPECT_TRUE(is_inlier[indices[i]]);
+  }
+
+  // Not enough inliers
+  AffineRansac ransac(math::AffineFittingFunctor(), math::InterestPointErrorMetric(),
+                      100, 2.0, 500);
+  EXPECT_THROW(ransac(p1, p2), math::RANSACErr);
+}
+
+TEST( Ransac, SameResultWithAnyThreads ) {
+
+  std::vector<Vector3> p1, p2;
+  std::vector<double> costs;
+  std::vector<bool> is_inlier;
+  make_matches(p1, p2, costs, is_inlier);
+
+  // With a loose threshold the best model depends on which samples are drawn
+  int num_threads = vw_settings().default_num_threads();
+  std::vector< Matrix<double> > fits;
+  for (int threads = 1; threads <= 8; threads *= 2) {
+    vw_settings().set_default_num_threads(threads);
+    AffineRansac ransac(math::AffineFittingFunctor(), math::InterestPointErrorMetric(),
+                        200, 50.0, 100);
+    fits.push_back(ransac(p1, p2, costs));
+  }
+  vw_settings().set_default_num_threads(num_threads);
+
+  for (size_t i = 1; i < fits.size(); i++)
+    EXPECT_MATRIX_NEAR(fits[0], fits[i], 1e-12);
+}
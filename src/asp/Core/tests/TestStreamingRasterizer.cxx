@@ -0,0 +1,63 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <asp/Core/StreamingRasterizer.h>
+
+using namespace vw;
+using namespace asp;
+
+TEST( StreamingRasterizer, PointBinStore ) {
+
+  // A tiny memory limit, so that most points end up in the temporary file
+  UnlinkName tmp_file("point_bins.bin");
+  PointBinStore store(10.0, tmp_file, 100);
+
+  // A 40 x 40 grid of points with height x + y, one unit apart,
+  // across negative and positive coordinates.
+  for (int x = -20; x < 20; x++) {
+    for (int y = -20; y < 20; y++)
+      store.add_point(Vector3(x + 0.5, y + 0.5, x + y + 1));
+  }
+  store.finish();
+  EXPECT_EQ(1600u, store.num_points());
+
+  std::vector<Vector3> points;
+  store.read_points(BBox2(-5, -5, 10, 10), points); // crosses four bins
+  ASSERT_EQ(100u, points.size());
+  for (size_t i = 0; i < points.size(); i++)
+    EXPECT_NEAR(points[i][0] + points[i][1], points[i][2], 1e-5);
+
+  // Grid the points. Each grid point is at a distance of sqrt(0.5)
+  // from four points with the same average height.
+  BBox2 box(-10, -10, 20, 20);
+  Mutex count_mutex;
+  size_t num_invalid = 0;
+  StreamingRasterizerView view(store, box, 1.0, 0.75, 0, f_mean, 0, -32768,
+                               &num_invalid, &count_mutex);
+  ASSERT_EQ(21, view.cols());
+  ASSERT_EQ(21, view.rows());
+  ImageView< PixelGray<float> > dem = view;
+  for (int row = 0; row < dem.rows(); row++) {
+    for (int col = 0; col < dem.cols(); col++) {
+      double x = -10 + col, y = 10 - row;
+      EXPECT_NEAR(x + y + 1, dem(col, row)[0], 1e-5);
+    }
+  }
+  EXPECT_EQ(0u, num_invalid);
+}
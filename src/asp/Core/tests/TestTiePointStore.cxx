@@ -0,0 +1,220 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/InterestPoint/InterestData.h>
+#include <asp/Core/TiePointStore.h>
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+
+namespace {
+  void add_match(std::vector<ip::InterestPoint> & ip1, std::vector<ip::InterestPoint> & ip2,
+                 float x1, float y1, float x2, float y2) {
+    ip1.push_back(ip::InterestPoint(x1, y1, 1.0));
+    ip2.push_back(ip::InterestPoint(x2, y2, 1.0));
+  }
+}
+
+TEST( TiePointStore, BuildAndRead ) {
+
+  UnlinkName match01("tp-0__1.match"), match12("tp-1__2.match");
+  UnlinkName store_file("tp-tie-points.bin"), manifest_file("tp-tie-points.txt");
+  std::string prefix = std::string(store_file).substr(0, store_file.size() - 15);
+  EXPECT_EQ(std::string(store_file),    tie_point_store_file(prefix));
+  EXPECT_EQ(std::string(manifest_file), tie_point_manifest_file(prefix));
+
+  // A feature seen in all three images, one seen twice in image 1,
+  // which is discarded, and one seen only in images 0 and 1.
+  std::vector<ip::InterestPoint> ip1, ip2;
+  add_match(ip1, ip2, 1, 1,  2,  2);
+  add_match(ip1, ip2, 5, 5,  6,  6);
+  add_match(ip1, ip2, 5, 5,  7,  7);
+  add_match(ip1, ip2, 8, 8,  9,  9);
+  ip::write_binary_match_file(match01, ip1, ip2);
+  ip1.clear(); ip2.clear();
+  add_match(ip1, ip2, 2, 2,  3,  3);
+  ip::write_binary_match_file(match12, ip1, ip2);
+
+  std::map< std::pair<int, int>, std::string> match_files;
+  match_files[std::make_pair(0, 1)] = match01;
+  match_files[std::make_pair(0, 2)] = "tp-missing.match";
+  match_files[std::make_pair(1, 2)] = match12;
+
+  std::vector<std::string> image_files;
+  image_files.push_back("tp-0.tif");
+  image_files.push_back("tp-1.tif");
+  image_files.push_back("tp-2.tif");
+
+  TiePointStore tie_points;
+  EXPECT_FALSE(tie_points.read(prefix));
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 1));
+  ASSERT_TRUE(tie_points.read(prefix));
+
+  EXPECT_EQ(3u, tie_points.num_images());
+  EXPECT_EQ(image_files[1], tie_points.image_file(1));
+  EXPECT_TRUE(tie_points.previous_signature().empty());
+  EXPECT_EQ(3u, tie_points.num_pairs());
+  EXPECT_EQ(std::string(match12), tie_points.match_file(2));
+  ASSERT_EQ(2u, tie_points.num_tracks());
+  ASSERT_EQ(5u, tie_points.num_observations());
+  ASSERT_EQ(3u, tie_points.num_matches());
+
+  // The first track is ordered by image
+  ASSERT_EQ(3, tie_points.track_end(0) - tie_points.track_begin(0));
+  for (int i = 0; i < 3; i++) {
+    TiePointStore::Observation const& obs = tie_points.track_begin(0)[i];
+    EXPECT_EQ(0u, obs.track);
+    EXPECT_EQ(vw::uint32(i), obs.image);
+    EXPECT_EQ(float(i + 1), obs.x);
+  }
+
+  // The matches are sorted by pair and refer to the same track
+  EXPECT_EQ(0u, tie_points.match(0).pair);
+  EXPECT_EQ(0u, tie_points.match(1).pair);
+  EXPECT_EQ(2u, tie_points.match(2).pair);
+  for (size_t m = 0; m < tie_points.num_matches(); m++) {
+    TiePointStore::Match const& match = tie_points.match(m);
+    EXPECT_EQ(tie_points.observation(match.left).track,
+              tie_points.observation(match.right).track);
+    EXPECT_EQ(vw::uint32(tie_points.pair_images(match.pair).first),
+              tie_points.observation(match.left).image);
+  }
+
+  // Nothing changed, so nothing is made again
+  EXPECT_FALSE(build_tie_point_store(prefix, image_files, match_files, 1));
+
+  // Fewer matches than asked for in the second file
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 2));
+  ASSERT_TRUE(tie_points.read(prefix));
+  EXPECT_EQ(2u, tie_points.num_tracks());
+  EXPECT_EQ(4u, tie_points.num_observations());
+
+  // Once a match file changes the tie points are out of date
+  std::time_t time = boost::filesystem::last_write_time(std::string(match01));
+  boost::filesystem::last_write_time(std::string(match01), time - 100);
+  EXPECT_FALSE(tie_points.read(prefix));
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 2));
+  EXPECT_TRUE(tie_points.read(prefix));
+}
+
+TEST( TiePointStore, Incremental ) {
+
+  UnlinkName match01("tpi-0__1.match"), match12("tpi-1__2.match");
+  UnlinkName store_file("tpi-tie-points.bin"), manifest_file("tpi-tie-points.txt");
+  UnlinkName positions_file("tpi-track-positions.bin");
+  std::string prefix = std::string(store_file).substr(0, store_file.size() - 15);
+  EXPECT_EQ(std::string(positions_file), track_positions_file(prefix));
+
+  std::vector<ip::InterestPoint> ip1, ip2;
+  add_match(ip1, ip2, 1, 1,  2,  2);
+  add_match(ip1, ip2, 8, 8,  9,  9);
+  ip::write_binary_match_file(match01, ip1, ip2);
+
+  std::vector<std::string> image_files;
+  image_files.push_back("tpi-0.tif");
+  image_files.push_back("tpi-1.tif");
+  std::map< std::pair<int, int>, std::string> match_files;
+  match_files[std::make_pair(0, 1)] = match01;
+
+  TiePointStore tie_points;
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 1, true));
+  ASSERT_TRUE(tie_points.read(prefix));
+  ASSERT_EQ(2u, tie_points.num_tracks());
+  std::vector<Vector3> positions;
+  positions.push_back(Vector3(1, 2, 3));
+  positions.push_back(Vector3(4, 5, 6));
+  write_track_positions(prefix, tie_points, positions);
+  EXPECT_EQ(2u, read_track_positions(prefix, tie_points, positions));
+  EXPECT_EQ(Vector3(4, 5, 6), positions[1]);
+
+  // A new image, put first, seeing the first track
+  ip1.clear(); ip2.clear();
+  add_match(ip1, ip2, 2, 2, 3, 3);
+  ip::write_binary_match_file(match12, ip1, ip2);
+  image_files.insert(image_files.begin(), "tpi-2.tif");
+  match_files.clear();
+  match_files[std::make_pair(1, 2)] = match01;
+  match_files[std::make_pair(2, 0)] = match12;
+
+  std::string old_signature = tie_points.signature();
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 1, true));
+  ASSERT_TRUE(tie_points.read(prefix));
+  EXPECT_EQ(old_signature, tie_points.previous_signature());
+  ASSERT_EQ(2u, tie_points.num_tracks());
+  ASSERT_EQ(5u, tie_points.num_observations());
+  ASSERT_EQ(3u, tie_points.num_matches());
+
+  // The track seen in the new image changed, the other one did not
+  ASSERT_EQ(3, tie_points.track_end(0) - tie_points.track_begin(0));
+  EXPECT_EQ(0u, tie_points.track_begin(0)->image);
+  EXPECT_EQ(TiePointStore::NO_TRACK, tie_points.previous_track(0));
+  EXPECT_EQ(1u, tie_points.previous_track(1));
+  EXPECT_EQ(1u, read_track_positions(prefix, tie_points, positions));
+  EXPECT_EQ(Vector3(),        positions[0]);
+  EXPECT_EQ(Vector3(4, 5, 6), positions[1]);
+
+  // Once a match file used before changes, all is made from scratch
+  std::time_t time = boost::filesystem::last_write_time(std::string(match01));
+  boost::filesystem::last_write_time(std::string(match01), time - 100);
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 1, true));
+  ASSERT_TRUE(tie_points.read(prefix));
+  EXPECT_TRUE(tie_points.previous_signature().empty());
+  EXPECT_EQ(0u, read_track_positions(prefix, tie_points, positions));
+}
+
+TEST( TiePointStore, PositionsOfOtherTracks ) {
+
+  UnlinkName match01("tpp-0__1.match");
+  UnlinkName store_file("tpp-tie-points.bin"), manifest_file("tpp-tie-points.txt");
+  UnlinkName positions_file("tpp-track-positions.bin");
+  std::string prefix = std::string(store_file).substr(0, store_file.size() - 15);
+
+  std::vector<ip::InterestPoint> ip1, ip2;
+  add_match(ip1, ip2, 1, 1,  2,  2);
+  ip::write_binary_match_file(match01, ip1, ip2);
+
+  std::vector<std::string> image_files;
+  image_files.push_back("tpp-0.tif");
+  image_files.push_back("tpp-1.tif");
+  std::map< std::pair<int, int>, std::string> match_files;
+  match_files[std::make_pair(0, 1)] = match01;
+
+  TiePointStore tie_points;
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 1));
+  ASSERT_TRUE(tie_points.read(prefix));
+  std::vector<Vector3> positions(1, Vector3(1, 2, 3));
+  write_track_positions(prefix, tie_points, positions);
+  EXPECT_EQ(1u, read_track_positions(prefix, tie_points, positions));
+
+  // Another match, of the same size, makes a store of the same size,
+  // likely within the same second. Its track is not the one whose
+  // position was saved.
+  ip1.clear(); ip2.clear();
+  add_match(ip1, ip2, 5, 5,  6,  6);
+  ip::write_binary_match_file(match01, ip1, ip2);
+  std::time_t time = boost::filesystem::last_write_time(std::string(match01));
+  boost::filesystem::last_write_time(std::string(match01), time - 100);
+  std::string old_signature = tie_points.signature();
+  EXPECT_TRUE(build_tie_point_store(prefix, image_files, match_files, 1));
+  ASSERT_TRUE(tie_points.read(prefix));
+  EXPECT_NE(old_signature, tie_points.signature());
+  EXPECT_EQ(0u, read_track_positions(prefix, tie_points, positions));
+  EXPECT_EQ(Vector3(), positions[0]);
+}
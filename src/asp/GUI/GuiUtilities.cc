@@ -864,7 +864,31 @@ DiskImagePyramidMultiChannel::DiskImagePyramidMultiChannel(std::string const& ba
   //  the list of temporary files it created.
   try {
     m_num_channels = get_num_channels(base_file);
-    if (m_num_channels == 1) {
+    if (m_num_channels == 1 && m_asp_pyramid.read(base_file)) {
+      // Single channel image with a current pyramid made by stereo_pprc
+      for (int level = 0; level < m_asp_pyramid.num_levels(); level++)
+        m_asp_levels.push_back(DiskImageView<float>(m_asp_pyramid.level_file(level)));
+      m_rows = m_asp_levels[0].rows();
+      m_cols = m_asp_levels[0].cols();
+      m_type = CH1_ASP_PYRAMID;
+
+      // The range of values, from the coarsest level
+      ImageView<float> top = m_asp_levels.back();
+      double nodata = m_asp_pyramid.nodata_value();
+      m_asp_bounds = Vector2(std::numeric_limits<double>::max(),
+                             -std::numeric_limits<double>::max());
+      for (int row = 0; row < top.rows(); row++) {
+        for (int col = 0; col < top.cols(); col++) {
+          double val = top(col, row);
+          if (val == nodata || std::isnan(val))
+            continue;
+          m_asp_bounds[0] = std::min(m_asp_bounds[0], val);
+          m_asp_bounds[1] = std::max(m_asp_bounds[1], val);
+        }
+      }
+      if (m_asp_bounds[0] > m_asp_bounds[1])
+        m_asp_bounds = Vector2(0, 1);
+    }else if (m_num_channels == 1) {
       // Single channel image with float pixels.
       m_img_ch1_double = vw::mosaic::DiskImagePyramid<double>(base_file, m_opt);
       m_rows = m_img_ch1_double.rows();
@@ -913,6 +937,8 @@ double DiskImagePyramidMultiChannel::get_nodata_val() const {
   // Extract the clip, then convert it from VW format to QImage format.
   if (m_type == CH1_DOUBLE) {
     return m_img_ch1_double.get_nodata_val();
+  } else if (m_type == CH1_ASP_PYRAMID) {
+    return m_asp_pyramid.nodata_value();
   } else if (m_type == CH2_UINT8) {
     return m_img_ch2_uint8.get_nodata_val();
   } else if (m_type == CH3_UINT8) {
@@ -928,7 +954,7 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
                   bool highlight_nodata,
                   QImage & qimg, double & scale_out, vw::BBox2i & region_out) const{
 
-  bool scale_pixels = (m_type == CH1_DOUBLE);
+  bool scale_pixels = (m_type == CH1_DOUBLE || m_type == CH1_ASP_PYRAMID);
   vw::Vector2 bounds;
 
   // Extract the clip, then convert it from VW format to QImage format.
@@ -941,6 +967,22 @@ void DiskImagePyramidMultiChannel::get_image_clip(double scale_in, vw::BBox2i re
 				    scale_out, region_out);
     formQimage(highlight_nodata, scale_pixels, m_img_ch1_double.get_nodata_val(), bounds,
 	       clip, qimg);
+  } else if (m_type == CH1_ASP_PYRAMID) {
+
+    // Use the coarsest level which is still at least as fine as the
+    // requested scale, as vw::mosaic::DiskImagePyramid does.
+    int level  = m_asp_pyramid.level_for_scale(scale_in);
+    int factor = asp::ImagePyramid::level_scale(level);
+    scale_out  = factor;
+    region_out = BBox2i(Vector2i(floor(double(region_in.min().x())/factor),
+                                 floor(double(region_in.min().y())/factor)),
+                        Vector2i(ceil(double(region_in.max().x())/factor),
+                                 ceil(double(region_in.max().y())/factor)));
+    region_out.crop(bounding_box(m_asp_levels[level]));
+
+    ImageView<double> clip = pixel_cast<double>(crop(m_asp_levels[level], region_out));
+    formQimage(highlight_nodata, scale_pixels, m_asp_pyramid.nodata_value(), m_asp_bounds,
+	       clip, qimg);
   } else if (m_type == CH2_UINT8) {
     ImageView<Vector<vw::uint8, 2> > clip;
     m_img_ch2_uint8.get_image_clip(scale_in, region_in, clip,
@@ -971,6 +1013,8 @@ std::string DiskImagePyramidMultiChannel::get_value_as_str(int32 x, int32 y) con
   std::ostringstream os;
   if (m_type == CH1_DOUBLE) {
     os << m_img_ch1_double.bottom()(x, y, 0);
+  } else if (m_type == CH1_ASP_PYRAMID) {
+    os << m_asp_levels[0](x, y);
   } else if (m_type == CH2_UINT8) {
     os << Vector2(m_img_ch2_uint8.bottom()(x, y, 0));
   } else if (m_type == CH3_UINT8) {
@@ -987,6 +1031,8 @@ std::string DiskImagePyramidMultiChannel::get_value_as_str(int32 x, int32 y) con
 double DiskImagePyramidMultiChannel::get_value_as_double(int32 x, int32 y) const {
   if (m_type == CH1_DOUBLE) {
     return m_img_ch1_double.bottom()(x, y, 0);
+  }else if (m_type == CH1_ASP_PYRAMID){
+    return m_asp_levels[0](x, y);
   }else if (m_type == CH2_UINT8){
     return m_img_ch2_uint8.bottom()(x, y, 0)[0];
   }else{
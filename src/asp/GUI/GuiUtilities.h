@@ -57,6 +57,7 @@
 
 // ASP
 #include <asp/Core/Common.h>
+#include <asp/Core/ImagePyramid.h>
 #include <vw/Image/AntiAliasing.h>
 
 class QMouseEvent;
@@ -96,7 +97,7 @@ namespace vw { namespace gui {
   std::string fileDialog(std::string title, std::string start_folder="");
 
   // The kinds of images we support
-  enum ImgType {UNINIT, CH1_DOUBLE, CH2_UINT8, CH3_UINT8, CH4_UINT8};
+  enum ImgType {UNINIT, CH1_DOUBLE, CH1_ASP_PYRAMID, CH2_UINT8, CH3_UINT8, CH4_UINT8};
 
   // Flip a point and a box in y
   inline Vector2 flip_in_y(Vector2 const& P){
@@ -225,6 +226,13 @@ namespace vw { namespace gui {
     vw::mosaic::DiskImagePyramid< Vector<vw::uint8, 2> > m_img_ch2_uint8;
     vw::mosaic::DiskImagePyramid< Vector<vw::uint8, 3> > m_img_ch3_uint8;
     vw::mosaic::DiskImagePyramid< Vector<vw::uint8, 4> > m_img_ch4_uint8;
+
+    // A single-channel image whose pyramid was saved by stereo_pprc,
+    // such as L.tif and R.tif, uses that pyramid instead of making
+    // its own.
+    asp::ImagePyramid                     m_asp_pyramid;
+    std::vector< vw::ImageViewRef<float> > m_asp_levels;
+    vw::Vector2                           m_asp_bounds;
     int m_num_channels;
     int m_rows, m_cols;
     ImgType m_type; // keeps track of which of the above images we use
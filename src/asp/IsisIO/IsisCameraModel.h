@@ -29,21 +29,25 @@
 #include <vw/Camera/CameraModel.h>
 
 // ASP
-#include <asp/IsisIO/IsisInterface.h>
+#include <asp/IsisIO/IsisInterfacePool.h>
 
 namespace vw {
 namespace camera {
 
   // This is largely just a shortened reimplementation of ISIS's
-  // Camera.cpp.
+  // Camera.cpp. The model can be used by many threads at once. Each
+  // call gets an instance of the ISIS camera from a pool, so threads
+  // never share one.
   class IsisCameraModel : public CameraModel {
 
+    typedef asp::isis::IsisInterfacePool::Lease Lease;
+
   public:
     //------------------------------------------------------------------
     // Constructors / Destructors
     //------------------------------------------------------------------
     IsisCameraModel(std::string cube_filename) :
-      m_interface(asp::isis::IsisInterface::open( cube_filename )) {}
+      m_pool(new asp::isis::IsisInterfacePool( cube_filename )) {}
     virtual std::string type() const { return "Isis"; }
 
     //------------------------------------------------------------------
@@ -54,55 +58,63 @@ namespace camera {
     //  image plane.  Returns a pixel location (col, row) where the
     //  point appears in the image.
     virtual Vector2 point_to_pixel(Vector3 const& point) const {
-      return m_interface->point_to_pixel( point ); }
+      return Lease(*m_pool)->point_to_pixel( point ); }
 
     // Returns a (normalized) pointing vector from the camera center
     //  through the position of the pixel 'pix' on the image plane.
     virtual Vector3 pixel_to_vector (Vector2 const& pix) const {
-      return m_interface->pixel_to_vector( pix ); }
+      return Lease(*m_pool)->pixel_to_vector( pix ); }
 
 
     // Returns the position of the focal point of the camera
     virtual Vector3 camera_center(Vector2 const& pix = Vector2() ) const {
-      return m_interface->camera_center( pix ); }
+      return Lease(*m_pool)->camera_center( pix ); }
 
     // Pose is a rotation which moves a vector in camera coordinates
     // into world coordinates.
     virtual Quat camera_pose(Vector2 const& pix = Vector2() ) const {
-      return m_interface->camera_pose( pix ); }
+      return Lease(*m_pool)->camera_pose( pix ); }
 
     // Returns the number of lines is the ISIS cube
-    int lines() const { return m_interface->lines(); }
+    int lines() const { return Lease(*m_pool)->lines(); }
 
     // Returns the number of samples in the ISIS cube
-    int samples() const{ return m_interface->samples(); }
+    int samples() const{ return Lease(*m_pool)->samples(); }
 
     // Returns the serial number of the ISIS cube
     std::string serial_number() const {
-      return m_interface->serial_number(); }
+      return Lease(*m_pool)->serial_number(); }
 
     // Returns the ephemeris time for a pixel
     double ephemeris_time( Vector2 const& pix = Vector2() ) const {
-      return m_interface->ephemeris_time( pix );
+      return Lease(*m_pool)->ephemeris_time( pix );
     }
 
-    // Sun position in the target frame's inertial frame
+    // Sun position in the target frame's inertial frame. This may
+    // need NAIF even if the camera does not, so it is serialized.
     Vector3 sun_position( Vector2 const& pix = Vector2() ) const {
-      return m_interface->sun_position( pix );
+      bool needs_naif = true;
+      return Lease(*m_pool, needs_naif)->sun_position( pix );
     }
 
     // The three main radii that make up the spheroid. Z is out the polar region.
     Vector3 target_radii() const {
-      return m_interface->target_radii();
+      return Lease(*m_pool)->target_radii();
     }
 
     // The spheroid name.
     std::string target_name() const {
-      return m_interface->target_name();
+      return Lease(*m_pool)->target_name();
+    }
+
+    // True if calls from many threads run at the same time, rather
+    // than one after another.
+    bool supports_multi_threading() const {
+      return m_pool->supports_multi_threading();
     }
 
   protected:
-    boost::shared_ptr<asp::isis::IsisInterface> m_interface;
+    boost::shared_ptr<asp::isis::IsisInterfacePool> m_pool;
 
     friend std::ostream& operator<<( std::ostream&, IsisCameraModel const& );
   };
@@ -111,8 +123,9 @@ namespace camera {
   // ---------------------------------------------
   inline std::ostream& operator<<( std::ostream& os,
                                    IsisCameraModel const& i ) {
-    os << "IsisCameraModel" << i.lines() << "x" << i.samples() << "( "
-       << i.m_interface << " )";
+    IsisCameraModel::Lease lease(*i.m_pool);
+    os << "IsisCameraModel" << lease->lines() << "x" << lease->samples() << "( "
+       << lease.get() << " )";
     return os;
   }
 
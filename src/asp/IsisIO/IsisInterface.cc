@@ -36,6 +36,8 @@
 #include <FileName.h>
 #include <CameraFactory.h>
 #include <SerialNumber.h>
+#include <SpicePosition.h>
+#include <SpiceRotation.h>
 #include <iTime.h>
 
 using namespace vw;
@@ -126,6 +128,12 @@ std::string IsisInterface::target_name() const {
   return m_camera->target()->name().toStdString();
 }
 
+bool IsisInterface::has_cached_spice() const {
+  return m_camera->instrumentPosition()->IsCached() &&
+    m_camera->instrumentRotation()->IsCached() &&
+    m_camera->bodyRotation()->IsCached();
+}
+
 std::ostream& asp::isis::operator<<( std::ostream& os, IsisInterface* i ) {
   os << "IsisInterface" << i->type()
        << "( Serial=" << i->serial_number()
@@ -73,6 +73,11 @@ namespace isis {
     vw::Vector3 target_radii  () const;
     std::string target_name   () const;
 
+    /// True if the SPICE data is attached to the cube and was read
+    /// into memory, so that finding the position and orientation of
+    /// the camera does not call into NAIF, which is not thread-safe.
+    bool        has_cached_spice() const;
+
   protected:
     // Standard Variables
     //------------------------------------------------------
@@ -0,0 +1,87 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/IsisIO/IsisInterfacePool.h>
+
+using namespace asp;
+using namespace asp::isis;
+
+vw::Mutex& IsisInterfacePool::naif_mutex() {
+  static vw::Mutex mutex;
+  return mutex;
+}
+
+IsisInterfacePool::IsisInterfacePool(std::string const& cube_file):
+  m_cube_file(cube_file), m_concurrent(false), m_num_instances(1) {
+  vw::Mutex::Lock lock(naif_mutex());
+  boost::shared_ptr<IsisInterface> interface(IsisInterface::open(cube_file));
+  m_concurrent = interface->has_cached_spice();
+  m_free.push_back(interface);
+}
+
+size_t IsisInterfacePool::num_instances() const {
+  vw::Mutex::Lock lock(m_mutex);
+  return m_num_instances;
+}
+
+boost::shared_ptr<IsisInterface> IsisInterfacePool::acquire() const {
+  {
+    vw::Mutex::Lock lock(m_mutex);
+    if (!m_free.empty()) {
+      boost::shared_ptr<IsisInterface> interface = m_free.back();
+      m_free.pop_back();
+      return interface;
+    }
+  }
+
+  // All instances are in use, open one more. Only the NAIF lock is
+  // held meanwhile, so other threads can use the instances they have.
+  boost::shared_ptr<IsisInterface> interface;
+  {
+    vw::Mutex::Lock lock(naif_mutex());
+    interface.reset(IsisInterface::open(m_cube_file));
+  }
+  vw::Mutex::Lock lock(m_mutex);
+  m_num_instances++;
+  return interface;
+}
+
+void IsisInterfacePool::release(boost::shared_ptr<IsisInterface> const& interface) const {
+  vw::Mutex::Lock lock(m_mutex);
+  m_free.push_back(interface);
+}
+
+IsisInterfacePool::Lease::Lease(IsisInterfacePool const& pool, bool needs_naif):
+  m_pool(pool) {
+  // A camera which reads SPICE with NAIF holds the lock for the whole
+  // call. Then there is never more than one instance of it. Otherwise
+  // the lock is taken after getting the instance, as opening one
+  // takes it as well.
+  if (!m_pool.m_concurrent) {
+    m_naif_lock.reset(new vw::Mutex::Lock(naif_mutex()));
+    m_interface = m_pool.acquire();
+  } else {
+    m_interface = m_pool.acquire();
+    if (needs_naif)
+      m_naif_lock.reset(new vw::Mutex::Lock(naif_mutex()));
+  }
+}
+
+IsisInterfacePool::Lease::~Lease() {
+  m_pool.release(m_interface);
+}
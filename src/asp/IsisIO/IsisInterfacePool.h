@@ -0,0 +1,95 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file IsisInterfacePool.h
+///
+/// An Isis::Camera keeps the state of the last pixel or time it was
+/// asked about, so one instance cannot be used by several threads at
+/// once. This pool keeps several instances of the IsisInterface for
+/// the same cube, and gives each thread its own instance for the
+/// duration of a call, opening a new one only when all are in use. So
+/// there are no more instances than threads using the camera at the
+/// same time.
+///
+/// NAIF is not thread-safe. Opening a cube, and any call to a camera
+/// whose SPICE data is not attached to the cube, and so is read with
+/// NAIF as needed, are serialized with a process-wide lock.
+
+#ifndef __ASP_ISIS_INTERFACE_POOL_H__
+#define __ASP_ISIS_INTERFACE_POOL_H__
+
+#include <vw/Core/Thread.h>
+#include <asp/IsisIO/IsisInterface.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace asp {
+namespace isis {
+
+  class IsisInterfacePool: private boost::noncopyable {
+  public:
+
+    /// Open the first instance
+    IsisInterfacePool(std::string const& cube_file);
+
+    /// An instance of the interface for the sole use of the holder,
+    /// returned to the pool when the lease goes out of scope. Set
+    /// needs_naif if the calls to be made use NAIF even if the SPICE
+    /// data is attached to the cube.
+    class Lease: private boost::noncopyable {
+    public:
+      Lease(IsisInterfacePool const& pool, bool needs_naif = false);
+      ~Lease();
+      IsisInterface* operator->() const { return m_interface.get(); }
+      IsisInterface* get       () const { return m_interface.get(); }
+    private:
+      IsisInterfacePool const&           m_pool;
+      boost::scoped_ptr<vw::Mutex::Lock> m_naif_lock;
+      boost::shared_ptr<IsisInterface>   m_interface;
+    };
+
+    /// If false, calls are serialized, as for any other user of NAIF
+    bool supports_multi_threading() const { return m_concurrent; }
+
+    /// How many instances were opened
+    size_t num_instances() const;
+
+    std::string const& cube_file() const { return m_cube_file; }
+
+    /// The lock for all calls into NAIF
+    static vw::Mutex& naif_mutex();
+
+  private:
+    boost::shared_ptr<IsisInterface> acquire() const;
+    void release(boost::shared_ptr<IsisInterface> const& interface) const;
+
+    std::string                                            m_cube_file;
+    bool                                                   m_concurrent;
+    mutable std::vector< boost::shared_ptr<IsisInterface> > m_free;
+    mutable size_t                                         m_num_instances;
+    mutable vw::Mutex                                      m_mutex;
+  };
+
+}}
+
+#endif//__ASP_ISIS_INTERFACE_POOL_H__
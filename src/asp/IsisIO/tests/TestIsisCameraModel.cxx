@@ -21,6 +21,7 @@
 #include <vw/Math/Vector.h>
 #include <vw/Core/Debugging.h>
 #include <asp/IsisIO/IsisCameraModel.h>
+#include <asp/IsisIO/IsisInterfacePool.h>
 #include <vw/Cartography/PointImageManipulation.h>
 
 #include <FileName.h>
@@ -271,3 +272,36 @@ TEST(IsisCameraModel, camera_model) {
     EXPECT_LT( angle_from_z, 0.5 );
   }
 }
+
+TEST(IsisCameraModel, interface_pool) {
+  if (!asp::isis::IsisEnv()) {
+    vw_out() << "ISISROOT or ISISDATA was not set. ISIS unit tests won't be run."
+	     << std::endl;
+    return;
+  }
+
+  typedef asp::isis::IsisInterfacePool::Lease Lease;
+  IsisCameraModel cam("5165r.cub");
+  asp::isis::IsisInterfacePool pool("5165r.cub");
+  EXPECT_EQ(1u, pool.num_instances());
+  EXPECT_EQ(cam.supports_multi_threading(), pool.supports_multi_threading());
+
+  Vector2 pixel(cam.samples()/2.0, cam.lines()/2.0);
+  {
+    Lease lease(pool);
+    EXPECT_VECTOR_NEAR(cam.pixel_to_vector(pixel), lease->pixel_to_vector(pixel), DELTA);
+  }
+
+  // An instance which is returned is used again
+  { Lease lease(pool); }
+  EXPECT_EQ(1u, pool.num_instances());
+
+  // Without NAIF, holders at the same time get their own instances,
+  // which agree with each other.
+  if (pool.supports_multi_threading()) {
+    Lease lease1(pool), lease2(pool);
+    EXPECT_NE(lease1.get(), lease2.get());
+    EXPECT_EQ(2u, pool.num_instances());
+    EXPECT_VECTOR_NEAR(lease1->camera_center(pixel), lease2->camera_center(pixel), DELTA);
+  }
+}
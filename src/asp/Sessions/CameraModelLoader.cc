@@ -127,6 +127,16 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_isis_camera_m
 
 } // End function load_isis_camera_model()
 
+bool camera_supports_multi_threading(vw::camera::CameraModel const* cam) {
+#if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
+  vw::camera::IsisCameraModel const* isis_cam
+    = dynamic_cast<vw::camera::IsisCameraModel const*>(vw::camera::unadjusted_model(cam));
+  if (isis_cam != NULL)
+    return isis_cam->supports_multi_threading();
+#endif
+  return true;
+}
+
 // Load an optical bar camera file
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_optical_bar_camera_model(std::string const& path) const
 {
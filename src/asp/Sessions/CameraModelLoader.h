@@ -50,6 +50,10 @@ namespace asp {
     CameraModelPtr load_csm_camera_model        (std::string const& path) const;
   }; // End class CameraModelLoader
 
+  /// False only for an ISIS camera whose SPICE data is not attached to the
+  /// cube, as its calls must then be serialized. True for all other cameras.
+  bool camera_supports_multi_threading(vw::camera::CameraModel const* cam);
+
 } // end namespace asp
 
 #endif // __STEREO_SESSION_CAMERAMODELLOADER_H__
@@ -341,6 +341,17 @@ namespace asp {
     cam2 = camera_model(m_right_image_file, m_right_camera_file);
   }
 
+bool StereoSession::cameras_support_multi_threading() const {
+  if (m_cameras_support_multi_threading < 0) {
+    boost::shared_ptr<vw::camera::CameraModel> cam1, cam2;
+    camera_models(cam1, cam2);
+    m_cameras_support_multi_threading
+      = (camera_supports_multi_threading(cam1.get()) &&
+         camera_supports_multi_threading(cam2.get()));
+  }
+  return (m_cameras_support_multi_threading != 0);
+}
+
 boost::shared_ptr<vw::camera::CameraModel>
 StereoSession::camera_model(std::string const& image_file, std::string const& camera_file) const{
   
@@ -49,6 +49,7 @@ namespace asp {
     friend class StereoSessionFactory; // Needed so the factory can call initialize()
 
   public:
+    StereoSession(): m_cameras_support_multi_threading(-1) {}
     virtual ~StereoSession() {}
 
     /// Simple typedef of a factory function that creates a StereoSession instance
@@ -219,10 +220,18 @@ namespace asp {
     /// Object to help with camera model loading, mostly used by derived classes.
     CameraModelLoader m_camera_loader;
 
+    /// Whether both cameras can be used by many threads at once. Set by
+    /// cameras_support_multi_threading(), -1 until then.
+    mutable int m_cameras_support_multi_threading;
+
     /// Storage for the camera models used to map project the input images.
     /// - Not used in non map-projected sessions.
     boost::shared_ptr<vw::camera::CameraModel> m_left_map_proj_model, m_right_map_proj_model;
 
+    /// Load both cameras and check that they can be used by many threads
+    /// at once. The cameras are loaded on the first call only.
+    bool cameras_support_multi_threading() const;
+
   private:
 
     /// Handles init required for map projected session types.
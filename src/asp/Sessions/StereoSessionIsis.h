@@ -150,7 +150,8 @@ namespace asp {
 
     virtual std::string name() const { return "isis"; }
     
-    /// Only the alternative CSM sensor model for ISIS images supports multi threading.
+    /// CSM cameras, and ISIS cameras with the SPICE data attached to the
+    /// cube, support multi threading. The cameras are checked only once.
     virtual bool supports_multi_threading() const;
     
     /// Returns the target datum to use for a given camera model
@@ -208,8 +208,10 @@ void write_preprocessed_isis_image( vw::cartography::GdalWriteOptions const& opt
 
 
 bool StereoSessionIsis::supports_multi_threading () const {
-  return (asp::CsmModel::file_has_isd_extension(m_left_camera_file ) && 
-          asp::CsmModel::file_has_isd_extension(m_right_camera_file)   );
+  if (asp::CsmModel::file_has_isd_extension(m_left_camera_file ) && 
+      asp::CsmModel::file_has_isd_extension(m_right_camera_file)   )
+    return true;
+  return cameras_support_multi_threading();
 }
 
 /// Returns the target datum to use for a given camera model.
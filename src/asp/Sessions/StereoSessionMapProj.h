@@ -104,10 +104,13 @@ namespace asp {
     virtual std::string name() const { return "isismapisis"; }
     virtual bool uses_rpc_map_projection() const {return false;}
 
-    /// Only the alternative CSM sensor model for ISIS images supports multi threading.
+    /// CSM cameras, and ISIS cameras with the SPICE data attached to the
+    /// cube, support multi threading. The cameras are checked only once.
     virtual bool supports_multi_threading() const {
-      return (asp::CsmModel::file_has_isd_extension(m_left_camera_file ) && 
-              asp::CsmModel::file_has_isd_extension(m_right_camera_file)   );
+      if (asp::CsmModel::file_has_isd_extension(m_left_camera_file ) && 
+          asp::CsmModel::file_has_isd_extension(m_right_camera_file)   )
+        return true;
+      return cameras_support_multi_threading();
     }
 
     static StereoSession* construct() { return new StereoSessionIsisMapIsis; }
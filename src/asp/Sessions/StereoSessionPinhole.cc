@@ -21,6 +21,7 @@
 
 #include <asp/Sessions/StereoSessionPinhole.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/Ransac.h>
 
 #include <vw/Math/BBox.h>
 #include <vw/Math/Geometry.h>
@@ -99,13 +100,14 @@ asp::StereoSessionPinhole::determine_image_align(std::string const& out_prefix,
   try {
 
     double ip_inlier_factor = stereo_settings().ip_inlier_factor; // default is 1/15
-    vw::math::RandomSampleConsensus<vw::math::HomographyFittingFunctor,       
-      vw::math::InterestPointErrorMetric> ransac( vw::math::HomographyFittingFunctor(), 
+    asp::ParallelRansac<vw::math::HomographyFittingFunctor,
+      vw::math::InterestPointErrorMetric> ransac( vw::math::HomographyFittingFunctor(),
                                                   vw::math::InterestPointErrorMetric(),
                                                   stereo_settings().ip_num_ransac_iterations,
                                                   10*(15.0*ip_inlier_factor), // inlier thresh
                                                   ransac_ip1.size()/2, true);
-    T = ransac( ransac_ip2, ransac_ip1 );
+    // 2 then 1 is used here for legacy reasons
+    T = ransac( ransac_ip2, ransac_ip1, asp::ip_match_costs(matched_ip1, matched_ip2) );
     std::vector<size_t> indices = ransac.inlier_indices(T, ransac_ip2, ransac_ip1 );
     vw_out(DebugMessage,"asp") << "\t--> AlignMatrix: " << T << std::endl;
 
@@ -21,6 +21,7 @@
 
 #include <vw/Camera/CameraUtilities.h>
 #include <vw/Core/CmdUtils.h>
+#include <vw/Core/Stopwatch.h>
 #include <vw/BundleAdjustment/BundleAdjustReport.h>
 #include <vw/BundleAdjustment/AdjustRef.h>
 #include <asp/Core/Macros.h>
@@ -232,7 +233,7 @@ void compute_residuals(bool apply_loss_function,
   ceres::Problem::EvaluateOptions eval_options;
   eval_options.apply_loss_function = apply_loss_function;
   if (opt.single_threaded_cameras)
-    eval_options.num_threads = 1; // ISIS must be single threaded!
+    eval_options.num_threads = 1; // ISIS cameras which use NAIF
   else
     eval_options.num_threads = opt.num_threads;
   problem.Evaluate(eval_options, &cost, &residuals, 0, 0);
@@ -675,22 +676,18 @@ int update_outliers(ControlNetwork   & cnet,
 }
 
 // TODO: At least part of this should be a class function??
-/// Remove the outliers flagged earlier
+/// Remove the outliers flagged earlier, and write clean match files
+/// having the remaining matches.
 void remove_outliers(ControlNetwork const& cnet, BAParamStorage &param_storage,
                      Options const& opt){
 
-  // Work on individual image pairs
-  typedef std::map< std::pair<int, int>, std::string>::const_iterator match_type;
-  for (match_type match_it = opt.match_files.begin(); match_it != opt.match_files.end();
-       match_it++){
+  // The index of a tie point in the control network is the index of
+  // its track, and the matches are sorted by pair.
+  asp::TiePointStore const& tie_points = opt.tie_points;
+  size_t match_index = 0;
+  for (size_t pair = 0; pair < tie_points.num_pairs(); pair++) {
 
-    // IP from the control network, for which we flagged outliers
-    std::vector<vw::ip::InterestPoint> left_ip, right_ip;
-
-    std::pair<int, int> cam_pair   = match_it->first;
-    std::string         match_file = match_it->second;
-    size_t left_cam  = cam_pair.first;
-    size_t right_cam = cam_pair.second;
+    std::string match_file = tie_points.match_file(pair);
 
     // Just skip over match files that don't exist.
     if (!boost::filesystem::exists(match_file)) {
@@ -698,61 +695,24 @@ void remove_outliers(ControlNetwork const& cnet, BAParamStorage &param_storage,
       continue;
     }
 
-    // Read the original IP, to ensure later we write to disk only
-    // the subset of the IP from the control network which
-    // are part of these original ones. 
-    std::vector<ip::InterestPoint> orig_left_ip, orig_right_ip;
-    ip::read_binary_match_file(match_file, orig_left_ip, orig_right_ip);
-    std::map< std::pair<double, double>, std::pair<double, double> > lookup;
-    for (size_t ip_iter = 0; ip_iter < orig_left_ip.size(); ip_iter++) {
-      lookup [ std::pair<double, double>(orig_left_ip[ip_iter].x, orig_left_ip[ip_iter].y) ]
-        =  std::pair<double, double>(orig_right_ip[ip_iter].x, orig_right_ip[ip_iter].y);
-    }
-
-    // TODO: ???
-    // Iterate over the control network, and, for each control point,
-    // look only at the measure for left_cam and right_cam
-    int ipt = -1;
-    for ( ControlNetwork::const_iterator iter = cnet.begin();
-      iter != cnet.end(); ++iter ) {
-
-      ipt++; // control point index
+    std::vector<vw::ip::InterestPoint> left_ip, right_ip;
+    for (; match_index < tie_points.num_matches() &&
+           tie_points.match(match_index).pair == pair; match_index++) {
 
-      // Skip gcp
-      if (cnet[ipt].type() == ControlPoint::GroundControlPoint) {
-        continue;
-      }
-        
-      bool has_left = true, has_right = false;
-      ip::InterestPoint lip, rip;
-      for ( ControlPoint::const_iterator measure = (*iter).begin();
-            measure != (*iter).end(); ++measure ) {
-        if (measure->image_id() == left_cam) {
-          has_left = true;
-          lip = ip::InterestPoint( measure->position()[0], measure->position()[1],
-                                   measure->sigma()[0] );
-        }else if (measure->image_id() == right_cam) {
-          has_right = true;
-          rip = ip::InterestPoint( measure->position()[0], measure->position()[1],
-                                   measure->sigma()[0] );
-        }
-      }
+      asp::TiePointStore::Match const& match = tie_points.match(match_index);
+      asp::TiePointStore::Observation const& left  = tie_points.observation(match.left);
+      asp::TiePointStore::Observation const& right = tie_points.observation(match.right);
+      int ipt = left.track;
 
-      // Keep only ip for these two images
-      if (!has_left || !has_right)
+      // Skip gcp, including points whose height came from a DEM
+      if (cnet[ipt].type() == ControlPoint::GroundControlPoint)
         continue;
 
       if (param_storage.get_point_outlier(ipt))
         continue; // skip outliers
 
-      // Only add ip that were there originally
-      std::pair<double, double> left (lip.x, lip.y);
-      std::pair<double, double> right(rip.x, rip.y);
-      if (lookup.find(left) == lookup.end() || lookup[left] != right)
-        continue;
-      
-      left_ip.push_back (lip);
-      right_ip.push_back(rip);
+      left_ip.push_back (ip::InterestPoint(left.x,  left.y,  left.sigma));
+      right_ip.push_back(ip::InterestPoint(right.x, right.y, right.sigma));
     }
     
     // Filter by disparity
@@ -785,6 +745,69 @@ void remove_outliers(ControlNetwork const& cnet, BAParamStorage &param_storage,
 // End outlier functions
 // ----------------------------------------------------------------
 
+/// Choose the linear solver and preconditioner per --solver-profile,
+/// and, per --schur-ordering, the order in which the Schur solvers
+/// eliminate the variables.
+void set_solver_profile(Options const& opt, int num_cameras,
+                        BAParamStorage const& param_storage, ceres::Problem & problem,
+                        ceres::Solver::Options & options) {
+
+  std::string profile = opt.solver_profile;
+  if (profile == "auto") {
+    // Per the recommendations in the Ceres solving FAQs
+    if (num_cameras < 100)
+      profile = "dense-schur";
+    else if (num_cameras <= 3500)
+      profile = "sparse-schur";
+    else
+      profile = "iterative-schur-jacobi";
+  }
+
+  if (profile == "dense-schur") {
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+  } else if (profile == "sparse-schur") {
+    options.linear_solver_type = ceres::SPARSE_SCHUR;
+  } else {
+    options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+    if (profile == "iterative-schur-jacobi")
+      options.preconditioner_type = ceres::SCHUR_JACOBI;
+    else if (profile == "iterative-schur-cluster-jacobi")
+      options.preconditioner_type = ceres::CLUSTER_JACOBI;
+    else if (profile == "iterative-schur-cluster-tridiagonal")
+      options.preconditioner_type = ceres::CLUSTER_TRIDIAGONAL;
+    else
+      vw_throw( ArgumentErr() << "Unknown solver profile: " << profile << ".\n" );
+
+    // Forming the Schur complement explicitly is supposed to help
+    // with speed in a certain size range. Ceres supports that only
+    // with the Jacobi preconditioner.
+    options.use_explicit_schur_complement = (options.preconditioner_type == ceres::SCHUR_JACOBI &&
+                                             num_cameras > 3500 && num_cameras <= 7000);
+  }
+  vw_out() << "Using the " << profile << " solver profile.\n";
+
+  if (opt.schur_ordering == "auto")
+    return; // Ceres finds an ordering, which can take a while for big problems
+
+  // Eliminate the triangulated points first, and then solve for the
+  // rest. The points are stored one after another.
+  std::vector<double*> blocks;
+  problem.GetParameterBlocks(&blocks);
+  std::less<double const*> before;
+  double const* points_beg = NULL;
+  double const* points_end = NULL;
+  if (param_storage.num_points() > 0) {
+    points_beg = param_storage.get_point_ptr(0);
+    points_end = points_beg + param_storage.num_points()*param_storage.params_per_point();
+  }
+  ceres::ParameterBlockOrdering * ordering = new ceres::ParameterBlockOrdering;
+  options.linear_solver_ordering.reset(ordering); // takes ownership
+  for (size_t i = 0; i < blocks.size(); i++) {
+    bool is_point = !before(blocks[i], points_beg) && before(blocks[i], points_end);
+    ordering->AddElementToGroup(blocks[i], is_point ? 0 : 1);
+  }
+}
+
 int do_ba_ceres_one_pass(Options             & opt,
                          CRNJ                & crn,
                          bool                  first_pass,
@@ -1172,19 +1195,8 @@ int do_ba_ceres_one_pass(Options             & opt,
   else
     options.num_threads = opt.num_threads;
 
-  // Set solver options according to the recommendations in the Ceres solving FAQs
-  options.linear_solver_type = ceres::SPARSE_SCHUR;
-  if (num_cameras < 100)
-    options.linear_solver_type = ceres::DENSE_SCHUR;
-  if (num_cameras > 3500) {
-    options.use_explicit_schur_complement = true; // This is supposed to help with speed in a certain size range
-    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
-    options.preconditioner_type = ceres::SCHUR_JACOBI;
-  }
-  if (num_cameras > 7000)
-    options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+  set_solver_profile(opt, num_cameras, param_storage, problem, options);
 
-  //options.ordering_type = ceres::SCHUR;
   //options.eta = 1e-3; // FLAGS_eta;
   //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
   //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
@@ -1197,6 +1209,11 @@ int do_ba_ceres_one_pass(Options             & opt,
   ceres::Solve(options, &problem, &summary);
   final_cost = summary.final_cost;
   vw_out() << summary.FullReport() << "\n";
+  vw_out() << "Solver time in seconds: preprocessing: " << summary.preprocessor_time_in_seconds
+           << ", residual evaluation: " << summary.residual_evaluation_time_in_seconds
+           << ", Jacobian evaluation: " << summary.jacobian_evaluation_time_in_seconds
+           << ", linear solve: "        << summary.linear_solver_time_in_seconds
+           << ", total: "               << summary.total_time_in_seconds << ".\n";
   if (summary.termination_type == ceres::NO_CONVERGENCE){
     // Print a clarifying message, so the user does not think that the algorithm failed.
     vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
@@ -1229,6 +1246,8 @@ int do_ba_ceres_one_pass(Options             & opt,
   }
 
   int num_new_outliers = 0;
+  Stopwatch outlier_sw;
+  outlier_sw.start();
   if (!last_pass) 
     num_new_outliers =
       update_outliers(cnet, crn,
@@ -1241,6 +1260,9 @@ int do_ba_ceres_one_pass(Options             & opt,
   // make sure the clean match files are written at least once.
   if (opt.num_ba_passes > 1) 
     remove_outliers(cnet, param_storage, opt);
+  outlier_sw.stop();
+  if (!last_pass || opt.num_ba_passes > 1)
+    vw_out() << "Outlier removal time: " << outlier_sw.elapsed_seconds() << " seconds.\n";
   
   return num_new_outliers;
 } // End function do_ba_ceres_one_pass
@@ -1254,13 +1276,41 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
   opt.cnet.reset( new ControlNetwork("BundleAdjust") );
   ControlNetwork & cnet = *(opt.cnet.get());
 
-  bool success = vw::ba::build_control_network( true, // Always have input cameras
-                                                cnet, opt.camera_models,
-                                                opt.image_files,
-                                                opt.match_files,
-                                                opt.min_matches,
-                                                opt.min_triangulation_angle*(M_PI/180),
-                                                opt.forced_triangulation_distance);
+  // The tie points are read from the match files only if these changed
+  // since the last run, and are memory-mapped otherwise. In incremental
+  // mode only the new match files are read, and only the tracks which
+  // are new or changed are triangulated.
+  asp::build_tie_point_store(opt.out_prefix, opt.image_files, opt.match_files,
+                             opt.min_matches, opt.incremental);
+  if (!opt.tie_points.read(opt.out_prefix))
+    vw_throw(IOErr() << "Failed to read: " << asp::tie_point_store_file(opt.out_prefix) << "\n");
+  std::vector<Vector3> track_positions;
+  if (opt.incremental) {
+    size_t num_found = asp::read_track_positions(opt.out_prefix, opt.tie_points,
+                                                 track_positions);
+    vw_out() << "Found the positions of " << num_found << " tie points from a previous run.\n";
+  }
+  std::vector<Vector3> const* known_positions = opt.incremental ? &track_positions : NULL;
+
+  // The adjustments of a previous run and an initial transform change
+  // the cameras, and the control network is then made again below with
+  // the new cameras. The one made with the input cameras is needed
+  // only to align pinhole cameras to camera positions or to GCP.
+  const bool have_est_camera_positions = (opt.camera_position_file != "");
+  const bool align_pinhole
+    = (opt.camera_type == BaCameraType_Pinhole) &&
+    (have_est_camera_positions ||
+     (opt.gcp_files.size() > 0 &&
+      (opt.transform_cameras_using_gcp || !opt.disable_pinhole_gcp_init)));
+  const bool cameras_will_change
+    = (opt.initial_transform_file != "") ||
+    (opt.camera_type == BaCameraType_Other && opt.input_prefix != "");
+  bool success = true;
+  if (!cameras_will_change || align_pinhole)
+    success = asp::build_control_network(opt.tie_points, cnet, opt.camera_models,
+                                         opt.min_triangulation_angle*(M_PI/180),
+                                         opt.forced_triangulation_distance,
+                                         known_positions);
   if (!success) {
     vw_out() << "Failed to build a control network. Consider removing "
              << "the currently found interest point matches and increasing "
@@ -1273,13 +1323,16 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
   
   // If we change the cameras, we must rebuild the control network
   bool cameras_changed = false;
+  // Whether the cameras were moved other than by reading the adjustments
+  // of a previous run, so that the positions saved by it do not apply
+  bool cameras_moved = (opt.initial_transform_file != "");
   
   // If camera positions were provided for local inputs, align to them.
-  const bool have_est_camera_positions = (opt.camera_position_file != "");
   if ((opt.camera_type==BaCameraType_Pinhole) && have_est_camera_positions) {
     init_pinhole_model_with_camera_positions(opt.cnet, opt.camera_models,
                                              opt.image_files, estimated_camera_gcc);
     cameras_changed = true;
+    cameras_moved   = true;
   }
 
   // If we have GPC's for pinhole cameras, try to do a simple affine
@@ -1295,9 +1348,11 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
       if (opt.transform_cameras_using_gcp) {
 	init_pinhole_model_with_mono_gcp(opt.cnet, opt.camera_models);
 	cameras_changed = true;
+	cameras_moved   = true;
       } else if (!opt.disable_pinhole_gcp_init) {
 	init_pinhole_model_with_multi_gcp(opt.cnet, opt.camera_models);
 	    cameras_changed = true;
+	    cameras_moved   = true;
       }
     }
     
@@ -1310,8 +1365,9 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
   int num_points  = cnet.size();
   const int num_cameras = opt.image_files.size();
 
-  // This is important to prevent a crash later
-  if (num_points == 0) {
+  // This is important to prevent a crash later. If the control network
+  // is to be made again, this is checked then.
+  if (num_points == 0 && !cameras_will_change) {
     vw_out() << "No points to optimize (GCP or otherwise). Cannot continue.\n";
     return;
   }
@@ -1363,14 +1419,17 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     cnet = ControlNetwork("Updated network"); // Wipe it all first
     /*bool success = */
     // Building the control network below may fail if there are only GCP,
-    // but we will continue nevertheless.
-    vw::ba::build_control_network( true, // Always have input cameras
-                                   cnet, new_cam_models,
-                                   opt.image_files,
-                                   opt.match_files,
-                                   opt.min_matches,
-                                   opt.min_triangulation_angle*(M_PI/180),
-                                   opt.forced_triangulation_distance);
+    // but we will continue nevertheless. The saved track positions go
+    // with the cameras of the previous run, which these start from when
+    // its adjustments are read. If the cameras were moved otherwise,
+    // all tracks are triangulated again.
+    if (cameras_moved && known_positions != NULL)
+      vw_out() << "The cameras were moved. Not using the tie point positions "
+               << "from a previous run.\n";
+    asp::build_control_network(opt.tie_points, cnet, new_cam_models,
+                               opt.min_triangulation_angle*(M_PI/180),
+                               opt.forced_triangulation_distance,
+                               cameras_moved ? NULL : known_positions);
     
     // Restore the rest of the cnet object
     vw::ba::add_ground_control_points(cnet, opt.gcp_files, opt.datum);
@@ -1379,6 +1438,10 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     
     // Must update the number of points after the control network is recomputed
     num_points = cnet.size();
+    if (num_points == 0) {
+      vw_out() << "No points to optimize (GCP or otherwise). Cannot continue.\n";
+      return;
+    }
     param_storage.get_point_vector().resize(num_points*BAParamStorage::PARAMS_PER_POINT);
   }
 
@@ -1505,6 +1568,17 @@ void do_ba_ceres(Options & opt, std::vector<Vector3> const& estimated_camera_gcc
     };
   } // End loop through cameras
 
+  // Save the position of each track, for an incremental run to start
+  // from. Outliers get a zero position, so they are triangulated again.
+  track_positions.assign(opt.tie_points.num_tracks(), Vector3());
+  for (size_t ipt = 0; ipt < track_positions.size(); ipt++) {
+    if (best_params_ptr->get_point_outlier(ipt))
+      continue;
+    double const* point = best_params_ptr->get_point_ptr(ipt);
+    track_positions[ipt] = Vector3(point[0], point[1], point[2]);
+  }
+  asp::write_track_positions(opt.out_prefix, opt.tie_points, track_positions);
+
 } // end do_ba_ceres
 
 
@@ -1655,6 +1729,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
             "Set the maximum number of iterations.") // alias for num-iterations
     ("parameter-tolerance",  po::value(&opt.parameter_tolerance)->default_value(1e-8),
             "Stop when the relative error in the variables being optimized is less than this.")
+    ("solver-profile",       po::value(&opt.solver_profile)->default_value("auto"),
+            "How to solve the linear system at each iteration. Options: dense-schur, sparse-schur, iterative-schur-jacobi, iterative-schur-cluster-jacobi, iterative-schur-cluster-tridiagonal, and auto, which picks one of the first three by the number of cameras.")
+    ("schur-ordering",       po::value(&opt.schur_ordering)->default_value("auto"),
+            "The order in which the Schur solvers eliminate the variables. Options: auto (let the solver find it), points-first (eliminate the triangulated points, then solve for the cameras; this is faster to set up for big problems).")
     ("overlap-limit",        po::value(&opt.overlap_limit)->default_value(0),
             "Limit the number of subsequent images to search for matches to the current image to this value.  By default match all images.")
     ("overlap-list",         po::value(&opt.overlap_list_file)->default_value(""),
@@ -1708,7 +1786,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     ("ip-triangulation-max-error",  po::value(&opt.ip_triangulation_max_error)->default_value(-1),
      "When matching IP, filter out any pairs with a triangulation error higher than this.")
     ("ip-num-ransac-iterations", po::value(&opt.ip_num_ransac_iterations)->default_value(1000),
-     "How many RANSAC iterations to do in interest point matching.")
+     "The most RANSAC iterations to do in interest point matching. Fewer are done once a fit made only of inliers was found with 99% confidence.")
     ("min-triangulation-angle",      po::value(&opt.min_triangulation_angle)->default_value(0.1),
             "The minimum angle, in degrees, at which rays must meet at a triangulated point to accept this point as valid.")
     ("forced-triangulation-distance",      po::value(&opt.forced_triangulation_distance)->default_value(-1),
@@ -1718,6 +1796,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "When having GCP, interpret the three standard deviations in the GCP file as applying not to x, y, and z, but rather to latitude, longitude, and height.")
     ("force-reuse-match-files", po::bool_switch(&opt.force_reuse_match_files)->default_value(false)->implicit_value(true),
      "Force reusing the match files even if older than the images or cameras.")
+    ("incremental", po::bool_switch(&opt.incremental)->default_value(false)->implicit_value(true),
+     "Reuse the tie points and the triangulated points of a previous run with the same output prefix. Only the match files which are new since are read, and only the points seen in them are triangulated. Use with --input-adjustments-prefix set to the output prefix of the previous run.")
     ("mapprojected-data",  po::value(&opt.mapprojected_data)->default_value(""),
             "Given map-projected versions of the input images, the DEM they were mapprojected onto, and IP matches among the mapprojected images, create IP matches among the un-projected images before doing bundle adjustment. Specify the mapprojected images and the DEM as a string in quotes, separated by spaces. An example is in the documentation.")
     ("save-cnet-as-csv", po::bool_switch(&opt.save_cnet_as_csv)->default_value(false)->implicit_value(true),
@@ -2053,6 +2133,20 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   opt.save_iteration = vm.count("save-iteration-data");
   boost::to_lower( opt.cost_function );
 
+  boost::to_lower( opt.solver_profile );
+  if (opt.solver_profile != "auto"                           &&
+      opt.solver_profile != "dense-schur"                    &&
+      opt.solver_profile != "sparse-schur"                   &&
+      opt.solver_profile != "iterative-schur-jacobi"         &&
+      opt.solver_profile != "iterative-schur-cluster-jacobi" &&
+      opt.solver_profile != "iterative-schur-cluster-tridiagonal")
+    vw_throw( ArgumentErr() << "Unknown value for --solver-profile: "
+                            << opt.solver_profile << ".\n" << usage << general_options );
+  boost::to_lower( opt.schur_ordering );
+  if (opt.schur_ordering != "auto" && opt.schur_ordering != "points-first")
+    vw_throw( ArgumentErr() << "Unknown value for --schur-ordering: "
+                            << opt.schur_ordering << ".\n" << usage << general_options );
+
   if (opt.initial_transform_file != "") {
     std::ifstream is(opt.initial_transform_file.c_str());
     for (size_t row = 0; row < opt.initial_transform.rows(); row++){
@@ -2380,7 +2474,6 @@ int main(int argc, char* argv[]) {
       image_stats_indices.push_back(i);
     
     // Compute statistics for the designated images
-    opt.single_threaded_cameras = false;
     for (size_t i=0; i<image_stats_indices.size(); ++i) {
       
       size_t index = image_stats_indices[i];
@@ -2396,8 +2489,6 @@ int main(int argc, char* argv[]) {
       boost::shared_ptr<DiskImageResource> rsrc(vw::DiskImageResourcePtr(image_path));
       float nodata, dummy;
       session->get_nodata_values(rsrc, rsrc, nodata, dummy);
-      if (!session->supports_multi_threading())
-        opt.single_threaded_cameras = true;
 
       // Set up the image view
       DiskImageView<float> image_view(rsrc);
@@ -2419,6 +2510,9 @@ int main(int argc, char* argv[]) {
     
     // Create the stereo session. This will attempt to identify the session type.
     // Read in the camera model and image info for the input images.
+    // Check each loaded camera for multi-threading support, rather than
+    // loading it again just for that.
+    opt.single_threaded_cameras = false;
     for (int i = 0; i < num_images; i++){
       vw_out(DebugMessage,"asp") << "Loading: " << opt.image_files [i] << ' '
                                                 << opt.camera_files[i] << "\n";
@@ -2432,6 +2526,8 @@ int main(int argc, char* argv[]) {
       
       opt.camera_models.push_back(session->camera_model(opt.image_files [i],
                                                         opt.camera_files[i]));
+      if (!asp::camera_supports_multi_threading(opt.camera_models.back().get()))
+        opt.single_threaded_cameras = true;
       if (opt.approximate_pinhole_intrinsics) {
         boost::shared_ptr<vw::camera::PinholeModel> pinhole_ptr = 
                 boost::dynamic_pointer_cast<vw::camera::PinholeModel>(opt.camera_models.back());
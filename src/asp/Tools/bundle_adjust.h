@@ -42,6 +42,7 @@
 #include <iostream>
 
 #include <asp/Core/BundleAdjustUtils.h>
+#include <asp/Core/TiePointStore.h>
 #include <asp/Camera/RPC_XML.h>
 #include <asp/Camera/OpticalBarModel.h>
 #include <asp/Tools/bundle_adjust_misc_functions.h>
@@ -80,7 +81,7 @@ struct Options : public vw::cartography::GdalWriteOptions {
     heights_from_dem;
   double semi_major, semi_minor, position_filter_dist;
   int    num_ba_passes, max_num_reference_points;
-  std::string remove_outliers_params_str;
+  std::string remove_outliers_params_str, solver_profile, schur_ordering;
   std::vector<double> intrinsics_limits;
   vw::Vector<double, 4> remove_outliers_params;
   vw::Vector2 remove_outliers_by_disp_params;
@@ -92,7 +93,7 @@ struct Options : public vw::cartography::GdalWriteOptions {
   double ip_inlier_factor, ip_uniqueness_thresh, nodata_value, max_disp_error,
     reference_terrain_weight, heights_from_dem_weight, heights_from_dem_robust_threshold;
   bool   skip_rough_homography, enable_rough_homography, disable_tri_filtering, enable_tri_filtering, no_datum, individually_normalize, use_llh_error,
-    force_reuse_match_files, save_cnet_as_csv;
+    force_reuse_match_files, save_cnet_as_csv, incremental;
   vw::Vector2  elevation_limit;     // Expected range of elevation to limit results to.
   vw::BBox2    lon_lat_limit;       // Limit the triangulated interest points to this lonlat range
   std::string           overlap_list_file;
@@ -102,6 +103,7 @@ struct Options : public vw::cartography::GdalWriteOptions {
   std::set<int> fixed_cameras_indices;
   IntrinsicOptions intrinisc_options;
   std::map< std::pair<int, int>, std::string> match_files;
+  asp::TiePointStore tie_points; // The matches, without the descriptors
   bool single_threaded_cameras; // Set to true if any sessions are single threaded.
   
   // Make sure all values are initialized, even though they will be
@@ -117,7 +119,8 @@ struct Options : public vw::cartography::GdalWriteOptions {
              datum(vw::cartography::Datum(UNSPECIFIED_DATUM, "User Specified Spheroid",
                                           "Reference Meridian", 1, 1, 0)),
              ip_detect_method(0), num_scales(-1), skip_rough_homography(false),
-             individually_normalize(false), use_llh_error(false), force_reuse_match_files(false){}
+             individually_normalize(false), use_llh_error(false), force_reuse_match_files(false),
+             incremental(false){}
 
   /// Duplicate info to asp settings where it needs to go.
   void copy_to_asp_settings() const{
@@ -41,13 +41,14 @@
 #include <limits>
 #include <algorithm>
 
-#include <vw/FileIO/DiskImageManager.h>
 #include <vw/Image/InpaintView.h>
 #include <vw/Image/Algorithms2.h>
 #include <vw/Image/Filter.h>
 #include <vw/Cartography/GeoTransform.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/DemMosaic.h>
+#include <asp/Core/PointCloudIndex.h>
 
 
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -324,23 +325,26 @@ struct Options: vw::cartography::GdalWriteOptions {
   bool   has_out_nodata, force_projwin;
   double out_nodata_value;
   int    tile_size, tile_index, erode_len, priority_blending_len,
-         extra_crop_len, hole_fill_len, block_size, save_dem_weight;
+         extra_crop_len, hole_fill_len, block_size, save_dem_weight, max_open_files,
+         stack_memory_limit;
   double weights_exp, weights_blur_sigma, dem_blur_sigma;
   double nodata_threshold;
   bool   first, last, min, max, block_max, mean, stddev, median, nmad,
          count, save_index_map, use_centerline_weights,
-         first_dem_as_reference, propagate_nodata, no_border_blend;
+         first_dem_as_reference, propagate_nodata, no_border_blend, incremental;
   std::set<int> tile_list;
   BBox2 projwin;
   Options(): tr(0), geo_tile_size(0), has_out_nodata(false), force_projwin(false), tile_index(-1),
              erode_len(0), priority_blending_len(0), extra_crop_len(0),
-             hole_fill_len(0), block_size(0), save_dem_weight(-1), 
+             hole_fill_len(0), block_size(0), save_dem_weight(-1), max_open_files(0),
+             stack_memory_limit(0),
              weights_exp(0), weights_blur_sigma(0.0), dem_blur_sigma(0.0),
              nodata_threshold(std::numeric_limits<double>::quiet_NaN()),
              first(false), last(false), min(false), max(false), block_max(false),
              mean(false), stddev(false), median(false), nmad(false),
              count(false), save_index_map(false),
-             use_centerline_weights(false), first_dem_as_reference(false), projwin(BBox2()) {}
+             use_centerline_weights(false), first_dem_as_reference(false), incremental(false),
+             projwin(BBox2()) {}
 };
 
 /// Return the number of no-blending options selected.
@@ -368,42 +372,82 @@ std::string tile_suffix(Options const& opt){
   return ans;
 }
 
+/// A string describing the output grid and all the options which
+/// affect the values of the output tiles, to tell with --incremental
+/// if a tile written earlier can be kept.
+std::string incremental_key(Options const& opt, GeoReference const& georef,
+                            int cols, int rows, int block_size) {
+  std::ostringstream os;
+  os.precision(17);
+  Matrix3x3 T = georef.transform();
+  os << georef.overall_proj4_str() << ' ' << georef.datum().semi_major_axis() << ' '
+     << georef.datum().semi_minor_axis() << ' '
+     << T(0, 0) << ' ' << T(0, 1) << ' ' << T(0, 2) << ' '
+     << T(1, 0) << ' ' << T(1, 1) << ' ' << T(1, 2) << ' '
+     << cols << ' ' << rows << ' ' << opt.tile_size << ' ' << block_size << ' '
+     << tile_suffix(opt) << ' ' << opt.output_type << ' ' << opt.out_nodata_value << ' '
+     << opt.nodata_threshold << ' ' << opt.erode_len << ' ' << opt.priority_blending_len << ' '
+     << opt.extra_crop_len << ' ' << opt.hole_fill_len << ' ' << opt.weights_exp << ' '
+     << opt.weights_blur_sigma << ' ' << opt.dem_blur_sigma << ' '
+     << opt.use_centerline_weights << opt.first_dem_as_reference << opt.propagate_nodata
+     << opt.no_border_blend << ' ' << opt.this_dem_as_reference;
+
+  // The key is saved on one line
+  std::string key = os.str();
+  std::replace(key.begin(), key.end(), '\n', ' ');
+  return key;
+}
+
 /// Class that does the actual image processing work
 class DemMosaicView: public ImageViewBase<DemMosaicView>{
   int m_cols, m_rows, m_bias;
   Options                 const& m_opt;              // alias
-  DiskImageManager<RealT>      & m_imgMgr;           // alias
+  asp::DiskImageCache<RealT>   & m_dem_cache;        // alias
   vector<GeoReference>    const& m_georefs;          // alias
   GeoReference                   m_out_georef;
   vector<double>          const& m_nodata_values;    // alias
   vector<BBox2i>          const& m_dem_pixel_bboxes; // alias
+  asp::BBoxTree           const& m_dem_tree;         // alias, DEM extents in output pixels
   long long int                & m_num_valid_pixels; // alias, to populate on output
   vw::Mutex                    & m_count_mutex;      // alias, a lock for m_num_valid_pixels
 
 public:
   DemMosaicView(int cols, int rows, int bias,
                 Options                const& opt,
-                DiskImageManager<RealT>     & imgMgr,
+                asp::DiskImageCache<RealT>  & dem_cache,
                 vector<GeoReference>   const& georefs,
                 GeoReference           const& out_georef,
                 vector<double>         const& nodata_values,
                 vector<BBox2i>         const& dem_pixel_bboxes,
+                asp::BBoxTree          const& dem_tree,
                 long long int               & num_valid_pixels,
                 vw::Mutex                   & count_mutex):
     m_cols(cols), m_rows(rows), m_bias(bias), m_opt(opt),
-    m_imgMgr(imgMgr), m_georefs(georefs),
+    m_dem_cache(dem_cache), m_georefs(georefs),
     m_out_georef(out_georef), m_nodata_values(nodata_values),
-    m_dem_pixel_bboxes(dem_pixel_bboxes), m_num_valid_pixels(num_valid_pixels),
+    m_dem_pixel_bboxes(dem_pixel_bboxes), m_dem_tree(dem_tree),
+    m_num_valid_pixels(num_valid_pixels),
     m_count_mutex(count_mutex) {
 
     // How many valid pixels we will have
     m_num_valid_pixels = 0;
     
-    if (imgMgr.size() != georefs.size()       ||
-        imgMgr.size() != nodata_values.size() ||
-        imgMgr.size() != dem_pixel_bboxes.size())
+    if (dem_cache.size() != georefs.size()       ||
+        dem_cache.size() != nodata_values.size() ||
+        dem_cache.size() != dem_pixel_bboxes.size() ||
+        dem_cache.size() != dem_tree.size())
       vw_throw(ArgumentErr() << "Inputs expected to have the same size do not.\n");
 
+    // Sanity check: the output no-data value must not equal to
+    // any of the indices in the index map, as then the two cannot be
+    // distinguished.
+    if (m_opt.save_index_map && m_opt.out_nodata_value >= 0 &&
+        m_opt.out_nodata_value < double(dem_cache.size()) &&
+        m_opt.out_nodata_value == int(m_opt.out_nodata_value))
+      vw_throw(ArgumentErr() << "Cannot have the output no-data value equal to "
+               << m_opt.out_nodata_value
+               << " as this is one of the indices being saved in the index map.\n");
+
     // Sanity check, see if datums differ, then the tool won't work
     const double out_major_axis = m_out_georef.datum().semi_major_axis();
     const double out_minor_axis = m_out_georef.datum().semi_minor_axis();
@@ -471,12 +515,33 @@ public:
     // True if we won't be doing any DEM blending.
     bool noblend = (no_blend(m_opt) > 0);
 
+    // The DEMs which may overlap this tile, in the input order. With
+    // priority blending 'bbox' already has the needed padding, and
+    // otherwise the DEM extents in the tree were padded with it.
+    std::vector<size_t> dem_indices;
+    m_dem_tree.intersect(BBox2(bbox), dem_indices);
+    std::sort(dem_indices.begin(), dem_indices.end());
+
     // A vector of images the size of the output tile.
-    // - Used for median, nmad, and stddev calculation.
+    // - Used for stddev calculation and priority blending.
     std::vector< ImageView<double> > tile_vec, weight_vec;
-    std::vector< std::string > dem_vec;
-    if (m_opt.median || m_opt.nmad) // Store each input separately
-      tile_vec.reserve(m_imgMgr.size());
+
+    // For median and nmad, the valid values of all DEMs at each pixel.
+    // Beyond a memory limit these go to a temporary file.
+    boost::shared_ptr<asp::PixelValueStack> stack;
+    if (m_opt.median || m_opt.nmad) {
+      std::ostringstream os;
+      os << m_opt.out_prefix << "-tmp-stack-" << bbox.min().x() << "-" << bbox.min().y() << ".bin";
+      size_t max_memory_bytes = size_t(m_opt.stack_memory_limit) * 1024 * 1024;
+      stack.reset(new asp::PixelValueStack(bbox.width(), bbox.height(), os.str(),
+                                           max_memory_bytes));
+    }
+
+    // For max per block, the tile of the DEM with the largest sum of values
+    ImageView<double> block_max_tile;
+    double block_max_sum = 0;
+    bool block_max_found = false;
+
     if (m_opt.stddev) { // Need one working image
       tile_vec.push_back(ImageView<double>(bbox.width(), bbox.height()));
       // Each pixel starts at zero, nodata is handled later
@@ -484,8 +549,8 @@ public:
       fill( tile,        0.0 );
     }
     if (use_priority_blend) { // Store each weight separately
-      tile_vec.reserve  (m_imgMgr.size());
-      weight_vec.reserve(m_imgMgr.size());
+      tile_vec.reserve  (dem_indices.size());
+      weight_vec.reserve(dem_indices.size());
     }
 
     // This will ensure that pixels from earlier images are
@@ -509,23 +574,15 @@ public:
     if (m_opt.save_index_map) {
       index_map = ImageView<double>(bbox.width(), bbox.height());
       fill(index_map, m_opt.out_nodata_value);
-
-      // Sanity check: the output no-data value must not equal to
-      // any of the indices in the map, as then the two cannot be
-      // distinguished.
-      for (int dem_iter = 0; dem_iter < (int)m_imgMgr.size(); dem_iter++){
-        if (dem_iter == m_opt.out_nodata_value) 
-          vw_throw(ArgumentErr() << "Cannot have the output no-data value equal to "
-                   << m_opt.out_nodata_value
-                   << " as this is one of the indices being saved in the index map.\n");
-      }
     }
 
     ImageView<double> first_dem;
     ImageView<double> local_wts_orig;
 
-    // Loop through all input DEMs
-    for (int dem_iter = 0; dem_iter < (int)m_imgMgr.size(); dem_iter++){
+    // Loop through the input DEMs which may overlap this tile
+    for (size_t dem_pos = 0; dem_pos < dem_indices.size(); dem_pos++){
+
+      int dem_iter = dem_indices[dem_pos];
 
       // Load the information for this DEM
       GeoReference georef        = m_georefs         [dem_iter];
@@ -560,7 +617,10 @@ public:
 
       // Crop the disk dem to a 2-channel in-memory image. First
       // channel is the image pixels, second will be the weights.
-      ImageViewRef<double     > disk_dem = pixel_cast<double>(m_imgMgr.get_handle(dem_iter, bbox));
+      // The cache keeps the file open for the next tiles, unless too
+      // many files are open.
+      asp::DiskImageCache<RealT>::HandleType handle = m_dem_cache.get(dem_iter);
+      ImageViewRef<double     > disk_dem = pixel_cast<double>(*handle);
       ImageView   <DoubleGrayA> dem      = crop(disk_dem, in_box);
 
       if (m_opt.first_dem_as_reference && dem_iter == 0) {
@@ -569,7 +629,7 @@ public:
         first_dem = crop(disk_dem, bbox);
       }
 
-      std::string dem_name = m_imgMgr.get_file_name(dem_iter);
+      std::string dem_name = m_dem_cache.file_name(dem_iter);
 
       // If the nodata_threshold is specified, all values no more than this
       // will be invalidated.
@@ -597,11 +657,6 @@ public:
         }
       }
 
-      // Mark the handle to the image as not in use, though we still
-      // keep that image file open, for increased performance, unless
-      // their number becomes too large.
-      m_imgMgr.release(dem_iter);
-
       if (dem_iter == 0 && m_opt.this_dem_as_reference != "") {
         // We won't actually use this DEM, we just do all in reference to it.
         continue;
@@ -837,12 +892,29 @@ public:
         } // End col loop
       } // End row loop
 
-      // For the median option, keep a copy of the output tile for each input DEM!
-      // Also do it for max per block.
-      // - This will be memory intensive. 
-      if (m_opt.median || m_opt.nmad || m_opt.block_max) {
-        tile_vec.push_back(copy(tile));
-        dem_vec.push_back(dem_name);
+      // For the median option, store the values of each input DEM
+      if (m_opt.median || m_opt.nmad)
+        stack->add_image(tile, m_opt.out_nodata_value, dem_iter);
+
+      // For max per block, find the sum of values in each DEM
+      if (m_opt.block_max) {
+        double tile_sum = 0;
+        for (int c = 0; c < tile.cols(); c++) {
+          for (int r = 0; r < tile.rows(); r++) {
+            if (tile(c, r) != m_opt.out_nodata_value)
+              tile_sum += tile(c, r);
+          }
+        }
+        // The whole purpose of --block-max is to print the sum of
+        // pixels for each mapprojected image/DEM when doing SfS.
+        // The documentation has a longer explanation.
+        vw_out() << "\n" << bbox << " " << dem_name
+                 << " pixel sum: " << tile_sum << std::endl;
+        if (!block_max_found || tile_sum > block_max_sum) {
+          block_max_tile  = copy(tile);
+          block_max_sum   = tile_sum;
+          block_max_found = true;
+        }
       }
       
       // For priority blending, need also to keep all tiles, but also the weights
@@ -851,7 +923,7 @@ public:
         weight_vec.push_back(copy(weights));
       }
       
-      if (use_priority_blend || m_opt.save_index_map)
+      if (use_priority_blend)
 	clip2dem_index.push_back(dem_iter);
       
     } // End iterating over DEMs
@@ -887,24 +959,22 @@ public:
 
     // For the median and nmad operations
     if (m_opt.median || m_opt.nmad){
+      stack->finish();
       // Init output pixels to nodata
       fill( tile, m_opt.out_nodata_value );
-      vector<double> vals, vals_all(tile_vec.size());
-      // Iterate through all pixels
-      for (int c = 0; c < bbox.width(); c++){
-        for (int r = 0; r < bbox.height(); r++){
+      std::vector< std::vector<asp::PixelValueStack::Entry> > entries;
+      vector<double> vals;
+      // Iterate through all pixels, a row at a time
+      for (int r = 0; r < bbox.height(); r++){
+        stack->read_row(r, entries);
+        for (int c = 0; c < bbox.width(); c++){
           // Compute the median for this pixel
-          vals.clear();
-          for (int i = 0; i < (int)tile_vec.size(); i++){
-            ImageView<double> & tile_ref = tile_vec[i];
-            double this_val = tile_ref(c, r);
-            vals_all[i] = this_val; // Record the original order.
-            if (this_val == m_opt.out_nodata_value)
-              continue;
-            vals.push_back(this_val);
-          }
-          if (vals.empty())
+          std::vector<asp::PixelValueStack::Entry> const& pix_entries = entries[c];
+          if (pix_entries.empty())
             continue;
+          vals.resize(pix_entries.size());
+          for (size_t i = 0; i < pix_entries.size(); i++)
+            vals[i] = pix_entries[i].value;
           if (m_opt.median)
             tile(c, r) = math::destructive_median(vals);
           else
@@ -915,49 +985,27 @@ public:
           // Record the index of the image that is closest to the
           // median value.  Note that the median can average two
           // values, so the median value may not equal exactly any of
-          // the input values.
+          // the input values. The index is in the full list of DEMs,
+          // some of which are likely skipped in this tile as they
+          // don't intersect it.
           double min_dist = std::numeric_limits<double>::max();
-          for (size_t m = 0; m < vals_all.size(); m++) {
-            double dist = fabs(vals_all[m] - tile(c, r));
+          for (size_t m = 0; m < pix_entries.size(); m++) {
+            double dist = fabs(pix_entries[m].value - tile(c, r));
             if (dist < min_dist) {
-	      // Here we save the index not in the current array which
-	      // is m, but in the full list of DEMs, some of which are
-	      // likely skipped in this tile as they don't intersect
-	      // it.
-              index_map(c, r) = clip2dem_index[m];
+              index_map(c, r) = pix_entries[m].index;
               min_dist = dist;
             }
           }
 
-        }// End row loop
-      } // End col loop
+        }// End col loop
+      } // End row loop
     } // End median/nmad case
 
-    // For max per block, find the sum of values in each DEM
+    // For max per block, use the DEM with the largest sum of values
     if (m_opt.block_max) {
       fill( tile, m_opt.out_nodata_value );
-      int num_tiles = tile_vec.size();
-      if (tile_vec.size() != dem_vec.size()) 
-        vw_throw(ArgumentErr() << "Book-keeping error.\n");
-      std::vector<double> tile_sum(num_tiles, 0);
-      for (int i = 0; i < num_tiles; i++) {
-        for (int c = 0; c < tile_vec[i].cols(); c++) {
-          for (int r = 0; r < tile_vec[i].rows(); r++) {
-            if (tile_vec[i](c, r) != m_opt.out_nodata_value) {
-              tile_sum[i] += tile_vec[i](c, r);
-            }
-          }
-        }
-        // The whole purpose of --block-max is to print the sum of
-        // pixels for each mapprojected image/DEM when doing SfS.
-        // The documentation has a longer explanation.
-        vw_out() << "\n" << bbox << " " << dem_vec[i]
-                 << " pixel sum: " << tile_sum[i] << std::endl;
-      }
-      int max_index = std::distance(tile_sum.begin(),
-                                    std::max_element(tile_sum.begin(), tile_sum.end()));
-      if (max_index >= 0 && max_index < num_tiles) 
-        tile = copy(tile_vec[max_index]);
+      if (block_max_found)
+        tile = block_max_tile;
     }
 
     // For priority blending length.
@@ -1285,9 +1333,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("stddev",    po::bool_switch(&opt.stddev)->default_value(false),
 	   "Find the standard deviation of the DEM values.")
     ("median",  po::bool_switch(&opt.median)->default_value(false),
-	   "Find the median DEM value (this can be memory-intensive, fewer threads are suggested).")
+	   "Find the median DEM value. See also --stack-memory-limit.")
     ("nmad",  po::bool_switch(&opt.nmad)->default_value(false),
-	   "Find the normalized median absolute deviation DEM value (this can be memory-intensive, fewer threads are suggested).")
+	   "Find the normalized median absolute deviation DEM value. See also --stack-memory-limit.")
     ("count",   po::bool_switch(&opt.count)->default_value(false),
      "Each pixel is set to the number of valid DEM heights at that pixel.")
     ("block-max", po::bool_switch(&opt.block_max)->default_value(false),
@@ -1322,6 +1370,12 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "Make the output mosaic fill precisely the specified projwin, by padding it if necessary and aligning the output grid to the region.")
     ("save-index-map",   po::bool_switch(&opt.save_index_map)->default_value(false),
      "For each output pixel, save the index of the input DEM it came from (applicable only for --first, --last, --min, --max, --median, and --nmad). A text file with the index assigned to each input DEM is saved as well.")
+    ("incremental", po::bool_switch(&opt.incremental)->default_value(false),
+     "Save next to each output tile the list of input DEMs it was made from. On later runs with this option, do not make again the tiles whose input DEMs and options did not change.")
+    ("stack-memory-limit",  po::value<int>(&opt.stack_memory_limit)->default_value(256),
+     "With --median or --nmad, keep in memory for each block being processed at most about this many MB of DEM values. The rest are kept in a temporary file.")
+    ("max-open-files",      po::value<int>(&opt.max_open_files)->default_value(400),
+     "Keep at most this many input DEM files open at the same time. The least recently used ones are closed first.")
     ("threads",             po::value<int>(&opt.num_threads)->default_value(4),
      "Number of threads to use.")
     ("help,h", "Display this help message.");
@@ -1361,6 +1415,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_throw(ArgumentErr() << "The priority blending length must not be negative.\n"
                            << usage << general_options );
 
+  if (opt.max_open_files <= 0)
+    vw_throw(ArgumentErr() << "The maximum number of open files must be positive.\n"
+                           << usage << general_options );
+
+  if (opt.stack_memory_limit <= 0)
+    vw_throw(ArgumentErr() << "The value of --stack-memory-limit must be positive.\n"
+                           << usage << general_options );
+
   // If priority blending is used, need to adjust extra_crop_len accordingly
   opt.extra_crop_len = std::max(opt.extra_crop_len, 3*opt.priority_blending_len);
 
@@ -1701,33 +1763,51 @@ int main( int argc, char *argv[] ) {
       tile_pixel_bboxes.push_back(tile_box);
     }
 
-    // Store the no-data values, pointers to images, and georeferences (for speed).
+    // The tiles to write, ordered so that consecutive tiles are
+    // close, and then mostly use the same DEMs, which will be open
+    // already.
+    std::vector<int> tile_ids;
+    for (int tile_id = start_tile; tile_id < end_tile; tile_id++){
+      if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
+        continue;
+      tile_ids.push_back(tile_id);
+    }
+    asp::hilbert_tile_order(num_tiles_x, num_tiles_y, tile_ids);
+
+    // An R-tree of the tiles in projected coordinates, to find quickly
+    // the tiles a DEM intersects.
+    std::vector<BBox2> tile_proj_bboxes;
+    for (size_t tile_iter = 0; tile_iter < tile_ids.size(); tile_iter++)
+      tile_proj_bboxes.push_back(mosaic_georef.pixel_to_point_bbox
+                                 (tile_pixel_bboxes[tile_ids[tile_iter] - start_tile]));
+    asp::BBoxTree tile_tree;
+    tile_tree.build(tile_proj_bboxes);
+
+    // Store the no-data values, georeferences, and extents (for speed).
     vw_out() << "Reading the input DEMs.\n";
     vector<double>          nodata_values;
     vector<GeoReference>    georefs;
     std::vector<string>     loaded_dems;
-    DiskImageManager<RealT> imgMgr;
+    std::vector<BBox2>      loaded_dem_out_boxes;
 
     BBox2i output_dem_box = BBox2i(0, 0, cols, rows); // output DEM box
-    
+
+    // How far beyond a tile to read from the DEMs, in pixels of the DEMs
+    int dem_padding = bias + BilinearInterpolation::pixel_buffer + 2;
+
     // Loop through all DEMs
+    std::vector<size_t> dem_tiles;
     for (int dem_iter = 0; dem_iter < (int)opt.dem_files.size(); dem_iter++){
 
       // Get the DEM bounding box that we previously computed (output projected coords)
       BBox2 dem_bbox = dem_proj_bboxes[dem_iter];
 
-      // Go through each of the tile bounding boxes and see they intersect this DEM
+      // See if any of the tiles intersect this DEM. The tree also
+      // counts boxes which just touch, so check again.
       bool use_this_dem = false;
-      for (int tile_id = start_tile; tile_id < end_tile; tile_id++){
-
-        if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
-          continue;
-        
-        // Get tile bbox in pixels, then convert it to projected coords.
-        BBox2i tile_pixel_box = tile_pixel_bboxes[tile_id - start_tile];
-        BBox2  tile_proj_box  = mosaic_georef.pixel_to_point_bbox(tile_pixel_box);
-
-        if (tile_proj_box.intersects(dem_bbox)) {
+      tile_tree.intersect(dem_bbox, dem_tiles);
+      for (size_t tile_iter = 0; tile_iter < dem_tiles.size(); tile_iter++){
+        if (tile_proj_bboxes[dem_tiles[tile_iter]].intersects(dem_bbox)) {
           use_this_dem = true;
           break;
         }
@@ -1741,25 +1821,23 @@ int main( int argc, char *argv[] ) {
       BBox2i dem_pixel_box = dem_pixel_bboxes[dem_iter];
       GeoTransform geotrans(georef, mosaic_georef, dem_pixel_box, output_dem_box);
 
-      // Get the current DEM bounding box in pixel units of the output mosaicked DEM
-      BBox2 curr_box = geotrans.forward_bbox(dem_pixel_box);
-      curr_box.crop(output_dem_box);
+      // The region of the output DEM whose tiles need this DEM, which
+      // is its extent, padded as when the tiles are created, in the
+      // output pixels. If that fails, the DEM will be checked for
+      // all tiles.
+      BBox2i padded_box = dem_pixel_box;
+      padded_box.expand(dem_padding);
+      BBox2 out_box = geotrans.forward_bbox(padded_box);
+      if (out_box.empty())
+        out_box = BBox2(-std::numeric_limits<double>::max()/2,
+                        -std::numeric_limits<double>::max()/2,
+                         std::numeric_limits<double>::max(),
+                         std::numeric_limits<double>::max());
+      out_box.expand(1);
 
-      // This is a fix for GDAL crashing when there are too many open
-      // file handles. In such situation, just selectively close the
-      // handles furthest from the current location.
-      imgMgr.add_file_handle_not_thread_safe(opt.dem_files[dem_iter], curr_box);
-      
       double curr_nodata_value = opt.out_nodata_value;
-      try {
-        // Get the nodata-value. Need a try block, in case we can't
-        // open more handles.
-        DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
-        if ( in_rsrc.has_nodata_read() )
-          curr_nodata_value = RealT(in_rsrc.nodata_read());
-      }catch(std::exception const& e){
-        // Try again
-        imgMgr.freeup_handles_not_thread_safe();
+      {
+        // Get the nodata-value
         DiskImageResourceGDAL in_rsrc(opt.dem_files[dem_iter]);
         if ( in_rsrc.has_nodata_read() )
           curr_nodata_value = RealT(in_rsrc.nodata_read());
@@ -1774,8 +1852,34 @@ int main( int argc, char *argv[] ) {
       nodata_values.push_back(curr_nodata_value);
       georefs.push_back(georef);
       loaded_dem_pixel_bboxes.push_back(dem_pixel_box);
+      loaded_dem_out_boxes.push_back(out_box);
     } // End loop through DEM files
 
+    // The DEM files are opened when first needed, and closed when
+    // too many are open. This is shared by all tiles.
+    asp::DiskImageCache<RealT> dem_cache(loaded_dems, opt.max_open_files);
+
+    // An R-tree of the DEM extents in output pixels, to find the DEMs
+    // a tile needs.
+    asp::BBoxTree dem_tree;
+    dem_tree.build(loaded_dem_out_boxes);
+
+    // With --incremental, identify the DEMs each tile is made from by
+    // their signatures. If their indices are saved, a changed index
+    // also requires the tile to be made again.
+    std::string key;
+    std::vector<std::string> dem_signatures;
+    if (opt.incremental) {
+      key = incremental_key(opt, mosaic_georef, cols, rows, block_size);
+      bool use_index = (opt.save_index_map || opt.save_dem_weight >= 0);
+      for (int dem_iter = 0; dem_iter < (int)loaded_dems.size(); dem_iter++) {
+        std::string signature = asp::file_signature(loaded_dems[dem_iter]);
+        if (use_index)
+          signature = stringify(dem_iter) + " " + signature;
+        dem_signatures.push_back(signature);
+      }
+    }
+
     // If there are 17 tiles, let them be tile-00, ..., tile-16.
     int num_digits = 1;
     int tens = 10;
@@ -1785,11 +1889,10 @@ int main( int argc, char *argv[] ) {
     }
     
     // Time to generate each of the output tiles
-    for (int tile_id = start_tile; tile_id < end_tile; tile_id++){
+    for (size_t tile_iter = 0; tile_iter < tile_ids.size(); tile_iter++){
+
+      int tile_id = tile_ids[tile_iter];
 
-      if (!opt.tile_list.empty() && opt.tile_list.find(tile_id) == opt.tile_list.end()) 
-        continue;
-      
       // Get the bounding box we previously computed
       BBox2i tile_box = tile_pixel_bboxes[tile_id - start_tile];
 
@@ -1802,6 +1905,27 @@ int main( int argc, char *argv[] ) {
 	dem_tile = os.str();
       }else
 	dem_tile = opt.out_prefix; // the file name was set by user
+
+      // With --incremental, skip the tile if made earlier from the same
+      // DEMs. These are the ones overlapping the tile, padded as in
+      // DemMosaicView, as the extents in the tree were padded already.
+      std::string manifest_file;
+      std::vector<std::string> tile_signatures;
+      if (opt.incremental) {
+        manifest_file = fs::path(dem_tile).replace_extension("").string() + "-manifest.txt";
+        BBox2i query_box = tile_box;
+        if (opt.priority_blending_len > 0)
+          query_box.expand(bias + BilinearInterpolation::pixel_buffer + 1);
+        std::vector<size_t> tile_dems;
+        dem_tree.intersect(BBox2(query_box), tile_dems);
+        std::sort(tile_dems.begin(), tile_dems.end());
+        for (size_t i = 0; i < tile_dems.size(); i++)
+          tile_signatures.push_back(dem_signatures[tile_dems[i]]);
+        if (asp::tile_manifest_is_current(manifest_file, key, dem_tile, tile_signatures)) {
+          vw_out() << "Skipping tile with unchanged input DEMs: " << dem_tile << std::endl;
+          continue;
+        }
+      }
       
       // Set up tile image and metadata
       long long int num_valid_pixels; // Will be populated when saving to disk
@@ -1809,9 +1933,9 @@ int main( int argc, char *argv[] ) {
 
       ImageViewRef<RealT> out_dem
         = crop(DemMosaicView(cols, rows, bias, opt,
-                             imgMgr, georefs,
+                             dem_cache, georefs,
                              mosaic_georef, nodata_values,
-                             loaded_dem_pixel_bboxes,
+                             loaded_dem_pixel_bboxes, dem_tree,
                              num_valid_pixels, count_mutex),
                tile_box);
       GeoReference crop_georef = crop(mosaic_georef, tile_box.min().x(),
@@ -1865,9 +1989,16 @@ int main( int argc, char *argv[] ) {
         vw_out() << "Removing tile with no valid pixels: " << dem_tile << std::endl;
         boost::filesystem::remove(dem_tile);
       }
+
+      // Must be written after the tile, as it records the tile's signature
+      if (opt.incremental)
+        asp::write_tile_manifest(manifest_file, key, dem_tile, tile_signatures);
       
     } // End loop through tiles
 
+    vw_out(DebugMessage, "asp") << "Opened " << dem_cache.num_opened() << " times the "
+                                << loaded_dems.size() << " input DEMs.\n";
+
     // Write the name of each DEM file that was used together with its index
     if (opt.save_index_map) {
       std::string index_map = opt.out_prefix + "-index-map.txt";
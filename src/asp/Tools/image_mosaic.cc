@@ -32,6 +32,7 @@
 #include <asp/Core/Common.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/Ransac.h>
 
 using namespace vw;
 namespace po = boost::program_options;
@@ -155,7 +156,8 @@ Matrix<double> compute_ip_matching(std::string const& image_file1,
   std::vector<Vector3> ransac_ip1 = iplist_to_vectorlist(matched_ip1);
   std::vector<Vector3> ransac_ip2 = iplist_to_vectorlist(matched_ip2);
 
-  // RANSAC parameters.
+  // RANSAC parameters. The best matches are tried first.
+  std::vector<double> match_costs = asp::ip_match_costs(matched_ip1, matched_ip2);
   const int    num_iterations   = 100;
   const double inlier_threshold = 10;
   const int    min_num_output_inliers = ransac_ip1.size()/2;
@@ -165,26 +167,26 @@ Matrix<double> compute_ip_matching(std::string const& image_file1,
   std::vector<size_t> indices;
   try {
     if (opt.use_affine_transform) {
-      vw::math::RandomSampleConsensus<vw::math::AffineFittingFunctor,
-                                      vw::math::InterestPointErrorMetric>
+      asp::ParallelRansac<vw::math::AffineFittingFunctor,
+                          vw::math::InterestPointErrorMetric>
                                         ransac(vw::math::AffineFittingFunctor(),
                                               vw::math::InterestPointErrorMetric(),
                                               num_iterations,
                                               inlier_threshold,
                                               min_num_output_inliers,
                                               reduce_min_num_output_inliers_if_no_fit);
-      tf      = ransac( ransac_ip2, ransac_ip1 );
+      tf      = ransac( ransac_ip2, ransac_ip1, match_costs );
       indices = ransac.inlier_indices(tf, ransac_ip2, ransac_ip1 );
     } else { // More restricted transform.
-      vw::math::RandomSampleConsensus<vw::math::TranslationRotationFittingFunctorN<2>,
-                                      vw::math::InterestPointErrorMetric>
+      asp::ParallelRansac<vw::math::TranslationRotationFittingFunctorN<2>,
+                          vw::math::InterestPointErrorMetric>
                                         ransac(vw::math::TranslationRotationFittingFunctorN<2>(),
                                               vw::math::InterestPointErrorMetric(),
                                               num_iterations,
                                               inlier_threshold,
                                               min_num_output_inliers,
                                               reduce_min_num_output_inliers_if_no_fit);
-      tf      = ransac( ransac_ip2, ransac_ip1 );
+      tf      = ransac( ransac_ip2, ransac_ip1, match_costs );
       indices = ransac.inlier_indices(tf, ransac_ip2, ransac_ip1 );
     }
   } catch (...) {
@@ -34,6 +34,7 @@
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/LocalHomography.h>
 #include <asp/Core/InterestPointMatching.h>
+#include <asp/Core/Ransac.h>
 #include <asp/Tools/stereo.h>
 
 #include <iomanip>
@@ -191,7 +192,7 @@ bool determineShifts(Parameters & params,
       printf("Found %lu, %lu matched interest points.\n", matched_ip1.size(), matched_ip2.size());
 
       // Filter interest point matches
-      math::RandomSampleConsensus<math::SimilarityFittingFunctor, math::InterestPointErrorMetric>
+      asp::ParallelRansac<math::SimilarityFittingFunctor, math::InterestPointErrorMetric>
         ransac( math::SimilarityFittingFunctor(), math::InterestPointErrorMetric(),
                 100, 5, 100, true );
       std::vector<Vector3> ransac_ip1 = ip::iplist_to_vectorlist(matched_ip1);
@@ -199,7 +200,8 @@ bool determineShifts(Parameters & params,
 
       // Finding offset using RANSAC...
       try{
-        Matrix<double> H(ransac(ransac_ip1, ransac_ip2));
+        Matrix<double> H(ransac(ransac_ip1, ransac_ip2,
+                                asp::ip_match_costs(matched_ip1, matched_ip2)));
         vw_out() << "ipfind based similarity: " << H << std::endl;
         
         // Use the estimated transform between the images to determine a search offset range
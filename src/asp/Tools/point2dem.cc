@@ -21,6 +21,7 @@
 
 #include <asp/Core/PointUtils.h>
 #include <asp/Core/OrthoRasterizer.h>
+#include <asp/Core/StreamingRasterizer.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
@@ -87,7 +88,8 @@ struct Options : vw::cartography::GdalWriteOptions {
   std::string csv_format_str, csv_proj4_str, filter;
   double      search_radius_factor, sigma_factor, default_grid_size_multiplier;
   bool        use_surface_sampling;
-  bool        has_las_or_csv_or_pcd;
+  bool        has_las_or_csv_or_pcd, stream_las_csv, use_point_cloud_index;
+  int         stream_memory_limit, point_cloud_cache_size;
   Vector2i    max_output_size;
 
   // Output
@@ -100,7 +102,9 @@ struct Options : vw::cartography::GdalWriteOptions {
       remove_outliers_with_pct(true), max_valid_triangulation_error(0),
       erode_len(0), search_radius_factor(0), sigma_factor(0),
       default_grid_size_multiplier(1.0), use_surface_sampling(false),
-      has_las_or_csv_or_pcd(false), max_output_size(9999999, 9999999){}
+      has_las_or_csv_or_pcd(false), stream_las_csv(false), use_point_cloud_index(false),
+      stream_memory_limit(2048), point_cloud_cache_size(1024),
+      max_output_size(9999999, 9999999){}
 };
 
 void parse_input_clouds_textures(std::vector<std::string> const& files,
@@ -397,6 +401,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
             "Erode input point clouds by this many pixels at boundary (after outliers are removed, but before filling in holes).")
     ("csv-format",     po::value(&opt.csv_format_str)->default_value(""), asp::csv_opt_caption().c_str())
     ("csv-proj4",      po::value(&opt.csv_proj4_str)->default_value(""), "The PROJ.4 string to use to interpret the entries in input CSV files, if those files contain Easting and Northing fields. If not specified, --t_srs will be used.")
+    ("stream-las-csv", po::bool_switch(&opt.stream_las_csv)->default_value(false),
+     "Read the points in the input LAS, CSV, or PCD files and grid them directly, without first converting them to temporary point cloud files. Points beyond --stream-memory-limit are kept in a temporary file. Outliers are not removed in this mode. The DEM spacing must be set with --dem-spacing.")
+    ("stream-memory-limit", po::value(&opt.stream_memory_limit)->default_value(2048),
+     "With --stream-las-csv, keep in memory approximately at most this many MB of points.")
     ("filter",      po::value(&opt.filter)->default_value("weighted_average"), "The filter to apply to the heights of the cloud points within a given circular neighborhood when gridding (its radius is controlled via --search-radius-factor). Options: weighted_average (default), min, max, mean, median, stddev, count (number of points), nmad (= 1.4826 * median(abs(X - median(X)))), n-pct (where n is a real value between 0 and 100, for example, 80-pct, meaning, 80th percentile). Except for the default, the name of the filter will be added to the obtained DEM file name, e.g., output-min-DEM.tif.")
     ("rounding-error", po::value(&opt.rounding_error)->default_value(asp::APPROX_ONE_MM),
             "How much to round the output DEM and errors, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. [Default: 1/2^10]")
@@ -406,6 +414,10 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "The value s to be used in the Gaussian exp(-s*(x/grid_size)^2) when computing the DEM. The default is -log(0.25) = 1.3863. A smaller value will result in a smoother terrain.")
     ("default-grid-size-multiplier", po::value(&opt.default_grid_size_multiplier)->default_value(1.0),
      "If the output DEM grid size (--dem-spacing) is not specified, compute it automatically (as the mean ground sample distance), and then multiply it by this number. It is suggested that this number be set to 4 though the default is 1.")
+    ("use-point-cloud-index", po::bool_switch(&opt.use_point_cloud_index)->default_value(false),
+     "Save the bounding boxes of the blocks of the input point cloud next to the first input cloud, as <cloud>-index.bin, and reuse them in later runs with the same cloud, projection, and outlier removal settings, such as for DEMs at other resolutions.")
+    ("point-cloud-cache-size", po::value(&opt.point_cloud_cache_size)->default_value(1024),
+     "Keep in memory up to this many MB of point cloud tiles, with outliers removed, to reuse them when creating the DEMs at all spacings and the error images, rather than reading the cloud again. Set to 0 to not cache.")
     ("use-surface-sampling", po::bool_switch(&opt.use_surface_sampling)->default_value(false),
      "Use the older algorithm, interpret the point cloud as a surface made up of triangles and interpolate into it (prone to aliasing).")
     ("fsaa",   po::value<int>(&opt.fsaa)->default_value(1),            "Oversampling amount to perform antialiasing (obsolete).")
@@ -495,6 +507,28 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if (opt.use_surface_sampling && opt.has_las_or_csv_or_pcd)
     vw_throw( ArgumentErr() << "Cannot use surface " << "sampling with LAS or CSV files.\n" );
 
+  if (opt.stream_las_csv){
+    for (size_t i = 0; i < opt.pointcloud_files.size(); i++){
+      if (!asp::is_las_or_csv_or_pcd(opt.pointcloud_files[i]))
+        vw_throw( ArgumentErr() << "The --stream-las-csv option can be used only "
+                                << "with LAS, CSV, or PCD inputs.\n" );
+    }
+    if (opt.do_error || opt.has_alpha || opt.do_ortho || opt.erode_len > 0 ||
+        opt.use_surface_sampling)
+      vw_throw( ArgumentErr() << "The --stream-las-csv option cannot be used with "
+                              << "--errorimage, --use-alpha, --orthoimage, --erode-length, "
+                              << "or --use-surface-sampling.\n" );
+    for (size_t i = 0; i < opt.dem_spacing.size(); i++){
+      if (opt.dem_spacing[i] <= 0)
+        vw_throw( ArgumentErr() << "With --stream-las-csv, the DEM spacing must be set.\n" );
+    }
+    if (opt.stream_memory_limit <= 0)
+      vw_throw( ArgumentErr() << "The value of --stream-memory-limit must be positive.\n" );
+  }
+
+  if (opt.point_cloud_cache_size < 0)
+    vw_throw( ArgumentErr() << "The value of --point-cloud-cache-size must be non-negative.\n" );
+
   if (opt.fsaa != 1 && !opt.use_surface_sampling){
     vw_throw( ArgumentErr() << "The --fsaa option is obsolete. It can be used only with the "
               << "--use-surface-sampling option which invokes the old algorithm.\n" << usage << general_options );
@@ -923,7 +957,9 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
                                cartography::GeoReference& georef,
                                ImageViewRef<double> const& error_image,
                                double estim_max_error,
-                               size_t *num_invalid_pixels) {
+                               size_t *num_invalid_pixels,
+                               bool write_dem_and_errors,
+                               bool write_ortho) {
 
   vw_out() << "\t-- Starting DEM rasterization --\n";
   vw_out() << "\t--> DEM spacing: " <<     rasterizer.spacing() << " pt/px\n";
@@ -974,7 +1010,7 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
   // Write out the DEM. We've set the texture to be the height.
   Vector2 tile_size(vw_settings().default_tile_size(),
                     vw_settings().default_tile_size());
-  if ( !opt.no_dem ){
+  if ( write_dem_and_errors && !opt.no_dem ){
     Stopwatch sw2;
     sw2.start();
     ImageViewRef< PixelGray<float> > dem
@@ -1013,7 +1049,7 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
   }
 
   // Write triangulation error image if requested
-  if ( opt.do_error ) {
+  if ( write_dem_and_errors && opt.do_error ) {
     int num_channels = asp::num_channels(opt.pointcloud_files);
 
     int hole_fill_len = 0;
@@ -1056,7 +1092,7 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
   }
 
   // Write out a normalized version of the DEM, if requested (for debugging)
-  if (opt.do_normalize) {
+  if (write_dem_and_errors && opt.do_normalize) {
     int hole_fill_len = 0;
     DiskImageView< PixelGray<float> > dem_image(opt.out_prefix + "-DEM." + opt.output_file_type);
     asp::save_image(opt, apply_mask(channel_cast<uint8>(normalize(create_mask(dem_image,opt.nodata_value),
@@ -1071,7 +1107,7 @@ void do_software_rasterization(asp::OrthoRasterizerView& rasterizer,
   // Write DRG if the user requested and provided a texture file.
   // This must be at the end, as we may be messing with the point
   // image in irreversible ways.
-  if (opt.do_ortho) {
+  if (write_ortho && opt.do_ortho) {
 
     Stopwatch sw3;
     sw3.start();
@@ -1165,6 +1201,25 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
   vw::Mutex count_mutex; // Need to pass in by pointer due to C++ class restrictions
   size_t num_invalid_pixels = 0; // Need to pass in by pointer because we can't get back the number from
                                  //  the original rasterizer object otherwise for some reason.
+  // The point cloud index file and the key identifying what was used
+  // to create it. The rasterizer will add its own settings to the key.
+  std::string index_file, index_key;
+  if (opt.use_point_cloud_index && !opt.has_las_or_csv_or_pcd) {
+    index_file = fs::path(opt.pointcloud_files[0]).replace_extension("").string() + "-index.bin";
+    std::ostringstream os;
+    os.precision(17);
+    for (size_t i = 0; i < opt.pointcloud_files.size(); i++) {
+      std::string const& file = opt.pointcloud_files[i];
+      os << file << ' ' << fs::file_size(file) << ' ' << fs::last_write_time(file) << ' ';
+    }
+    os << georef.overall_proj4_str() << ' ' << georef.datum().semi_major_axis() << ' '
+       << georef.datum().semi_minor_axis()
+       << " rotation: " << opt.phi_rot << ' ' << opt.omega_rot << ' ' << opt.kappa_rot
+       << ' ' << opt.rot_order
+       << " offset: " << opt.lon_offset << ' ' << opt.lat_offset << ' ' << opt.height_offset;
+    index_key = os.str();
+  }
+
   asp::OrthoRasterizerView
     rasterizer(proj_points.impl(), select_channel(proj_points.impl(),2),
                opt.search_radius_factor, opt.sigma_factor, opt.use_surface_sampling,
@@ -1174,6 +1229,7 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
                error_image, estim_max_error, estim_proj_box, opt.max_valid_triangulation_error,
                opt.median_filter_params, opt.erode_len, opt.has_las_or_csv_or_pcd,
                opt.filter, opt.default_grid_size_multiplier,
+               index_file, index_key,
                &num_invalid_pixels, &count_mutex,
                TerminalProgressCallback("asp","QuadTree: "));
 
@@ -1184,24 +1240,262 @@ void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_p
   rasterizer.set_use_alpha(opt.has_alpha);
   rasterizer.set_use_minz_as_default(false);
   rasterizer.set_default_value(opt.nodata_value);
+  rasterizer.set_point_block_cache_size(size_t(opt.point_cloud_cache_size)*1024*1024);
 
   std::string base_out_prefix = opt.out_prefix;
+  ImageViewRef<Vector3> point_image = rasterizer.get_point_image();
+
+  // First create the DEMs and error images at all spacings, as these
+  // can reuse the point cloud tiles cached by the rasterizer. Then
+  // create the orthoimages, for which the cloud may be hole-filled.
+  for (int pass = 0; pass < 2; pass++) {
+
+    if (pass == 1 && !opt.do_ortho)
+      break;
+
+    // Call the function for each dem spacing
+    for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
+      double this_spacing = opt.dem_spacing[i];
+
+      // Required second init step for each spacing
+      rasterizer.initialize_spacing(this_spacing);
+
+      if (pass == 0)
+        rasterizer.set_height_as_texture();
+      else if (i > 0 && opt.ortho_hole_fill_len > 0)
+        rasterizer.set_point_image(point_image); // undo the previous hole-filling
+
+      // Each spacing gets a variation of the output prefix
+      if (i == 0)
+        opt.out_prefix = base_out_prefix;
+      else // Write later iterations to a different path.
+        opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(i);
+      num_invalid_pixels = 0; // not to count the pixels of other images
+      do_software_rasterization(rasterizer, opt, georef, error_image,
+                                estim_max_error, &num_invalid_pixels,
+                                pass == 0, pass == 1);
+    } // End loop through spacings
+  }
 
-  // Call the function for each dem spacing
-  for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
-    double this_spacing = opt.dem_spacing[i];
+  opt.out_prefix = base_out_prefix; // Restore the original value
+}
+
+// Read the points in LAS, CSV, or PCD files one at a time, project them, and
+// grid them directly, without first converting them to point cloud tif files.
+// The output georef must have its projection and datum set. Its
+// longitude center will be set here.
+void do_streaming_rasterization(Options& opt, cartography::GeoReference& georef) {
+
+  Stopwatch sw;
+  sw.start();
+
+  // Set up the CSV converter and georef as when converting to tif
+  int num_files = opt.pointcloud_files.size();
+  for (int i = 0; i < num_files; i++){
+    if (asp::is_csv(opt.pointcloud_files[i]) && opt.csv_format_str == "")
+      vw_throw(ArgumentErr() << "CSV files were passed in, but the "
+                             << "CSV format string was not set.\n");
+  }
+  asp::CsvConv csv_conv;
+  csv_conv.parse_csv_format(opt.csv_format_str, opt.csv_proj4_str);
+  GeoReference csv_georef;
+  csv_conv.parse_georef(csv_georef);
+  csv_georef.set_datum(georef.datum());
+
+  // Bins about the size of a DEM tile at the finest resolution
+  double min_spacing = *std::min_element(opt.dem_spacing.begin(), opt.dem_spacing.end());
+  double bin_size    = min_spacing * vw_settings().default_tile_size();
+
+  std::string tmp_file = opt.out_prefix + "-tmp-points.bin";
+  const int NUM_TEMP_NAME_RETRIES = 1000;
+  for (int count = 0; count < NUM_TEMP_NAME_RETRIES; count++){
+    if (!fs::exists(tmp_file))
+      break;
+    tmp_file = opt.out_prefix + "-tmp-points-" + vw::num_to_str(count) + ".bin";
+  }
+  if (fs::exists(tmp_file))
+    vw_throw( ArgumentErr() << "Too many attempts at creating a temporary file.\n");
+
+  size_t max_memory_bytes = size_t(opt.stream_memory_limit) * 1024 * 1024;
+  asp::PointBinStore store(bin_size, tmp_file, max_memory_bytes);
+
+  bool do_rotate = (opt.phi_rot != 0 || opt.omega_rot != 0 || opt.kappa_rot != 0);
+  Matrix3x3 rot = math::identity_matrix<3>();
+  if (do_rotate) {
+    vw_out() << "\t--> Applying rotation sequence: " << opt.rot_order
+             << "      Angles: " << opt.phi_rot << "   "
+             << opt.omega_rot << "  " << opt.kappa_rot << "\n";
+    rot = math::euler_to_rotation_matrix(opt.phi_rot, opt.omega_rot,
+                                         opt.kappa_rot, opt.rot_order);
+  }
+  Vector3 offset(opt.lon_offset, opt.lat_offset, opt.height_offset);
+  if (offset != Vector3())
+    vw_out() << "\t--> Applying offset: " << opt.lon_offset
+             << " " << opt.lat_offset << " " << opt.height_offset << "\n";
+
+  // The longitude range is decided from the first points read, which
+  // are kept until then. See the analogous logic in main().
+  const size_t NUM_POINTS_FOR_AVG_LON = 1000000;
+  std::vector<Vector3> first_points;
+  bool have_avg_lon = false;
+  asp::CenterLongitudeFunc center_lon;
+
+  for (int i = 0; i < num_files; i++){
+
+    std::string in_file = opt.pointcloud_files[i];
+    vw_out() << "Reading: " << in_file << std::endl;
+    boost::shared_ptr<asp::BaseReader> reader
+      = asp::open_point_reader(in_file, csv_georef, csv_conv);
+    TerminalProgressCallback tpc("asp", "\t--> ");
+    boost::uint64_t count = 0, num_points = std::max(reader->m_num_points,
+                                                     boost::uint64_t(1));
+
+    while (1) {
+
+      // Read the points, and once there is no more, flush what was set aside
+      bool is_good = reader->ReadNextPoint();
+      if (is_good) {
+        Vector3 xyz = asp::reader_point_to_cartesian(*reader, reader->GetPoint());
+        if (xyz == Vector3()) // invalid point
+          continue;
+        if (do_rotate)
+          xyz = rot*xyz;
+        first_points.push_back(xyz);
+
+        count++;
+        if (count % 100000 == 0)
+          tpc.report_fractional_progress(std::min(count, num_points), num_points);
+      }
+
+      bool last_file = (i + 1 == num_files);
+      if (!have_avg_lon && (first_points.size() >= NUM_POINTS_FOR_AVG_LON ||
+                            (!is_good && last_file))) {
+        Vector3 sum;
+        for (size_t p = 0; p < first_points.size(); p++)
+          sum += first_points[p];
+        double avg_lon = sum.x() >= 0 ? 0 : 180;
+        if (georef.overall_proj4_str().find("+proj=aea") == std::string::npos)
+          georef.set_lon_center(avg_lon < 100);
+        center_lon   = asp::CenterLongitudeFunc(avg_lon);
+        have_avg_lon = true;
+      }
+
+      if (have_avg_lon) {
+        for (size_t p = 0; p < first_points.size(); p++) {
+          Vector3 llh = georef.datum().cartesian_to_geodetic(first_points[p]);
+          llh = center_lon(llh) + offset;
+          Vector2 proj = georef.lonlat_to_point(subvector(llh, 0, 2));
+          Vector3 point(proj[0], proj[1], llh[2]);
+          if (boost::math::isnan(point[0]) || boost::math::isnan(point[1]) ||
+              boost::math::isnan(point[2]))
+            continue;
+          store.add_point(point);
+        }
+        first_points.clear();
+      }
+
+      if (!is_good)
+        break;
+    }
+    tpc.report_finished();
+  }
+  store.finish();
+
+  sw.stop();
+  vw_out(DebugMessage,"asp") << "Point reading and binning time: "
+                             << sw.elapsed_seconds() << std::endl;
+
+  if (store.num_points() == 0)
+    vw_throw( ArgumentErr() << "No valid points were found in the input files.\n" );
+
+  double percentile = 0.0;
+  asp::FilterType filter = asp::parse_filter(opt.filter, percentile);
+
+  // Do not round the DEM heights for small bodies
+  if (georef.datum().semi_major_axis() <= asp::MIN_RADIUS_FOR_ROUNDING ||
+      georef.datum().semi_minor_axis() <= asp::MIN_RADIUS_FOR_ROUNDING){
+    opt.rounding_error = 0.0;
+  }
+
+  std::string base_out_prefix = opt.out_prefix;
+  Vector2 tile_size(vw_settings().default_tile_size(),
+                    vw_settings().default_tile_size());
 
-    // Required second init step for each spacing
-    rasterizer.initialize_spacing(this_spacing);
+  for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
 
-    // Each spacing gets a variation of the output prefix
+    double spacing = opt.dem_spacing[i];
     if (i == 0)
       opt.out_prefix = base_out_prefix;
     else // Write later iterations to a different path.
       opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(i);
-    do_software_rasterization(rasterizer, opt, georef, error_image,
-                              estim_max_error, &num_invalid_pixels);
-  } // End loop through spacings
+
+    // Form the grid the same way as the OrthoRasterizerView
+    BBox3 snapped_bbox = store.bounding_box();
+    if (opt.search_radius_factor > 0)
+      snapped_bbox.expand(spacing*opt.search_radius_factor);
+    asp::snap_bbox(spacing, snapped_bbox);
+    BBox2 snapped_box(subvector(snapped_bbox.min(), 0, 2),
+                      subvector(snapped_bbox.max(), 0, 2));
+    if (opt.target_projwin != BBox2())
+      snapped_box = opt.target_projwin;
+
+    double search_radius = spacing;
+    if (opt.search_radius_factor > 0)
+      search_radius = spacing*opt.search_radius_factor;
+
+    vw::Mutex count_mutex;
+    size_t num_invalid_pixels = 0;
+    asp::StreamingRasterizerView rasterizer(store, snapped_box, spacing,
+                                            search_radius, opt.sigma_factor,
+                                            filter, percentile, opt.nodata_value,
+                                            &num_invalid_pixels, &count_mutex);
+
+    vw_out() << "\t-- Starting DEM rasterization --\n";
+    vw_out() << "\t--> DEM spacing: " <<     spacing << " pt/px\n";
+    vw_out() << "\t             or: " << 1.0/spacing << " px/pt\n";
+
+    georef.set_transform(rasterizer.geo_transform());
+    if ( georef.pixel_interpretation() == cartography::GeoReference::PixelAsArea ) {
+      Matrix3x3 transform = georef.transform();
+      transform(0,2) -= 0.5 * transform(0,0);
+      transform(1,2) -= 0.5 * transform(1,1);
+      georef.set_transform( transform );
+    }
+
+    if (opt.no_dem)
+      continue;
+
+    Stopwatch sw2;
+    sw2.start();
+    ImageViewRef< PixelGray<float> > raster = rasterizer;
+    ImageViewRef< PixelGray<float> > dem
+      = asp::round_image_pixels_skip_nodata(raster, opt.rounding_error,
+                                            opt.nodata_value);
+
+    int hole_fill_len = opt.dem_hole_fill_len;
+    if (hole_fill_len > 0){
+      dem = apply_mask
+        (vw::fill_holes_grass(create_mask
+                               (block_cache(dem, tile_size, opt.num_threads),
+                                opt.nodata_value),
+                               hole_fill_len),
+         opt.nodata_value);
+    }
+
+    Vector2i dem_size = bounding_box(dem).size();
+    vw_out()<< "Creating output file that is " << dem_size << " px.\n";
+    if ((dem_size[0] > opt.max_output_size[0]) || (dem_size[1] > opt.max_output_size[1]))
+      vw_throw( ArgumentErr()
+                << "Requested DEM size is too large, max allowed output size is "
+                << opt.max_output_size << " pixels.\n" );
+
+    asp::save_image(opt, dem, georef, hole_fill_len, "DEM");
+    sw2.stop();
+    vw_out(DebugMessage,"asp") << "DEM render time: " << sw2.elapsed_seconds() << ".\n";
+
+    double invalid_ratio = double(num_invalid_pixels) / (double(dem_size[0])*dem_size[1]);
+    vw_out() << "Percentage of valid pixels = " << 1.0-invalid_ratio << "\n";
+  }
 
   opt.out_prefix = base_out_prefix; // Restore the original value
 }
@@ -1309,6 +1603,11 @@ int main( int argc, char *argv[] ) {
       asp::set_srs_string(opt.target_srs_string, have_user_datum, user_datum, output_georef);
     }
 
+    if (opt.stream_las_csv) {
+      do_streaming_rasterization(opt, output_georef);
+      return 0;
+    }
+
     // Convert any input LAS or CSV files to ASP's point cloud tif format
     // - The output and input datum will match unless the input data files
     //   themselves specify a different datum.
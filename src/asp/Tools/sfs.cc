@@ -81,6 +81,7 @@
 #include <vw/Image/InpaintView.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <vw/Core/CmdUtils.h>
@@ -88,6 +89,7 @@
 #include <asp/IsisIO/IsisCameraModel.h>
 #include <asp/Core/BundleAdjustUtils.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/HorizonShadow.h>
 #include <asp/Camera/RPCModelGen.h>
 #include <ceres/ceres.h>
 #include <ceres/loss_function.h>
@@ -597,11 +599,10 @@ namespace vw { namespace camera {
     // so we iterate to find it.
     virtual Vector2 point_to_pixel(Vector3 const& xyz) const{
 
-      if (m_use_semi_approx){
-        vw::Mutex::Lock lock(m_camera_mutex);
-        g_num_locks++;
+      // The exact camera can be used by many threads at once, so it
+      // needs no lock.
+      if (m_use_semi_approx)
         return m_exact_unadjusted_camera->point_to_pixel(xyz);
-      }
       
       if (m_use_rpc_approximation) 
 	return m_rpc_model->point_to_pixel(xyz);
@@ -734,11 +735,8 @@ namespace vw { namespace camera {
 
     virtual Vector3 pixel_to_vector(Vector2 const& pix) const {
 
-      if (m_use_semi_approx) {
-        vw::Mutex::Lock lock(m_camera_mutex);
-        g_num_locks++;
+      if (m_use_semi_approx)
         return this->exact_unadjusted_camera()->pixel_to_vector(pix);
-      }
 
       if (m_use_rpc_approximation){
 	return m_rpc_model->pixel_to_vector(pix);
@@ -1143,100 +1141,11 @@ void compute_image_stats(ImageT const& I1, ImageT const& I2,
 
 }
 
-// Find the points on a given DEM that are shadowed by other points of
-// the DEM.  Start marching from the point on the DEM on a ray towards
-// the sun in small increments, until hitting the maximum DEM height.
-bool isInShadow(int col, int row, Vector3 & sunPos,
-		ImageView<double> const& dem, double max_dem_height,
-		double gridx, double gridy,
-		cartography::GeoReference const& geo){
-
-  // Here bicubic interpolation won't work. It is easier to interpret
-  // the DEM as piecewise-linear when dealing with rays intersecting
-  // it.
-  InterpolationView<EdgeExtensionView< ImageView<double>,
-    ConstantEdgeExtension >, BilinearInterpolation>
-    interp_dem = interpolate(dem, BilinearInterpolation(),
-			     ConstantEdgeExtension());
-
-  // The xyz position at the center grid point
-  Vector2 dem_llh = geo.pixel_to_lonlat(Vector2(col, row));
-  Vector3 dem_lonlat_height = Vector3(dem_llh(0), dem_llh(1), dem(col, row));
-  Vector3 xyz = geo.datum().geodetic_to_cartesian(dem_lonlat_height);
-
-  // Normalized direction from the view point
-  Vector3 dir = sunPos - xyz;
-  if (dir == Vector3())
-    return false;
-  dir = dir/norm_2(dir);
-
-  // The projection of dir onto the tangent plane at xyz,
-  // that is, the "horizontal" component at the current sphere surface.
-  Vector3 dir2 = dir - dot_prod(dir, xyz)*xyz/dot_prod(xyz, xyz);
-
-  // Ensure that we advance by at most half a grid point each time
-  double delta = 0.5*std::min(gridx, gridy)/std::max(norm_2(dir2), 1e-16);
-
-  // go along the ray. Don't allow the loop to go forever.
-  for (int i = 1; i < 10000000; i++) {
-    Vector3 ray_P = xyz + i * delta * dir;
-    Vector3 ray_llh = geo.datum().cartesian_to_geodetic(ray_P);
-    if (ray_llh[2] > max_dem_height) {
-      // We're above the terrain, no point in continuing
-      return false;
-    }
-
-    // Compensate for any longitude 360 degree offset, e.g., 270 deg vs -90 deg
-    ray_llh[0] += 360.0*round((dem_llh[0] - ray_llh[0])/360.0);
-
-    Vector2 ray_pix = geo.lonlat_to_pixel(Vector2(ray_llh[0], ray_llh[1]));
-
-    if (ray_pix[0] < 0 || ray_pix[0] > dem.cols() - 1 ||
-	ray_pix[1] < 0 || ray_pix[1] > dem.rows() - 1 ) {
-      return false; // got out of the DEM, no point continuing
-    }
-
-    // Dem height at the current point on the ray
-    double dem_h = interp_dem(ray_pix[0], ray_pix[1]);
-
-    if (ray_llh[2] < dem_h) {
-      // The ray goes under the DEM, so we are in shadow.
-      return true;
-    }
-  }
-
-  return false;
-}
-
-void areInShadow(Vector3 & sunPos, ImageView<double> const& dem,
-		 double gridx, double gridy,
-		 cartography::GeoReference const& geo,
-		 ImageView<float> & shadow){
-
-  // Find the max DEM height
-  double max_dem_height = -std::numeric_limits<double>::max();
-  for (int col = 0; col < dem.cols(); col++) {
-    for (int row = 0; row < dem.rows(); row++) {
-      if (dem(col, row) > max_dem_height) {
-	max_dem_height = dem(col, row);
-      }
-    }
-  }
-
-  shadow.set_size(dem.cols(), dem.rows());
-  for (int col = 0; col < dem.cols(); col++) {
-    for (int row = 0; row < dem.rows(); row++) {
-      shadow(col, row) = isInShadow(col, row, sunPos, dem,
-				    max_dem_height, gridx, gridy, geo);
-    }
-  }
-}
-
 struct Options : public vw::cartography::GdalWriteOptions {
   std::string input_dems_str, out_prefix, stereo_session_string, bundle_adjust_prefix;
   std::vector<std::string> input_dems, input_images, input_cameras;
   std::string shadow_thresholds, max_valid_image_vals, skip_images_str, image_exposure_prefix,
-    model_coeffs_prefix, model_coeffs, image_haze_prefix;
+    model_coeffs_prefix, model_coeffs, image_haze_prefix, camera_lookup_prefix;
   std::vector<float> shadow_threshold_vec, max_valid_image_vals_vec;
   std::vector<double> image_exposures_vec;
   std::vector< std::vector<double> > image_haze_vec;
@@ -1250,10 +1159,13 @@ struct Options : public vw::cartography::GdalWriteOptions {
     save_dem_with_nodata, use_approx_camera_models, use_approx_adjusted_camera_models,
     use_rpc_approximation, use_semi_approx,
     crop_input_images, float_dem_at_boundary, boundary_fix, fix_dem, 
-    float_reflectance_model, float_sun_position, query, save_sparingly, float_haze;
+    float_reflectance_model, float_sun_position, query, save_sparingly, float_haze,
+    use_camera_lookup_tables, use_analytic_derivatives;
   double smoothness_weight, integrability_weight, smoothness_weight_pq, init_dem_height, nodata_val,
     initial_dem_constraint_weight, albedo_constraint_weight, camera_position_step_size,
-    rpc_penalty_weight, rpc_max_error, unreliable_intensity_threshold;
+    rpc_penalty_weight, rpc_max_error, unreliable_intensity_threshold,
+    shadow_azimuth_tol, camera_lookup_height_tol;
+  int tile_size, padding;
   vw::BBox2 crop_win;
 
   Options():max_iterations(0), max_coarse_iterations(0), reflectance_type(0),
@@ -1273,12 +1185,15 @@ struct Options : public vw::cartography::GdalWriteOptions {
             float_dem_at_boundary(false), boundary_fix(false), fix_dem(false),
             float_reflectance_model(false), float_sun_position(false),
             query(false), save_sparingly(false), float_haze(false),
+            use_camera_lookup_tables(false), use_analytic_derivatives(false),
 	    smoothness_weight(0), integrability_weight(0), smoothness_weight_pq(0),
             initial_dem_constraint_weight(0.0),
 	    albedo_constraint_weight(0.0),
 	    camera_position_step_size(1.0), rpc_penalty_weight(0.0),
             rpc_max_error(0.0),
             unreliable_intensity_threshold(0.0),
+            shadow_azimuth_tol(0.0), camera_lookup_height_tol(0.0),
+            tile_size(0), padding(50),
 	    crop_win(BBox2i(0, 0, 0, 0)){}
 };
 
@@ -1295,6 +1210,299 @@ struct ModelParams {
   ~ModelParams(){}
 };
 
+// For each DEM pixel, store the image pixel the DEM point projects
+// into, and the height at which it was found. Projecting into ISIS
+// cameras is expensive, so the pixel is looked up, and linearly
+// extrapolated in height, as long as the DEM height stays within a
+// tolerance of the height at which the entry was computed. The rate of
+// change of the pixel with height and the camera center vary slowly
+// over the DEM, so they are kept only on a coarse grid and are
+// interpolated from it. That makes the table 12 bytes per DEM pixel.
+// The table is saved to disk and can be reused by later runs. It is
+// valid only as long as the camera does not change.
+class CameraLookupTable {
+
+public:
+  CameraLookupTable(): m_cols(0), m_rows(0), m_coarse_cols(0), m_coarse_rows(0),
+                       m_height_tol(0.0){}
+
+  bool empty() const { return m_heights.empty(); }
+
+  // Look up the image pixel and camera center for a DEM pixel at given
+  // height. Optionally also return the derivative of the pixel with
+  // respect to the height.
+  bool lookup(int col, int row, double height, Vector2 & pix, Vector3 & cam_ctr,
+              Vector2 * dpix_dh = NULL) const {
+    if (col < 0 || col >= m_cols || row < 0 || row >= m_rows)
+      return false;
+    size_t index = size_t(row)*m_cols + col;
+    double dh = height - m_heights[index];
+    if (boost::math::isnan(m_heights[index]) || std::abs(dh) > m_height_tol)
+      return false;
+
+    // Bilinear interpolation in the coarse grid
+    int    c  = col/COARSE_SPACING, r = row/COARSE_SPACING;
+    double wc = double(col - c*COARSE_SPACING)/COARSE_SPACING;
+    double wr = double(row - r*COARSE_SPACING)/COARSE_SPACING;
+    float const* v00 = coarse_entry(c,   r  );
+    float const* v10 = coarse_entry(c+1, r  );
+    float const* v01 = coarse_entry(c,   r+1);
+    float const* v11 = coarse_entry(c+1, r+1);
+    double vals[NUM_COARSE_VALS];
+    for (int it = 0; it < NUM_COARSE_VALS; it++)
+      vals[it] = (1-wr)*((1-wc)*v00[it] + wc*v10[it]) + wr*((1-wc)*v01[it] + wc*v11[it]);
+    if (boost::math::isnan(vals[0]))
+      return false; // A grid node does not project into the camera
+
+    pix     = Vector2(m_pixels[2*index] + dh*vals[0], m_pixels[2*index + 1] + dh*vals[1]);
+    cam_ctr = Vector3(vals[2], vals[3], vals[4]);
+    if (dpix_dh != NULL)
+      *dpix_dh = Vector2(vals[0], vals[1]);
+    return true;
+  }
+
+  // Recompute the entries whose height differs from the current DEM
+  // height by more than the tolerance. If the table is empty or does not
+  // match the DEM, compute all entries. Use the given number of threads,
+  // if the camera can be used from several threads. Return the number
+  // of recomputed entries.
+  int update(ImageView<double> const& dem, GeoReference const& geo,
+             CameraModel const* camera, double height_tol, int num_threads) {
+
+    m_height_tol = height_tol;
+    bool new_table = (m_cols != dem.cols() || m_rows != dem.rows());
+    if (new_table) {
+      m_cols        = dem.cols();
+      m_rows        = dem.rows();
+      m_coarse_cols = (m_cols - 1)/COARSE_SPACING + 2;
+      m_coarse_rows = (m_rows - 1)/COARSE_SPACING + 2;
+      m_heights.assign(size_t(m_cols)*m_rows, std::numeric_limits<float>::quiet_NaN());
+      m_pixels.assign(2*size_t(m_cols)*m_rows, std::numeric_limits<float>::quiet_NaN());
+      m_coarse.assign(NUM_COARSE_VALS*size_t(m_coarse_cols)*m_coarse_rows,
+                      std::numeric_limits<float>::quiet_NaN());
+    }
+
+    // Split the rows among the threads. The tasks write to different
+    // entries. Without more than one thread, stay in this thread, as
+    // some cameras can be used only from it.
+    int total_rows = new_table ? m_coarse_rows : 0;
+    total_rows += m_rows;
+    std::vector<int> num_updated;
+    if (num_threads <= 1) {
+      num_updated.resize(1, 0);
+      if (new_table)
+        update_rows(dem, geo, camera, true, 0, m_coarse_rows, num_updated[0]);
+      update_rows(dem, geo, camera, false, 0, m_rows, num_updated[0]);
+    } else {
+      int rows_per_task = std::max(1, total_rows/(4*num_threads));
+      int num_tasks     = 0;
+      if (new_table)
+        num_tasks += (m_coarse_rows + rows_per_task - 1)/rows_per_task;
+      num_tasks += (m_rows + rows_per_task - 1)/rows_per_task;
+      num_updated.resize(num_tasks, 0);
+
+      // The coarse grid is needed only by lookups, so it can be made
+      // together with the entries.
+      FifoWorkQueue queue(num_threads);
+      int task_iter = 0;
+      for (int pass = (new_table ? 0 : 1); pass < 2; pass++) {
+        bool coarse   = (pass == 0);
+        int  end_row  = coarse ? m_coarse_rows : m_rows;
+        for (int row = 0; row < end_row; row += rows_per_task) {
+          boost::shared_ptr<Task>
+            task(new UpdateTask(*this, dem, geo, camera, coarse, row,
+                                std::min(end_row, row + rows_per_task),
+                                num_updated[task_iter]));
+          queue.add_task(task);
+          task_iter++;
+        }
+      }
+      queue.join_all();
+    }
+
+    int total = 0;
+    for (size_t it = 0; it < num_updated.size(); it++)
+      total += num_updated[it];
+    return total;
+  }
+
+  // Read the table from disk. Check a sample of the entries against the
+  // camera, as the table may have been created with a different camera
+  // or DEM. Return false if the table is missing or does not agree.
+  bool read(std::string const& file, ImageView<double> const& dem,
+            GeoReference const& geo, CameraModel const* camera) {
+
+    std::ifstream ifs(file.c_str(), std::ios::binary);
+    if (!ifs.good())
+      return false;
+
+    std::string magic;
+    int cols = 0, rows = 0;
+    ifs >> magic >> cols >> rows;
+    ifs.get(); // the newline
+    if (magic != MAGIC || cols != dem.cols() || rows != dem.rows())
+      return false;
+
+    int coarse_cols = (cols - 1)/COARSE_SPACING + 2;
+    int coarse_rows = (rows - 1)/COARSE_SPACING + 2;
+    std::vector<float> heights(size_t(cols)*rows), pixels(2*heights.size()),
+      coarse(NUM_COARSE_VALS*size_t(coarse_cols)*coarse_rows);
+    ifs.read((char*)&heights[0], heights.size()*sizeof(float));
+    ifs.read((char*)&pixels[0],  pixels.size()*sizeof(float));
+    ifs.read((char*)&coarse[0],  coarse.size()*sizeof(float));
+    if (!ifs.good())
+      return false;
+
+    // Compare the table with exact projections on a coarse grid
+    int num_samples = 5;
+    for (int i = 0; i < num_samples; i++) {
+      for (int j = 0; j < num_samples; j++) {
+        int col = (cols - 1)*i/(num_samples - 1);
+        int row = (rows - 1)*j/(num_samples - 1);
+        size_t index = size_t(row)*cols + col;
+        if (boost::math::isnan(heights[index]))
+          continue;
+        Vector2 exact;
+        if (!project(col, row, heights[index], geo, camera, exact) ||
+            norm_2(Vector2(exact[0] - pixels[2*index], exact[1] - pixels[2*index + 1])) > 0.1)
+          return false;
+      }
+    }
+
+    m_cols        = cols;
+    m_rows        = rows;
+    m_coarse_cols = coarse_cols;
+    m_coarse_rows = coarse_rows;
+    m_heights.swap(heights);
+    m_pixels.swap(pixels);
+    m_coarse.swap(coarse);
+    return true;
+  }
+
+  void write(std::string const& file) const {
+    vw_out() << "Writing: " << file << std::endl;
+    std::ofstream ofs(file.c_str(), std::ios::binary);
+    ofs << MAGIC << " " << m_cols << " " << m_rows << "\n";
+    if (!m_heights.empty()) {
+      ofs.write((char const*)&m_heights[0], m_heights.size()*sizeof(float));
+      ofs.write((char const*)&m_pixels[0],  m_pixels.size()*sizeof(float));
+      ofs.write((char const*)&m_coarse[0],  m_coarse.size()*sizeof(float));
+    }
+    if (!ofs.good())
+      vw_throw( ArgumentErr() << "Failed writing: " << file << "\n" );
+  }
+
+private:
+
+  // The values at each node of the coarse grid are the derivative of
+  // the image pixel with respect to height (2) and the camera center
+  // (3), NaN if the node does not project into the camera. The grid
+  // extends one node past the last DEM row and column.
+  static const int NUM_COARSE_VALS = 5;
+  static const int COARSE_SPACING  = 8;
+  static const char * const MAGIC;
+
+  // Find the entries in some rows of the DEM or of the coarse grid
+  class UpdateTask: public Task, private boost::noncopyable {
+    CameraLookupTable       & m_table;
+    ImageView<double>  const& m_dem;
+    GeoReference       const& m_geo;
+    CameraModel        const* m_camera;
+    bool                      m_coarse;
+    int                       m_start_row, m_end_row;
+    int                     & m_num_updated;
+  public:
+    UpdateTask(CameraLookupTable & table, ImageView<double> const& dem,
+               GeoReference const& geo, CameraModel const* camera, bool coarse,
+               int start_row, int end_row, int & num_updated):
+      m_table(table), m_dem(dem), m_geo(geo), m_camera(camera), m_coarse(coarse),
+      m_start_row(start_row), m_end_row(end_row), m_num_updated(num_updated){}
+    void operator()() {
+      m_table.update_rows(m_dem, m_geo, m_camera, m_coarse, m_start_row, m_end_row,
+                          m_num_updated);
+    }
+  };
+
+  float const* coarse_entry(int c, int r) const {
+    return &m_coarse[NUM_COARSE_VALS*(size_t(r)*m_coarse_cols + c)];
+  }
+
+  void update_rows(ImageView<double> const& dem, GeoReference const& geo,
+                   CameraModel const* camera, bool coarse, int start_row, int end_row,
+                   int & num_updated) {
+
+    if (coarse) {
+      for (int r = start_row; r < end_row; r++) {
+        for (int c = 0; c < m_coarse_cols; c++) {
+          int col = c*COARSE_SPACING, row = r*COARSE_SPACING;
+          double height = dem(std::min(col, m_cols - 1), std::min(row, m_rows - 1));
+          compute_coarse_entry(col, row, height, geo, camera,
+                               &m_coarse[NUM_COARSE_VALS*(size_t(r)*m_coarse_cols + c)]);
+        }
+      }
+      return;
+    }
+
+    for (int row = start_row; row < end_row; row++) {
+      for (int col = 0; col < m_cols; col++) {
+        size_t index = size_t(row)*m_cols + col;
+        if (!boost::math::isnan(m_heights[index]) &&
+            std::abs(dem(col, row) - m_heights[index]) <= m_height_tol)
+          continue;
+        Vector2 pix;
+        if (project(col, row, dem(col, row), geo, camera, pix)) {
+          m_heights[index]      = dem(col, row);
+          m_pixels[2*index]     = pix[0];
+          m_pixels[2*index + 1] = pix[1];
+        } else {
+          m_heights[index] = std::numeric_limits<float>::quiet_NaN();
+        }
+        num_updated++;
+      }
+    }
+  }
+
+  static bool project(int col, int row, double height, GeoReference const& geo,
+                      CameraModel const* camera, Vector2 & pix) {
+    Vector2 lonlat = geo.pixel_to_lonlat(Vector2(col, row));
+    try {
+      pix = camera->point_to_pixel
+        (geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], height)));
+    } catch(...){
+      return false;
+    }
+    return true;
+  }
+
+  static void compute_coarse_entry(int col, int row, double height, GeoReference const& geo,
+                                   CameraModel const* camera, float * entry) {
+
+    for (int it = 0; it < NUM_COARSE_VALS; it++)
+      entry[it] = std::numeric_limits<float>::quiet_NaN();
+
+    double dh = 1.0; // in meters
+    Vector2 pix0, pix1;
+    if (!project(col, row, height, geo, camera, pix0) ||
+        !project(col, row, height + dh, geo, camera, pix1))
+      return;
+    try {
+      Vector3 ctr = camera->camera_center(pix0);
+      entry[0] = (pix1[0] - pix0[0])/dh;
+      entry[1] = (pix1[1] - pix0[1])/dh;
+      for (int it = 0; it < 3; it++)
+        entry[2 + it] = ctr[it];
+    } catch(...){
+      // Leave the entry invalid
+    }
+  }
+
+  int m_cols, m_rows, m_coarse_cols, m_coarse_rows;
+  double m_height_tol;
+  std::vector<float> m_heights, m_pixels, m_coarse;
+};
+
+const char * const CameraLookupTable::MAGIC = "ASP_SFS_CAMERA_LOOKUP_TABLE_V2";
+
 // Make the reflectance nonlinear using a rational function
 double nonlin_reflectance(double reflectance, double exposure,
                           double const* haze, int num_haze_coeffs){
@@ -1311,7 +1519,34 @@ double nonlin_reflectance(double reflectance, double exposure,
   vw_throw(ArgumentErr() << "Invalid value for the number of haze coefficients.\n");
   return 0;
 }
-                          
+
+// Same as nonlin_reflectance(), but also return the derivative with
+// respect to the reflectance. The function is a ratio of polynomials
+// in the reflectance, with the coefficients laid out as above.
+double nonlin_reflectance_deriv(double reflectance, double exposure,
+                                double const* haze, int num_haze_coeffs,
+                                double & deriv){
+
+  if (num_haze_coeffs < 0 || num_haze_coeffs > 6)
+    vw_throw(ArgumentErr() << "Invalid value for the number of haze coefficients.\n");
+
+  double P[4] = {0.0, exposure, 0.0, 0.0}; // numerator
+  double Q[4] = {1.0, 0.0,      0.0, 0.0}; // denominator
+  for (int it = 0; it < num_haze_coeffs; it++) {
+    if (it % 2 == 0) P[it/2 + (it > 0 ? 1 : 0)] = haze[it];
+    else             Q[(it + 1)/2]              = haze[it];
+  }
+
+  double r = reflectance; // for short
+  double p  = P[0] + r*(P[1] + r*(P[2] + r*P[3]));
+  double q  = Q[0] + r*(Q[1] + r*(Q[2] + r*Q[3]));
+  double dp = P[1] + r*(2.0*P[2] + 3.0*r*P[3]);
+  double dq = Q[1] + r*(2.0*Q[2] + 3.0*r*Q[3]);
+
+  deriv = (dp*q - p*dq)/(q*q);
+  return p/q;
+}
+
 enum {NO_REFL = 0, LAMBERT, LUNAR_LAMBERT, HAPKE, ARBITRARY_MODEL, CHARON};
 
 // computes the Lambertian reflectance model (cosine of the light
@@ -1719,34 +1954,193 @@ double ComputeReflectance(Vector3 const& cameraPosition,
   return input_img_reflectance;
 }
 
-bool computeReflectanceAndIntensity(double left_h, double center_h, double right_h,
-				    double bottom_h, double top_h,
-                                    bool use_pq, double p, double q, // dem partial derivatives
-				    int col, int row,
-				    ImageView<double>         const& dem,
-				    cartography::GeoReference const& geo,
-				    bool model_shadows,
-				    double max_dem_height,
-				    double gridx, double gridy,
-				    ModelParams  const & model_params,
-				    GlobalParams const & global_params,
-				    BBox2i       const & crop_box,
-				    MaskedImgT   const & image,
-				    DoubleImgT   const & blend_weight,
-				    CameraModel  const * camera,
-                                    double       const * scaled_sun_posn,
-				    PixelMask<double>  & reflectance,
-				    PixelMask<double>  & intensity,
-				    double             & weight,
-                                    const double       * reflectance_model_coeffs) {
+// The Lambertian, Lunar-Lambertian, and Hapke models from above,
+// written in terms of mu_0 (cosine of the angle between the sun
+// direction and the normal), mu (same for the view direction), and the
+// cosine of the phase angle. Also return the partial derivatives of the
+// reflectance with respect to mu_0 and mu, which the analytic
+// derivatives of the intensity error use. ReflectanceRow below uses
+// only the reflectance.
+inline double lambertianReflectance(double mu_0, double mu, double cos_alpha,
+                                    double & dR_dmu0, double & dR_dmu) {
+  dR_dmu0 = 1.0;
+  dR_dmu  = 0.0;
+  return mu_0;
+}
 
-  // Set output values
-  reflectance = 0.0; reflectance.invalidate();
-  intensity   = 0.0; intensity.invalidate();
-  weight      = 0.0;
-  
-  if (col >= dem.cols() - 1 || row >= dem.rows() - 1) return false;
-  if (crop_box.empty()) return false;
+inline double lunarLambertianReflectance(double mu_0, double mu, double cos_alpha,
+                                         double phaseCoeffC1, double phaseCoeffC2,
+                                         const double * reflectance_model_coeffs,
+                                         double & dR_dmu0, double & dR_dmu) {
+
+  double alpha     = acos(cos_alpha);  // phase angle in radians
+  double deg_alpha = alpha*180.0/M_PI; // phase angle in degrees
+
+  double O = reflectance_model_coeffs[0];
+  double A = reflectance_model_coeffs[1];
+  double B = reflectance_model_coeffs[2];
+  double C = reflectance_model_coeffs[3];
+  double L = O + deg_alpha*(A + deg_alpha*(B + deg_alpha*C));
+
+  double phase = exp(-phaseCoeffC1*alpha) + phaseCoeffC2;
+  double s     = mu_0 + mu;
+  double R     = 2*L*mu_0/s + (1-L)*mu_0;
+
+  // The scalar version returns 0 in these cases
+  bool valid = (s != 0 && R == R);
+  R       = valid ? phase*R                           : 0.0;
+  dR_dmu0 = valid ? phase*(2*L*mu/(s*s) + (1-L))      : 0.0;
+  dR_dmu  = valid ? -phase*2*L*mu_0/(s*s)             : 0.0;
+  return R;
+}
+
+inline double hapkeReflectance(double mu_0, double mu, double cos_g,
+                               const double * reflectance_model_coeffs,
+                               double & dR_dmu0, double & dR_dmu) {
+
+  double omega = std::abs(reflectance_model_coeffs[0]);
+  double b     = std::abs(reflectance_model_coeffs[1]);
+  double c     = std::abs(reflectance_model_coeffs[2]);
+  double B0    = std::abs(reflectance_model_coeffs[3]);
+  double h     = std::abs(reflectance_model_coeffs[4]);
+
+  double g  = acos(cos_g);
+  double Pg = (1.0 - c) * (1.0 - b*b) / pow(1.0 + 2.0*b*cos_g + b*b, 1.5)
+    +         c         * (1.0 - b*b) / pow(1.0 - 2.0*b*cos_g + b*b, 1.5);
+  double Bg = B0 / ( 1.0 + (1.0/h)*tan(g/2.0) );
+
+  // H(x) = (1 + 2x)/(1 + 2x*sq), H'(x) = 2(1 - sq)/(1 + 2x*sq)^2
+  double sq    = sqrt(1.0 - omega);
+  double d_mu0 = 1.0 + 2*mu_0*sq;
+  double d_mu  = 1.0 + 2*mu  *sq;
+  double H_mu0 = (1.0 + 2*mu_0)/d_mu0;
+  double H_mu  = (1.0 + 2*mu  )/d_mu;
+  double dH_mu0 = 2.0*(1.0 - sq)/(d_mu0*d_mu0);
+  double dH_mu  = 2.0*(1.0 - sq)/(d_mu *d_mu );
+
+  double K = omega/4.0/M_PI;
+  double s = mu_0 + mu;
+  double F = mu_0/s;
+  double G = (1.0 + Bg)*Pg + H_mu0*H_mu - 1.0;
+
+  dR_dmu0 = K*( (mu/(s*s))*G   + F*dH_mu0*H_mu );
+  dR_dmu  = K*( (-mu_0/(s*s))*G + F*H_mu0*dH_mu );
+  return K*F*G;
+}
+
+// Storage for the reflectance at a row of DEM pixels, as used when
+// finding the reflectance and intensity of a whole DEM for the outputs
+// and at each iteration. The solver does not use this, its cost
+// functions are evaluated one pixel at a time. The sun and view
+// directions and the normals are unit vectors.
+struct ReflectanceRow {
+  std::vector<double> sun_x,  sun_y,  sun_z;  // direction to the sun
+  std::vector<double> view_x, view_y, view_z; // direction to the camera
+  std::vector<double> nx,     ny,     nz;     // surface normal
+  std::vector<double> refl;                   // the reflectance
+  std::vector<double> mu_0, mu, cos_alpha, dR_dmu0, dR_dmu; // scratch space
+
+  int size() const { return refl.size(); }
+
+  // Resize all arrays. This does not free memory, so the storage can be
+  // reused for all rows of a DEM without further allocations.
+  void resize(int n) {
+    std::vector<double> * arrays[] = {&sun_x, &sun_y, &sun_z, &view_x, &view_y, &view_z,
+                                      &nx, &ny, &nz, &refl,
+                                      &mu_0, &mu, &cos_alpha, &dR_dmu0, &dR_dmu};
+    for (size_t it = 0; it < sizeof(arrays)/sizeof(arrays[0]); it++)
+      arrays[it]->resize(n);
+  }
+
+  // Set the inputs at given index from the sun and camera positions,
+  // the ground point, and the normal there
+  void set(int i, Vector3 const& sunPos, Vector3 const& viewPos,
+           Vector3 const& xyz, Vector3 const& normal) {
+    Vector3 sunDir  = normalize(sunPos  - xyz);
+    Vector3 viewDir = normalize(viewPos - xyz);
+    sun_x[i]  = sunDir[0];  sun_y[i]  = sunDir[1];  sun_z[i]  = sunDir[2];
+    view_x[i] = viewDir[0]; view_y[i] = viewDir[1]; view_z[i] = viewDir[2];
+    nx[i]     = normal[0];  ny[i]     = normal[1];  nz[i]     = normal[2];
+  }
+};
+
+// Compute the reflectance for all pixels in the row, with the model
+// chosen once for the row rather than per pixel.
+void computeReflectanceRow(GlobalParams const& global_params,
+                           const double * reflectance_model_coeffs,
+                           ReflectanceRow & row) {
+
+  int n = row.size();
+  if (n == 0) return;
+
+  double const* sx = &row.sun_x[0];  double const* sy = &row.sun_y[0];
+  double const* sz = &row.sun_z[0];
+  double const* vx = &row.view_x[0]; double const* vy = &row.view_y[0];
+  double const* vz = &row.view_z[0];
+  double const* nx = &row.nx[0];     double const* ny = &row.ny[0];
+  double const* nz = &row.nz[0];
+  double * mu_0      = &row.mu_0[0];
+  double * mu        = &row.mu[0];
+  double * cos_alpha = &row.cos_alpha[0];
+  double * dR_dmu0   = &row.dR_dmu0[0];
+  double * dR_dmu    = &row.dR_dmu[0];
+  double * refl      = &row.refl[0];
+
+  for (int i = 0; i < n; i++) {
+    mu_0[i]      = sx[i]*nx[i] + sy[i]*ny[i] + sz[i]*nz[i];
+    mu[i]        = vx[i]*nx[i] + vy[i]*ny[i] + vz[i]*nz[i];
+    cos_alpha[i] = sx[i]*vx[i] + sy[i]*vy[i] + sz[i]*vz[i];
+  }
+
+  switch (global_params.reflectanceType) {
+  case LAMBERT:
+    for (int i = 0; i < n; i++)
+      refl[i] = lambertianReflectance(mu_0[i], mu[i], cos_alpha[i], dR_dmu0[i], dR_dmu[i]);
+    break;
+  case LUNAR_LAMBERT:
+    for (int i = 0; i < n; i++)
+      refl[i] = lunarLambertianReflectance(mu_0[i], mu[i], cos_alpha[i],
+                                           global_params.phaseCoeffC1,
+                                           global_params.phaseCoeffC2,
+                                           reflectance_model_coeffs,
+                                           dR_dmu0[i], dR_dmu[i]);
+    break;
+  case HAPKE:
+    for (int i = 0; i < n; i++)
+      refl[i] = hapkeReflectance(mu_0[i], mu[i], cos_alpha[i], reflectance_model_coeffs,
+                                 dR_dmu0[i], dR_dmu[i]);
+    break;
+  default:
+    {
+      // Use the scalar code. With the ground point at the origin the
+      // sun and camera positions are the same as the directions.
+      ModelParams model_params;
+      for (int i = 0; i < n; i++) {
+        double phase_angle = 0.0;
+        model_params.sunPosition = Vector3(sx[i], sy[i], sz[i]);
+        refl[i] = ComputeReflectance(Vector3(vx[i], vy[i], vz[i]),
+                                     Vector3(nx[i], ny[i], nz[i]), Vector3(),
+                                     model_params, global_params, phase_angle,
+                                     reflectance_model_coeffs);
+      }
+    }
+  }
+}
+
+// Find the xyz position of a DEM grid point and the normal there, from
+// the heights at that point and its four neighbors, and project that
+// point into the camera. Return false if the projection fails.
+bool computeNormalAndProjection(double left_h, double center_h, double right_h,
+                                double bottom_h, double top_h,
+                                bool use_pq, double p, double q, // dem partial derivatives
+                                int col, int row,
+                                cartography::GeoReference const& geo,
+                                CameraLookupTable const& camera_lookup,
+                                double gridx, double gridy,
+                                GlobalParams const & global_params,
+                                CameraModel  const * camera,
+                                Vector3 & base, Vector3 & normal,
+                                Vector2 & pix, Vector3 & cameraPosition) {
 
   if (use_pq) {
     // p is defined as (right_h - left_h)/(2*gridx)
@@ -1762,7 +2156,7 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   Vector2 lonlat = geo.pixel_to_lonlat(Vector2(col, row));
   double h = center_h;
   Vector3 lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 base = geo.datum().geodetic_to_cartesian(lonlat3);
+  base = geo.datum().geodetic_to_cartesian(lonlat3);
 
   // The xyz position at the left grid point
   lonlat = geo.pixel_to_lonlat(Vector2(col-1, row));
@@ -1792,40 +2186,41 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   Vector3 dx = right - left;
   Vector3 dy = bottom - top;
 
-  Vector3 normal = -normalize(cross_prod(dx, dy)); // so normal points up
-
-  ModelParams local_model_params = model_params;
+  normal = -normalize(cross_prod(dx, dy)); // so normal points up
 
-  // Update the sun position using the scaled sun position variable 
-  for (int it = 0; it < 3; it++) 
-    local_model_params.sunPosition[it] = scaled_sun_posn[it] * model_params.sunPosition[it]; 
-    
   // Update the camera position for the given pixel (camera position
   // is pixel-dependent for linescan cameras.
-  Vector2 pix;
-  Vector3 cameraPosition;
   try {
-    pix = camera->point_to_pixel(base);
+    // Use the precomputed projection if available for this height
+    if (!camera_lookup.lookup(col, row, center_h, pix, cameraPosition)) {
+      pix = camera->point_to_pixel(base);
     
-    // Need camera center only for Lunar Lambertian
-    if ( global_params.reflectanceType != LAMBERT ) {
-      cameraPosition = camera->camera_center(pix);
+      // Need camera center only for Lunar Lambertian
+      if ( global_params.reflectanceType != LAMBERT ) {
+        cameraPosition = camera->camera_center(pix);
+      }
     }
     
   } catch(...){
-    reflectance = 0.0; reflectance.invalidate();
-    intensity   = 0.0; intensity.invalidate();
-    weight      = 0.0;
     return false;
   }
-  
-  double phase_angle;
-  reflectance = ComputeReflectance(cameraPosition,
-				   normal, base, local_model_params,
-				   global_params, phase_angle,
-                                   reflectance_model_coeffs);
-  reflectance.validate();
 
+  return true;
+}
+
+// Given the reflectance at a DEM grid point and the camera pixel that
+// point projects into, find the image intensity and blending weight
+// there, and zero the reflectance if the point is in shadow. If the
+// intensity cannot be found, invalidate all outputs and return false.
+bool sampleIntensity(int col, int row, Vector2 pix,
+                     bool model_shadows,
+                     ImageView<float> const& shadow_mask,
+                     BBox2i       const & crop_box,
+                     MaskedImgT   const & image,
+                     DoubleImgT   const & blend_weight,
+                     PixelMask<double>  & reflectance,
+                     PixelMask<double>  & intensity,
+                     double             & weight) {
 
   // Since our image is cropped
   pix -= crop_box.min();
@@ -1861,11 +2256,10 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
     return false;
   }
 
-
   if (model_shadows) {
-    bool inShadow = isInShadow(col, row, local_model_params.sunPosition,
-			       dem, max_dem_height, gridx, gridy,
-			       geo);
+    // The shadow mask is computed for the whole DEM ahead of time
+    bool inShadow = (col < shadow_mask.cols() && row < shadow_mask.rows() &&
+                     shadow_mask(col, row) > 0);
 
     if (inShadow) {
       // The reflectance is valid, it is just zero
@@ -1877,11 +2271,68 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   return true;
 }
 
+bool computeReflectanceAndIntensity(double left_h, double center_h, double right_h,
+				    double bottom_h, double top_h,
+                                    bool use_pq, double p, double q, // dem partial derivatives
+				    int col, int row,
+				    ImageView<double>         const& dem,
+				    cartography::GeoReference const& geo,
+				    bool model_shadows,
+				    ImageView<float> const& shadow_mask,
+				    CameraLookupTable const& camera_lookup,
+				    double gridx, double gridy,
+				    ModelParams  const & model_params,
+				    GlobalParams const & global_params,
+				    BBox2i       const & crop_box,
+				    MaskedImgT   const & image,
+				    DoubleImgT   const & blend_weight,
+				    CameraModel  const * camera,
+                                    double       const * scaled_sun_posn,
+				    PixelMask<double>  & reflectance,
+				    PixelMask<double>  & intensity,
+				    double             & weight,
+                                    const double       * reflectance_model_coeffs) {
+
+  // Set output values
+  reflectance = 0.0; reflectance.invalidate();
+  intensity   = 0.0; intensity.invalidate();
+  weight      = 0.0;
+  
+  if (col >= dem.cols() - 1 || row >= dem.rows() - 1) return false;
+  if (crop_box.empty()) return false;
+
+  Vector3 base, normal, cameraPosition;
+  Vector2 pix;
+  if (!computeNormalAndProjection(left_h, center_h, right_h, bottom_h, top_h,
+                                  use_pq, p, q, col, row, geo, camera_lookup,
+                                  gridx, gridy, global_params, camera,
+                                  base, normal, pix, cameraPosition))
+    return false;
+
+  ModelParams local_model_params = model_params;
+
+  // Update the sun position using the scaled sun position variable 
+  for (int it = 0; it < 3; it++) 
+    local_model_params.sunPosition[it] = scaled_sun_posn[it] * model_params.sunPosition[it]; 
+    
+  double phase_angle;
+  reflectance = ComputeReflectance(cameraPosition,
+				   normal, base, local_model_params,
+				   global_params, phase_angle,
+                                   reflectance_model_coeffs);
+  reflectance.validate();
+
+  return sampleIntensity(col, row, pix, model_shadows, shadow_mask,
+                         crop_box, image, blend_weight,
+                         reflectance, intensity, weight);
+}
+
 void computeReflectanceAndIntensity(ImageView<double> const& dem,
                                     ImageView<Vector2> const& pq,
                                     cartography::GeoReference const& geo,
 				    bool model_shadows,
-				    double & max_dem_height, // alias
+				    ImageView<float> const& shadow_mask,
+				    CameraLookupTable const& camera_lookup,
 				    double gridx, double gridy,
                                     int sample_col_rate, int sample_row_rate,
 				    ModelParams const& model_params,
@@ -1896,19 +2347,6 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
 				    ImageView< double            > & weight,
                                     const double * reflectance_model_coeffs) {
 
-  // Update max_dem_height
-  max_dem_height = -std::numeric_limits<double>::max();
-  if (model_shadows) {
-    for (int col = 0; col < dem.cols(); col += sample_col_rate) {
-      for (int row = 0; row < dem.rows(); row += sample_row_rate) {
-        if (dem(col, row) > max_dem_height) {
-          max_dem_height = dem(col, row);
-        }
-      }
-    }
-    vw_out() << "Maximum DEM height: " << max_dem_height << std::endl;
-  }
-  
   // Init the reflectance and intensity as invalid. Do it at all grid
   // points, not just where we sample, to ensure that these quantities
   // are fully initialized.
@@ -1923,27 +2361,51 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
     }
   }
 
+  if (crop_box.empty()) return;
+
+  // Process the DEM a row at a time. First find the normals and the
+  // projections into the camera, then the reflectance for the whole
+  // row at once, then the image intensities.
   bool use_pq = (pq.cols() > 0 && pq.rows() > 0);
-  for (int col = 1; col < dem.cols()-1; col += sample_col_rate) {
-    for (int row = 1; row < dem.rows()-1; row += sample_row_rate) {
+  ReflectanceRow refl_row;
+  std::vector<int> cols;
+  std::vector<Vector2> pixels;
+  for (int row = 1; row < dem.rows()-1; row += sample_row_rate) {
+
+    refl_row.resize(dem.cols());
+    cols.clear();
+    pixels.clear();
+    for (int col = 1; col < dem.cols()-1; col += sample_col_rate) {
       
       double pval = 0, qval = 0;
       if (use_pq) {
         pval = pq(col, row)[0];
         qval = pq(col, row)[1];
       }
-      computeReflectanceAndIntensity(dem(col-1, row), dem(col, row), dem(col+1, row),
-                                     dem(col, row+1), dem(col, row-1),
-                                     use_pq, pval, qval,
-				     col, row, dem,  geo,
-				     model_shadows, max_dem_height,
-				     gridx, gridy,
-				     model_params, global_params,
-				     crop_box, image, blend_weight, camera,
-                                     scaled_sun_posn, 
-				     reflectance(col, row), intensity(col, row),
-                                     weight(col, row),
-                                     reflectance_model_coeffs);
+      Vector3 base, normal, cameraPosition;
+      Vector2 pix;
+      if (!computeNormalAndProjection(dem(col-1, row), dem(col, row), dem(col+1, row),
+                                      dem(col, row+1), dem(col, row-1),
+                                      use_pq, pval, qval, col, row, geo, camera_lookup,
+                                      gridx, gridy, global_params, camera,
+                                      base, normal, pix, cameraPosition))
+        continue;
+
+      refl_row.set(cols.size(), sunPos, cameraPosition, base, normal);
+      cols.push_back(col);
+      pixels.push_back(pix);
+    }
+
+    refl_row.resize(cols.size());
+    computeReflectanceRow(global_params, reflectance_model_coeffs, refl_row);
+
+    for (size_t it = 0; it < cols.size(); it++) {
+      int col = cols[it];
+      reflectance(col, row) = refl_row.refl[it];
+      reflectance(col, row).validate();
+      sampleIntensity(col, row, pixels[it], model_shadows, shadow_mask,
+                      crop_box, image, blend_weight,
+                      reflectance(col, row), intensity(col, row), weight(col, row));
     }
   }
 
@@ -1958,6 +2420,17 @@ std::string haze_file_name(std::string const& prefix){
   return prefix + "-haze.txt";
 }
 
+// The camera lookup table for a given image, coarseness level, and DEM clip
+std::string camera_lookup_file_name(std::string const& prefix, std::string const& image_file,
+                                    int level, int dem_iter, int num_dems){
+  std::ostringstream os;
+  os << prefix << "-" << fs::path(image_file).stem().string() << "-camera-lookup";
+  if (level > 0)    os << "-level" << level;
+  if (num_dems > 1) os << "-clip"  << dem_iter;
+  os << ".bin";
+  return os.str();
+}
+
 std::string model_coeffs_file_name(std::string const& prefix){
   return prefix + "-model_coeffs.txt";
 }
@@ -2029,6 +2502,25 @@ boost::shared_ptr<CameraModel> get_isis_cam(Options const& opt,
   return isis_cam;
 }
 
+// Exact ISIS cameras can be used by many threads at once only if the
+// SPICE data is attached to the cubes, so that NAIF is not used.
+bool isis_cams_support_multi_threading
+(Options const& opt,
+ std::vector< std::vector<boost::shared_ptr<CameraModel> > > const& cameras) {
+  for (size_t dem_iter = 0; dem_iter < cameras.size(); dem_iter++) {
+    for (size_t image_iter = 0; image_iter < cameras[dem_iter].size(); image_iter++) {
+      if (cameras[dem_iter][image_iter].get() == NULL)
+        continue;
+      bool allow_unadjusted = true;
+      boost::shared_ptr<CameraModel> cam
+        = get_isis_cam(opt, cameras[dem_iter][image_iter], allow_unadjusted);
+      if (!dynamic_cast<IsisCameraModel*>(cam.get())->supports_multi_threading())
+        return false;
+    }
+  }
+  return true;
+}
+
 // Find the sun azimuth and elevation at the lon-lat position of the
 // center of the DEM. The result can change depending on the DEM.
 void sun_angles(Options const& opt,
@@ -2085,6 +2577,50 @@ void sun_angles(Options const& opt,
   
 }
 
+// Compute the shadow masks of a DEM clip for all images. Images with
+// close Sun azimuths share the horizon computation.
+void computeShadowMasks(ImageView<double> const& dem, GeoReference const& geo,
+                        std::vector<ModelParams> const& model_params,
+                        std::vector<double> const& scaled_sun_posns,
+                        double shadow_azimuth_tol,
+                        std::vector< ImageView<float> > & shadow_masks){
+
+  int num_images = model_params.size();
+  std::vector<Vector3> sun_positions(num_images);
+  for (int image_iter = 0; image_iter < num_images; image_iter++) {
+    for (int it = 0; it < 3; it++) 
+      sun_positions[image_iter][it] = scaled_sun_posns[3*image_iter + it]
+        * model_params[image_iter].sunPosition[it];
+  }
+
+  asp::HorizonShadow horizon_shadow(dem, geo);
+  horizon_shadow.compute_shadows(sun_positions, shadow_azimuth_tol*M_PI/180.0,
+                                 shadow_masks);
+}
+
+// Compute the shadow masks for all DEM clips and images, if shadows are
+// modeled.
+void computeShadowMasks(Options const& opt,
+                        std::vector< ImageView<double> > const& dems,
+                        std::vector<GeoReference> const& geo,
+                        std::vector<ModelParams> const& model_params,
+                        std::vector<double> const& scaled_sun_posns,
+                        std::vector< std::vector< ImageView<float> > > & shadow_masks){
+
+  int num_images = model_params.size();
+  int num_dems   = dems.size();
+  shadow_masks.clear();
+  shadow_masks.resize(num_dems, std::vector< ImageView<float> >(num_images));
+  if (!opt.model_shadows)
+    return;
+
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    vw_out() << "Computing shadows for clip " << dem_iter << ".\n";
+    computeShadowMasks(dems[dem_iter], geo[dem_iter], model_params, scaled_sun_posns,
+                       opt.shadow_azimuth_tol, shadow_masks[dem_iter]);
+  }
+}
+
 // A function to invoke at every iteration of ceres.
 // We need a lot of global variables to do something useful.
 Options                                const * g_opt = NULL;
@@ -2105,7 +2641,8 @@ std::vector<double>                          * g_exposures = NULL;
 std::vector< std::vector<double> >           * g_haze = NULL;
 std::vector<double>                          * g_adjustments = NULL;
 std::vector<double>                          * g_scaled_sun_posns = NULL;
-std::vector<double>                          * g_max_dem_height = NULL;
+std::vector< std::vector< ImageView<float> > > * g_shadow_masks = NULL;
+std::vector< std::vector<CameraLookupTable> >  * g_camera_lookups = NULL;
 double                                       * g_gridx = NULL;
 double                                       * g_gridy = NULL;
 int                                            g_level = -1;
@@ -2176,6 +2713,30 @@ public:
 
     int num_dems = (*g_dem).size();
     for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+
+      // Find the shadows again from the current DEM, as it changes
+      // while it is solved for.
+      if (g_opt->model_shadows)
+        computeShadowMasks((*g_dem)[dem_iter], (*g_geo)[dem_iter], *g_model_params,
+                           *g_scaled_sun_posns, g_opt->shadow_azimuth_tol,
+                           (*g_shadow_masks)[dem_iter]);
+
+      // Refresh the camera lookup tables where the DEM moved. Save
+      // them at the end, for use in later runs.
+      if (g_opt->use_camera_lookup_tables) {
+        for (size_t image_iter = 0; image_iter < (*g_masked_images)[dem_iter].size(); image_iter++) {
+          if (g_opt->skip_images[dem_iter].find(image_iter) !=
+              g_opt->skip_images[dem_iter].end()) continue;
+          CameraLookupTable & table = (*g_camera_lookups)[dem_iter][image_iter];
+          table.update((*g_dem)[dem_iter], (*g_geo)[dem_iter],
+                       (*g_cameras)[dem_iter][image_iter].get(),
+                       g_opt->camera_lookup_height_tol, g_opt->num_threads);
+          if (g_final_iter)
+            table.write(camera_lookup_file_name(g_opt->out_prefix,
+                                                g_opt->input_images[image_iter],
+                                                g_level, dem_iter, num_dems));
+        }
+      }
       
       // Apply the most recent adjustments to the cameras.
       for (size_t image_iter = 0; image_iter < (*g_masked_images)[dem_iter].size(); image_iter++) {
@@ -2301,7 +2862,8 @@ public:
         computeReflectanceAndIntensity((*g_dem)[dem_iter], (*g_pq)[dem_iter],
                                        (*g_geo)[dem_iter],
                                        g_opt->model_shadows,
-                                       (*g_max_dem_height)[dem_iter],
+                                       (*g_shadow_masks)[dem_iter][image_iter],
+                                       (*g_camera_lookups)[dem_iter][image_iter],
                                        *g_gridx, *g_gridy,
                                        sample_col_rate, sample_row_rate,
                                        (*g_model_params)[image_iter],
@@ -2412,9 +2974,7 @@ public:
         // Dump the points in shadow
         ImageView<float> shadow; // don't use int, scaled weirdly by ASP on reading
         
-        Vector3 sunPos = // all wrong here &(*g_scaled_sun_posns)[3*image_iter]; // fix here
-        // = (*g_model_params)[image_iter].sunPosition;
-        areInShadow(sunPos, (*g_dem)[dem_iter], *g_gridx, *g_gridy,  (*g_geo)[dem_iter], shadow);
+        shadow = (*g_shadow_masks)[dem_iter][image_iter];
 
 	std::string out_shadow_file = iter_str2 + "-shadow.tif";
         vw_out() << "Writing: " << out_shadow_file << std::endl;
@@ -2462,7 +3022,8 @@ calc_intensity_residual(const F* const exposure,
                         cartography::GeoReference         const & m_geo,            // alias
                         bool                                      m_model_shadows,
                         double                                    m_camera_position_step_size,
-                        double                            const & m_max_dem_height, // alias
+                        ImageView<float>                  const & m_shadow_mask,    // alias
+                        CameraLookupTable                 const & m_camera_lookup,  // alias
                         double                                    m_gridx,
                         double                                    m_gridy,
                         GlobalParams                      const & m_global_params,  // alias
@@ -2531,7 +3092,8 @@ calc_intensity_residual(const F* const exposure,
                                      bottom[0], top[0],
                                      use_pq, p, q,
                                      m_col, m_row,  m_dem, m_geo,
-                                     m_model_shadows, m_max_dem_height,
+                                     m_model_shadows, m_shadow_mask,
+                                     m_camera_lookup,
                                      m_gridx, m_gridy,
                                      m_model_params,  m_global_params,
                                      m_crop_box, m_image, m_blend_weight, camera,
@@ -2569,7 +3131,8 @@ struct IntensityError {
 		 cartography::GeoReference const& geo,
 		 bool model_shadows,
 		 double camera_position_step_size,
-		 double const& max_dem_height, // note: this is an alias
+		 ImageView<float> const& shadow_mask, // note: this is an alias
+		 CameraLookupTable const& camera_lookup, // alias
 		 double gridx, double gridy,
 		 GlobalParams const& global_params,
 		 ModelParams const& model_params,
@@ -2581,7 +3144,8 @@ struct IntensityError {
     m_col(col), m_row(row), m_dem(dem), m_geo(geo),
     m_model_shadows(model_shadows),
     m_camera_position_step_size(camera_position_step_size),
-    m_max_dem_height(max_dem_height),
+    m_shadow_mask(shadow_mask),
+    m_camera_lookup(camera_lookup),
     m_gridx(gridx), m_gridy(gridy),
     m_global_params(global_params),
     m_model_params(model_params),
@@ -2621,7 +3185,8 @@ struct IntensityError {
                                    m_geo,  // alias
                                    m_model_shadows,  
                                    m_camera_position_step_size,  
-                                   m_max_dem_height,  // alias
+                                   m_shadow_mask,  // alias
+                                   m_camera_lookup,  // alias
                                    m_gridx, m_gridy,  
                                    m_global_params,   // alias
                                    m_model_params,    // alias
@@ -2639,7 +3204,8 @@ struct IntensityError {
 				     vw::cartography::GeoReference const& geo,
 				     bool model_shadows,
 				     double camera_position_step_size,
-				     double const& max_dem_height, // alias
+				     ImageView<float> const& shadow_mask, // alias
+				     CameraLookupTable const& camera_lookup, // alias
 				     double gridx, double gridy,
 				     GlobalParams const& global_params,
 				     ModelParams const& model_params,
@@ -2653,7 +3219,8 @@ struct IntensityError {
 	    (new IntensityError(col, row, dem, geo,
 				model_shadows,
 				camera_position_step_size,
-				max_dem_height,
+				shadow_mask,
+				camera_lookup,
 				gridx, gridy,
 				global_params, model_params,
 				crop_box, image, blend_weight, scaled_sun_posn, camera)));
@@ -2664,7 +3231,8 @@ struct IntensityError {
   cartography::GeoReference         const & m_geo;            // alias
   bool                                      m_model_shadows;
   double                                    m_camera_position_step_size;
-  double                            const & m_max_dem_height; // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
+  CameraLookupTable                 const & m_camera_lookup;  // alias
   double                                    m_gridx, m_gridy;
   GlobalParams                      const & m_global_params;  // alias
   ModelParams                       const & m_model_params;   // alias
@@ -2687,7 +3255,8 @@ struct IntensityErrorFloatDemOnly {
                              cartography::GeoReference const& geo,
                              bool model_shadows,
                              double camera_position_step_size,
-                             double const& max_dem_height, // note: this is an alias
+                             ImageView<float> const& shadow_mask, // note: this is an alias
+                             CameraLookupTable const& camera_lookup, // alias
                              double gridx, double gridy,
                              GlobalParams const& global_params,
                              ModelParams const& model_params,
@@ -2702,7 +3271,8 @@ struct IntensityErrorFloatDemOnly {
     m_geo(geo),
     m_model_shadows(model_shadows),
     m_camera_position_step_size(camera_position_step_size),
-    m_max_dem_height(max_dem_height),
+    m_shadow_mask(shadow_mask),
+    m_camera_lookup(camera_lookup),
     m_gridx(gridx), m_gridy(gridy),
     m_global_params(global_params),
     m_model_params(model_params),
@@ -2735,7 +3305,8 @@ struct IntensityErrorFloatDemOnly {
                                    m_geo,  // alias
                                    m_model_shadows,  
                                    m_camera_position_step_size,  
-                                   m_max_dem_height,  // alias
+                                   m_shadow_mask,  // alias
+                                   m_camera_lookup,  // alias
                                    m_gridx, m_gridy,  
                                    m_global_params,   // alias
                                    m_model_params,    // alias
@@ -2758,7 +3329,8 @@ struct IntensityErrorFloatDemOnly {
 				     vw::cartography::GeoReference const& geo,
 				     bool model_shadows,
 				     double camera_position_step_size,
-				     double const& max_dem_height, // alias
+				     ImageView<float> const& shadow_mask, // alias
+				     CameraLookupTable const& camera_lookup, // alias
 				     double gridx, double gridy,
 				     GlobalParams const& global_params,
 				     ModelParams const& model_params,
@@ -2775,7 +3347,8 @@ struct IntensityErrorFloatDemOnly {
                                             geo,
                                             model_shadows,
                                             camera_position_step_size,
-                                            max_dem_height,
+                                            shadow_mask,
+                                            camera_lookup,
                                             gridx, gridy,
                                             global_params, model_params,
                                             crop_box, image, blend_weight, scaled_sun_posn, camera)));
@@ -2791,7 +3364,8 @@ struct IntensityErrorFloatDemOnly {
   cartography::GeoReference         const & m_geo;            // alias
   bool                                      m_model_shadows;
   double                                    m_camera_position_step_size;
-  double                            const & m_max_dem_height; // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
+  CameraLookupTable                 const & m_camera_lookup;  // alias
   double                                    m_gridx, m_gridy;
   GlobalParams                      const & m_global_params;  // alias
   ModelParams                       const & m_model_params;   // alias
@@ -2802,6 +3376,297 @@ struct IntensityErrorFloatDemOnly {
   boost::shared_ptr<CameraModel>    const & m_camera;         // alias
 };
 
+// Same as IntensityErrorFloatDemOnly, but with analytic derivatives.
+// The reflectance depends on the left, right, bottom, and top heights
+// through the normal, and the intensity depends on the center height
+// through the pixel the DEM point projects into. This needs one camera
+// projection per evaluation, or none with camera lookup tables, rather
+// than the ten extra evaluations of the residual done by numerical
+// differentiation. The small change in the sun and view directions and
+// in the blending weight as the center height varies is ignored.
+class IntensityErrorFloatDemOnlyAnalytic: public ceres::SizedCostFunction<1, 1, 1, 1, 1, 1> {
+public:
+  IntensityErrorFloatDemOnlyAnalytic(int col, int row,
+                                     ImageView<double> const& dem,
+                                     double albedo,
+                                     double * reflectance_model_coeffs, 
+                                     double * exposure, 
+                                     double * haze, 
+                                     double * camera_adjustments, 
+                                     cartography::GeoReference const& geo,
+                                     bool model_shadows,
+                                     double camera_position_step_size,
+                                     ImageView<float> const& shadow_mask, // note: this is an alias
+                                     CameraLookupTable const& camera_lookup, // alias
+                                     GlobalParams const& global_params,
+                                     ModelParams const& model_params,
+                                     BBox2i const& crop_box,
+                                     MaskedImgT const& image,
+                                     DoubleImgT const& blend_weight,
+                                     double * scaled_sun_posn, 
+                                     boost::shared_ptr<CameraModel> const& camera):
+    m_col(col), m_row(row), m_dem(dem),
+    m_albedo(albedo), m_reflectance_model_coeffs(reflectance_model_coeffs),
+    m_exposure(exposure), m_haze(haze), m_camera_adjustments(camera_adjustments),
+    m_geo(geo),
+    m_model_shadows(model_shadows),
+    m_camera_position_step_size(camera_position_step_size),
+    m_shadow_mask(shadow_mask),
+    m_camera_lookup(camera_lookup),
+    m_global_params(global_params),
+    m_model_params(model_params),
+    m_crop_box(crop_box),
+    m_image(image), m_blend_weight(blend_weight),
+    m_scaled_sun_posn(scaled_sun_posn),
+    m_camera(camera) {}
+
+  // The parameters are the left, center, right, bottom, and top heights.
+  // See SmoothnessError() for their definitions.
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals,
+                        double** jacobians) const {
+
+    // Same as in calc_intensity_residual(), use a zero residual when
+    // it cannot be computed.
+    residuals[0] = 0.0;
+    if (jacobians != NULL) {
+      for (int it = 0; it < 5; it++) {
+        if (jacobians[it] != NULL)
+          jacobians[it][0] = 0.0;
+      }
+    }
+
+    if (m_col >= m_dem.cols() - 1 || m_row >= m_dem.rows() - 1) return true;
+    if (m_crop_box.empty()) return true;
+
+    try{
+
+      // See calc_intensity_residual() for why the camera is copied
+      AdjustedCameraModel adj_cam_copy(m_camera);
+      CameraModel * camera = NULL;
+      if (g_opt->use_approx_adjusted_camera_models) {
+        camera = (CameraModel*)(m_camera.get());
+      }else{
+        AdjustedCameraModel * adj_cam
+          = dynamic_cast<AdjustedCameraModel*>(m_camera.get());
+        if (adj_cam == NULL)
+          vw_throw( ArgumentErr() << "Expecting an adjusted camera.\n");
+        adj_cam_copy = *adj_cam;
+        Vector3 axis_angle;
+        Vector3 translation;
+        for (int param_iter = 0; param_iter < 3; param_iter++) {
+          translation[param_iter]
+            = (g_position_scale_factor*m_camera_position_step_size)*m_camera_adjustments[param_iter];
+          axis_angle[param_iter] = m_camera_adjustments[3 + param_iter];
+        }
+        adj_cam_copy.set_translation(translation);
+        adj_cam_copy.set_axis_angle_rotation(axis_angle);
+        camera = &adj_cam_copy;
+      }
+
+      // The xyz positions of the left, center, right, bottom, and top
+      // grid points, and their derivatives with respect to the heights,
+      // which are the directions normal to the datum.
+      int dcol[] = {-1, 0, 1, 0,  0};
+      int drow[] = { 0, 0, 0, 1, -1};
+      Vector3 xyz[5], up[5];
+      for (int it = 0; it < 5; it++) {
+        Vector2 lonlat = m_geo.pixel_to_lonlat(Vector2(m_col + dcol[it], m_row + drow[it]));
+        double h = parameters[it][0];
+        xyz[it] = m_geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], h));
+        up[it]  = m_geo.datum().geodetic_to_cartesian(Vector3(lonlat[0], lonlat[1], h + 1.0))
+          - xyz[it];
+      }
+
+      // four-point normal (centered), pointing up
+      Vector3 dx = xyz[2] - xyz[0];
+      Vector3 dy = xyz[3] - xyz[4];
+      Vector3 unnormalized = -cross_prod(dx, dy);
+      double len = norm_2(unnormalized);
+      if (len == 0) return true;
+      Vector3 normal = unnormalized/len;
+
+      // The camera pixel and center, and the rate of change of the pixel
+      // with the center height
+      Vector2 pix, dpix_dh;
+      Vector3 cameraPosition;
+      if (!m_camera_lookup.lookup(m_col, m_row, parameters[1][0], pix, cameraPosition,
+                                  &dpix_dh)) {
+        pix = camera->point_to_pixel(xyz[1]);
+        cameraPosition = camera->camera_center(pix);
+        dpix_dh = Vector2();
+        if (jacobians != NULL && jacobians[1] != NULL) {
+          try {
+            dpix_dh = camera->point_to_pixel(xyz[1] + up[1]) - pix;
+          } catch(...){}
+        }
+      }
+
+      // The reflectance and its gradient with respect to the normal
+      Vector3 sunPos;
+      for (int it = 0; it < 3; it++) 
+        sunPos[it] = m_scaled_sun_posn[it] * m_model_params.sunPosition[it]; 
+      Vector3 sunDir  = normalize(sunPos - xyz[1]);
+      Vector3 viewDir = normalize(cameraPosition - xyz[1]);
+      double mu_0      = dot_prod(sunDir, normal);
+      double mu        = dot_prod(viewDir, normal);
+      double cos_alpha = dot_prod(sunDir, viewDir);
+      double dR_dmu0 = 0.0, dR_dmu = 0.0, R = 0.0;
+      switch (m_global_params.reflectanceType) {
+      case LAMBERT:
+        R = lambertianReflectance(mu_0, mu, cos_alpha, dR_dmu0, dR_dmu);
+        break;
+      case LUNAR_LAMBERT:
+        R = lunarLambertianReflectance(mu_0, mu, cos_alpha,
+                                       m_global_params.phaseCoeffC1,
+                                       m_global_params.phaseCoeffC2,
+                                       m_reflectance_model_coeffs, dR_dmu0, dR_dmu);
+        break;
+      case HAPKE:
+        R = hapkeReflectance(mu_0, mu, cos_alpha, m_reflectance_model_coeffs,
+                             dR_dmu0, dR_dmu);
+        break;
+      default:
+        vw_throw(ArgumentErr() << "Analytic derivatives are not implemented "
+                 << "for this reflectance model.\n");
+      }
+
+      if (m_model_shadows && m_col < m_shadow_mask.cols() && m_row < m_shadow_mask.rows() &&
+          m_shadow_mask(m_col, m_row) > 0) {
+        R = 0.0; dR_dmu0 = 0.0; dR_dmu = 0.0;
+      }
+
+      // The intensity, by bilinear interpolation, and its gradient
+      pix -= m_crop_box.min();
+      if (pix[0] < 0 || pix[0] >= m_image.cols()-1 ||
+          pix[1] < 0 || pix[1] >= m_image.rows()-1)
+        return true;
+      int c0 = (int)floor(pix[0]), r0 = (int)floor(pix[1]);
+      double a = pix[0] - c0, b = pix[1] - r0;
+      PixelMask<float> i00 = m_image(c0, r0),   i10 = m_image(c0+1, r0);
+      PixelMask<float> i01 = m_image(c0, r0+1), i11 = m_image(c0+1, r0+1);
+      if (!is_valid(i00) || !is_valid(i10) || !is_valid(i01) || !is_valid(i11))
+        return true;
+      double I = (1-b)*((1-a)*i00.child() + a*i10.child())
+        +            b*((1-a)*i01.child() + a*i11.child());
+      Vector2 dI_dpix((1-b)*(i10.child() - i00.child()) + b*(i11.child() - i01.child()),
+                      (1-a)*(i01.child() - i00.child()) + a*(i11.child() - i10.child()));
+
+      double weight = 1.0;
+      if (m_blend_weight.cols() > 0 && m_blend_weight.rows() > 0) {
+        InterpolationView<EdgeExtensionView<DoubleImgT, ConstantEdgeExtension>,
+                          BilinearInterpolation>
+          interp_weight = interpolate(m_blend_weight, BilinearInterpolation(),
+                                      ConstantEdgeExtension());
+        weight = interp_weight(pix[0], pix[1]);
+      }
+
+      double dweight_dI = 0.0;
+      double thresh = g_opt->unreliable_intensity_threshold;
+      if (thresh > 0 && I <= thresh && I >= 0) {
+        dweight_dI = 2.0*weight*I/(thresh*thresh);
+        weight    *= (I/thresh)*(I/thresh);
+      }
+
+      double dN_dR = 0.0;
+      double N = nonlin_reflectance_deriv(R, *m_exposure, m_haze, g_opt->num_haze_coeffs,
+                                          dN_dR);
+      double diff = I - m_albedo*N;
+      residuals[0] = weight*diff;
+
+      if (jacobians == NULL)
+        return true;
+
+      // The derivative of the unnormalized normal with respect to each
+      // height is a cross product of the datum normal with dx or dy.
+      // Project the reflectance gradient to account for normalizing.
+      Vector3 grad = dR_dmu0*sunDir + dR_dmu*viewDir;
+      grad = (grad - normal*dot_prod(normal, grad))/len;
+      double dres_dR = -weight*m_albedo*dN_dR;
+
+      if (jacobians[0] != NULL)
+        jacobians[0][0] = dres_dR*dot_prod(grad,  cross_prod(up[0], dy)); // left
+      if (jacobians[1] != NULL)
+        jacobians[1][0] = (weight + dweight_dI*diff)*dot_prod(dI_dpix, dpix_dh); // center
+      if (jacobians[2] != NULL)
+        jacobians[2][0] = dres_dR*dot_prod(grad, -cross_prod(up[2], dy)); // right
+      if (jacobians[3] != NULL)
+        jacobians[3][0] = dres_dR*dot_prod(grad, -cross_prod(dx, up[3])); // bottom
+      if (jacobians[4] != NULL)
+        jacobians[4][0] = dres_dR*dot_prod(grad,  cross_prod(dx, up[4])); // top
+
+    } catch (const ArgumentErr&) {
+      throw;
+    } catch (...) {
+      // Failure to project into the camera, as in calc_intensity_residual()
+      residuals[0] = 0.0;
+      if (jacobians != NULL) {
+        for (int it = 0; it < 5; it++) {
+          if (jacobians[it] != NULL)
+            jacobians[it][0] = 0.0;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  // Factory to hide the construction of the CostFunction object from
+  // the client code.
+  static ceres::CostFunction* Create(int col, int row,
+				     ImageView<double> const& dem,
+                                     double albedo,
+                                     double * reflectance_model_coeffs, 
+                                     double * exposure, 
+                                     double * haze, 
+                                     double * camera_adjustments, 
+				     vw::cartography::GeoReference const& geo,
+				     bool model_shadows,
+				     double camera_position_step_size,
+				     ImageView<float> const& shadow_mask, // alias
+				     CameraLookupTable const& camera_lookup, // alias
+				     GlobalParams const& global_params,
+				     ModelParams const& model_params,
+				     BBox2i const& crop_box,
+				     MaskedImgT const& image,
+				     DoubleImgT const& blend_weight,
+                                     double * scaled_sun_posn, 
+				     boost::shared_ptr<CameraModel> const& camera){
+    return new IntensityErrorFloatDemOnlyAnalytic(col, row, dem,
+                                                  albedo, reflectance_model_coeffs,
+                                                  exposure, haze, camera_adjustments,
+                                                  geo,
+                                                  model_shadows,
+                                                  camera_position_step_size,
+                                                  shadow_mask,
+                                                  camera_lookup,
+                                                  global_params, model_params,
+                                                  crop_box, image, blend_weight,
+                                                  scaled_sun_posn, camera);
+  }
+
+private:
+  int                                       m_col, m_row;
+  ImageView<double>                 const & m_dem;            // alias
+  double                                    m_albedo;
+  double                                  * m_reflectance_model_coeffs;
+  double                                  * m_exposure;
+  double                                  * m_haze;
+  double                                  * m_camera_adjustments;
+  cartography::GeoReference         const & m_geo;            // alias
+  bool                                      m_model_shadows;
+  double                                    m_camera_position_step_size;
+  ImageView<float>                  const & m_shadow_mask;    // alias
+  CameraLookupTable                 const & m_camera_lookup;  // alias
+  GlobalParams                      const & m_global_params;  // alias
+  ModelParams                       const & m_model_params;   // alias
+  BBox2i                                    m_crop_box;
+  MaskedImgT                        const & m_image;          // alias
+  DoubleImgT                        const & m_blend_weight;   // alias
+  double                                  * m_scaled_sun_posn;   // pointer
+  boost::shared_ptr<CameraModel>    const & m_camera;         // alias
+};
+
 // A variation of IntensityError where albedo, dem, and model params are fixed.
 struct IntensityErrorFixedMost {
   IntensityErrorFixedMost(int col, int row,
@@ -2811,7 +3676,8 @@ struct IntensityErrorFixedMost {
                           cartography::GeoReference const& geo,
                           bool model_shadows,
                           double camera_position_step_size,
-                          double const& max_dem_height, // note: this is an alias
+                          ImageView<float> const& shadow_mask, // note: this is an alias
+                          CameraLookupTable const& camera_lookup, // alias
                           double gridx, double gridy,
                           GlobalParams const& global_params,
                           ModelParams const& model_params,
@@ -2824,7 +3690,8 @@ struct IntensityErrorFixedMost {
     m_geo(geo),
     m_model_shadows(model_shadows),
     m_camera_position_step_size(camera_position_step_size),
-    m_max_dem_height(max_dem_height),
+    m_shadow_mask(shadow_mask),
+    m_camera_lookup(camera_lookup),
     m_gridx(gridx), m_gridy(gridy),
     m_global_params(global_params),
     m_model_params(model_params),
@@ -2860,7 +3727,8 @@ struct IntensityErrorFixedMost {
                                    m_geo,  // alias
                                    m_model_shadows,  
                                    m_camera_position_step_size,  
-                                   m_max_dem_height,  // alias
+                                   m_shadow_mask,  // alias
+                                   m_camera_lookup,  // alias
                                    m_gridx, m_gridy,  
                                    m_global_params,  // alias
                                    m_model_params,  // alias
@@ -2880,7 +3748,8 @@ struct IntensityErrorFixedMost {
                                      vw::cartography::GeoReference const& geo,
 				     bool model_shadows,
 				     double camera_position_step_size,
-				     double const& max_dem_height, // alias
+				     ImageView<float> const& shadow_mask, // alias
+				     CameraLookupTable const& camera_lookup, // alias
 				     double gridx, double gridy,
 				     GlobalParams const& global_params,
 				     ModelParams const& model_params,
@@ -2893,7 +3762,8 @@ struct IntensityErrorFixedMost {
 	    (new IntensityErrorFixedMost(col, row, dem, albedo, reflectance_model_coeffs, geo,
 				model_shadows,
 				camera_position_step_size,
-				max_dem_height,
+				shadow_mask,
+				camera_lookup,
 				gridx, gridy,
 				global_params, model_params,
 				crop_box, image, blend_weight, camera)));
@@ -2906,7 +3776,8 @@ struct IntensityErrorFixedMost {
   cartography::GeoReference         const & m_geo;            // alias
   bool                                      m_model_shadows;
   double                                    m_camera_position_step_size;
-  double                            const & m_max_dem_height; // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
+  CameraLookupTable                 const & m_camera_lookup;  // alias
   double                                    m_gridx, m_gridy;
   GlobalParams                      const & m_global_params;  // alias
   ModelParams                       const & m_model_params;   // alias
@@ -2924,7 +3795,8 @@ struct IntensityErrorPQ {
                    cartography::GeoReference const& geo,
                    bool model_shadows,
                    double camera_position_step_size,
-                   double const& max_dem_height, // note: this is an alias
+                   ImageView<float> const& shadow_mask, // note: this is an alias
+                   CameraLookupTable const& camera_lookup, // alias
                    double gridx, double gridy,
                    GlobalParams const& global_params,
                    ModelParams const& model_params,
@@ -2935,7 +3807,8 @@ struct IntensityErrorPQ {
     m_col(col), m_row(row), m_dem(dem), m_geo(geo),
     m_model_shadows(model_shadows),
     m_camera_position_step_size(camera_position_step_size),
-    m_max_dem_height(max_dem_height),
+    m_shadow_mask(shadow_mask),
+    m_camera_lookup(camera_lookup),
     m_gridx(gridx), m_gridy(gridy),
     m_global_params(global_params),
     m_model_params(model_params),
@@ -2968,7 +3841,8 @@ struct IntensityErrorPQ {
                                    m_geo,  // alias
                                    m_model_shadows,  
                                    m_camera_position_step_size,  
-                                   m_max_dem_height,  // alias
+                                   m_shadow_mask,  // alias
+                                   m_camera_lookup,  // alias
                                    m_gridx, m_gridy,  
                                    m_global_params,   // alias
                                    m_model_params,    // alias
@@ -2986,7 +3860,8 @@ struct IntensityErrorPQ {
 				     vw::cartography::GeoReference const& geo,
 				     bool model_shadows,
 				     double camera_position_step_size,
-				     double const& max_dem_height, // alias
+				     ImageView<float> const& shadow_mask, // alias
+				     CameraLookupTable const& camera_lookup, // alias
 				     double gridx, double gridy,
 				     GlobalParams const& global_params,
 				     ModelParams const& model_params,
@@ -2999,7 +3874,8 @@ struct IntensityErrorPQ {
 	    (new IntensityErrorPQ(col, row, dem, geo,
                                   model_shadows,
                                   camera_position_step_size,
-                                  max_dem_height,
+                                  shadow_mask,
+                                  camera_lookup,
                                   gridx, gridy,
                                   global_params, model_params,
                                   crop_box, image, blend_weight, camera)));
@@ -3010,7 +3886,8 @@ struct IntensityErrorPQ {
   cartography::GeoReference         const & m_geo;            // alias
   bool                                      m_model_shadows;
   double                                    m_camera_position_step_size;
-  double                            const & m_max_dem_height; // alias
+  ImageView<float>                  const & m_shadow_mask;    // alias
+  CameraLookupTable                 const & m_camera_lookup;  // alias
   double                                    m_gridx, m_gridy;
   GlobalParams                      const & m_global_params;  // alias
   ModelParams                       const & m_model_params;   // alias
@@ -3312,6 +4189,16 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Float the camera pose for each image, including the first one. Experimental.")
     ("model-shadows",   po::bool_switch(&opt.model_shadows)->default_value(false)->implicit_value(true),
      "Model the fact that some points on the DEM are in the shadow (occluded from the Sun).")
+    ("use-camera-lookup-tables",   po::bool_switch(&opt.use_camera_lookup_tables)->default_value(false)->implicit_value(true),
+     "For each image, precompute and save to disk the projections of the DEM points into the camera, and look them up during optimization. Recompute only where the DEM height changes by more than --camera-lookup-height-tolerance. Cannot be used when floating the cameras.")
+    ("camera-lookup-height-tolerance", po::value(&opt.camera_lookup_height_tol)->default_value(1.0),
+     "Use a camera lookup table entry as long as the DEM height is within this distance (in meters) of the height at which the entry was computed.")
+    ("camera-lookup-prefix", po::value(&opt.camera_lookup_prefix)->default_value(""),
+     "Read the camera lookup tables created by a previous run with this output prefix, if they agree with the current cameras and DEM.")
+    ("use-analytic-derivatives",   po::bool_switch(&opt.use_analytic_derivatives)->default_value(false)->implicit_value(true),
+     "Use analytic rather than numerical derivatives of the intensity error, which is much faster as the camera projections are not repeated. Can be used only when floating just the DEM, and with the Lambertian, Lunar-Lambertian, and Hapke reflectance models.")
+    ("shadow-azimuth-tolerance", po::value(&opt.shadow_azimuth_tol)->default_value(0.0),
+     "When modeling shadows, images whose Sun azimuths differ by no more than this (in degrees) share the computation of the terrain horizon. A small positive value can save time with many images.")
     ("save-computed-intensity-only",   po::bool_switch(&opt.save_computed_intensity_only)->default_value(false)->implicit_value(true),
      "Do not run any optimization. Simply compute the intensity for a given DEM with exposures, camera positions, etc, coming from a previous SfS run. Useful with --model-shadows.")
     ("compute-exposures-only",   po::bool_switch(&opt.compute_exposures_only)->default_value(false)->implicit_value(true),
@@ -3363,6 +4250,10 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Use this value for initial DEM heights. An input DEM still needs to be provided for georeference information.")
     ("crop-win", po::value(&opt.crop_win)->default_value(BBox2i(0, 0, 0, 0), "startx starty stopx stopy"),
        "Crop the input DEM to this region before continuing.")
+    ("tile-size", po::value(&opt.tile_size)->default_value(0),
+     "Solve for the DEM in tiles of this size (not counting the padding), one tile at a time, and blend the results. The tiles are solved independently, and only the padding is shared. With --crop-input-images, memory usage is then bounded by the tile size and padding, including when finding the exposures, which are the median of those found on each tile, unless given with --image-exposures-prefix. The exposures and haze are kept fixed, so --float-exposure, --float-haze, --float-cameras, --float-all-cameras, --float-reflectance-model, and --float-sun-position cannot be used.")
+    ("padding", po::value(&opt.padding)->default_value(50),
+     "When solving in tiles, expand each tile by this many pixels on each side.")
     ("nodata-value", po::value(&opt.nodata_val)->default_value(std::numeric_limits<double>::quiet_NaN()),
      "Use this as the DEM no-data value, over-riding what is in the initial guess DEM.")
     ("float-dem-at-boundary",   po::bool_switch(&opt.float_dem_at_boundary)->default_value(false)->implicit_value(true),
@@ -3486,6 +4377,45 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
     }
   }
   
+  if (opt.use_camera_lookup_tables) {
+    if (opt.float_cameras || opt.float_all_cameras)
+      vw_throw(ArgumentErr() << "Cannot use camera lookup tables when floating the cameras.\n");
+    if (opt.camera_lookup_height_tol < 0)
+      vw_throw(ArgumentErr() << "The camera lookup height tolerance must be non-negative.\n");
+    if (opt.camera_lookup_prefix == "")
+      opt.camera_lookup_prefix = opt.out_prefix;
+  }
+
+  if (opt.use_analytic_derivatives) {
+    if (opt.reflectance_type != 0 && opt.reflectance_type != 1 && opt.reflectance_type != 2)
+      vw_throw(ArgumentErr() << "Analytic derivatives are implemented only for the "
+               << "Lambertian, Lunar-Lambertian, and Hapke reflectance models.\n");
+    if (opt.float_albedo || opt.float_exposure || opt.float_cameras ||
+        opt.float_all_cameras || opt.float_dem_at_boundary ||
+        opt.boundary_fix || opt.fix_dem || opt.float_reflectance_model ||
+        opt.float_sun_position || opt.float_haze || opt.integrability_weight > 0)
+      vw_throw(ArgumentErr() << "Analytic derivatives can be used only when floating "
+               << "just the DEM.\n");
+  }
+
+  if (opt.tile_size > 0) {
+    if (opt.input_dems.size() > 1)
+      vw_throw(ArgumentErr() << "Cannot solve in tiles with multiple DEM clips.\n");
+    if (!opt.crop_win.empty() || opt.query || opt.compute_exposures_only)
+      vw_throw(ArgumentErr() << "Cannot solve in tiles with --crop-win, --query, or "
+               << "--compute-exposures-only.\n");
+    if (opt.float_exposure || opt.float_haze || opt.float_cameras ||
+        opt.float_all_cameras || opt.float_reflectance_model || opt.float_sun_position)
+      vw_throw(ArgumentErr() << "When solving in tiles, the exposures, haze, cameras, "
+               << "reflectance model, and sun positions must be fixed, so that all "
+               << "tiles are consistent.\n");
+    if (opt.padding < 0)
+      vw_throw(ArgumentErr() << "The padding must be non-negative.\n");
+    if (!opt.crop_input_images)
+      vw_out(WarningMessage) << "Solving in tiles without --crop-input-images. The full "
+                             << "input images will be loaded for each tile.\n";
+  }
+
   if (opt.blending_dist > 0 && !opt.crop_input_images) 
     vw_throw(ArgumentErr() << "A blending distance is only supported with --crop-input-images.\n");
   
@@ -3793,22 +4723,48 @@ void run_sfs_level(// Fixed inputs
   g_gridx = &gridx;
   g_gridy = &gridy;
 
-  std::vector<double> max_dem_height(num_dems, -std::numeric_limits<double>::max());
-  if (opt.model_shadows) {
-    // Find the max DEM height
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) { 
-      double curr_max_dem_height = -std::numeric_limits<double>::max();
-      for (int col = 0; col < dems[dem_iter].cols(); col++) {
-        for (int row = 0; row < dems[dem_iter].rows(); row++) {
-          if (dems[dem_iter](col, row) > curr_max_dem_height) {
-            curr_max_dem_height = dems[dem_iter](col, row);
-          }
-        }
+  std::vector< std::vector< ImageView<float> > > shadow_masks;
+  computeShadowMasks(opt, dems, geo, model_params, scaled_sun_posns, shadow_masks);
+  g_shadow_masks = &shadow_masks;
+
+  if (opt.num_threads > 1 &&
+      !opt.use_approx_camera_models &&
+      !opt.use_approx_adjusted_camera_models &&
+      !isis_cams_support_multi_threading(opt, cameras)) {
+    vw_out() << "Using exact ISIS camera models whose SPICE data is not attached "
+             << "to the cubes. Can run with only a single thread.\n";
+    opt.num_threads = 1;
+  }
+  vw_out() << "Using: " << opt.num_threads << " threads.\n";
+
+  // Projections of the DEM points into the cameras. Read them from a
+  // previous run if possible, and refresh only where the DEM changed.
+  std::vector< std::vector<CameraLookupTable> >
+    camera_lookups(num_dems, std::vector<CameraLookupTable>(num_images));
+  if (opt.use_camera_lookup_tables) {
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      for (int image_iter = 0; image_iter < num_images; image_iter++) {
+        if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
+          continue;
+        CameraLookupTable & table = camera_lookups[dem_iter][image_iter];
+        CameraModel const* camera = cameras[dem_iter][image_iter].get();
+        std::string in_file = camera_lookup_file_name(opt.camera_lookup_prefix,
+                                                      opt.input_images[image_iter],
+                                                      g_level, dem_iter, num_dems);
+        bool was_read = table.read(in_file, dems[dem_iter], geo[dem_iter], camera);
+        if (was_read)
+          vw_out() << "Read: " << in_file << std::endl;
+        int num_updated = table.update(dems[dem_iter], geo[dem_iter], camera,
+                                       opt.camera_lookup_height_tol, opt.num_threads);
+        vw_out() << "Computed " << num_updated << " camera lookup table entries for "
+                 << opt.input_images[image_iter] << ".\n";
+        if (!was_read || num_updated > 0 || opt.camera_lookup_prefix != opt.out_prefix)
+          table.write(camera_lookup_file_name(opt.out_prefix, opt.input_images[image_iter],
+                                              g_level, dem_iter, num_dems));
       }
-      max_dem_height[dem_iter] = curr_max_dem_height;
     }
   }
-  g_max_dem_height = &max_dem_height;
+  g_camera_lookups = &camera_lookups;
 
   // See if a given image is used in at least one clip or skipped in
   // all of them
@@ -3875,25 +4831,48 @@ void run_sfs_level(// Fixed inputs
           
           ceres::LossFunction* loss_function_img = NULL;
           if (float_dem_only) {
-            ceres::CostFunction* cost_function_img =
-              IntensityErrorFloatDemOnly::Create(col, row,
-                                                 dems[dem_iter],
-                                                 albedos[dem_iter](col, row), 
-                                                 &reflectance_model_coeffs[0],
-                                                 &exposures[image_iter],      // exposure
-                                                 &haze[image_iter][0],        // haze
-                                                 &adjustments[6*image_iter],  // camera adjustments
-                                                 geo[dem_iter],
-                                                 opt.model_shadows,
-                                                 opt.camera_position_step_size,
-                                                 max_dem_height[dem_iter],
-                                                 gridx, gridy,
-                                                 global_params, model_params[image_iter],
-                                                 crop_boxes[dem_iter][image_iter],
-                                                 masked_images[dem_iter][image_iter],
-                                                 blend_weights[dem_iter][image_iter],
-                                                 &scaled_sun_posns[3*image_iter], // sun positions
-                                                 cameras[dem_iter][image_iter]);
+            ceres::CostFunction* cost_function_img = NULL;
+            if (opt.use_analytic_derivatives)
+              cost_function_img =
+                IntensityErrorFloatDemOnlyAnalytic::Create(col, row,
+                                                           dems[dem_iter],
+                                                           albedos[dem_iter](col, row), 
+                                                           &reflectance_model_coeffs[0],
+                                                           &exposures[image_iter],
+                                                           &haze[image_iter][0],
+                                                           &adjustments[6*image_iter],
+                                                           geo[dem_iter],
+                                                           opt.model_shadows,
+                                                           opt.camera_position_step_size,
+                                                           shadow_masks[dem_iter][image_iter],
+                                                           camera_lookups[dem_iter][image_iter],
+                                                           global_params, model_params[image_iter],
+                                                           crop_boxes[dem_iter][image_iter],
+                                                           masked_images[dem_iter][image_iter],
+                                                           blend_weights[dem_iter][image_iter],
+                                                           &scaled_sun_posns[3*image_iter],
+                                                           cameras[dem_iter][image_iter]);
+            else
+              cost_function_img =
+                IntensityErrorFloatDemOnly::Create(col, row,
+                                                   dems[dem_iter],
+                                                   albedos[dem_iter](col, row), 
+                                                   &reflectance_model_coeffs[0],
+                                                   &exposures[image_iter],      // exposure
+                                                   &haze[image_iter][0],        // haze
+                                                   &adjustments[6*image_iter],  // camera adjustments
+                                                   geo[dem_iter],
+                                                   opt.model_shadows,
+                                                   opt.camera_position_step_size,
+                                                   shadow_masks[dem_iter][image_iter],
+                                                   camera_lookups[dem_iter][image_iter],
+                                                   gridx, gridy,
+                                                   global_params, model_params[image_iter],
+                                                   crop_boxes[dem_iter][image_iter],
+                                                   masked_images[dem_iter][image_iter],
+                                                   blend_weights[dem_iter][image_iter],
+                                                   &scaled_sun_posns[3*image_iter], // sun positions
+                                                   cameras[dem_iter][image_iter]);
             problem.AddResidualBlock(cost_function_img, loss_function_img,
                                      &dems[dem_iter](col-1, row),  // left
                                      &dems[dem_iter](col, row),    // center
@@ -3908,7 +4887,8 @@ void run_sfs_level(// Fixed inputs
               IntensityError::Create(col, row, dems[dem_iter], geo[dem_iter],
                                      opt.model_shadows,
                                      opt.camera_position_step_size,
-                                     max_dem_height[dem_iter],
+                                     shadow_masks[dem_iter][image_iter],
+                                     camera_lookups[dem_iter][image_iter],
                                      gridx, gridy,
                                      global_params, model_params[image_iter],
                                      crop_boxes[dem_iter][image_iter],
@@ -3936,7 +4916,8 @@ void run_sfs_level(// Fixed inputs
               IntensityErrorPQ::Create(col, row, dems[dem_iter], geo[dem_iter],
                                        opt.model_shadows,
                                        opt.camera_position_step_size,
-                                       max_dem_height[dem_iter],
+                                       shadow_masks[dem_iter][image_iter],
+                                       camera_lookups[dem_iter][image_iter],
                                        gridx, gridy,
                                        global_params, model_params[image_iter],
                                        crop_boxes[dem_iter][image_iter],
@@ -4133,14 +5114,6 @@ void run_sfs_level(// Fixed inputs
     }
   }
   
-  if (opt.num_threads > 1 &&
-      !opt.use_approx_camera_models &&
-      !opt.use_approx_adjusted_camera_models) {
-    vw_out() << "Using exact ISIS camera models. Can run with only a single thread.\n";
-    opt.num_threads = 1;
-  }
-  vw_out() << "Using: " << opt.num_threads << " threads.\n";
-
   ceres::Solver::Options options;
   options.gradient_tolerance = 1e-16;
   options.function_tolerance = 1e-16;
@@ -4361,923 +5334,1129 @@ inline nodata( ImageViewBase<ImageT> const& image, NoDataT nodata ) {
   
 #endif
 
-int main(int argc, char* argv[]) {
-  
-  Stopwatch sw_total;
-  sw_total.start();
-  
-  Options opt;
-  g_opt = &opt;
-  try {
-    handle_arguments( argc, argv, opt );
+// Run sfs on the input DEMs, or on the region of the input DEM given
+// by --crop-win.
+void run_sfs(Options & opt) {
 
-    if (opt.compute_exposures_only && !opt.image_exposures_vec.empty()) {
-      // TODO: This needs to be adjusted if haze is computed.
-      vw_out() << "Exposures exist.";
-      return 0;
-    }
+  g_opt = &opt;
+  
+  if (opt.compute_exposures_only && !opt.image_exposures_vec.empty()) {
+    // TODO: This needs to be adjusted if haze is computed.
+    vw_out() << "Exposures exist.";
+    return;
+  }
 
-    GlobalParams global_params;
-    if (opt.reflectance_type == 0)
-      global_params.reflectanceType = LAMBERT;
-    else if (opt.reflectance_type == 1)
-      global_params.reflectanceType = LUNAR_LAMBERT;
-    else if (opt.reflectance_type == 2)
-      global_params.reflectanceType = HAPKE;
-    else if (opt.reflectance_type == 3)
-      global_params.reflectanceType = ARBITRARY_MODEL;
-    else if (opt.reflectance_type == 4)
-      global_params.reflectanceType = CHARON;
-    else
-      vw_throw( ArgumentErr()
-		<< "Expecting Lambertian or Lunar-Lambertian reflectance." );
-    global_params.phaseCoeffC1 = 0; //1.383488;
-    global_params.phaseCoeffC2 = 0; //0.501149;
-    
-    // Default model coefficients, unless they were read already
-    if (opt.model_coeffs_vec.empty()) {
+  GlobalParams global_params;
+  if (opt.reflectance_type == 0)
+    global_params.reflectanceType = LAMBERT;
+  else if (opt.reflectance_type == 1)
+    global_params.reflectanceType = LUNAR_LAMBERT;
+  else if (opt.reflectance_type == 2)
+    global_params.reflectanceType = HAPKE;
+  else if (opt.reflectance_type == 3)
+    global_params.reflectanceType = ARBITRARY_MODEL;
+  else if (opt.reflectance_type == 4)
+    global_params.reflectanceType = CHARON;
+  else
+    vw_throw( ArgumentErr()
+              << "Expecting Lambertian or Lunar-Lambertian reflectance." );
+  global_params.phaseCoeffC1 = 0; //1.383488;
+  global_params.phaseCoeffC2 = 0; //0.501149;
+  
+  // Default model coefficients, unless they were read already
+  if (opt.model_coeffs_vec.empty()) {
+    opt.model_coeffs_vec.resize(g_num_model_coeffs);
+    if (global_params.reflectanceType == LUNAR_LAMBERT ||
+        global_params.reflectanceType == ARBITRARY_MODEL ) {
+      // Lunar lambertian or its crazy experimental generalization
       opt.model_coeffs_vec.resize(g_num_model_coeffs);
-      if (global_params.reflectanceType == LUNAR_LAMBERT ||
-	  global_params.reflectanceType == ARBITRARY_MODEL ) {
-        // Lunar lambertian or its crazy experimental generalization
-        opt.model_coeffs_vec.resize(g_num_model_coeffs);
-        opt.model_coeffs_vec[0] = 1;
-        opt.model_coeffs_vec[1] = -0.019;
-        opt.model_coeffs_vec[2] =  0.000242;   //0.242*1e-3;
-        opt.model_coeffs_vec[3] = -0.00000146; //-1.46*1e-6;
-        opt.model_coeffs_vec[4] = 1;
-        opt.model_coeffs_vec[5] = 0;
-        opt.model_coeffs_vec[6] = 0;
-        opt.model_coeffs_vec[7] = 0;
-        opt.model_coeffs_vec[8] = 1;
-        opt.model_coeffs_vec[9] = -0.019;
-        opt.model_coeffs_vec[10] =  0.000242;   //0.242*1e-3;
-        opt.model_coeffs_vec[11] = -0.00000146; //-1.46*1e-6;
-        opt.model_coeffs_vec[12] = 1;
-        opt.model_coeffs_vec[13] = 0;
-        opt.model_coeffs_vec[14] = 0;
-        opt.model_coeffs_vec[15] = 0;
-      }else if (global_params.reflectanceType == HAPKE) {
-	opt.model_coeffs_vec[0] = 0.68; // omega (also known as w)
-	opt.model_coeffs_vec[1] = 0.17; // b
-	opt.model_coeffs_vec[2] = 0.62; // c
-	opt.model_coeffs_vec[3] = 0.52; // B0
-	opt.model_coeffs_vec[4] = 0.52; // h
-      }else if (global_params.reflectanceType == CHARON) {
-        opt.model_coeffs_vec.resize(g_num_model_coeffs);
-        opt.model_coeffs_vec[0] = 0.7; // A
-        opt.model_coeffs_vec[1] = 0.63; // f(alpha)
-      }else if (global_params.reflectanceType != LAMBERT) {
-	vw_throw( ArgumentErr() << "The Hapke model coefficients were not set. "
-		  << "Use the --model-coeffs option." );
-      }
+      opt.model_coeffs_vec[0] = 1;
+      opt.model_coeffs_vec[1] = -0.019;
+      opt.model_coeffs_vec[2] =  0.000242;   //0.242*1e-3;
+      opt.model_coeffs_vec[3] = -0.00000146; //-1.46*1e-6;
+      opt.model_coeffs_vec[4] = 1;
+      opt.model_coeffs_vec[5] = 0;
+      opt.model_coeffs_vec[6] = 0;
+      opt.model_coeffs_vec[7] = 0;
+      opt.model_coeffs_vec[8] = 1;
+      opt.model_coeffs_vec[9] = -0.019;
+      opt.model_coeffs_vec[10] =  0.000242;   //0.242*1e-3;
+      opt.model_coeffs_vec[11] = -0.00000146; //-1.46*1e-6;
+      opt.model_coeffs_vec[12] = 1;
+      opt.model_coeffs_vec[13] = 0;
+      opt.model_coeffs_vec[14] = 0;
+      opt.model_coeffs_vec[15] = 0;
+    }else if (global_params.reflectanceType == HAPKE) {
+      opt.model_coeffs_vec[0] = 0.68; // omega (also known as w)
+      opt.model_coeffs_vec[1] = 0.17; // b
+      opt.model_coeffs_vec[2] = 0.62; // c
+      opt.model_coeffs_vec[3] = 0.52; // B0
+      opt.model_coeffs_vec[4] = 0.52; // h
+    }else if (global_params.reflectanceType == CHARON) {
+      opt.model_coeffs_vec.resize(g_num_model_coeffs);
+      opt.model_coeffs_vec[0] = 0.7; // A
+      opt.model_coeffs_vec[1] = 0.63; // f(alpha)
+    }else if (global_params.reflectanceType != LAMBERT) {
+      vw_throw( ArgumentErr() << "The Hapke model coefficients were not set. "
+                << "Use the --model-coeffs option." );
     }
-    g_reflectance_model_coeffs = &opt.model_coeffs_vec[0];
-    
-    int num_dems = opt.input_dems.size();
+  }
+  g_reflectance_model_coeffs = &opt.model_coeffs_vec[0];
+  
+  int num_dems = opt.input_dems.size();
 
-    // Manage no-data
-    double dem_nodata_val = -std::numeric_limits<float>::max(); // note we use a float nodata
-    if (vw::read_nodata_val(opt.input_dems[0], dem_nodata_val)){
-      vw_out() << "Found DEM nodata value: " << dem_nodata_val << std::endl;
-    }
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      double curr_nodata_val = -std::numeric_limits<float>::max(); 
-      if (vw::read_nodata_val(opt.input_dems[dem_iter], curr_nodata_val)){
-        if (dem_nodata_val != curr_nodata_val) {
-          vw_throw( ArgumentErr() << "All DEMs must have the same nodata value.\n" );
-        }
+  // Manage no-data
+  double dem_nodata_val = -std::numeric_limits<float>::max(); // note we use a float nodata
+  if (vw::read_nodata_val(opt.input_dems[0], dem_nodata_val)){
+    vw_out() << "Found DEM nodata value: " << dem_nodata_val << std::endl;
+  }
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    double curr_nodata_val = -std::numeric_limits<float>::max(); 
+    if (vw::read_nodata_val(opt.input_dems[dem_iter], curr_nodata_val)){
+      if (dem_nodata_val != curr_nodata_val) {
+        vw_throw( ArgumentErr() << "All DEMs must have the same nodata value.\n" );
       }
     }
-    if (!boost::math::isnan(opt.nodata_val)) {
-      dem_nodata_val = opt.nodata_val;
-      vw_out() << "Over-riding the DEM nodata value with: " << dem_nodata_val << std::endl;
-    }
-    g_dem_nodata_val = &dem_nodata_val;
-    
-    // Prepare for multiple levels
-    int levels = opt.coarse_levels;
-
-    // Read the handles to the DEMs. Here we don't load them into
-    // memory yet. We will later load into memory only cropped
-    // versions if cropping is specified. This is to save on memory.
-    std::vector< ImageViewRef<double> > dem_handles(num_dems);
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) 
-      dem_handles[dem_iter] = DiskImageView<double>(opt.input_dems[dem_iter]);
-
-    // There are multiple DEM clips, and multiple coarseness levels
-    // for each DEM. Same about albedo and georeferences.
-    std::vector< std::vector< ImageView<double> > >
-      orig_dems(levels+1), dems(levels+1), albedos(levels+1);
-    std::vector< std::vector< GeoReference > > geos(levels+1);
-    for (int level = 0; level <= levels; level++) {
-      orig_dems [level].resize(num_dems);
-      dems      [level].resize(num_dems);
-      albedos   [level].resize(num_dems);
-      geos      [level].resize(num_dems);
-    }
-    
-    if ( (!opt.crop_win.empty() || opt.query) && num_dems > 1) 
-      vw_throw( ArgumentErr() << "Cannot run parallel_stereo with multiple DEM clips.\n" );
-
-    // This must be done before the DEM is cropped. This stats is
-    // queried from parallel_sfs.
-    if (opt.query) {
-      vw_out() << "dem_cols, " << dem_handles[0].cols() << std::endl;
-      vw_out() << "dem_rows, " << dem_handles[0].rows() << std::endl;
-    }
+  }
+  if (!boost::math::isnan(opt.nodata_val)) {
+    dem_nodata_val = opt.nodata_val;
+    vw_out() << "Over-riding the DEM nodata value with: " << dem_nodata_val << std::endl;
+  }
+  g_dem_nodata_val = &dem_nodata_val;
+  
+  // Prepare for multiple levels
+  int levels = opt.coarse_levels;
+
+  // Read the handles to the DEMs. Here we don't load them into
+  // memory yet. We will later load into memory only cropped
+  // versions if cropping is specified. This is to save on memory.
+  std::vector< ImageViewRef<double> > dem_handles(num_dems);
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) 
+    dem_handles[dem_iter] = DiskImageView<double>(opt.input_dems[dem_iter]);
+
+  // There are multiple DEM clips, and multiple coarseness levels
+  // for each DEM. Same about albedo and georeferences.
+  std::vector< std::vector< ImageView<double> > >
+    orig_dems(levels+1), dems(levels+1), albedos(levels+1);
+  std::vector< std::vector< GeoReference > > geos(levels+1);
+  for (int level = 0; level <= levels; level++) {
+    orig_dems [level].resize(num_dems);
+    dems      [level].resize(num_dems);
+    albedos   [level].resize(num_dems);
+    geos      [level].resize(num_dems);
+  }
+  
+  if ( (!opt.crop_win.empty() || opt.query) && num_dems > 1) 
+    vw_throw( ArgumentErr() << "Cannot run parallel_stereo with multiple DEM clips.\n" );
+
+  // This must be done before the DEM is cropped. This stats is
+  // queried from parallel_sfs.
+  if (opt.query) {
+    vw_out() << "dem_cols, " << dem_handles[0].cols() << std::endl;
+    vw_out() << "dem_rows, " << dem_handles[0].rows() << std::endl;
+  }
 
-    // Adjust the crop win
-    opt.crop_win.crop(bounding_box(dem_handles[0]));
+  // Adjust the crop win
+  opt.crop_win.crop(bounding_box(dem_handles[0]));
+  
+  // Read the georeference. 
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    if (!read_georeference(geos[0][dem_iter], opt.input_dems[dem_iter]))
+      vw_throw( ArgumentErr() << "The input DEM has no georeference.\n" );
     
-    // Read the georeference. 
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      if (!read_georeference(geos[0][dem_iter], opt.input_dems[dem_iter]))
-        vw_throw( ArgumentErr() << "The input DEM has no georeference.\n" );
-      
-      // Crop the DEM and georef if requested to given box.  The
-      // cropped DEM (or uncropped if no cropping happens) is fully
-      // loaded in memory.
-      if (!opt.crop_win.empty()) {
-        dems[0][dem_iter] = crop(dem_handles[dem_iter], opt.crop_win);
-        geos[0][dem_iter] = crop(geos[0][dem_iter], opt.crop_win);
-      }else{
-        dems[0][dem_iter] = dem_handles[dem_iter]; // load in memory
+    // Crop the DEM and georef if requested to given box.  The
+    // cropped DEM (or uncropped if no cropping happens) is fully
+    // loaded in memory.
+    if (!opt.crop_win.empty()) {
+      dems[0][dem_iter] = crop(dem_handles[dem_iter], opt.crop_win);
+      geos[0][dem_iter] = crop(geos[0][dem_iter], opt.crop_win);
+    }else{
+      dems[0][dem_iter] = dem_handles[dem_iter]; // load in memory
+    }
+  
+    // This can be useful
+    vw_out() << "DEM cols and rows: " << dems[0][dem_iter].cols()  << ' '
+             << dems[0][dem_iter].rows() << std::endl;
+  }
+  
+  // Replace no-data values with the min valid value. That is because
+  // no-data values usually come from shadows, and those are low-lying.
+  // This works better than using the mean value.
+  // TODO: Maybe do hole-filling instead.
+  int min_dem_size = 5;
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    double min_val = std::numeric_limits<double>::max(), mean = 0, num = 0;
+    for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
+      for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
+        if (dems[0][dem_iter](col, row) != dem_nodata_val) {
+          mean += dems[0][dem_iter](col, row);
+          num += 1;
+          min_val = std::min(min_val, dems[0][dem_iter](col, row));
+        }
       }
-    
-      // This can be useful
-      vw_out() << "DEM cols and rows: " << dems[0][dem_iter].cols()  << ' '
-               << dems[0][dem_iter].rows() << std::endl;
     }
-    
-    // Replace no-data values with the min valid value. That is because
-    // no-data values usually come from shadows, and those are low-lying.
-    // This works better than using the mean value.
-    // TODO: Maybe do hole-filling instead.
-    int min_dem_size = 5;
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      double min_val = std::numeric_limits<double>::max(), mean = 0, num = 0;
-      for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
-        for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
-          if (dems[0][dem_iter](col, row) != dem_nodata_val) {
-            mean += dems[0][dem_iter](col, row);
-            num += 1;
-            min_val = std::min(min_val, dems[0][dem_iter](col, row));
-          }
+    if (num > 0) mean /= num;
+    for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
+      for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
+        if (dems[0][dem_iter](col, row) == dem_nodata_val) {
+          dems[0][dem_iter](col, row) = min_val;
         }
       }
-      if (num > 0) mean /= num;
+    }
+
+    // See if to use a constant init value
+    if (!boost::math::isnan(opt.init_dem_height)) {
       for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
         for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
-          if (dems[0][dem_iter](col, row) == dem_nodata_val) {
-            dems[0][dem_iter](col, row) = min_val;
-          }
+          dems[0][dem_iter](col, row) = opt.init_dem_height;
         }
       }
+    }
 
-      // See if to use a constant init value
-      if (!boost::math::isnan(opt.init_dem_height)) {
-        for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
-          for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
-            dems[0][dem_iter](col, row) = opt.init_dem_height;
-          }
-        }
-      }
-  
-      if (dems[0][dem_iter].cols() < min_dem_size ||
-          dems[0][dem_iter].rows() < min_dem_size) {
-        vw_throw( ArgumentErr() << "The input DEM with index "
-                  << dem_iter << " is too small.\n" );
-      }
+    if (dems[0][dem_iter].cols() < min_dem_size ||
+        dems[0][dem_iter].rows() < min_dem_size) {
+      vw_throw( ArgumentErr() << "The input DEM with index "
+                << dem_iter << " is too small.\n" );
     }
-  
-    // Read in the camera models for the input images.
-    int num_images = opt.input_images.size();
-    std::vector< std::vector< boost::shared_ptr<CameraModel> > > cameras(num_dems);
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+  }
 
-      cameras[dem_iter].resize(num_images);
-      for (int image_iter = 0; image_iter < num_images; image_iter++){
+  // Read in the camera models for the input images.
+  int num_images = opt.input_images.size();
+  std::vector< std::vector< boost::shared_ptr<CameraModel> > > cameras(num_dems);
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+
+    cameras[dem_iter].resize(num_images);
+    for (int image_iter = 0; image_iter < num_images; image_iter++){
 	
-	if (opt.skip_images[dem_iter].find(image_iter)
-	    != opt.skip_images[dem_iter].end()) continue;
+      if (opt.skip_images[dem_iter].find(image_iter)
+          != opt.skip_images[dem_iter].end()) continue;
 	
-	typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
-	SessionPtr session(asp::StereoSessionFactory::create
-			   (opt.stereo_session_string, opt,
-			    opt.input_images[image_iter],
-			    opt.input_images[image_iter],
-			    opt.input_cameras[image_iter],
-			    opt.input_cameras[image_iter],
-			    opt.out_prefix));
+      typedef boost::scoped_ptr<asp::StereoSession> SessionPtr;
+      SessionPtr session(asp::StereoSessionFactory::create
+                         (opt.stereo_session_string, opt,
+                          opt.input_images[image_iter],
+                          opt.input_images[image_iter],
+                          opt.input_cameras[image_iter],
+                          opt.input_cameras[image_iter],
+                          opt.out_prefix));
 	
-	vw_out() << "Loading image and camera: " << opt.input_images[image_iter] << " "
-		 <<  opt.input_cameras[image_iter] << " for DEM clip " << dem_iter << ".\n";
-	cameras[dem_iter][image_iter] = session->camera_model(opt.input_images[image_iter],
-							      opt.input_cameras[image_iter]);
-        if (dem_iter == 0) {
-          double azimuth, elevation;
-          sun_angles(opt, dems[0][dem_iter], dem_nodata_val, geos[0][dem_iter],
-                     cameras[dem_iter][image_iter], azimuth, elevation);
-          // This line is being parsed outside this tool
-          vw_out() << "Sun azimuth and elevation for: "
-                   << opt.input_images[image_iter] << " are " << azimuth
-                   << " and " << elevation << " degrees.\n";
-        }
+      vw_out() << "Loading image and camera: " << opt.input_images[image_iter] << " "
+               <<  opt.input_cameras[image_iter] << " for DEM clip " << dem_iter << ".\n";
+      cameras[dem_iter][image_iter] = session->camera_model(opt.input_images[image_iter],
+                                                            opt.input_cameras[image_iter]);
+      if (dem_iter == 0) {
+        double azimuth, elevation;
+        sun_angles(opt, dems[0][dem_iter], dem_nodata_val, geos[0][dem_iter],
+                   cameras[dem_iter][image_iter], azimuth, elevation);
+        // This line is being parsed outside this tool
+        vw_out() << "Sun azimuth and elevation for: "
+                 << opt.input_images[image_iter] << " are " << azimuth
+                 << " and " << elevation << " degrees.\n";
       }
     }
-    
-    if (opt.query) {
-      return 0;
-    }
+  }
+  
+  if (opt.query) {
+    return;
+  }
 
-    // Since we may float the cameras, ensure our camera models are
-    // always adjustable. Note that if the user invoked this tool with
-    // --bundle-adjust-prefix, the adjustments were already loaded
-    // by now so the cameras are already adjustable. 
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      for (int image_iter = 0; image_iter < num_images; image_iter++){
-        
-        if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
-          continue;
-        CameraModel * icam
-          = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
-        if (icam == NULL) {
-          // Set a default identity adjustment
-          Vector2 pixel_offset;
-          Vector3 translation;
-          Quaternion<double> rotation = Quat(math::identity_matrix<3>());
-          // For clarity, first make a copy of the object that we will overwrite.
-          // This may not be necessary but looks safer this way.
-          boost::shared_ptr<CameraModel> cam_ptr = cameras[dem_iter][image_iter];
-          cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>
-            (new AdjustedCameraModel(cam_ptr, translation,
-                                     rotation, pixel_offset));
-        }
+  // Since we may float the cameras, ensure our camera models are
+  // always adjustable. Note that if the user invoked this tool with
+  // --bundle-adjust-prefix, the adjustments were already loaded
+  // by now so the cameras are already adjustable. 
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    for (int image_iter = 0; image_iter < num_images; image_iter++){
+      
+      if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
+        continue;
+      CameraModel * icam
+        = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+      if (icam == NULL) {
+        // Set a default identity adjustment
+        Vector2 pixel_offset;
+        Vector3 translation;
+        Quaternion<double> rotation = Quat(math::identity_matrix<3>());
+        // For clarity, first make a copy of the object that we will overwrite.
+        // This may not be necessary but looks safer this way.
+        boost::shared_ptr<CameraModel> cam_ptr = cameras[dem_iter][image_iter];
+        cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>
+          (new AdjustedCameraModel(cam_ptr, translation,
+                                   rotation, pixel_offset));
       }
     }
-    
-    // Prepare for working at multiple levels
-    int factor = 2;
-    std::vector<int> factors;
-    factors.push_back(1);
-    for (int level = 1; level <= levels; level++) {
-      factors.push_back(factors[level-1]*factor);
+  }
+  
+  // Prepare for working at multiple levels
+  int factor = 2;
+  std::vector<int> factors;
+  factors.push_back(1);
+  for (int level = 1; level <= levels; level++) {
+    factors.push_back(factors[level-1]*factor);
+  }
+  
+  // We won't load the full images, just portions restricted
+  // to the area we we will compute the DEM.
+  std::vector<std::vector< std::vector<BBox2i> > > crop_boxes(levels+1);
+  for (int level = 0; level <= levels; level++) {
+    crop_boxes[level].resize(num_dems);
+  }
+  
+  // The crop box starts as the original image bounding box. We'll shrink it later.
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    for (int image_iter = 0; image_iter < num_images; image_iter++){
+      std::string img_file = opt.input_images[image_iter];
+      crop_boxes[0][dem_iter].push_back(bounding_box(DiskImageView<float>(img_file)));
     }
+  }
+  
+  // Ensure that no two threads can access an ISIS camera at the same time.
+  // Declare the lock here, as we want it to live until the end of the program. 
+  vw::Mutex camera_mutex;
+
+  // callTop();
+  
+  // If to use approximate camera models
+  if (opt.use_approx_camera_models || opt.use_approx_adjusted_camera_models) {
+
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
     
-    // We won't load the full images, just portions restricted
-    // to the area we we will compute the DEM.
-    std::vector<std::vector< std::vector<BBox2i> > > crop_boxes(levels+1);
-    for (int level = 0; level <= levels; level++) {
-      crop_boxes[level].resize(num_dems);
-    }
+      double max_approx_err = 0.0;
     
-    // The crop box starts as the original image bounding box. We'll shrink it later.
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
       for (int image_iter = 0; image_iter < num_images; image_iter++){
-	std::string img_file = opt.input_images[image_iter];
-	crop_boxes[0][dem_iter].push_back(bounding_box(DiskImageView<float>(img_file)));
-      }
-    }
+      
+        if (opt.skip_images[dem_iter].find(image_iter)
+            != opt.skip_images[dem_iter].end()) continue;
     
-    // Ensure that no two threads can access an ISIS camera at the same time.
-    // Declare the lock here, as we want it to live until the end of the program. 
-    vw::Mutex camera_mutex;
-
-    // callTop();
-    
-    // If to use approximate camera models
-    if (opt.use_approx_camera_models || opt.use_approx_adjusted_camera_models) {
-
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      
-        double max_approx_err = 0.0;
-      
-        for (int image_iter = 0; image_iter < num_images; image_iter++){
-        
-          if (opt.skip_images[dem_iter].find(image_iter)
-              != opt.skip_images[dem_iter].end()) continue;
-      
-          // Here we make a copy, since soon cameras[dem_iter][image_iter] will be overwritten
-          AdjustedCameraModel exact_adjusted_camera
-            = *dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
-
-          boost::shared_ptr<CameraModel>
-            exact_unadjusted_camera = exact_adjusted_camera.unadjusted_model();
-          if (dynamic_cast<IsisCameraModel*>(exact_unadjusted_camera.get()) == NULL)
-            vw_throw( ArgumentErr() << "Expecting an ISIS camera model.\n" );
-
-          vw_out() << "Creating an approximate camera model for "
-                   << opt.input_cameras[image_iter] << " and clip "
-                   << opt.input_dems[dem_iter] <<".\n";
-          BBox2i img_bbox = crop_boxes[0][dem_iter][image_iter];
-          Stopwatch sw;
-          sw.start();
-          boost::shared_ptr<CameraModel> apcam;
-          if (opt.use_approx_camera_models) {
-            apcam = boost::shared_ptr<CameraModel>
-              (new ApproxCameraModel(exact_adjusted_camera, exact_unadjusted_camera,
-                                     img_bbox, dems[0][dem_iter],
-                                     geos[0][dem_iter],
-                                     dem_nodata_val, opt.use_rpc_approximation,
-                                     opt.use_semi_approx,
-                                     opt.rpc_penalty_weight, camera_mutex));
-            
-            // Copy the adjustments over to the approximate camera model
-            Vector3 translation  = exact_adjusted_camera.translation();
-            Quat rotation        = exact_adjusted_camera.rotation();
-            Vector2 pixel_offset = exact_adjusted_camera.pixel_offset();
-            double scale         = exact_adjusted_camera.scale();
-            cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>
-              (new AdjustedCameraModel(apcam, translation,
-                                       rotation, pixel_offset, scale));
-          }else if (opt.use_approx_adjusted_camera_models){
-            apcam = boost::shared_ptr<CameraModel>
-              (new ApproxAdjustedCameraModel(exact_adjusted_camera, exact_unadjusted_camera,
-                                             img_bbox,
-                                             dems[0][dem_iter], geos[0][dem_iter],
-                                             dem_nodata_val, camera_mutex));
-            // Adjustments are already baked into the adjusted
-            // approximate cameras, that is why the logic as above to
-            // reincorporate the adjustments is not needed.
-            cameras[dem_iter][image_iter] = apcam;
-          }
-          
-          sw.stop();
-          vw_out() << "Approximate model generation time: " << sw.elapsed_seconds()
-                   << " s." << std::endl;
+        // Here we make a copy, since soon cameras[dem_iter][image_iter] will be overwritten
+        AdjustedCameraModel exact_adjusted_camera
+          = *dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+
+        boost::shared_ptr<CameraModel>
+          exact_unadjusted_camera = exact_adjusted_camera.unadjusted_model();
+        if (dynamic_cast<IsisCameraModel*>(exact_unadjusted_camera.get()) == NULL)
+          vw_throw( ArgumentErr() << "Expecting an ISIS camera model.\n" );
+
+        vw_out() << "Creating an approximate camera model for "
+                 << opt.input_cameras[image_iter] << " and clip "
+                 << opt.input_dems[dem_iter] <<".\n";
+        BBox2i img_bbox = crop_boxes[0][dem_iter][image_iter];
+        Stopwatch sw;
+        sw.start();
+        boost::shared_ptr<CameraModel> apcam;
+        if (opt.use_approx_camera_models) {
+          apcam = boost::shared_ptr<CameraModel>
+            (new ApproxCameraModel(exact_adjusted_camera, exact_unadjusted_camera,
+                                   img_bbox, dems[0][dem_iter],
+                                   geos[0][dem_iter],
+                                   dem_nodata_val, opt.use_rpc_approximation,
+                                   opt.use_semi_approx,
+                                   opt.rpc_penalty_weight, camera_mutex));
           
-          // callTop();
+          // Copy the adjustments over to the approximate camera model
+          Vector3 translation  = exact_adjusted_camera.translation();
+          Quat rotation        = exact_adjusted_camera.rotation();
+          Vector2 pixel_offset = exact_adjusted_camera.pixel_offset();
+          double scale         = exact_adjusted_camera.scale();
+          cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>
+            (new AdjustedCameraModel(apcam, translation,
+                                     rotation, pixel_offset, scale));
+        }else if (opt.use_approx_adjusted_camera_models){
+          apcam = boost::shared_ptr<CameraModel>
+            (new ApproxAdjustedCameraModel(exact_adjusted_camera, exact_unadjusted_camera,
+                                           img_bbox,
+                                           dems[0][dem_iter], geos[0][dem_iter],
+                                           dem_nodata_val, camera_mutex));
+          // Adjustments are already baked into the adjusted
+          // approximate cameras, that is why the logic as above to
+          // reincorporate the adjustments is not needed.
+          cameras[dem_iter][image_iter] = apcam;
+        }
+        
+        sw.stop();
+        vw_out() << "Approximate model generation time: " << sw.elapsed_seconds()
+                 << " s." << std::endl;
+        
+        // callTop();
 
-          // Cast the pointer back to ApproxBaseCameraModel as we need that.
-          ApproxBaseCameraModel* cam_ptr = dynamic_cast<ApproxBaseCameraModel*>(apcam.get());
-          if (cam_ptr == NULL) 
-            vw_throw( ArgumentErr() << "Expecting a ApproxBaseCameraModel." );
+        // Cast the pointer back to ApproxBaseCameraModel as we need that.
+        ApproxBaseCameraModel* cam_ptr = dynamic_cast<ApproxBaseCameraModel*>(apcam.get());
+        if (cam_ptr == NULL) 
+          vw_throw( ArgumentErr() << "Expecting a ApproxBaseCameraModel." );
 
-          bool model_is_valid = cam_ptr->model_is_valid();
-          
-          // Compared original and unadjusted models
-          double max_curr_err = 0.0;
-
-          // TODO: No need to test how unadjusted models compare for RPC,
-          // test only the adjusted models. 
-          if (model_is_valid) {
-            // Recompute the crop box, can be done more reliably here
-            if (opt.use_rpc_approximation || opt.use_semi_approx)
-              cam_ptr->crop_box() = BBox2();
-            for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
-              for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
-                Vector2 ll = geos[0][dem_iter].pixel_to_lonlat(Vector2(col, row));
-                Vector3 xyz = geos[0][dem_iter].datum().geodetic_to_cartesian
-                  (Vector3(ll[0], ll[1], dems[0][dem_iter](col, row)));
-
-                if (opt.use_approx_camera_models) {
-                  // For approx adjusted camera models we don't do this,
-                  // as we don't approximate the unadjusted camera.
-                  // Test how unadjusted models compare
-                  Vector2 pix1 = exact_unadjusted_camera->point_to_pixel(xyz);
-                  //if (!img_bbox.contains(pix1)) continue;
-                  
-                  Vector2 pix2 = apcam->point_to_pixel(xyz);
-                  max_curr_err = std::max(max_curr_err, norm_2(pix1 - pix2));
-                  //std::cout << "orig and approx1 " << pix1 << ' ' << pix2 << ' '
-                  //          << norm_2(pix1-pix2) << std::endl;
-                  
-                  // Use these pixels to expand the crop box, as we now also know the adjustments.
-                  // This is a bug fix.
-                  cam_ptr->crop_box().grow(pix1);
-                  cam_ptr->crop_box().grow(pix2);
-                }
+        bool model_is_valid = cam_ptr->model_is_valid();
+        
+        // Compared original and unadjusted models
+        double max_curr_err = 0.0;
+
+        // TODO: No need to test how unadjusted models compare for RPC,
+        // test only the adjusted models. 
+        if (model_is_valid) {
+          // Recompute the crop box, can be done more reliably here
+          if (opt.use_rpc_approximation || opt.use_semi_approx)
+            cam_ptr->crop_box() = BBox2();
+          for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
+            for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
+              Vector2 ll = geos[0][dem_iter].pixel_to_lonlat(Vector2(col, row));
+              Vector3 xyz = geos[0][dem_iter].datum().geodetic_to_cartesian
+                (Vector3(ll[0], ll[1], dems[0][dem_iter](col, row)));
+
+              if (opt.use_approx_camera_models) {
+                // For approx adjusted camera models we don't do this,
+                // as we don't approximate the unadjusted camera.
+                // Test how unadjusted models compare
+                Vector2 pix1 = exact_unadjusted_camera->point_to_pixel(xyz);
+                //if (!img_bbox.contains(pix1)) continue;
                 
-                // Test how adjusted (exact and approximate) models compare
-                Vector2 pix3 = exact_adjusted_camera.point_to_pixel(xyz);
-                //if (!img_bbox.contains(pix3)) continue;
-                Vector2 pix4 = cameras[dem_iter][image_iter]->point_to_pixel(xyz);
-                max_curr_err = std::max(max_curr_err, norm_2(pix3 - pix4));
-                //std::cout << "orig and approx2 " << pix3 << ' ' << pix4 << ' '
-                //          << norm_2(pix3-pix4) << std::endl;
-
-                cam_ptr->crop_box().grow(pix3);
-                cam_ptr->crop_box().grow(pix4);
+                Vector2 pix2 = apcam->point_to_pixel(xyz);
+                max_curr_err = std::max(max_curr_err, norm_2(pix1 - pix2));
+                //std::cout << "orig and approx1 " << pix1 << ' ' << pix2 << ' '
+                //          << norm_2(pix1-pix2) << std::endl;
+                
+                // Use these pixels to expand the crop box, as we now also know the adjustments.
+                // This is a bug fix.
+                cam_ptr->crop_box().grow(pix1);
+                cam_ptr->crop_box().grow(pix2);
               }
+              
+              // Test how adjusted (exact and approximate) models compare
+              Vector2 pix3 = exact_adjusted_camera.point_to_pixel(xyz);
+              //if (!img_bbox.contains(pix3)) continue;
+              Vector2 pix4 = cameras[dem_iter][image_iter]->point_to_pixel(xyz);
+              max_curr_err = std::max(max_curr_err, norm_2(pix3 - pix4));
+              //std::cout << "orig and approx2 " << pix3 << ' ' << pix4 << ' '
+              //          << norm_2(pix3-pix4) << std::endl;
+
+              cam_ptr->crop_box().grow(pix3);
+              cam_ptr->crop_box().grow(pix4);
             }
-
-            cam_ptr->crop_box().crop(img_bbox);
-            
-            vw_out() << "Max approximate model error in pixels for: "
-                     <<  opt.input_cameras[image_iter] << " and clip "
-                     << opt.input_dems[dem_iter] << ": " << max_curr_err << std::endl;
-          }else{
-            vw_out() << "Invalid model for clip: " << dem_iter << ".\n";
-          }
-          
-          if (max_curr_err > opt.rpc_max_error || !model_is_valid) {
-            // This is a bugfix. When the DEM clip does not intersect the image,
-            // the approx camera model has incorrect values.
-            if (model_is_valid)
-              vw_out() << "Error is too big.\n";
-	    vw_out() << "Skip image " << image_iter << " for clip " << dem_iter << std::endl;
-            opt.skip_images[dem_iter].insert(image_iter);
-            cam_ptr->crop_box() = BBox2();
-            max_curr_err = 0.0;
           }
 
-          max_approx_err = std::max(max_approx_err, max_curr_err);
-        
-          if (opt.use_rpc_approximation && !cam_ptr->crop_box().empty()){
-            // Grow the box just a bit more, to ensure we still see
-            // enough of the images during optimization.
-            double extra = 0.2;
-            double extrax = extra*cam_ptr->crop_box().width();
-            double extray = extra*cam_ptr->crop_box().height();
-            cam_ptr->crop_box().min() -= Vector2(extrax, extray);
-            cam_ptr->crop_box().max() += Vector2(extrax, extray);
-          }
           cam_ptr->crop_box().crop(img_bbox);
-          vw_out() << "Crop box dimensions: " << cam_ptr->crop_box() << std::endl;
-	
-          // Copy the crop box
-          if (opt.crop_input_images)
-            crop_boxes[0][dem_iter][image_iter].crop(cam_ptr->crop_box());
-
-          // Skip images which result in empty crop boxes
-          if (crop_boxes[0][dem_iter][image_iter].empty()) {
-            opt.skip_images[dem_iter].insert(image_iter);
-          }
           
-        } // end iterating over images
-        vw_out() << "Max total approximate model error in pixels: " << max_approx_err << std::endl;
+          vw_out() << "Max approximate model error in pixels for: "
+                   <<  opt.input_cameras[image_iter] << " and clip "
+                   << opt.input_dems[dem_iter] << ": " << max_curr_err << std::endl;
+        }else{
+          vw_out() << "Invalid model for clip: " << dem_iter << ".\n";
+        }
         
-      } // end iterating over dem clips
-    } // end computing the approximate camera model
-    
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+        if (max_curr_err > opt.rpc_max_error || !model_is_valid) {
+          // This is a bugfix. When the DEM clip does not intersect the image,
+          // the approx camera model has incorrect values.
+          if (model_is_valid)
+            vw_out() << "Error is too big.\n";
+          vw_out() << "Skip image " << image_iter << " for clip " << dem_iter << std::endl;
+          opt.skip_images[dem_iter].insert(image_iter);
+          cam_ptr->crop_box() = BBox2();
+          max_curr_err = 0.0;
+        }
+
+        max_approx_err = std::max(max_approx_err, max_curr_err);
       
-      // Make the crop boxes lower left corner be multiple of 2^level
-      int last_factor = factors.back();
-      for (int image_iter = 0; image_iter < num_images; image_iter++){
-        if (!crop_boxes[0][dem_iter][image_iter].empty()) {
-          Vector2i mn = crop_boxes[0][dem_iter][image_iter].min();
-          crop_boxes[0][dem_iter][image_iter].min() = last_factor*(floor(mn/double(last_factor)));
+        if (opt.use_rpc_approximation && !cam_ptr->crop_box().empty()){
+          // Grow the box just a bit more, to ensure we still see
+          // enough of the images during optimization.
+          double extra = 0.2;
+          double extrax = extra*cam_ptr->crop_box().width();
+          double extray = extra*cam_ptr->crop_box().height();
+          cam_ptr->crop_box().min() -= Vector2(extrax, extray);
+          cam_ptr->crop_box().max() += Vector2(extrax, extray);
         }
-      }
+        cam_ptr->crop_box().crop(img_bbox);
+        vw_out() << "Crop box dimensions: " << cam_ptr->crop_box() << std::endl;
+	
+        // Copy the crop box
+        if (opt.crop_input_images)
+          crop_boxes[0][dem_iter][image_iter].crop(cam_ptr->crop_box());
+
+        // Skip images which result in empty crop boxes
+        if (crop_boxes[0][dem_iter][image_iter].empty()) {
+          opt.skip_images[dem_iter].insert(image_iter);
+        }
+        
+      } // end iterating over images
+      vw_out() << "Max total approximate model error in pixels: " << max_approx_err << std::endl;
       
-      // Crop boxes at the coarser resolutions
-      for (int image_iter = 0; image_iter < num_images; image_iter++){
-	for (int level = 1; level <= levels; level++) {
-	  crop_boxes[level][dem_iter].push_back(crop_boxes[0][dem_iter][image_iter]/factors[level]);
-	}
+    } // end iterating over dem clips
+  } // end computing the approximate camera model
+  
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    
+    // Make the crop boxes lower left corner be multiple of 2^level
+    int last_factor = factors.back();
+    for (int image_iter = 0; image_iter < num_images; image_iter++){
+      if (!crop_boxes[0][dem_iter][image_iter].empty()) {
+        Vector2i mn = crop_boxes[0][dem_iter][image_iter].min();
+        crop_boxes[0][dem_iter][image_iter].min() = last_factor*(floor(mn/double(last_factor)));
       }
     }
     
-    // Masked images and weights.
-    std::vector<std::vector< std::vector<MaskedImgT> > > masked_images_vec(levels+1);
-    std::vector<std::vector< std::vector<DoubleImgT> > > blend_weights_vec(levels+1);
-    for (int level = levels; level >= 0; level--) {
-      masked_images_vec[level].resize(num_dems);
-      blend_weights_vec[level].resize(num_dems);
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-        masked_images_vec[level][dem_iter].resize(num_images);
-        blend_weights_vec[level][dem_iter].resize(num_images);
+    // Crop boxes at the coarser resolutions
+    for (int image_iter = 0; image_iter < num_images; image_iter++){
+      for (int level = 1; level <= levels; level++) {
+        crop_boxes[level][dem_iter].push_back(crop_boxes[0][dem_iter][image_iter]/factors[level]);
       }
     }
+  }
+  
+  // Masked images and weights.
+  std::vector<std::vector< std::vector<MaskedImgT> > > masked_images_vec(levels+1);
+  std::vector<std::vector< std::vector<DoubleImgT> > > blend_weights_vec(levels+1);
+  for (int level = levels; level >= 0; level--) {
+    masked_images_vec[level].resize(num_dems);
+    blend_weights_vec[level].resize(num_dems);
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      masked_images_vec[level][dem_iter].resize(num_images);
+      blend_weights_vec[level][dem_iter].resize(num_images);
+    }
+  }
+  
+  float img_nodata_val = -std::numeric_limits<float>::max();
+  for (int image_iter = 0; image_iter < num_images; image_iter++){
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
     
-    float img_nodata_val = -std::numeric_limits<float>::max();
-    for (int image_iter = 0; image_iter < num_images; image_iter++){
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      
-        if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
-          continue;
-       
-        std::string img_file = opt.input_images[image_iter];
-        if (vw::read_nodata_val(img_file, img_nodata_val)){
-          //vw_out() << "Found image " << image_iter << " nodata value: "
-          //         << img_nodata_val << std::endl;
-        }
-        // Model the shadow threshold
-        float shadow_thresh = opt.shadow_threshold_vec[image_iter];
-        if (opt.crop_input_images) {
-          // Make a copy in memory for faster access
-          if (!crop_boxes[0][dem_iter][image_iter].empty()) {
-            ImageView<float> cropped_img = 
-              crop(DiskImageView<float>(img_file), crop_boxes[0][dem_iter][image_iter]);
-            masked_images_vec[0][dem_iter][image_iter]
-              = create_pixel_range_mask2(cropped_img,
-					 std::max(img_nodata_val, shadow_thresh),
-					 opt.max_valid_image_vals_vec[image_iter]
-					 );
-            
-            // Compute blending weights only when using an approx camera model and
-            // cropping the images. Otherwise the weights are too huge.
-            if (opt.blending_dist > 0)
-              blend_weights_vec[0][dem_iter][image_iter]
-                = comp_blending_weights(masked_images_vec[0][dem_iter][image_iter],
-                                        opt.blending_dist, opt.blending_power,
-                                        opt.min_blend_size);
-          }
-        }else{
+      if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end())
+        continue;
+     
+      std::string img_file = opt.input_images[image_iter];
+      if (vw::read_nodata_val(img_file, img_nodata_val)){
+        //vw_out() << "Found image " << image_iter << " nodata value: "
+        //         << img_nodata_val << std::endl;
+      }
+      // Model the shadow threshold
+      float shadow_thresh = opt.shadow_threshold_vec[image_iter];
+      if (opt.crop_input_images) {
+        // Make a copy in memory for faster access
+        if (!crop_boxes[0][dem_iter][image_iter].empty()) {
+          ImageView<float> cropped_img = 
+            crop(DiskImageView<float>(img_file), crop_boxes[0][dem_iter][image_iter]);
           masked_images_vec[0][dem_iter][image_iter]
-            = create_pixel_range_mask2(DiskImageView<float>(img_file),
-				       std::max(img_nodata_val, shadow_thresh),
-				       opt.max_valid_image_vals_vec[image_iter]
-				       );
+            = create_pixel_range_mask2(cropped_img,
+                                       std::max(img_nodata_val, shadow_thresh),
+                                       opt.max_valid_image_vals_vec[image_iter]
+                                       );
+          
+          // Compute blending weights only when using an approx camera model and
+          // cropping the images. Otherwise the weights are too huge.
+          if (opt.blending_dist > 0)
+            blend_weights_vec[0][dem_iter][image_iter]
+              = comp_blending_weights(masked_images_vec[0][dem_iter][image_iter],
+                                      opt.blending_dist, opt.blending_power,
+                                      opt.min_blend_size);
         }
+      }else{
+        masked_images_vec[0][dem_iter][image_iter]
+          = create_pixel_range_mask2(DiskImageView<float>(img_file),
+                                     std::max(img_nodata_val, shadow_thresh),
+                                     opt.max_valid_image_vals_vec[image_iter]
+                                     );
       }
     }
-    g_img_nodata_val = &img_nodata_val;
+  }
+  g_img_nodata_val = &img_nodata_val;
 
-    // Get the sun and camera positions from the ISIS cube
-    std::vector<ModelParams> model_params;
-    model_params.resize(num_images);
-    for (int image_iter = 0; image_iter < num_images; image_iter++){
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-	if (opt.skip_images[dem_iter].find(image_iter) !=
-	    opt.skip_images[dem_iter].end()) continue;
-	IsisCameraModel* icam
-	  = dynamic_cast<IsisCameraModel*>(get_isis_cam(opt, cameras[dem_iter][image_iter]).get());
-	model_params[image_iter].sunPosition = icam->sun_position();
-        vw_out() << "Sun position for image: " << image_iter << " "
-	       << model_params[image_iter].sunPosition << std::endl;
-      }
+  // Get the sun and camera positions from the ISIS cube
+  std::vector<ModelParams> model_params;
+  model_params.resize(num_images);
+  for (int image_iter = 0; image_iter < num_images; image_iter++){
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      if (opt.skip_images[dem_iter].find(image_iter) !=
+          opt.skip_images[dem_iter].end()) continue;
+      IsisCameraModel* icam
+        = dynamic_cast<IsisCameraModel*>(get_isis_cam(opt, cameras[dem_iter][image_iter]).get());
+      model_params[image_iter].sunPosition = icam->sun_position();
+      vw_out() << "Sun position for image: " << image_iter << " "
+             << model_params[image_iter].sunPosition << std::endl;
     }
+  }
 
-    // Copy sun positions to an array
-    std::vector<double> scaled_sun_posns(3*num_images);
-    for (int image_iter = 0; image_iter < num_images; image_iter++){
-      for (int it = 0; it < 3; it++) 
-        scaled_sun_posns[3*image_iter + it] = 1; // model_params[image_iter].sunPosition[it];
-    }    
-    
-    // Find the grid sizes in meters. Note that dem heights are in
-    // meters too, so we treat both horizontal and vertical
-    // measurements in same units.
-    double gridx, gridy;
-    compute_grid_sizes_in_meters(dems[0][0], geos[0][0], dem_nodata_val, gridx, gridy);
-    vw_out() << "grid in x and y in meters: "
-	     << gridx << ' ' << gridy << std::endl;
-    g_gridx = &gridx;
-    g_gridy = &gridy;
-
-    // Find the max DEM height
-    std::vector<double> max_dem_height(num_dems, -std::numeric_limits<double>::max());
-    if (opt.model_shadows) {
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-        double curr_max_dem_height = -std::numeric_limits<double>::max();
-        for (int col = 0; col < dems[0][dem_iter].cols(); col++) {
-          for (int row = 0; row < dems[0][dem_iter].rows(); row++) {
-            if (dems[0][dem_iter](col, row) > curr_max_dem_height) {
-              curr_max_dem_height = dems[0][dem_iter](col, row);
-            }
-          }
-        }
-        max_dem_height[dem_iter] = curr_max_dem_height;
+  // Copy sun positions to an array
+  std::vector<double> scaled_sun_posns(3*num_images);
+  for (int image_iter = 0; image_iter < num_images; image_iter++){
+    for (int it = 0; it < 3; it++) 
+      scaled_sun_posns[3*image_iter + it] = 1; // model_params[image_iter].sunPosition[it];
+  }    
+  
+  // Find the grid sizes in meters. Note that dem heights are in
+  // meters too, so we treat both horizontal and vertical
+  // measurements in same units.
+  double gridx, gridy;
+  compute_grid_sizes_in_meters(dems[0][0], geos[0][0], dem_nodata_val, gridx, gridy);
+  vw_out() << "grid in x and y in meters: "
+           << gridx << ' ' << gridy << std::endl;
+  g_gridx = &gridx;
+  g_gridy = &gridy;
+
+  // Find the points in shadow
+  std::vector< std::vector< ImageView<float> > > shadow_masks;
+  computeShadowMasks(opt, dems[0], geos[0], model_params, scaled_sun_posns, shadow_masks);
+  g_shadow_masks = &shadow_masks;
+  
+  // Initial albedo. This will be updated later.
+  double initial_albedo = 1.0;
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    albedos[0][dem_iter].set_size(dems[0][dem_iter].cols(), dems[0][dem_iter].rows());
+    for (int col = 0; col < albedos[0][dem_iter].cols(); col++) {
+      for (int row = 0; row < albedos[0][dem_iter].rows(); row++) {
+        albedos[0][dem_iter](col, row) = initial_albedo;
       }
     }
-    g_max_dem_height = &max_dem_height;
+  }
+  
+  // We have intensity = albedo * double nonlin_reflectance(reflectance,
+  // exposure, haze, num_haze_coeffs)
+  // Assume that haze is 0 to start with. Find the exposure as
+  // mean(intensity)/mean(reflectance)/albedo. Use this to compute an
+  // initial exposure and decide based on that which images to
+  // skip. If the user provided initial exposures and haze, use those, but
+  // still go through the motions to find the images to skip.
+  if (!opt.save_computed_intensity_only) {
+
+    vw_out() << "Computing exposures.\n";
+    std::vector<double> local_exposures_vec(num_images, 0);
+    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+
+      std::vector<double> exposures_per_dem;
+      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
     
-    // Initial albedo. This will be updated later.
-    double initial_albedo = 1.0;
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      albedos[0][dem_iter].set_size(dems[0][dem_iter].cols(), dems[0][dem_iter].rows());
-      for (int col = 0; col < albedos[0][dem_iter].cols(); col++) {
-        for (int row = 0; row < albedos[0][dem_iter].rows(); row++) {
-          albedos[0][dem_iter](col, row) = initial_albedo;
-        }
-      }
-    }
+        if (opt.skip_images[dem_iter].find(image_iter) !=
+            opt.skip_images[dem_iter].end()) continue;
     
-    // We have intensity = albedo * double nonlin_reflectance(reflectance,
-    // exposure, haze, num_haze_coeffs)
-    // Assume that haze is 0 to start with. Find the exposure as
-    // mean(intensity)/mean(reflectance)/albedo. Use this to compute an
-    // initial exposure and decide based on that which images to
-    // skip. If the user provided initial exposures and haze, use those, but
-    // still go through the motions to find the images to skip.
-    if (!opt.save_computed_intensity_only) {
-
-      vw_out() << "Computing exposures.\n";
-      std::vector<double> local_exposures_vec(num_images, 0);
-      for (int image_iter = 0; image_iter < num_images; image_iter++) {
-
-	std::vector<double> exposures_per_dem;
-	for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      
-	  if (opt.skip_images[dem_iter].find(image_iter) !=
-	      opt.skip_images[dem_iter].end()) continue;
-      
-	  ImageView< PixelMask<double> > reflectance, intensity;
-	  ImageView<double> weight;
-          ImageView<Vector2> pq; // no need for these just for initialization
-
-          // Sample the large DEMs. Keep about 200 row and column samples.
-          int sample_col_rate = std::max((int)round(dems[0][dem_iter].cols()/200.0), 1);
-          int sample_row_rate = std::max((int)round(dems[0][dem_iter].rows()/200.0), 1);
-          computeReflectanceAndIntensity(dems[0][dem_iter], pq, geos[0][dem_iter],
-					 opt.model_shadows, max_dem_height[dem_iter],
-					 gridx, gridy, sample_col_rate, sample_row_rate,
-					 model_params[image_iter],
-					 global_params,
-					 crop_boxes[0][dem_iter][image_iter],
-					 masked_images_vec[0][dem_iter][image_iter],
-					 blend_weights_vec[0][dem_iter][image_iter],
-					 cameras[dem_iter][image_iter].get(),
-                                         &scaled_sun_posns[3*image_iter],
-					 reflectance, intensity, weight,
-					 &opt.model_coeffs_vec[0]);
-
-          // TODO: Below is not the optimal way of finding the exposure!
-          // Find it as the analytical minimum using calculus.
-	  double imgmean, imgstdev, refmean, refstdev;
-	  compute_image_stats(intensity, reflectance, imgmean, imgstdev, refmean, refstdev);
-	  double exposure = imgmean/refmean/initial_albedo;
-	  vw_out() << "img mean std: " << imgmean << ' ' << imgstdev << std::endl;
-	  vw_out() << "ref mean std: " << refmean << ' ' << refstdev << std::endl;
-	  vw_out() << "Local exposure for image " << image_iter << " and clip "
-		   << dem_iter << ": " << exposure << std::endl;
+        ImageView< PixelMask<double> > reflectance, intensity;
+        ImageView<double> weight;
+        ImageView<Vector2> pq; // no need for these just for initialization
+
+        // Sample the large DEMs. Keep about 200 row and column samples.
+        int sample_col_rate = std::max((int)round(dems[0][dem_iter].cols()/200.0), 1);
+        int sample_row_rate = std::max((int)round(dems[0][dem_iter].rows()/200.0), 1);
+        computeReflectanceAndIntensity(dems[0][dem_iter], pq, geos[0][dem_iter],
+                                       opt.model_shadows, shadow_masks[dem_iter][image_iter],
+                                       CameraLookupTable(), // not computed at this stage
+                                       gridx, gridy, sample_col_rate, sample_row_rate,
+                                       model_params[image_iter],
+                                       global_params,
+                                       crop_boxes[0][dem_iter][image_iter],
+                                       masked_images_vec[0][dem_iter][image_iter],
+                                       blend_weights_vec[0][dem_iter][image_iter],
+                                       cameras[dem_iter][image_iter].get(),
+                                       &scaled_sun_posns[3*image_iter],
+                                       reflectance, intensity, weight,
+                                       &opt.model_coeffs_vec[0]);
+
+        // TODO: Below is not the optimal way of finding the exposure!
+        // Find it as the analytical minimum using calculus.
+        double imgmean, imgstdev, refmean, refstdev;
+        compute_image_stats(intensity, reflectance, imgmean, imgstdev, refmean, refstdev);
+        double exposure = imgmean/refmean/initial_albedo;
+        vw_out() << "img mean std: " << imgmean << ' ' << imgstdev << std::endl;
+        vw_out() << "ref mean std: " << refmean << ' ' << refstdev << std::endl;
+        vw_out() << "Local exposure for image " << image_iter << " and clip "
+                 << dem_iter << ": " << exposure << std::endl;
 	
-	  double big = 1e+100; // There's no way image exposure can be bigger than this
-	  bool is_good = ( 0 < exposure && exposure < big );
-	  if (is_good) {
-	    exposures_per_dem.push_back(exposure);
-	  }else{
-	    // Skip images with bad exposure. Apparently there is no good
-	    // imagery in the area.
-	    opt.skip_images[dem_iter].insert(image_iter);
-	    vw_out() << "Skip image " << image_iter << " for clip " << dem_iter << std::endl;
-	  }
-	}
-
-	// Out the exposures for this image on all clips, pick the median
-	int len = exposures_per_dem.size();
-	if (len > 0) {
-	  std::sort(exposures_per_dem.begin(), exposures_per_dem.end());
-	  local_exposures_vec[image_iter] = 
-	    0.5*(exposures_per_dem[(len-1)/2] + exposures_per_dem[len/2]);
-	  //vw_out() << "Median exposure for image " << image_iter << " on all clips: "
-	  //	 << local_exposures_vec[image_iter] << std::endl;
-	}
+        double big = 1e+100; // There's no way image exposure can be bigger than this
+        bool is_good = ( 0 < exposure && exposure < big );
+        if (is_good) {
+          exposures_per_dem.push_back(exposure);
+        }else{
+          // Skip images with bad exposure. Apparently there is no good
+          // imagery in the area.
+          opt.skip_images[dem_iter].insert(image_iter);
+          vw_out() << "Skip image " << image_iter << " for clip " << dem_iter << std::endl;
+        }
       }
-    
-      if (opt.image_exposures_vec.empty()) opt.image_exposures_vec = local_exposures_vec;
-    }
 
-    // Initialize the haze as 0.
-    if ( (!opt.image_haze_vec.empty()) && (int)opt.image_haze_vec.size() != num_images )
-      vw_throw(ArgumentErr() << "Expecting as many haze values as images.\n");
-    if (opt.image_haze_vec.empty()) {
-      for (int image_iter = 0; image_iter < num_images; image_iter++) {
-        // Pad the haze vec
-        std::vector<double> haze_vec;
-        while (haze_vec.size() < g_max_num_haze_coeffs) haze_vec.push_back(0);
-        opt.image_haze_vec.push_back(haze_vec);
+      // Out the exposures for this image on all clips, pick the median
+      int len = exposures_per_dem.size();
+      if (len > 0) {
+        std::sort(exposures_per_dem.begin(), exposures_per_dem.end());
+        local_exposures_vec[image_iter] = 
+          0.5*(exposures_per_dem[(len-1)/2] + exposures_per_dem[len/2]);
+        //vw_out() << "Median exposure for image " << image_iter << " on all clips: "
+        //	 << local_exposures_vec[image_iter] << std::endl;
       }
     }
-    
-    for (size_t image_iter = 0; image_iter < opt.image_exposures_vec.size(); image_iter++) {
-      vw_out() << "Image exposure for " << opt.input_images[image_iter] << ' '
-               << opt.image_exposures_vec[image_iter] << std::endl;
-    }
+  
+    if (opt.image_exposures_vec.empty()) opt.image_exposures_vec = local_exposures_vec;
+  }
 
-    if (opt.compute_exposures_only){
-      save_exposures(opt.out_prefix, opt.input_images, opt.image_exposures_vec);
-      return 0;
+  // Initialize the haze as 0.
+  if ( (!opt.image_haze_vec.empty()) && (int)opt.image_haze_vec.size() != num_images )
+    vw_throw(ArgumentErr() << "Expecting as many haze values as images.\n");
+  if (opt.image_haze_vec.empty()) {
+    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+      // Pad the haze vec
+      std::vector<double> haze_vec;
+      while (haze_vec.size() < g_max_num_haze_coeffs) haze_vec.push_back(0);
+      opt.image_haze_vec.push_back(haze_vec);
     }
+  }
+  
+  for (size_t image_iter = 0; image_iter < opt.image_exposures_vec.size(); image_iter++) {
+    vw_out() << "Image exposure for " << opt.input_images[image_iter] << ' '
+             << opt.image_exposures_vec[image_iter] << std::endl;
+  }
 
-    if (opt.num_haze_coeffs > 0) {
-      for (size_t image_iter = 0; image_iter < opt.image_haze_vec.size(); image_iter++) {
-        vw_out() << "Image haze for " << opt.input_images[image_iter] << ':';
-        for (size_t hiter = 0; hiter < opt.image_haze_vec[image_iter].size(); hiter++) {
-          vw_out() << " " << opt.image_haze_vec[image_iter][hiter];
-        }
-        vw_out() << "\n";
+  if (opt.compute_exposures_only){
+    save_exposures(opt.out_prefix, opt.input_images, opt.image_exposures_vec);
+    return;
+  }
+
+  if (opt.num_haze_coeffs > 0) {
+    for (size_t image_iter = 0; image_iter < opt.image_haze_vec.size(); image_iter++) {
+      vw_out() << "Image haze for " << opt.input_images[image_iter] << ':';
+      for (size_t hiter = 0; hiter < opt.image_haze_vec[image_iter].size(); hiter++) {
+        vw_out() << " " << opt.image_haze_vec[image_iter][hiter];
       }
+      vw_out() << "\n";
     }
-    
-    g_exposures     = &opt.image_exposures_vec;
-    g_haze          = &opt.image_haze_vec;
-    g_scaled_sun_posns = &scaled_sun_posns;
-    
-    // For images that we don't use, wipe the cameras and all other
-    // info, as those take up memory (the camera is a table). 
-    for (int image_iter = 0; image_iter < num_images; image_iter++) {
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-        if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) {
-          masked_images_vec[0][dem_iter][image_iter] = ImageView< PixelMask<float> >();
-          blend_weights_vec[0][dem_iter][image_iter] = ImageView<double>();
-          cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>();
-        }
+  }
+  
+  g_exposures     = &opt.image_exposures_vec;
+  g_haze          = &opt.image_haze_vec;
+  g_scaled_sun_posns = &scaled_sun_posns;
+  
+  // For images that we don't use, wipe the cameras and all other
+  // info, as those take up memory (the camera is a table). 
+  for (int image_iter = 0; image_iter < num_images; image_iter++) {
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) {
+        masked_images_vec[0][dem_iter][image_iter] = ImageView< PixelMask<float> >();
+        blend_weights_vec[0][dem_iter][image_iter] = ImageView<double>();
+        cameras[dem_iter][image_iter] = boost::shared_ptr<CameraModel>();
       }
     }
-    
-    // The initial camera adjustments. They will be updated later.
-    std::vector<double> adjustments(6*num_images, 0);
-    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+  }
+  
+  // The initial camera adjustments. They will be updated later.
+  std::vector<double> adjustments(6*num_images, 0);
+  for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
-      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-        if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) continue;
-      
-        Vector3 translation, axis_angle;
-        Vector2 pixel_offset;
+    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+      if (opt.skip_images[dem_iter].find(image_iter) != opt.skip_images[dem_iter].end()) continue;
+    
+      Vector3 translation, axis_angle;
+      Vector2 pixel_offset;
 
-        if (!opt.use_approx_adjusted_camera_models) {
-          AdjustedCameraModel * icam
-            = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
-          if (icam == NULL)
-            vw_throw(ArgumentErr() << "Expecting an adjusted camera model.\n");
-          translation = icam->translation();
-          axis_angle = icam->rotation().axis_angle();
-          pixel_offset = icam->pixel_offset();
-        }else{
-          ApproxAdjustedCameraModel * aapcam
-            = dynamic_cast<ApproxAdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
-          if (aapcam == NULL)
-            vw_throw(ArgumentErr() << "Expecting an approximate adjusted camera model.\n");
-          AdjustedCameraModel acam = aapcam->exact_adjusted_camera();
-          translation = acam.translation();
-          axis_angle = acam.rotation().axis_angle();
-          pixel_offset = acam.pixel_offset();
-        }
+      if (!opt.use_approx_adjusted_camera_models) {
+        AdjustedCameraModel * icam
+          = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+        if (icam == NULL)
+          vw_throw(ArgumentErr() << "Expecting an adjusted camera model.\n");
+        translation = icam->translation();
+        axis_angle = icam->rotation().axis_angle();
+        pixel_offset = icam->pixel_offset();
+      }else{
+        ApproxAdjustedCameraModel * aapcam
+          = dynamic_cast<ApproxAdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+        if (aapcam == NULL)
+          vw_throw(ArgumentErr() << "Expecting an approximate adjusted camera model.\n");
+        AdjustedCameraModel acam = aapcam->exact_adjusted_camera();
+        translation = acam.translation();
+        axis_angle = acam.rotation().axis_angle();
+        pixel_offset = acam.pixel_offset();
+      }
 
-        // TODO(oalexan1): This does not appear necessary use adjusted approximate cameras.
-        if (pixel_offset != Vector2())
-          vw_throw(ArgumentErr() << "Expecting zero pixel offset.\n");
-        for (int param_iter = 0; param_iter < 3; param_iter++) {
-          adjustments[6*image_iter + 0 + param_iter]
-            = translation[param_iter]/(g_position_scale_factor*opt.camera_position_step_size);
-          adjustments[6*image_iter + 3 + param_iter] = axis_angle[param_iter];
-        }
+      // TODO(oalexan1): This does not appear necessary use adjusted approximate cameras.
+      if (pixel_offset != Vector2())
+        vw_throw(ArgumentErr() << "Expecting zero pixel offset.\n");
+      for (int param_iter = 0; param_iter < 3; param_iter++) {
+        adjustments[6*image_iter + 0 + param_iter]
+          = translation[param_iter]/(g_position_scale_factor*opt.camera_position_step_size);
+        adjustments[6*image_iter + 3 + param_iter] = axis_angle[param_iter];
       }
     }
-    g_adjustments = &adjustments;
+  }
+  g_adjustments = &adjustments;
 
-    // Prepare data at each coarseness level
-    // orig_dems will keep the input DEMs and won't change. Keep to the optimized
-    // DEMs close to orig_dems. Make a deep copy below.
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-      orig_dems[0][dem_iter] = copy(dems[0][dem_iter]);
-    }
-    
-    double sub_scale = 1.0/factor;
-    for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+  // Prepare data at each coarseness level
+  // orig_dems will keep the input DEMs and won't change. Keep to the optimized
+  // DEMs close to orig_dems. Make a deep copy below.
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+    orig_dems[0][dem_iter] = copy(dems[0][dem_iter]);
+  }
+  
+  double sub_scale = 1.0/factor;
+  for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
 
-      for (int level = 1; level <= levels; level++) {
-        geos[level][dem_iter] = resample(geos[level-1][dem_iter], sub_scale);
-        orig_dems[level][dem_iter]
-          = pixel_cast<double>(vw::resample_aa
-                               (pixel_cast< PixelMask<double> >
-                                (orig_dems[level-1][dem_iter]), sub_scale));
-        dems[level][dem_iter] = copy(orig_dems[level][dem_iter]);
-        
-        // CERES won't be happy with tiny DEMs
-        if (dems[level][dem_iter].cols() < min_dem_size || dems[level][dem_iter].rows()
-            < min_dem_size) {
-          levels = std::max(0, level-1);
-          vw_out(WarningMessage) << "Reducing the number of coarse levels to "
-                                 << levels << ".\n";
-          geos.resize(levels+1);
-          orig_dems.resize(levels+1);
-          dems.resize(levels+1);
-          albedos.resize(levels+1);
-          masked_images_vec.resize(levels+1);
-          blend_weights_vec.resize(levels+1);
-          factors.resize(levels+1);
-          break;
-        }
+    for (int level = 1; level <= levels; level++) {
+      geos[level][dem_iter] = resample(geos[level-1][dem_iter], sub_scale);
+      orig_dems[level][dem_iter]
+        = pixel_cast<double>(vw::resample_aa
+                             (pixel_cast< PixelMask<double> >
+                              (orig_dems[level-1][dem_iter]), sub_scale));
+      dems[level][dem_iter] = copy(orig_dems[level][dem_iter]);
+      
+      // CERES won't be happy with tiny DEMs
+      if (dems[level][dem_iter].cols() < min_dem_size || dems[level][dem_iter].rows()
+          < min_dem_size) {
+        levels = std::max(0, level-1);
+        vw_out(WarningMessage) << "Reducing the number of coarse levels to "
+                               << levels << ".\n";
+        geos.resize(levels+1);
+        orig_dems.resize(levels+1);
+        dems.resize(levels+1);
+        albedos.resize(levels+1);
+        masked_images_vec.resize(levels+1);
+        blend_weights_vec.resize(levels+1);
+        factors.resize(levels+1);
+        break;
+      }
 
-        albedos[level][dem_iter] = pixel_cast<double>(vw::resample_aa
-                                                      (pixel_cast< PixelMask<double> >
-                                                       (albedos[level-1][dem_iter]), sub_scale));
+      albedos[level][dem_iter] = pixel_cast<double>(vw::resample_aa
+                                                    (pixel_cast< PixelMask<double> >
+                                                     (albedos[level-1][dem_iter]), sub_scale));
 
-        // We must write the subsampled images to disk, and then read
-        // them back, as VW cannot access individual pixels of the
-        // monstrosities created using the logic below, and even if it
-        // could, it is best if resampling is done once, and offline,
-        // rather than redoing it each time within the optimization
-        // loop.
-        for (int image_iter = 0; image_iter < num_images; image_iter++) {
+      // We must write the subsampled images to disk, and then read
+      // them back, as VW cannot access individual pixels of the
+      // monstrosities created using the logic below, and even if it
+      // could, it is best if resampling is done once, and offline,
+      // rather than redoing it each time within the optimization
+      // loop.
+      for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
-          if (opt.skip_images[dem_iter].find(image_iter)
-              != opt.skip_images[dem_iter].end()) continue;
+        if (opt.skip_images[dem_iter].find(image_iter)
+            != opt.skip_images[dem_iter].end()) continue;
+      
+        fs::path image_path(opt.input_images[image_iter]);
+        std::ostringstream os; os << "-level" << level;
+        if (num_dems > 1)      os << "-clip"  << dem_iter;
+        std::string sub_image = opt.out_prefix + "-"
+          + image_path.stem().string() + os.str() + ".tif";
+        vw_out() << "Writing subsampled image: " << sub_image << "\n";
+        bool has_img_georef = false;
+        GeoReference img_georef;
+        bool has_img_nodata = true;
+        int tile_size = 256;
+        int sub_threads = 1;
+        TerminalProgressCallback tpc("asp", ": ");
+        vw::cartography::block_write_gdal_image
+          (sub_image,
+           apply_mask
+           (block_rasterize
+            (vw::cache_tile_aware_render
+             (vw::resample_aa
+              (masked_images_vec[level-1][dem_iter][image_iter], sub_scale),
+              Vector2i(tile_size, tile_size) * sub_scale),
+             Vector2i(tile_size, tile_size), sub_threads), img_nodata_val),
+           has_img_georef, img_georef, has_img_nodata, img_nodata_val, opt, tpc);
+        
+        // Read it right back
+        if (opt.crop_input_images) {
+          // Read it fully in memory, as we cropped it before
+          ImageView<float> memory_img = copy(DiskImageView<float>(sub_image));
+          masked_images_vec[level][dem_iter][image_iter]
+            = create_mask(memory_img, img_nodata_val);
+        }else{
+          // Read just a handle, as the full image could be huge
+          masked_images_vec[level][dem_iter][image_iter]
+            = create_mask(DiskImageView<float>(sub_image), img_nodata_val);
+        }
+      
+        if (blend_weights_vec[level-1][dem_iter][image_iter].cols() > 0 &&
+            blend_weights_vec[level-1][dem_iter][image_iter].rows() > 0 ) {
+          fs::path weight_path(opt.input_images[image_iter]);
+          std::string sub_weight = opt.out_prefix + "-wt-"
+            + weight_path.stem().string() + os.str() + ".tif";
+          vw_out() << "Writing subsampled weight: " << sub_weight << "\n";
         
-          fs::path image_path(opt.input_images[image_iter]);
-          std::ostringstream os; os << "-level" << level;
-          if (num_dems > 1)      os << "-clip"  << dem_iter;
-          std::string sub_image = opt.out_prefix + "-"
-            + image_path.stem().string() + os.str() + ".tif";
-          vw_out() << "Writing subsampled image: " << sub_image << "\n";
-          bool has_img_georef = false;
-          GeoReference img_georef;
-          bool has_img_nodata = true;
-          int tile_size = 256;
-          int sub_threads = 1;
-          TerminalProgressCallback tpc("asp", ": ");
           vw::cartography::block_write_gdal_image
-            (sub_image,
+            (sub_weight,
              apply_mask
              (block_rasterize
               (vw::cache_tile_aware_render
                (vw::resample_aa
-                (masked_images_vec[level-1][dem_iter][image_iter], sub_scale),
-                Vector2i(tile_size, tile_size) * sub_scale),
-               Vector2i(tile_size, tile_size), sub_threads), img_nodata_val),
-             has_img_georef, img_georef, has_img_nodata, img_nodata_val, opt, tpc);
-          
-          // Read it right back
-          if (opt.crop_input_images) {
-            // Read it fully in memory, as we cropped it before
-            ImageView<float> memory_img = copy(DiskImageView<float>(sub_image));
-            masked_images_vec[level][dem_iter][image_iter]
-              = create_mask(memory_img, img_nodata_val);
-          }else{
-            // Read just a handle, as the full image could be huge
-            masked_images_vec[level][dem_iter][image_iter]
-              = create_mask(DiskImageView<float>(sub_image), img_nodata_val);
-          }
-        
-          if (blend_weights_vec[level-1][dem_iter][image_iter].cols() > 0 &&
-              blend_weights_vec[level-1][dem_iter][image_iter].rows() > 0 ) {
-            fs::path weight_path(opt.input_images[image_iter]);
-            std::string sub_weight = opt.out_prefix + "-wt-"
-              + weight_path.stem().string() + os.str() + ".tif";
-            vw_out() << "Writing subsampled weight: " << sub_weight << "\n";
-          
-            vw::cartography::block_write_gdal_image
-              (sub_weight,
-               apply_mask
-               (block_rasterize
-                (vw::cache_tile_aware_render
-                 (vw::resample_aa
-                  (create_mask(blend_weights_vec[level-1][dem_iter][image_iter],
-                               dem_nodata_val), sub_scale),
-                  Vector2i(tile_size,tile_size) * sub_scale),
-                 Vector2i(tile_size, tile_size), sub_threads), dem_nodata_val),
-               has_img_georef, img_georef, has_img_nodata, dem_nodata_val, opt, tpc);
-
-            ImageView<double> memory_weight = copy(DiskImageView<double>(sub_weight));
-            blend_weights_vec[level][dem_iter][image_iter] = memory_weight;
-          }
+                (create_mask(blend_weights_vec[level-1][dem_iter][image_iter],
+                             dem_nodata_val), sub_scale),
+                Vector2i(tile_size,tile_size) * sub_scale),
+               Vector2i(tile_size, tile_size), sub_threads), dem_nodata_val),
+             has_img_georef, img_georef, has_img_nodata, dem_nodata_val, opt, tpc);
+
+          ImageView<double> memory_weight = copy(DiskImageView<double>(sub_weight));
+          blend_weights_vec[level][dem_iter][image_iter] = memory_weight;
+        }
+      
+      }
+    }
+  }
+  
+  // Start going from the coarsest to the finest level
+  for (int level = levels; level >= 0; level--) {
+
+    g_level = level;
+
+    int num_iterations;
+    if (level == 0)
+      num_iterations = opt.max_iterations;
+    else
+      num_iterations = opt.max_coarse_iterations;
+
+    // Scale the cameras
+    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
         
+        if (opt.skip_images[dem_iter].find(image_iter) !=
+            opt.skip_images[dem_iter].end()) continue;
+
+        if (!opt.use_approx_adjusted_camera_models) {
+          AdjustedCameraModel * adj_cam
+            = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
+          if (adj_cam == NULL)
+            vw_throw( ArgumentErr() << "Expecting adjusted camera.\n");
+          adj_cam->set_scale(factors[level]);
         }
       }
     }
     
-    // Start going from the coarsest to the finest level
-    for (int level = levels; level >= 0; level--) {
+    run_sfs_level(// Fixed inputs
+                  num_iterations, opt, geos[level],
+                  opt.smoothness_weight*factors[level]*factors[level],
+                  dem_nodata_val, crop_boxes[level],
+                  masked_images_vec[level], blend_weights_vec[level],
+                  global_params, model_params,
+                  orig_dems[level], initial_albedo,
+                  // Quantities that will float
+                  dems[level], albedos[level], cameras,
+                  opt.image_exposures_vec,
+                  opt.image_haze_vec,
+                  scaled_sun_posns,
+                  adjustments, opt.model_coeffs_vec);
+
+    // TODO: Study this. Discarding the coarse DEM and exposure so
+    // keeping only the cameras seem to work better.
+    // Note that we overwrite dems[level-1] by resampling the coarser
+    // dems[level], but we keep orig_dems[level-1] from the beginning.
+    if (level > 0) {
+      for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
+        if (!opt.fix_dem)
+          interp_image(dems[level][dem_iter],    sub_scale, dems[level-1][dem_iter]);
+        if (opt.float_albedo)
+          interp_image(albedos[level][dem_iter], sub_scale, albedos[level-1][dem_iter]);
+      }
+    }
+    
+  }
+}
+
+// Blend the sfs results on overlapping tiles of the input DEM. The
+// weight of a tile at a pixel grows with the distance from the tile
+// boundary, so that the padding of each tile, which is less accurate
+// as the DEM is fixed at the tile boundary, contributes little to the
+// result. Only the tiles overlapping a given output block are read.
+class SfsTileBlendView: public ImageViewBase<SfsTileBlendView> {
+  int m_cols, m_rows;
+  std::vector<std::string> m_tile_files;
+  std::vector<BBox2i>      m_tile_boxes; // in the pixels of the full DEM
+  double                   m_nodata_val;
 
-      g_level = level;
+public:
+  SfsTileBlendView(int cols, int rows,
+                   std::vector<std::string> const& tile_files,
+                   std::vector<BBox2i> const& tile_boxes,
+                   double nodata_val):
+    m_cols(cols), m_rows(rows), m_tile_files(tile_files),
+    m_tile_boxes(tile_boxes), m_nodata_val(nodata_val){}
+
+  // Boilerplate
+  typedef double     pixel_type;
+  typedef pixel_type result_type;
+  typedef ProceduralPixelAccessor<SfsTileBlendView> pixel_accessor;
+  inline int cols  () const { return m_cols; }
+  inline int rows  () const { return m_rows; }
+  inline int planes() const { return 1; }
+  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+  inline pixel_type operator()( double/*i*/, double/*j*/, int/*p*/ = 0 ) const {
+    vw_throw(NoImplErr() << "SfsTileBlendView::operator()(...) is not implemented");
+    return pixel_type();
+  }
 
-      int num_iterations;
-      if (level == 0)
-        num_iterations = opt.max_iterations;
-      else
-        num_iterations = opt.max_coarse_iterations;
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
+  inline prerasterize_type prerasterize(BBox2i bbox) const {
 
-      // Scale the cameras
-      for (int image_iter = 0; image_iter < num_images; image_iter++) {
-        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-          
-          if (opt.skip_images[dem_iter].find(image_iter) !=
-              opt.skip_images[dem_iter].end()) continue;
-
-          if (!opt.use_approx_adjusted_camera_models) {
-            AdjustedCameraModel * adj_cam
-              = dynamic_cast<AdjustedCameraModel*>(cameras[dem_iter][image_iter].get());
-            if (adj_cam == NULL)
-              vw_throw( ArgumentErr() << "Expecting adjusted camera.\n");
-            adj_cam->set_scale(factors[level]);
-          }
+    ImageView<double> tile(bbox.width(), bbox.height()), weights(bbox.width(), bbox.height());
+    fill(tile, 0.0);
+    fill(weights, 0.0);
+
+    for (size_t tile_iter = 0; tile_iter < m_tile_boxes.size(); tile_iter++) {
+
+      BBox2i tile_box = m_tile_boxes[tile_iter];
+      BBox2i overlap  = bbox;
+      overlap.crop(tile_box);
+      if (overlap.empty())
+        continue;
+
+      double tile_nodata = m_nodata_val;
+      vw::read_nodata_val(m_tile_files[tile_iter], tile_nodata);
+      ImageView<double> data = crop(DiskImageView<double>(m_tile_files[tile_iter]),
+                                    overlap - tile_box.min());
+
+      for (int col = 0; col < data.cols(); col++) {
+        for (int row = 0; row < data.rows(); row++) {
+          double val = data(col, row);
+          if (val == tile_nodata || boost::math::isnan(val))
+            continue;
+
+          // Distance to the tile boundary, in the pixels of the full DEM
+          int c = col + overlap.min().x(), r = row + overlap.min().y();
+          double dist = std::min(std::min(c - tile_box.min().x(), tile_box.max().x() - 1 - c),
+                                 std::min(r - tile_box.min().y(), tile_box.max().y() - 1 - r));
+          double wt = (dist + 1.0)*(dist + 1.0);
+
+          int oc = c - bbox.min().x(), orow = r - bbox.min().y();
+          tile(oc, orow)    += wt*val;
+          weights(oc, orow) += wt;
         }
       }
-      
-      run_sfs_level(// Fixed inputs
-                    num_iterations, opt, geos[level],
-                    opt.smoothness_weight*factors[level]*factors[level],
-                    dem_nodata_val, crop_boxes[level],
-                    masked_images_vec[level], blend_weights_vec[level],
-                    global_params, model_params,
-                    orig_dems[level], initial_albedo,
-                    // Quantities that will float
-                    dems[level], albedos[level], cameras,
-                    opt.image_exposures_vec,
-                    opt.image_haze_vec,
-                    scaled_sun_posns,
-                    adjustments, opt.model_coeffs_vec);
-
-      // TODO: Study this. Discarding the coarse DEM and exposure so
-      // keeping only the cameras seem to work better.
-      // Note that we overwrite dems[level-1] by resampling the coarser
-      // dems[level], but we keep orig_dems[level-1] from the beginning.
-      if (level > 0) {
-        for (int dem_iter = 0; dem_iter < num_dems; dem_iter++) {
-          if (!opt.fix_dem)
-            interp_image(dems[level][dem_iter],    sub_scale, dems[level-1][dem_iter]);
-          if (opt.float_albedo)
-            interp_image(albedos[level][dem_iter], sub_scale, albedos[level-1][dem_iter]);
-        }
+    }
+
+    for (int col = 0; col < tile.cols(); col++) {
+      for (int row = 0; row < tile.rows(); row++) {
+        if (weights(col, row) > 0)
+          tile(col, row) /= weights(col, row);
+        else
+          tile(col, row) = m_nodata_val;
       }
-      
     }
 
+    return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+}; // End class SfsTileBlendView
+
+// Run sfs on overlapping tiles of the input DEM, one tile at a time,
+// and blend the results. Each tile is padded, and only the tile and,
+// with --crop-input-images, the corresponding portions of the images
+// are kept in memory. The tiles are solved independently, and only
+// share the padding that is blended. The exposures are found on each
+// tile first, and the median for each image is then kept fixed, so
+// that all tiles are consistent.
+void run_sfs_tiled(Options const& opt) {
+
+  DiskImageView<double> dem_handle(opt.input_dems[0]);
+  int dem_cols = dem_handle.cols(), dem_rows = dem_handle.rows();
+
+  GeoReference georef;
+  if (!read_georeference(georef, opt.input_dems[0]))
+    vw_throw( ArgumentErr() << "The input DEM has no georeference.\n" );
+
+  Options tile_opt = opt;
+  tile_opt.tile_size = 0;
+
+  // The tiles, with padding, in the pixels of the full DEM
+  std::vector<BBox2i> tile_boxes;
+  for (int col = 0; col < dem_cols; col += opt.tile_size) {
+    for (int row = 0; row < dem_rows; row += opt.tile_size) {
+      BBox2i box(col, row, opt.tile_size, opt.tile_size);
+      box.expand(opt.padding);
+      box.crop(BBox2i(0, 0, dem_cols, dem_rows));
+      tile_boxes.push_back(box);
+    }
+  }
+
+  // Find the exposures on each tile, if not provided, and for each
+  // image keep the median over the tiles where it is usable, as is
+  // done for multiple DEM clips. Each tile loads only its own portions
+  // of the images, so the memory use stays bounded.
+  if (tile_opt.image_exposures_vec.empty()) {
+    int num_images = opt.input_images.size();
+    std::vector< std::vector<double> > exposures_per_tile(num_images);
+    for (size_t tile_iter = 0; tile_iter < tile_boxes.size(); tile_iter++) {
+      vw_out() << "Computing exposures for tile " << tile_iter + 1 << " out of "
+               << tile_boxes.size() << ".\n";
+      std::ostringstream os;
+      os << opt.out_prefix << "-tile-" << tile_iter;
+      Options exp_opt = tile_opt;
+      exp_opt.compute_exposures_only = true;
+      exp_opt.crop_win   = tile_boxes[tile_iter];
+      exp_opt.out_prefix = os.str();
+      run_sfs(exp_opt);
+      if (int(exp_opt.image_exposures_vec.size()) != num_images)
+        continue;
+      for (int image_iter = 0; image_iter < num_images; image_iter++) {
+        double exposure = exp_opt.image_exposures_vec[image_iter];
+        if (exposure > 0) // zero means the image is not usable on this tile
+          exposures_per_tile[image_iter].push_back(exposure);
+      }
+    }
+
+    tile_opt.image_exposures_vec.resize(num_images, 0);
+    for (int image_iter = 0; image_iter < num_images; image_iter++) {
+      std::vector<double> & exposures = exposures_per_tile[image_iter];
+      int len = exposures.size();
+      if (len == 0)
+        continue;
+      std::sort(exposures.begin(), exposures.end());
+      tile_opt.image_exposures_vec[image_iter]
+        = 0.5*(exposures[(len-1)/2] + exposures[len/2]);
+    }
+    save_exposures(opt.out_prefix, opt.input_images, tile_opt.image_exposures_vec);
+  }
+
+  std::vector<std::string> dem_files, albedo_files;
+  for (size_t tile_iter = 0; tile_iter < tile_boxes.size(); tile_iter++) {
+
+    std::ostringstream os;
+    os << opt.out_prefix << "-tile-" << tile_iter;
+    std::string tile_prefix = os.str();
+    dem_files.push_back(tile_prefix + "-DEM-final.tif");
+    albedo_files.push_back(tile_prefix + "-comp-albedo-final.tif");
+
+    vw_out() << "Processing tile " << tile_iter + 1 << " out of " << tile_boxes.size()
+             << ": " << tile_boxes[tile_iter] << ".\n";
+    Options curr_opt = tile_opt;
+    curr_opt.crop_win   = tile_boxes[tile_iter];
+    curr_opt.out_prefix = tile_prefix;
+
+    // The camera lookup tables of each tile have their own names, both
+    // those written now and those read from a previous tiled run.
+    std::ostringstream lookup_os;
+    lookup_os << opt.camera_lookup_prefix << "-tile-" << tile_iter;
+    curr_opt.camera_lookup_prefix = lookup_os.str();
+    run_sfs(curr_opt);
+  }
+  g_opt = &opt;
+
+  double dem_nodata_val = -std::numeric_limits<float>::max();
+  vw::read_nodata_val(dem_files[0], dem_nodata_val);
+
+  bool has_georef = true, has_nodata = true;
+  std::string out_dem_file = opt.out_prefix + "-DEM-final.tif";
+  vw_out() << "Writing: " << out_dem_file << std::endl;
+  TerminalProgressCallback tpc("asp", ": ");
+  block_write_gdal_image(out_dem_file,
+                         SfsTileBlendView(dem_cols, dem_rows, dem_files, tile_boxes,
+                                          dem_nodata_val),
+                         has_georef, georef, has_nodata, dem_nodata_val, opt, tpc);
+
+  if (opt.float_albedo) {
+    std::string out_albedo_file = opt.out_prefix + "-comp-albedo-final.tif";
+    vw_out() << "Writing: " << out_albedo_file << std::endl;
+    block_write_gdal_image(out_albedo_file,
+                           SfsTileBlendView(dem_cols, dem_rows, albedo_files, tile_boxes,
+                                            dem_nodata_val),
+                           has_georef, georef, has_nodata, dem_nodata_val, opt, tpc);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  
+  Stopwatch sw_total;
+  sw_total.start();
+  
+  Options opt;
+  g_opt = &opt;
+  try {
+    handle_arguments( argc, argv, opt );
+
+    if (opt.tile_size > 0)
+      run_sfs_tiled(opt);
+    else
+      run_sfs(opt);
+    
   } ASP_STANDARD_CATCHES;
   
   VW_OUT(DebugMessage, "asp") << "Number of times we used the global lock: "
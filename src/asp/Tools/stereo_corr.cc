@@ -30,6 +30,8 @@
 #include <asp/Tools/stereo.h>
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/CorrMemory.h>
+#include <asp/Core/CorrSubTiles.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionPinhole.h>
 #include <xercesc/util/PlatformUtils.hpp>
@@ -932,62 +934,14 @@ public:
     ImageViewRef<InputPixelType> right_trans_img;
     ImageViewRef<vw::uint8     > right_trans_mask;
 
-    bool do_round = true; // round integer disparities after transform
-
     // User strategies
     BBox2f local_search_range;
     if ( stereo_settings().seed_mode > 0 ) {
 
-      // The low-res version of bbox
-      BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
-                        elem_quot(bbox.max(), m_upscale_factor) );
-      seed_bbox.expand(1);
-      seed_bbox.crop( m_seed_bbox );
-      // Get the disparity range in d_sub corresponding to this tile.
-      VW_OUT(DebugMessage, "stereo") << "\nGetting disparity range for : " << seed_bbox << "\n";
-      DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
-
-      if (!use_local_homography){
-        local_search_range = stereo::get_disparity_range( disparity_in_box );
-      }else{ // use local homography
+      if (use_local_homography){
         int ts = ASPGlobalOptions::corr_tile_size();
         lowres_hom = m_local_hom(bbox.min().x()/ts, bbox.min().y()/ts);
-        local_search_range = stereo::get_disparity_range
-          (transform_disparities(do_round, seed_bbox,
-           lowres_hom, disparity_in_box));
-      }
-
-      bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 &&
-                                   m_sub_disp_spread.rows() != 0 );
-      // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
-      if ( has_sub_disp_spread &&
-           m_sub_disp_spread.cols() != m_sub_disp.cols() &&
-           m_sub_disp_spread.rows() != m_sub_disp.rows() ){
-        vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
-      }
-
-      if (has_sub_disp_spread){
-        // Expand the disparity range by m_sub_disp_spread.
-        SpreadImageType spread_in_box = crop( m_sub_disp_spread, seed_bbox );
-
-        if (!use_local_homography){
-          BBox2f spread = stereo::get_disparity_range( spread_in_box );
-          local_search_range.min() -= spread.max();
-          local_search_range.max() += spread.max();
-        }else{
-          DispSeedImageType upper_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                                               disparity_in_box + spread_in_box);
-          DispSeedImageType lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
-                                                               disparity_in_box - spread_in_box);
-          BBox2f upper_range = stereo::get_disparity_range(upper_disp);
-          BBox2f lower_range = stereo::get_disparity_range(lower_disp);
-
-          local_search_range = upper_range;
-          local_search_range.grow(lower_range);
-        } //endif use_local_homography
-      } //endif has_sub_disp_spread
 
-      if (use_local_homography){
         Vector3 upscale(     m_upscale_factor[0],     m_upscale_factor[1], 1 );
         Vector3 dnscale( 1.0/m_upscale_factor[0], 1.0/m_upscale_factor[1], 1 );
         fullres_hom = diagonal_matrix(upscale)*lowres_hom*diagonal_matrix(dnscale);
@@ -1002,20 +956,10 @@ public:
         right_trans_mask = channel_cast_rescale<uint8>(select_channel(right_trans_masked_img, 1));
       } //endif use_local_homography
 
-      local_search_range = grow_bbox_to_int(local_search_range);
-      // Expand local_search_range by 1. This is necessary since
-      // m_sub_disp is integer-valued, and perhaps the search
-      // range was supposed to be a fraction of integer bigger.
-      local_search_range.expand(1);
-
-      // Scale the search range to full-resolution
-      local_search_range.min() = floor(elem_prod(local_search_range.min(),m_upscale_factor));
-      local_search_range.max() = ceil (elem_prod(local_search_range.max(),m_upscale_factor));
+      local_search_range = seeded_search_range(bbox, lowres_hom);
 
-      // If the user specified a search range limit, apply it here.
       if ((stereo_settings().search_range_limit.min() != Vector2i()) || 
           (stereo_settings().search_range_limit.max() != Vector2i())   ) {     
-        local_search_range.crop(stereo_settings().search_range_limit);
         vw_out() << "\t--> Local search range constrained to: " << local_search_range << "\n";
       }
 
@@ -1029,12 +973,156 @@ public:
       VW_OUT(DebugMessage,"stereo") << "Searching with " << stereo_settings().search_range << "\n";
     }
 
+    // With the block matcher, parts of the tile whose search ranges
+    // are much smaller than the one of the whole tile are correlated
+    // separately. SGM must do the whole tile at once.
+    bool using_sgm = (stereo_settings().stereo_algorithm > vw::stereo::VW_CORRELATION_BM);
+    int  min_size  = stereo_settings().corr_min_sub_tile_size;
+    if (stereo_settings().seed_mode == 0 || using_sgm || min_size <= 0)
+      return correlate(bbox, local_search_range, right_trans_img, right_trans_mask);
+
+    std::vector< std::pair<BBox2i, BBox2f> > sub_tiles;
+    asp::split_by_search_range(bbox, local_search_range, min_size,
+                               SubTileSeed(*this, lowres_hom), sub_tiles);
+    if (sub_tiles.size() == 1)
+      return correlate(bbox, local_search_range, right_trans_img, right_trans_mask);
+
+    VW_OUT(DebugMessage, "stereo") << "SeededCorrelatorView(" << bbox << ") split into "
+                                   << sub_tiles.size() << " sub-tiles.\n";
+
+    ImageView<pixel_type> result(bbox.width(), bbox.height());
+    for (size_t i = 0; i < sub_tiles.size(); i++) {
+      BBox2i const& sub_bbox = sub_tiles[i].first;
+      prerasterize_type sub_disp = correlate(sub_bbox, sub_tiles[i].second,
+                                             right_trans_img, right_trans_mask);
+      crop(result, sub_bbox - bbox.min()) = crop(sub_disp, sub_bbox);
+    }
+
+    return prerasterize_type(result, BBox2i(-bbox.min().x(), -bbox.min().y(), cols(), rows()));
+  } // End function prerasterize
+
+  template <class DestT>
+  inline void rasterize(DestT const& dest, BBox2i bbox) const {
+    vw::rasterize(prerasterize(bbox), dest, bbox);
+  }
+
+private:
+
+  /// The region of D_sub which seeds the given region of the left image
+  BBox2i seed_box(BBox2i const& bbox) const {
+    BBox2i seed_bbox( elem_quot(bbox.min(), m_upscale_factor),
+                      elem_quot(bbox.max(), m_upscale_factor) );
+    seed_bbox.expand(1);
+    seed_bbox.crop( m_seed_bbox );
+    return seed_bbox;
+  }
+
+  /// Whether D_sub has valid disparities to seed the given region
+  bool has_seed(BBox2i const& bbox) const {
+    ImageView<PixelMask<Vector2f> > disparity_in_box = crop( m_sub_disp, seed_box(bbox) );
+    for (int row = 0; row < disparity_in_box.rows(); row++) {
+      for (int col = 0; col < disparity_in_box.cols(); col++) {
+        if (is_valid(disparity_in_box(col, row)))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  /// The full-resolution search range for the given region of the
+  /// left image, found from D_sub, and D_sub_spread if available.
+  BBox2f seeded_search_range(BBox2i const& bbox, Matrix<double> const& lowres_hom) const {
+
+    bool use_local_homography = stereo_settings().use_local_homography;
+    bool do_round = true; // round integer disparities after transform
+
+    // The low-res version of bbox
+    BBox2i seed_bbox = seed_box(bbox);
+    // Get the disparity range in d_sub corresponding to this tile.
+    VW_OUT(DebugMessage, "stereo") << "\nGetting disparity range for : " << seed_bbox << "\n";
+    DispSeedImageType disparity_in_box = crop( m_sub_disp, seed_bbox );
+
+    BBox2f local_search_range;
+    if (!use_local_homography){
+      local_search_range = stereo::get_disparity_range( disparity_in_box );
+    }else{ // use local homography
+      local_search_range = stereo::get_disparity_range
+        (transform_disparities(do_round, seed_bbox,
+         lowres_hom, disparity_in_box));
+    }
+
+    bool has_sub_disp_spread = ( m_sub_disp_spread.cols() != 0 &&
+                                 m_sub_disp_spread.rows() != 0 );
+    // Sanity check: If m_sub_disp_spread was provided, it better have the same size as sub_disp.
+    if ( has_sub_disp_spread &&
+         m_sub_disp_spread.cols() != m_sub_disp.cols() &&
+         m_sub_disp_spread.rows() != m_sub_disp.rows() ){
+      vw_throw( ArgumentErr() << "stereo_corr: D_sub and D_sub_spread must have equal sizes.\n");
+    }
+
+    if (has_sub_disp_spread){
+      // Expand the disparity range by m_sub_disp_spread.
+      SpreadImageType spread_in_box = crop( m_sub_disp_spread, seed_bbox );
+
+      if (!use_local_homography){
+        BBox2f spread = stereo::get_disparity_range( spread_in_box );
+        local_search_range.min() -= spread.max();
+        local_search_range.max() += spread.max();
+      }else{
+        DispSeedImageType upper_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                                             disparity_in_box + spread_in_box);
+        DispSeedImageType lower_disp = transform_disparities(do_round, seed_bbox, lowres_hom,
+                                                             disparity_in_box - spread_in_box);
+        BBox2f upper_range = stereo::get_disparity_range(upper_disp);
+        BBox2f lower_range = stereo::get_disparity_range(lower_disp);
+
+        local_search_range = upper_range;
+        local_search_range.grow(lower_range);
+      } //endif use_local_homography
+    } //endif has_sub_disp_spread
+
+    local_search_range = grow_bbox_to_int(local_search_range);
+    // Expand local_search_range by 1. This is necessary since
+    // m_sub_disp is integer-valued, and perhaps the search
+    // range was supposed to be a fraction of integer bigger.
+    local_search_range.expand(1);
+
+    // Scale the search range to full-resolution
+    local_search_range.min() = floor(elem_prod(local_search_range.min(),m_upscale_factor));
+    local_search_range.max() = ceil (elem_prod(local_search_range.max(),m_upscale_factor));
+
+    // If the user specified a search range limit, apply it here.
+    if ((stereo_settings().search_range_limit.min() != Vector2i()) || 
+        (stereo_settings().search_range_limit.max() != Vector2i())   ) {     
+      local_search_range.crop(stereo_settings().search_range_limit);
+    }
+
+    return local_search_range;
+  }
+
+  /// Gives split_by_search_range() the seed of each part of a tile
+  struct SubTileSeed {
+    SeededCorrelatorView const& view;
+    Matrix<double> const& lowres_hom;
+    SubTileSeed(SeededCorrelatorView const& v, Matrix<double> const& h):
+      view(v), lowres_hom(h) {}
+    bool has_seed(BBox2i const& bbox) const { return view.has_seed(bbox); }
+    BBox2f search_range(BBox2i const& bbox) const {
+      return view.seeded_search_range(bbox, lowres_hom);
+    }
+  };
+
+  /// Correlate a region of the left image with the given search range
+  prerasterize_type correlate(BBox2i const& bbox, BBox2f const& local_search_range,
+                              ImageViewRef<InputPixelType> const& right_trans_img,
+                              ImageViewRef<vw::uint8     > const& right_trans_mask) const {
+
     SemiGlobalMatcher::SgmSubpixelMode sgm_subpixel_mode = get_sgm_subpixel_mode();
     Vector2i sgm_search_buffer = stereo_settings().sgm_search_buffer;
 
     // Now we are ready to actually perform correlation
     const int rm_half_kernel = 5; // Filter kernel size used by CorrelationView
-    if (use_local_homography){
+    if (stereo_settings().use_local_homography && stereo_settings().seed_mode > 0){
       typedef vw::stereo::PyramidCorrelationView<ImageType, ImageViewRef<InputPixelType>, 
                                                  MaskType,  ImageViewRef<vw::uint8     > > CorrView;
       CorrView corr_view( m_left_image,   right_trans_img,
@@ -1074,13 +1162,7 @@ public:
                           stereo_settings().stereo_debug );
       return corr_view.prerasterize(bbox);
     }
-    
-  } // End function prerasterize_helper
-
-  template <class DestT>
-  inline void rasterize(DestT const& dest, BBox2i bbox) const {
-    vw::rasterize(prerasterize(bbox), dest, bbox);
-  }
+  } // End function correlate
 }; // End class SeededCorrelatorView
 
 
@@ -1189,6 +1271,34 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
                << "Increase --corr-tile-size so the entire image fits in one tile, or "
                << "use parallel_stereo. Not that making --corr-tile-size larger than 9000 or so may "
                << "cause GDAL to crash.\n\n");
+
+    // Predict the memory SGM will need for this tile from its search
+    // range, to warn before running out of memory rather than after.
+    double memory_mb = 0.0;
+    if (stereo_settings().seed_mode > 0) {
+      ImageView<PixelMask<Vector2f> > sub_disp_img   = sub_disp;
+      ImageView<PixelMask<Vector2i> > sub_spread_img = sub_disp_spread;
+      Vector2 upscale(double(left_disk_image.cols()) / sub_disp_img.cols(),
+                      double(left_disk_image.rows()) / sub_disp_img.rows());
+      SgmMemoryModel model(sub_disp_img, sub_spread_img, upscale,
+                           stereo_settings().sgm_search_buffer,
+                           stereo_settings().corr_max_levels,
+                           stereo_settings().search_range_limit);
+      memory_mb = model.tile_memory_mb(trans_crop_win);
+    } else {
+      memory_mb = sgm_memory_mb(trans_crop_win.size(), stereo_settings().search_range,
+                                stereo_settings().sgm_search_buffer,
+                                stereo_settings().corr_max_levels);
+    }
+    vw_out() << "\t--> Estimated SGM memory use: " << round(memory_mb) << " MB.\n";
+    if (memory_mb > stereo_settings().corr_memory_limit_mb)
+      vw_out(WarningMessage) << "The estimated SGM memory use is more than the value of "
+                             << "--corr-memory-limit-mb, which is "
+                             << stereo_settings().corr_memory_limit_mb << " MB. Smaller "
+                             << "search ranges will be used for uncertain pixels, and if "
+                             << "that is not enough correlation will fail. Consider "
+                             << "decreasing --corr-tile-size, or using parallel_stereo "
+                             << "with --auto-corr-tile-size.\n";
   }
   
   switch(stereo_settings().pre_filter_mode){
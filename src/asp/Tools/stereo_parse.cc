@@ -26,6 +26,7 @@
 #include <vw/Stereo/CorrelationView.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
+#include <asp/Core/CorrMemory.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
 using namespace vw;
@@ -129,6 +130,51 @@ int main( int argc, char* argv[] ) {
       vw_out() << "collar_size," << stereo_settings().sgm_collar_size << endl;
     vw_out() << "corr_memory_limit_mb," << stereo_settings().corr_memory_limit_mb << endl;
 
+    // With SGM or MGM, once D_sub exists, predict the memory needed to
+    // correlate the tiles, each padded by the collar, from their search
+    // ranges, and find the largest tile size within the memory
+    // limit. This is used by parallel_stereo to size its jobs.
+    std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
+    if (stereo_settings().stereo_algorithm > vw::stereo::VW_CORRELATION_BM &&
+        stereo_settings().seed_mode > 0 && fs::exists(d_sub_file) &&
+        trans_left_image_size != Vector2()) {
+
+      ImageViewRef<PixelMask<Vector2f> > sub_disp_ref;
+      if (load_sub_disp_image(d_sub_file, sub_disp_ref)) {
+        ImageView<PixelMask<Vector2f> > sub_disp = sub_disp_ref;
+        ImageView<PixelMask<Vector2i> > sub_disp_spread;
+        std::string spread_file = opt.out_prefix + "-D_sub_spread.tif";
+        if (fs::exists(spread_file))
+          sub_disp_spread = DiskImageView<PixelMask<Vector2i> >(spread_file);
+
+        Vector2 upscale(trans_left_image_size.x() / sub_disp.cols(),
+                        trans_left_image_size.y() / sub_disp.rows());
+        SgmMemoryModel model(sub_disp, sub_disp_spread, upscale,
+                             stereo_settings().sgm_search_buffer,
+                             stereo_settings().corr_max_levels,
+                             stereo_settings().search_range_limit);
+
+        BBox2i region(0, 0, trans_left_image_size.x(), trans_left_image_size.y());
+        int collar = stereo_settings().sgm_collar_size;
+        vw_out() << "sgm_tile_memory_mb,"
+                 << model.max_tile_memory_mb(region, stereo_settings().corr_tile_size_ovr,
+                                             collar) << endl;
+
+        // Tiles bigger than the image are not useful, and GDAL may
+        // crash if the tile with its collar is larger than about 9000.
+        const int TILE_MULTIPLE = 16, MIN_TILE_SIZE = 256, MAX_PADDED_TILE_SIZE = 8192;
+        int max_tile_size = std::max(region.width(), region.height());
+        max_tile_size = TILE_MULTIPLE*((max_tile_size + TILE_MULTIPLE - 1)/TILE_MULTIPLE);
+        max_tile_size = std::min(max_tile_size, MAX_PADDED_TILE_SIZE - 2*collar);
+        max_tile_size = std::max(max_tile_size, MIN_TILE_SIZE);
+        vw_out() << "sgm_tile_size_for_memory_limit,"
+                 << model.tile_size_for_memory(region, collar,
+                                               stereo_settings().corr_memory_limit_mb,
+                                               MIN_TILE_SIZE, max_tile_size,
+                                               TILE_MULTIPLE) << endl;
+      }
+    }
+
     // This block of code should be in its own executable but I am
     // reluctant to create one just for it. This functionality will be
     // invoked after low-res disparity is computed, whether done in
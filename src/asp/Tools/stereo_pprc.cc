@@ -28,6 +28,7 @@
 #include <vw/Math/Functors.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/ImagePyramid.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionFactory.h>
 #include <xercesc/util/PlatformUtils.hpp>
@@ -366,6 +367,15 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                                << sw.elapsed_seconds() << " s." << endl;
   } // End creating masks
 
+  // Save downsampled versions of L.tif and R.tif for viewing in
+  // stereo_gui, if asked to. No later step of stereo reads them. Only
+  // the levels whose inputs changed are made again.
+  if (stereo_settings().build_image_pyramids) {
+    const int PYRAMID_MIN_SIZE = 256;
+    build_image_pyramid(left_image_file,  left_mask_file,  output_nodata, PYRAMID_MIN_SIZE, opt);
+    build_image_pyramid(right_image_file, right_mask_file, output_nodata, PYRAMID_MIN_SIZE, opt);
+  }
+
 
   string lsub  = opt.out_prefix+"-L_sub.tif";
   string rsub  = opt.out_prefix+"-R_sub.tif";
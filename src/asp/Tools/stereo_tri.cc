@@ -25,6 +25,7 @@
 #include <vw/InterestPoint/InterestData.h>
 
 #include <asp/Camera/RPCModel.h>
+#include <asp/Camera/RPCStereoModel.h>
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
@@ -57,6 +58,30 @@ T make_transform_copy(T trans){
   return T(new vw::cartography::Map2CamTrans(*t_ptr));
 }
 
+/// Triangulate the points seen at the given pixels, where the pixel
+/// of point k in image c is pixels[c][k], one point at a time.
+template <class StereoModelT>
+void triangulate_pixels(StereoModelT const& model,
+                        vector< vector<Vector2> > const& pixels,
+                        vector<Vector3> & points, vector<Vector3> & errors) {
+  size_t num_points = pixels.empty() ? 0 : pixels[0].size();
+  points.resize(num_points);
+  errors.resize(num_points);
+  vector<Vector2> pixVec(pixels.size());
+  for (size_t k = 0; k < num_points; k++) {
+    for (size_t c = 0; c < pixels.size(); c++)
+      pixVec[c] = pixels[c][k];
+    points[k] = model(pixVec, errors[k]);
+  }
+}
+
+/// With RPC cameras, find the rays of all the pixels in one batch.
+void triangulate_pixels(asp::RPCStereoModel const& model,
+                        vector< vector<Vector2> > const& pixels,
+                        vector<Vector3> & points, vector<Vector3> & errors) {
+  model.triangulate_batch(pixels, points, errors);
+}
+
 /// The main class for taking in a set of disparities and returning a point cloud via joint triangulation.
 template <class DisparityImageT, class StereoModelT>
 class StereoTXAndErrorView : public ImageViewBase<StereoTXAndErrorView<DisparityImageT, StereoModelT> >
@@ -124,35 +149,22 @@ public:
     return result; // Contains location and error vector
   }
 
-  typedef StereoTXAndErrorView<ImageViewRef<DPixelT>, StereoModelT> prerasterize_type;
+  /// Triangulate all pixels in the box at once, one row at a time, so
+  /// that the transforms are applied to a whole row before the rays
+  /// are intersected, and the buffers are allocated once per tile
+  /// rather than once per pixel.
+  typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize( BBox2i const& bbox ) const {
-    return PreRasterHelper( bbox, m_transforms );
-  }
-  template <class DestT>
-  inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
-    vw::rasterize( prerasterize(bbox), dest, bbox );
-  }
-
-private:
 
-  /// RPC Map Transform needs to be explicitly copied and told to cache for performance.
-  template <class T>
-  prerasterize_type PreRasterHelper( BBox2i const& bbox, vector<T> const& transforms) const {
+    // We explicitly bring in-memory the disparities for the current box
+    // to speed up processing later.
+    vector< ImageView<DPixelT> > disparity_clips(m_disparity_maps.size());
+    for (int p = 0; p < (int)m_disparity_maps.size(); p++)
+      disparity_clips[p] = crop( m_disparity_maps[p], bbox );
 
     // Code for NON-MAP-PROJECTED session types.
-    if (m_is_map_projected == false) {
-      // We explicitly bring in-memory the disparities for the current box
-      // to speed up processing later, and then we pretend this is the entire
-      // image by virtually enlarging it using a CropView.
-      vector< ImageViewRef<DPixelT> > disparity_cropviews;
-      for (int p = 0; p < (int)m_disparity_maps.size(); p++){
-        ImageView<DPixelT> clip( crop( m_disparity_maps[p], bbox ) );
-        ImageViewRef<DPixelT> cropview_clip = crop(clip, -bbox.min().x(), -bbox.min().y(), cols(), rows() );
-        disparity_cropviews.push_back(cropview_clip);
-      }
-
-      return prerasterize_type(disparity_cropviews, transforms, m_stereo_model, m_is_map_projected);
-    }
+    if (m_is_map_projected == false)
+      return triangulate_tile(bbox, disparity_clips, m_transforms);
 
     // Code for MAP-PROJECTED session types.
 
@@ -163,9 +175,9 @@ private:
     // the cache in both transforms while the other threads want to do the same.
     // - Without some sort of duplication function in the transform base class we need
     //   to manually copy the Map2CamTrans type which is pretty hacky.
-    vector<T> transforms_copy(transforms.size());
-    for (size_t i = 0; i < transforms.size(); ++i) {
-      transforms_copy[i] = make_transform_copy(transforms[i]);
+    vector<TXT> transforms_copy(m_transforms.size());
+    for (size_t i = 0; i < m_transforms.size(); ++i) {
+      transforms_copy[i] = make_transform_copy(m_transforms[i]);
     }
     // As a side effect this call makes transforms_copy create a local cache we want later
     transforms_copy[0]->reverse_bbox(bbox); 
@@ -176,18 +188,10 @@ private:
                 << "than the number of images." );
     }
 
-    vector< ImageViewRef<DPixelT> > disparity_cropviews;
     for (int p = 0; p < (int)m_disparity_maps.size(); p++){
 
-      // We explicitly bring in-memory the disparities for the current
-      // box to speed up processing later, and then we pretend this is
-      // the entire image by virtually enlarging it using a CropView.
-      ImageView<DPixelT> clip( crop( m_disparity_maps[p], bbox ) );
-      ImageViewRef<DPixelT> cropview_clip = crop(clip, -bbox.min().x(), -bbox.min().y(), cols(), rows() );
-      disparity_cropviews.push_back(cropview_clip);
-
       // Work out what spots in the right image we'll be touching.
-      BBox2i disparity_range = stereo::get_disparity_range(clip);
+      BBox2i disparity_range = stereo::get_disparity_range(disparity_clips[p]);
       disparity_range.max() += Vector2i(1,1);
       BBox2i right_bbox = bbox + disparity_range.min();
       right_bbox.max() += disparity_range.size();
@@ -197,8 +201,91 @@ private:
       transforms_copy[p+1]->reverse_bbox(right_bbox); 
     }
 
-    return prerasterize_type(disparity_cropviews, transforms_copy, m_stereo_model, m_is_map_projected);
-  } // End function PreRasterHelper() DGMapRPC version
+    return triangulate_tile(bbox, disparity_clips, transforms_copy);
+  }
+  template <class DestT>
+  inline void rasterize( DestT const& dest, BBox2i const& bbox ) const {
+    vw::rasterize( prerasterize(bbox), dest, bbox );
+  }
+
+private:
+
+  /// Triangulate the pixels in the box, given the disparities
+  /// cropped to it.
+  prerasterize_type triangulate_tile(BBox2i const& bbox,
+                                     vector< ImageView<DPixelT> > const& disparities,
+                                     vector<TXT> const& transforms) const {
+
+    int num_disp = disparities.size();
+    int width    = bbox.width();
+    Vector2 nan_pix(std::numeric_limits<double>::quiet_NaN(),
+                    std::numeric_limits<double>::quiet_NaN());
+
+    ImageView<pixel_type> result(width, bbox.height());
+
+    // The de-warped pixels of the current row, one array per image,
+    // and whether a pixel has any valid disparity.
+    vector< vector<Vector2> > row_pixels(num_disp + 1, vector<Vector2>(width));
+    vector<uint8> row_valid(width);
+
+    // The same for the pixels with a valid disparity only, and their
+    // triangulated points and errors.
+    vector< vector<Vector2> > valid_pixels(num_disp + 1);
+    vector<int> valid_cols;
+    vector<Vector3> points, errors;
+
+    for (int row = 0; row < bbox.height(); row++) {
+      double j = bbox.min().y() + row;
+
+      // De-warp the "right" pixels, one image at a time
+      std::fill(row_valid.begin(), row_valid.end(), 0);
+      for (int c = 0; c < num_disp; c++) {
+        ImageView<DPixelT> const& disp_clip = disparities[c];
+        vw::Transform const& tx = *transforms[c+1];
+        vector<Vector2> & pixels = row_pixels[c+1];
+        for (int col = 0; col < width; col++) {
+          DPixelT const& disp = disp_clip(col, row);
+          if (is_valid(disp)) {
+            pixels[col] = tx.reverse(Vector2(bbox.min().x() + col, j) + stereo::DispHelper(disp));
+            row_valid[col] = 1;
+          } else {
+            pixels[col] = nan_pix; // flag value
+          }
+        }
+      }
+
+      // De-warp the "left" pixels, only where they will be used
+      vw::Transform const& left_tx = *transforms[0];
+      for (int col = 0; col < width; col++) {
+        if (row_valid[col])
+          row_pixels[0][col] = left_tx.reverse(Vector2(bbox.min().x() + col, j));
+      }
+
+      // Compute the location of the 3D point observed by each input
+      // pixel, for the whole row at once. Where no disparity is valid
+      // there is just one ray, for which the stereo model would return
+      // zero anyway.
+      valid_cols.clear();
+      for (int c = 0; c <= num_disp; c++)
+        valid_pixels[c].clear();
+      for (int col = 0; col < width; col++) {
+        if (!row_valid[col])
+          continue;
+        valid_cols.push_back(col);
+        for (int c = 0; c <= num_disp; c++)
+          valid_pixels[c].push_back(row_pixels[c][col]);
+      }
+      triangulate_pixels(m_stereo_model, valid_pixels, points, errors);
+      for (size_t k = 0; k < valid_cols.size(); k++) {
+        pixel_type & out = result(valid_cols[k], row);
+        subvector(out,0,3) = points[k];
+        subvector(out,3,3) = errors[k];
+      }
+    }
+
+    return prerasterize_type(result, BBox2i(-bbox.min().x(), -bbox.min().y(),
+                                            cols(), rows()));
+  }
 
 }; // End class StereoTXAndErrorView
 
@@ -1038,7 +1125,7 @@ void stereo_triangulation( string          const& output_prefix,
                                 max_num_matches, gen_triplets);
 
       int num_threads = opt_vec[0].num_threads;
-      if (opt_vec[0].session->name() == "isis" || opt_vec[0].session->name() == "isismapisis")
+      if (!opt_vec[0].session->supports_multi_threading())
         num_threads = 1;
       asp::jitter_adjust(image_files, camera_files, cameras,
                          output_prefix, opt_vec[0].session->name(),